@@ -13,6 +13,7 @@
 #pragma once
 
 #include <sdl/Config/ConfigureYaml.hpp>
+#include <sdl/CrfDemo/FeatureIds.hpp>
 #include <sdl/Hypergraph/Compose.hpp>
 #include <sdl/Hypergraph/IMutableHypergraph.hpp>
 #include <sdl/Hypergraph/MutableHypergraph.hpp>
@@ -23,22 +24,23 @@
 #include <sdl/Optimization/FeatureHypergraphPairs.hpp>
 #include <sdl/Optimization/ICreateSearchSpace.hpp>
 #include <sdl/Optimization/IInput.hpp>
+#include <sdl/Optimization/LinearChainCrf.hpp>
 #include <sdl/Optimization/Types.hpp>
 #include <sdl/Vocabulary/HelperFunctions.hpp>
 #include <sdl/Vocabulary/SpecialSymbols.hpp>
 #include <sdl/Util/Input.hpp>
+#include <sdl/Util/ParallelFor.hpp>
 #include <sdl/Util/Sleep.hpp>
-#include <sdl/Util/StringBuilder.hpp>
 #include <sdl/Util/Unordered.hpp>
 #include <sdl/IVocabulary.hpp>
-#include <boost/functional/hash.hpp>
-#include <graehl/shared/thread_group.hpp>
-#include <functional>
-#include <mutex>
+#include <sdl/Types.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <set>
 #include <sstream>
 #include <string>
-#include <thread>
+#include <vector>
 
 namespace sdl {
 namespace CrfDemo {
@@ -53,13 +55,21 @@ struct CrfDemoConfig {
     config.is("CrfDemo::CreateSearchSpace");
 
     config("conll-path", &conllPath)("Name of CoNLL training file");
-    config("meaningful-feature-names", &meaningfulFeatureNames)("Use meaningful feature names").init(false);
+    config("meaningful-feature-names", &meaningfulFeatureNames)
+        ("Hash symbol strings rather than vocabulary ids into feature ids (so ids agree between train and test runs)")
+        .init(false);
+    config("feature-names-path", &featureNamesPath)
+        ("Debugging: if set, record a readable name for each feature id and write them (id TAB name) to this file");
     config("fst-compose", &fstCompose)("Use FST compose").init(true);
     config("labels-path", &labelsPath)("Labels file path");
     config("labels-per-pos-path", &labelsPerPosPath)("Labels-per-pos file path");
     config("transition-model", &transitionModel)("Transition model").init(kBigram);
     config("num-features", &numFeatures)("Number of features (feature hashing trick)").init(500000);
     config("num-threads", &numThreads)("Number of threads for feature extraction").init(4);
+    config("dense-trellis", &denseTrellis)
+        ("Build dense (positions x candidate labels) examples instead of hypergraph pairs: faster training and "
+         "test for the unigram and bigram transition models (same objective)")
+        .init(false);
 
     config("read-train-archive-path", &readTrainArchivePath)("Path to read training archive");
     config("write-train-archive-path", &writeTrainArchivePath)("Path to write training archive");
@@ -67,14 +77,15 @@ struct CrfDemoConfig {
 
   std::string conllPath, labelsPath, labelsPerPosPath;
   std::string readTrainArchivePath, writeTrainArchivePath;
-  bool meaningfulFeatureNames, fstCompose;
+  std::string featureNamesPath;
+  bool meaningfulFeatureNames, fstCompose, denseTrellis;
   TransitionModelType transitionModel;
   Hypergraph::FeatureId numFeatures;
   std::size_t numThreads;
 };
 
 template <class A>
-class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
+class CreateSearchSpace : public Optimization::ICreateSearchSpace<A>, public Optimization::ILinearChainExamples {
   typedef A Arc;
   typedef typename Arc::Weight Weight;
   typedef Optimization::IFeatureHypergraphPairs<Arc> Pairs;
@@ -87,6 +98,8 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
   CreateSearchSpace(ConfigNode const& yamlConfig)
       : pVoc_(Vocabulary::createDefaultVocab()), testMode_(false) {
     Config::applyYaml(yamlConfig, &opts_);
+    featureHash_ = FeatureHasher(pVoc_, opts_.numFeatures, opts_.meaningfulFeatureNames);
+    if (!opts_.featureNamesPath.empty()) featureNames_.reset(new FeatureNames(pVoc_));
   }
 
   ///
@@ -143,6 +156,8 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
 
   shared_ptr<Optimization::IFeatureHypergraphPairs<Arc>> getFeatureHypergraphPairs() const { return pairs_; }
 
+  shared_ptr<Optimization::LinearChainData> getLinearChainData() const override { return linearChainData_; }
+
   std::size_t getNumFeatures() { return opts_.numFeatures; }
 
   void setTestMode() {
@@ -164,66 +179,102 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
       labels.clear();
     }
 
-    void add(std::string const& line, std::set<Sym>* allLabels, IVocabularyPtr& pVoc, bool testMode) {
-      std::stringstream ss(line);
-      std::string word, pos, label;
-      ss >> word >> pos >> label;
-      if (word.empty() || pos.empty() || label.empty()) {
-        SDL_THROW_LOG(CrfDemo, InvalidInputException, "Bad line: " << line);
-      }
+    void add(Slice word, Slice pos, Slice label, std::set<Sym>* allLabels, IVocabularyPtr& pVoc, bool testMode) {
       words.push_back(pVoc->add(word, kTerminal));
       poss.push_back(pVoc->add(pos, kTerminal));
       labels.push_back(pVoc->add(label, kTerminal));
-      SDL_DEBUG(CrfDemo, "id(" << word << "): " << words.back());
-      SDL_DEBUG(CrfDemo, "id(" << pos << "): " << poss.back());
-      SDL_DEBUG(CrfDemo, "id(" << label << "): " << labels.back());
+      SDL_DEBUG(CrfDemo, "id(" << pVoc->str(words.back()) << "): " << words.back());
+      SDL_DEBUG(CrfDemo, "id(" << pVoc->str(poss.back()) << "): " << poss.back());
+      SDL_DEBUG(CrfDemo, "id(" << pVoc->str(labels.back()) << "): " << labels.back());
       if (!testMode) {
         allLabels->insert(labels.back());
       }
     }
   };
-  /////////////////////////////////////////////////////////////////
-
-  Hypergraph::FeatureId getFeatureId(std::string const& featName) const {
-    std::size_t id = 0;
-    boost::hash_combine(id, featName);
-    id = id % opts_.numFeatures;
-    SDL_TRACE(CrfDemo, "getFeatId(" << featName << "): " << id);
-    return id;
-  }
 
-  std::string createFeatureName(std::string const& prefix, Sym sym) const {
-    if (opts_.meaningfulFeatureNames)
-      return Util::StringBuilder(prefix)("_")(pVoc_->str(sym)).str();
-    else
-      return Util::StringBuilder(prefix)("_")(sym).str();
-  }
+  /// word, pos, label fields of one CoNLL line
+  struct ConllFields {
+    Slice fields[3];
+  };
 
-  std::string createFeatureName(std::string const& prefix, Sym sym1, Sym sym2) const {
-    if (opts_.meaningfulFeatureNames)
-      return Util::StringBuilder(prefix)("_")(pVoc_->str(sym1))("_")(pVoc_->str(sym2)).str();
-    else
-      return Util::StringBuilder(prefix)("_")(sym1)("_")(sym2).str();
+  /// the lines [begin, end) of one sentence, split into fields (thread safe)
+  static void splitConllLines(Pchar begin, Pchar end, std::vector<ConllFields>& lines) {
+    lines.clear();
+    while (begin < end) {
+      Pchar const lineEnd = std::find(begin, end, '\n');
+      ConllFields line;
+      Pchar i = begin;
+      for (Slice& field : line.fields) {
+        while (i < lineEnd && std::isspace((unsigned char)*i)) ++i;
+        field.first = i;
+        while (i < lineEnd && !std::isspace((unsigned char)*i)) ++i;
+        field.second = i;
+        if (field.first == field.second)
+          SDL_THROW_LOG(CrfDemo, InvalidInputException, "Bad line: " << std::string(begin, lineEnd));
+      }
+      lines.push_back(line);
+      begin = lineEnd + 1;
+    }
   }
 
-  std::string createFeatureName(std::string const& prefix, Sym sym1, Sym sym2, Sym sym3) const {
-    if (opts_.meaningfulFeatureNames)
-      return Util::StringBuilder(prefix)("_")(pVoc_->str(sym1))("_")(pVoc_->str(sym2))("_")(pVoc_->str(sym3)).str();
-    else
-      return Util::StringBuilder(prefix)("_")(sym1)("_")(sym2)("_")(sym3).str();
-  }
+  /**
+     read CoNLL file (a sentence ends at each empty line; lines after the last
+     are ignored). lines are split into fields in parallel (opts_.numThreads);
+     fields are added to the vocabulary afterwards, in file order, so symbol
+     ids don't depend on the number of threads.
+  */
+  void readSentences(std::string const& path, std::vector<Sentence>& sents) {
+    std::string text;
+    {
+      Util::Input input(path);
+      std::ostringstream buf;
+      buf << input->rdbuf();
+      text = buf.str();
+    }
+    // sentence i is lines [sentBegins[i], sentEnds[i]) of text, without the empty line ending it
+    std::vector<Pchar> sentBegins, sentEnds;
+    Pchar const textEnd = text.data() + text.size();
+    Pchar sentBegin = text.data();
+    for (Pchar line = text.data(); line < textEnd;) {
+      Pchar const lineEnd = (Pchar)std::memchr(line, '\n', textEnd - line);
+      bool const empty = lineEnd ? line == lineEnd : false;
+      if (empty) {
+        sentBegins.push_back(sentBegin);
+        sentEnds.push_back(line);
+        sentBegin = lineEnd + 1;
+      }
+      if (!lineEnd) break;
+      line = lineEnd + 1;
+    }
 
-  std::string createFeatureName(std::string const& prefix, std::string const& sym1, std::string const& sym2,
-                                std::string const& sym3) const {
-    return Util::StringBuilder(prefix)("_")(sym1)("_")(sym2)("_")(sym3).str();
+    std::size_t const nSents = sentBegins.size();
+    std::vector<std::vector<ConllFields>> fields(nSents);
+    Util::parallelFor(0, nSents, (unsigned)opts_.numThreads,
+                      [&](std::size_t i) { splitConllLines(sentBegins[i], sentEnds[i], fields[i]); },
+                      kSentencesPerChunk);
+
+    sents.resize(nSents);
+    for (std::size_t i = 0; i < nSents; ++i) {
+      Sentence& sent = sents[i];
+      sent.clear();
+      for (ConllFields const& line : fields[i])
+        sent.add(line.fields[0], line.fields[1], line.fields[2], &allLabels_, pVoc_, testMode_);
+    }
   }
+  /////////////////////////////////////////////////////////////////
 
-  std::string createFeatureName(std::string const& prefix, std::string const& sym1, std::string const& sym2) const {
-    return Util::StringBuilder(prefix)("_")(sym1)("_")(sym2).str();
+  /// feature id of template t with up to 3 symbols (no name string is built unless featureNames_)
+  Hypergraph::FeatureId getFeatureId(FeatureTemplate t, Sym sym1, Sym sym2 = NoSymbol, Sym sym3 = NoSymbol) const {
+    Hypergraph::FeatureId const id = featureHash_(t, sym1, sym2, sym3);
+    if (featureNames_) featureNames_->add(id, t, sym1, sym2, sym3);
+    return id;
   }
 
-  std::string createFeatureName(std::string const& prefix, std::string const& sym1) const {
-    return Util::StringBuilder(prefix)("_")(sym1).str();
+  void writeFeatureNames(std::string const& fname) const {
+    SDL_INFO(CrfDemo, "Writing " << featureNames_->size() << " feature names to '" << fname << "' ("
+                                 << featureNames_->nCollisions << " hash collisions)");
+    Util::Output output(fname);
+    featureNames_->write(*output);
   }
 
   Hypergraph::IHypergraph<Arc>* createUnigramModel() const {
@@ -264,15 +315,15 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
       std::set<Sym>::const_iterator symIter = allLabels_.begin();
       for (StateId t = 1; t < finalState; ++t, ++symIter) {
         Weight weight(0.0f);
-        weight.insert(getFeatureId(createFeatureName("bi", historyNames[s], historyNames[t])), 1.0f);
+        weight.insert(getFeatureId(kBigramFeature, historyNames[s], historyNames[t]), 1.0f);
         model->addArc(new Arc(Head(t), Tails(s, model->addState(*symIter)), weight));
 
         // Final arcs
         {
           Weight weight(0.0f);
-          weight.insert(getFeatureId(createFeatureName("bi", historyNames[s], historyNames[t])),
+          weight.insert(getFeatureId(kBigramFeature, historyNames[s], historyNames[t]),
                         1.0f);  // s, then t
-          weight.insert(getFeatureId(createFeatureName("end", historyNames[t])), 1.0f);  // t, then end
+          weight.insert(getFeatureId(kEndFeature, historyNames[t]), 1.0f);  // t, then end
           model->addArc(new Arc(Head(finalState), Tails(s, model->addState(*symIter)), weight));
         }
       }
@@ -321,20 +372,20 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
       stateId[nt0] = model->addState(nt0);
 
       Weight weight1(0.0f);
-      weight1.insert(getFeatureId(createFeatureName("short", nt)), 1.0f);
+      weight1.insert(getFeatureId(kShortFeature, nt), 1.0f);
       model->addArc(new Arc(Head(stateId[nt]), Tails(stateId[b]), weight1));  // (NP) <- (B-NP)
 
       Weight weight2(0.0f);
-      weight2.insert(getFeatureId(createFeatureName("long", nt)), 1.0f);
+      weight2.insert(getFeatureId(kLongFeature, nt), 1.0f);
       model->addArc(
           new Arc(Head(stateId[nt]), Tails(stateId[b], stateId[nt0]), weight2));  // (NP) <- (B-NP) (NP0)
 
       Weight weight3(0.0f);
-      weight3.insert(getFeatureId(createFeatureName("short_sub", nt)), 1.0f);
+      weight3.insert(getFeatureId(kShortSubFeature, nt), 1.0f);
       model->addArc(new Arc(Head(stateId[nt0]), Tails(stateId[i]), weight3));  // (NP0) <- (I-NP)
 
       Weight weight4(0.0f);
-      weight4.insert(getFeatureId(createFeatureName("long_sub", nt)), 1.0f);
+      weight4.insert(getFeatureId(kLongSubFeature, nt), 1.0f);
       model->addArc(new Arc(Head(stateId[nt0]), Tails(stateId[i], stateId[nt0]), weight4));
     }
 
@@ -364,9 +415,9 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
           std::string const& nt3Str = pVoc_->str(nt3);
           Sym nt23 = sym(nt2Str + "+" + nt3Str);
           Weight weight(0.0f);
-          weight.insert(getFeatureId(createFeatureName("tri_nt", nt1Str, nt2Str, nt3Str)), 1.0f);
-          weight.insert(getFeatureId(createFeatureName("bi_nt", nt2Str, nt3Str)), 1.0f);
-          weight.insert(getFeatureId(createFeatureName("uni_nt", nt3Str)), 1.0f);
+          weight.insert(getFeatureId(kTrigramNtFeature, nt1, nt2, nt3), 1.0f);
+          weight.insert(getFeatureId(kBigramNtFeature, nt2, nt3), 1.0f);
+          weight.insert(getFeatureId(kUnigramNtFeature, nt3), 1.0f);
           model->addArc(new Arc(Head(stateId[nt23]), Tails(stateId[nt12], stateId[nt3]), weight));
         }
       }
@@ -383,9 +434,9 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
         std::string const& nt2Str = pVoc_->str(nt2);
         Sym nt12 = sym(nt1Str + "+" + nt2Str);
         Weight weight(0.0f);
-        weight.insert(getFeatureId(createFeatureName("tri_nt", "eps", nt1Str, nt2Str)), 1.0f);
-        weight.insert(getFeatureId(createFeatureName("bi_nt", nt1Str, nt2Str)), 1.0f);
-        weight.insert(getFeatureId(createFeatureName("uni_nt", nt2Str)), 1.0f);
+        weight.insert(getFeatureId(kTrigramNtFeature, EPSILON::ID, nt1, nt2), 1.0f);
+        weight.insert(getFeatureId(kBigramNtFeature, nt1, nt2), 1.0f);
+        weight.insert(getFeatureId(kUnigramNtFeature, nt2), 1.0f);
         model->addArc(new Arc(Head(stateId[nt12]), Tails(stateId[epsNt1], stateId[nt2]), weight));
       }
     }
@@ -397,8 +448,8 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
       std::string const& ntStr = pVoc_->str(nt);
       Sym epsNt = sym("eps+" + ntStr);
       Weight weight(0.0f);
-      weight.insert(getFeatureId(createFeatureName("bi_nt", "eps", ntStr)), 1.0f);
-      weight.insert(getFeatureId(createFeatureName("uni_nt", ntStr)), 1.0f);
+      weight.insert(getFeatureId(kBigramNtFeature, EPSILON::ID, nt), 1.0f);
+      weight.insert(getFeatureId(kUnigramNtFeature, nt), 1.0f);
       model->addArc(new Arc(Head(stateId[epsNt]), Tails(stateId[nt]), weight));
     }
 
@@ -412,9 +463,9 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
         std::string const& nt2Str = pVoc_->str(nt2);
         Sym nt12 = sym(nt1Str + "+" + nt2Str);
         Weight weight(0.0f);
-        weight.insert(getFeatureId(createFeatureName("tri_nt", nt1Str, nt2Str, "FINAL")), 1.0f);
-        weight.insert(getFeatureId(createFeatureName("bi_nt", nt2Str, "FINAL")), 1.0f);
-        weight.insert(getFeatureId(createFeatureName("uni_nt", "FINAL")), 1.0f);
+        weight.insert(getFeatureId(kTrigramNtFeature, nt1, nt2, SENT_END::ID), 1.0f);
+        weight.insert(getFeatureId(kBigramNtFeature, nt2, SENT_END::ID), 1.0f);
+        weight.insert(getFeatureId(kUnigramNtFeature, SENT_END::ID), 1.0f);
         model->addArc(new Arc(Head(stateId[final0]), Tails(stateId[nt12]), weight));
       }
     }
@@ -424,9 +475,9 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
       std::string const& nt1Str = pVoc_->str(nt1);
       Sym epsNt1 = sym("eps+" + nt1Str);
       Weight weight(0.0f);
-      weight.insert(getFeatureId(createFeatureName("tri_nt", "eps", nt1Str, "FINAL")), 1.0f);
-      weight.insert(getFeatureId(createFeatureName("bi_nt", nt1Str, "FINAL")), 1.0f);
-      weight.insert(getFeatureId(createFeatureName("uni_nt", "FINAL")), 1.0f);
+      weight.insert(getFeatureId(kTrigramNtFeature, EPSILON::ID, nt1, SENT_END::ID), 1.0f);
+      weight.insert(getFeatureId(kBigramNtFeature, nt1, SENT_END::ID), 1.0f);
+      weight.insert(getFeatureId(kUnigramNtFeature, SENT_END::ID), 1.0f);
       model->addArc(new Arc(Head(stateId[final0]), Tails(stateId[epsNt1]), weight));
     }
 
@@ -449,12 +500,66 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
     return model;
   }
 
+  /// the transitions of createUnigramModel or createBigramModel, for dense-trellis
+  void createLinearChainModel(Optimization::LinearChainModel& model) {
+    using namespace Optimization;
+    bool const bigram = opts_.transitionModel == kBigram;
+    model = LinearChainModel((LabelIndex)allLabels_.size(), bigram);
+    labelIndex_.clear();
+    for (Sym label : allLabels_) {
+      labelIndex_[label] = (LabelIndex)model.labelNames.size();
+      model.labelNames.push_back(pVoc_->str(label));
+    }
+    if (!bigram) return;
+    std::vector<Sym> historyNames(1, EPSILON::ID);
+    historyNames.insert(historyNames.end(), allLabels_.begin(), allLabels_.end());
+    for (LabelIndex l = 0; l < model.nLabels; ++l) {
+      Sym const label = historyNames[l + 1];
+      model.transition(model.start(), l).push_back(getFeatureId(kBigramFeature, EPSILON::ID, label));
+      for (LabelIndex prev = 0; prev < model.nLabels; ++prev)
+        model.transition(prev, l).push_back(getFeatureId(kBigramFeature, historyNames[prev + 1], label));
+      model.end(l).push_back(getFeatureId(kEndFeature, label));
+    }
+  }
+
+  /// the labels (and emission features) of createSearchSpace(sent, kUnclamped), with the observed label as gold
+  void createLinearChainExample(Sentence const& sent, Optimization::LinearChainExample& example) const {
+    for (std::size_t i = 0; i < sent.words.size(); ++i) {
+      example.addPosition();
+      std::set<Sym> const* labels = &allLabels_;
+      LabelsPerPosMap::const_iterator iter = labelsPerPos_.find(sent.poss[i]);
+      if (iter != labelsPerPos_.end()) labels = &(iter->second);
+      for (Sym label : *labels) {
+        unordered_map<Sym, Optimization::LabelIndex>::const_iterator index = labelIndex_.find(label);
+        if (index == labelIndex_.end()) continue;  // (test mode) not in labels-path
+        example.addCandidate(index->second, label == sent.labels[i]);
+        example.addFeature(getFeatureId(kWordLabelFeature, sent.words[i], label));
+        example.addFeature(getFeatureId(kPosLabelFeature, sent.poss[i], label));
+        example.addFeature(getFeatureId(kLabelFeature, label));
+      }
+      if (example.candidatesEnd(i) == example.candidatesBegin[i])
+        SDL_THROW_LOG(CrfDemo, InvalidInputException, "dense-trellis: no candidate labels for pos "
+                                                          << pVoc_->str(sent.poss[i]));
+    }
+    if (!testMode_ && !example.hasGold())
+      SDL_THROW_LOG(CrfDemo, InvalidInputException, "dense-trellis: observed label not among the candidates");
+  }
+
+  void createLinearChainData(std::vector<Sentence> const& sents) {
+    linearChainData_ = make_shared<Optimization::LinearChainData>();
+    createLinearChainModel(linearChainData_->model);
+    std::vector<Optimization::LinearChainExample>& examples = linearChainData_->examples;
+    examples.resize(sents.size());
+    Util::parallelFor(0, sents.size(), (unsigned)opts_.numThreads,
+                      [&](std::size_t i) { createLinearChainExample(sents[i], examples[i]); }, kSentencesPerChunk);
+  }
+
   void addLabelArc(Hypergraph::IMutableHypergraph<Arc>* hg, Sym word, Sym pos, Sym label,
                    Hypergraph::StateId from, Hypergraph::StateId to) const {
     Weight weight(0.0f);
-    weight.insert(getFeatureId(createFeatureName("word+label", word, label)), 1.0f);
-    weight.insert(getFeatureId(createFeatureName("pos+label", pos, label)), 1.0f);
-    weight.insert(getFeatureId(createFeatureName("label", label)), 1.0f);
+    weight.insert(getFeatureId(kWordLabelFeature, word, label), 1.0f);
+    weight.insert(getFeatureId(kPosLabelFeature, pos, label), 1.0f);
+    weight.insert(getFeatureId(kLabelFeature, label), 1.0f);
 
     using namespace Hypergraph;
     hg->addArc(new Arc(Head(to), Tails(from, hg->addState(label)), weight));
@@ -508,60 +613,27 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
     return composed;
   }
 
-  void processTrainingSentence(Sentence const& sent, Hypergraph::IHypergraph<Arc> const& transitionModel,
-                               Pairs& pairs) {
-    Hypergraph::IHypergraph<Arc>* clamped = createSearchSpace(sent, transitionModel, kClamped);
-    Hypergraph::IHypergraph<Arc>* unclamped = createSearchSpace(sent, transitionModel, kUnclamped);
-    std::lock_guard<std::mutex> lock(mutex_);
-    pairs.push_back(value_type(IHgPtr(clamped), IHgPtr(unclamped)));
+  value_type createTrainingPair(Sentence const& sent, Hypergraph::IHypergraph<Arc> const& transitionModel) const {
+    return value_type(IHgPtr(createSearchSpace(sent, transitionModel, kClamped)),
+                      IHgPtr(createSearchSpace(sent, transitionModel, kUnclamped)));
   }
 
-  ///
+  /// sentences are split into chunks of this many for parallelFor
+  enum { kSentencesPerChunk = 16 };
 
-  /// Threads can call this functor
-  struct ProcessTrainingExampleRange {
-
-    typedef CreateSearchSpace<A> Outer;
-    ProcessTrainingExampleRange(ProcessTrainingExampleRange const&) = delete;
-    ProcessTrainingExampleRange(Outer& o, std::size_t begin, std::size_t end, std::vector<Sentence> const& sents,
-                                Hypergraph::IHypergraph<A> const& transitionModel,
-                                typename Outer::Pairs& trainingExamples, bool doLogProgress)
-        : outer_(o)
-        , begin_(begin)
-        , end_(end)
-        , sents_(sents)
-        , transitionModel_(transitionModel)
-        , trainingExamples_(trainingExamples)
-        , doLogProgress_(doLogProgress) {}
-
-    void operator()() {
-      SDL_DEBUG(Optimization.ProcessTrainingExampleRange, "Processing sentences " << begin_ << " to " << end_);
-      for (std::size_t i = begin_; i < end_; ++i) {
-        SDL_DEBUG(Optimization.ProcessTrainingExampleRange, "Processing sentence " << i);
-        outer_.processTrainingSentence(sents_[i], transitionModel_, trainingExamples_);
-
-        if (doLogProgress_) {
-          std::size_t blockSize = (end_ - begin_) / 10.0f;
-          if (blockSize && (i - begin_ + 1) % blockSize == 0) {
-            SDL_INFO(CrfDemo, (((i - begin_ + 1.0f) / (end_ - begin_)) * 100.0f) << "% processed");
-          }
-        }
-      }
-    }
-
-    Outer& outer_;
-    std::size_t begin_, end_;
-    std::vector<Sentence> const& sents_;
-    Hypergraph::IHypergraph<A> const& transitionModel_;
-    typename Outer::Pairs& trainingExamples_;
-    bool doLogProgress_;
-  };
-
-  ///
+  /// pairs are built (in parallel) for this many sentences per thread at a time, then added in order
+  enum { kSentencesPerThreadPerWindow = 256 };
 
   void prepareTraining() {
     Util::Performance performance("CrfDemo.prepareTraining", std::cerr);
 
+    if (opts_.denseTrellis) {
+      if (opts_.transitionModel != kUnigram && opts_.transitionModel != kBigram)
+        SDL_THROW_LOG(CrfDemo, ConfigException, "dense-trellis needs transition-model unigram or bigram");
+      if (!opts_.writeTrainArchivePath.empty() || !opts_.readTrainArchivePath.empty())
+        SDL_THROW_LOG(CrfDemo, ConfigException, "dense-trellis can't read or write training archives");
+    }
+
     if (!opts_.writeTrainArchivePath.empty()) {  // Write archive?
       pairs_.reset(new Optimization::WriteFeatureHypergraphPairs<Arc>(opts_.writeTrainArchivePath));
     } else if (!opts_.readTrainArchivePath.empty()) {  // Read archive?
@@ -573,17 +645,7 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
 
     SDL_INFO(CrfDemo, "Loading " + opts_.conllPath);
     std::vector<Sentence> sents;
-    std::string line;
-    Sentence sent;
-    Util::Input input(opts_.conllPath);
-    while (std::getline(*input, line)) {
-      if (line.empty()) {
-        sents.push_back(sent);
-        sent.clear();
-      } else {
-        sent.add(line, &allLabels_, pVoc_, testMode_);
-      }
-    }
+    readSentences(opts_.conllPath, sents);
     assert(!allLabels_.empty());
     SDL_INFO(CrfDemo, "Read " << sents.size() << " training examples");
     SDL_INFO(CrfDemo, "Found " << allLabels_.size() << " labels");
@@ -595,44 +657,14 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
       }
     }
 
-    Hypergraph::IHypergraph<Arc>* transitionModel = opts_.transitionModel == kUnigram
-                                                        ? createUnigramModel()
-                                                        : opts_.transitionModel == kBigram
-                                                              ? createBigramModel()
-                                                              : opts_.transitionModel == kHierarchical
-                                                                    ? createHierarchicalModel()
-                                                                    : createBihierarchicalModel();
-    SDL_INFO(CrfDemo, "Extracting features");
+    if (opts_.denseTrellis) {
+      SDL_INFO(CrfDemo, "Extracting features (dense trellis)");
+      createLinearChainData(sents);
+    } else
+      extractHypergraphPairs(sents);
 
-    if (opts_.numThreads < 2) {
-      std::size_t cnt = 0;
-      for (Sentence const& sent : sents) {
-        processTrainingSentence(sent, *transitionModel, *pairs_);
-      }
-    } else {  // multi-threaded:
-      std::size_t numProducers = opts_.numThreads;
-      graehl::thread_group producer_threads;
-
-      std::size_t size = sents.size();
-      std::size_t blockSize = size / numProducers;
-      std::size_t numProducerThreads = (numProducers * blockSize == size) ? numProducers : numProducers + 1;
-
-      typedef Util::AutoDeleteAll<ProcessTrainingExampleRange> Producers;
-      Producers producers;
-      producers.reserve(numProducerThreads);
-      ProcessTrainingExampleRange* update;
-      for (std::size_t i = 0; i < numProducerThreads; ++i) {
-        TrainingDataIndex begin = i * blockSize;
-        TrainingDataIndex end = (i == numProducerThreads - 1) ? size : (i + 1) * blockSize;
-        producers.push_back(update = new ProcessTrainingExampleRange(*this, begin, end, sents,
-                                                                     *transitionModel, *pairs_, i == 0));
-        producer_threads.create_thread(std::ref(*update));
-      }
-      producer_threads.join_all();
-    }
-
-    delete transitionModel;
     SDL_INFO(CrfDemo, "Number of features: " << opts_.numFeatures);
+    if (featureNames_) writeFeatureNames(opts_.featureNamesPath);
 
     if (!testMode_) {
       writeLabelsFile(opts_.labelsPath);
@@ -650,16 +682,58 @@ class CreateSearchSpace : public Optimization::ICreateSearchSpace<A> {
     }
   }
 
+  void extractHypergraphPairs(std::vector<Sentence> const& sents) {
+    Hypergraph::IHypergraph<Arc>* transitionModel = opts_.transitionModel == kUnigram
+                                                        ? createUnigramModel()
+                                                        : opts_.transitionModel == kBigram
+                                                              ? createBigramModel()
+                                                              : opts_.transitionModel == kHierarchical
+                                                                    ? createHierarchicalModel()
+                                                                    : createBihierarchicalModel();
+    SDL_INFO(CrfDemo, "Extracting features");
+
+    // each window's pairs are built into their own slots by any thread, then
+    // appended in sentence order (so the pairs don't depend on the number of
+    // threads, and a training archive needn't hold all pairs in memory)
+    unsigned const numThreads = Util::effectiveNumThreads((unsigned)opts_.numThreads);
+    std::size_t const size = sents.size();
+    std::size_t const windowSize = numThreads < 2 ? size : numThreads * (std::size_t)kSentencesPerThreadPerWindow;
+    std::vector<value_type> window(std::min(windowSize, size));
+    unsigned loggedTenths = 0;
+    for (std::size_t begin = 0; begin < size; begin += windowSize) {
+      std::size_t const end = std::min(size, begin + windowSize);
+      Util::parallelFor(begin, end, numThreads, [&](std::size_t i) {
+        window[i - begin] = createTrainingPair(sents[i], *transitionModel);
+      });
+      for (std::size_t i = begin; i < end; ++i) {
+        pairs_->push_back(window[i - begin]);
+        window[i - begin] = value_type();
+      }
+      unsigned const tenths = (unsigned)(10 * end / size);
+      if (tenths > loggedTenths) {  // at most once per 10%
+        loggedTenths = tenths;
+        SDL_INFO(CrfDemo, (100.0 * end / size) << "% processed");
+      }
+    }
+
+    delete transitionModel;
+  }
+
   std::string getName() const { return "CrfDemo"; }
 
  private:
   IVocabularyPtr pVoc_;
   shared_ptr<Optimization::IFeatureHypergraphPairs<Arc>> pairs_;
   CrfDemoConfig opts_;
+  FeatureHasher featureHash_;
+  /// only if opts_.featureNamesPath
+  unique_ptr<FeatureNames> featureNames_;
   std::set<Sym> allLabels_;
   LabelsPerPosMap labelsPerPos_;
+  /// dense-trellis only
+  shared_ptr<Optimization::LinearChainData> linearChainData_;
+  unordered_map<Sym, Optimization::LabelIndex> labelIndex_;
   bool testMode_;
-  std::mutex mutex_;
 };
 
 
@@ -0,0 +1,137 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    CrfDemo feature ids: (template, up to 3 symbols) hashed (murmur) straight
+    into [0, numFeatures), without building a feature name string.
+
+    FeatureNames optionally records a readable name for each id (debugging).
+*/
+
+#ifndef SDL_CRFDEMO_FEATUREIDS_HPP
+#define SDL_CRFDEMO_FEATUREIDS_HPP
+#pragma once
+
+#include <sdl/Util/Hash.hpp>
+#include <sdl/Util/StringBuilder.hpp>
+#include <sdl/Util/Unordered.hpp>
+#include <sdl/IVocabulary.hpp>
+#include <sdl/Sym.hpp>
+#include <sdl/Types.hpp>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace sdl {
+namespace CrfDemo {
+
+enum FeatureTemplate {
+  kBigramFeature,
+  kEndFeature,
+  kShortFeature,
+  kLongFeature,
+  kShortSubFeature,
+  kLongSubFeature,
+  kTrigramNtFeature,
+  kBigramNtFeature,
+  kUnigramNtFeature,
+  kWordLabelFeature,
+  kPosLabelFeature,
+  kLabelFeature,
+  kNumFeatureTemplates
+};
+
+/// name prefix of each FeatureTemplate (for FeatureNames)
+inline char const* featureTemplateName(FeatureTemplate t) {
+  static char const* const names[kNumFeatureTemplates]
+      = {"bi",     "end",   "short",  "long",       "short_sub", "long_sub",
+         "tri_nt", "bi_nt", "uni_nt", "word+label", "pos+label", "label"};
+  return names[t];
+}
+
+/**
+   hash (template, syms) to a feature id. the syms are hashed by id, or by
+   their vocabulary string if hashSymbolText (so ids agree between runs that
+   build their vocabularies in a different order, e.g. train and test).
+
+   thread safe (if the vocabulary is no longer being added to).
+*/
+struct FeatureHasher {
+  FeatureHasher(IVocabularyPtr const& voc = IVocabularyPtr(), FeatureId numFeatures = 1,
+                bool hashSymbolText = false)
+      : voc(voc), numFeatures(numFeatures), hashSymbolText(hashSymbolText) {}
+
+  FeatureId operator()(FeatureTemplate t, Sym sym1, Sym sym2 = NoSymbol, Sym sym3 = NoSymbol) const {
+    uint64 key[4] = {(uint64)t, symHash(sym1), symHash(sym2), symHash(sym3)};
+    return (FeatureId)(Util::MurmurHash64(key, (int)sizeof(key)) % numFeatures);
+  }
+
+  uint64 symHash(Sym sym) const {
+    if (!hashSymbolText || !sym) return sym.id();
+    std::string const& text = voc->str(sym);
+    return Util::MurmurHash64(text.data(), (int)text.size());
+  }
+
+  IVocabularyPtr voc;
+  FeatureId numFeatures;
+  bool hashSymbolText;
+};
+
+/**
+   readable names ("template_sym1_sym2") of the features hashed so far, by
+   id. ids shared by several names (hash collisions) are counted. thread
+   safe.
+*/
+struct FeatureNames {
+  explicit FeatureNames(IVocabularyPtr const& voc) : voc(voc), nCollisions() {}
+
+  void add(FeatureId id, FeatureTemplate t, Sym sym1, Sym sym2 = NoSymbol, Sym sym3 = NoSymbol) {
+    Util::StringBuilder name(featureTemplateName(t));
+    Sym const syms[3] = {sym1, sym2, sym3};
+    for (Sym sym : syms)
+      if (sym) name('_')(voc->str(sym));
+    std::lock_guard<std::mutex> lock(mutex);
+    std::pair<Names::iterator, bool> added = names.insert(Names::value_type(id, std::string()));
+    if (added.second)
+      name.to(added.first->second);
+    else if (added.first->second != name.str())
+      ++nCollisions;
+  }
+
+  /// lines "id<TAB>name", by id
+  void write(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<FeatureId, std::string const*> byId;
+    for (Names::value_type const& idName : names) byId[idName.first] = &idName.second;
+    for (auto const& idName : byId) out << idName.first << '\t' << *idName.second << '\n';
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return names.size();
+  }
+
+  IVocabularyPtr voc;
+  /// # of times a name hashed to an id already named differently
+  std::size_t nCollisions;
+
+ private:
+  typedef unordered_map<FeatureId, std::string> Names;
+  Names names;
+  mutable std::mutex mutex;
+};
+
+
+}}
+
+#endif
@@ -11,6 +11,13 @@
 /** \file
 
     all-pairs summary of paths (using Weight plus, times).
+
+    floydWarshall (cubic, any FSM) optionally runs on several threads: per
+    intermediate state the rows are independent. for idempotent-plus weights
+    (Viterbi) the matrix is instead processed in cache-sized tiles (blocked
+    Floyd-Warshall). johnsonAllPairs (Viterbi only) is better for sparse graphs:
+    one Bellman-Ford pass for potentials, then a Dijkstra per source, in
+    parallel.
 */
 
 #ifndef HYPERGRAPH_ALL_PAIRS_SHORTESTDISTANCE_HPP
@@ -20,10 +27,20 @@
 #include <sdl/Hypergraph/ArcWeight.hpp>
 #include <sdl/Hypergraph/IHypergraph.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
-#include <sdl/Hypergraph/WeightUtil.hpp>
+#include <sdl/Hypergraph/WeightsFwdDecls.hpp>
 #include <sdl/Util/LogHelper.hpp>
 #include <sdl/Util/Matrix.hpp>
+#include <sdl/Util/ParallelFor.hpp>
+#include <sdl/Config/Init.hpp>
+#include <sdl/Exception.hpp>
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace sdl {
 namespace Hypergraph {
@@ -37,9 +54,8 @@ namespace Hypergraph {
 
    for graph, not hypergraph.
 
-   TODO: Johnson's algorithm is a faster all-pairs shortest-distance algorithm
-   than Floyd-Warshall.
-
+   (see johnsonAllPairs for a faster all-pairs shortest-distance algorithm on
+   sparse graphs)
 */
 template <class Arc, class ArcWtFn>
 void floydWarshallInit(IHypergraph<Arc> const& hg, Util::Matrix<typename ArcWtFn::Weight>* pdistances,
@@ -89,6 +105,141 @@ void floydWarshallOverMatrix(Util::Matrix<Weight>* pdistances) {
 }
 
 
+struct AllPairsOptions {
+  /// 0 means hardware concurrency
+  unsigned numThreads;
+  /// tile size (states) for blocked Floyd-Warshall
+  std::size_t blockSize;
+  /// use johnsonAllPairs (Viterbi only) instead of Floyd-Warshall
+  bool johnson;
+  /// fewer states than this: single-threaded, untiled
+  std::size_t minParallelStates;
+
+  AllPairsOptions() { Config::inits(this); }
+
+  template <class Config>
+  void configure(Config& config) {
+    config.is("AllPairsOptions");
+    config("all-pairs shortest distance (Floyd-Warshall or Johnson)");
+    config("num-threads", &numThreads).init(1)("threads to use (0: one per cpu)");
+    config("block-size", &blockSize).init(64)("tile size (states) for blocked Viterbi Floyd-Warshall");
+    config("johnson", &johnson)
+        .init(false)("Johnson (Bellman-Ford + per-source Dijkstra) instead of Floyd-Warshall - Viterbi only; "
+                     "faster for sparse graphs");
+    config("min-parallel-states", &minParallelStates)
+        .init(256)("use plain single-threaded Floyd-Warshall for fewer states than this");
+  }
+};
+
+/**
+   relax the (i, j) entries of [iBegin, iEnd) x [jBegin, jEnd) through
+   intermediates [kBegin, kEnd) (k outermost, so a tile may overlap the k rows
+   or columns). only correct for idempotent plus (a tile is revisited in a
+   different order than the plain triple loop).
+*/
+template <class Weight>
+void floydWarshallRelaxTile(Util::Matrix<Weight>& dist, std::size_t iBegin, std::size_t iEnd,
+                            std::size_t jBegin, std::size_t jEnd, std::size_t kBegin, std::size_t kEnd) {
+  for (std::size_t k = kBegin; k < kEnd; ++k) {
+    Weight const* rowk = dist.row(k);
+    for (std::size_t i = iBegin; i < iEnd; ++i) {
+      if (k == i) continue;
+      Weight* rowi = dist.row(i);
+      Weight const wik(rowi[k]);
+      if (isZero(wik)) continue;
+      for (std::size_t j = jBegin; j < jEnd; ++j) {
+        if (i == j) continue;
+        Weight const& wkj = rowk[j];
+        if (isZero(wkj)) continue;
+        Hypergraph::plusBy(times(wik, wkj), rowi[j]);
+      }
+    }
+  }
+}
+
+/**
+   blocked (tiled) Floyd-Warshall for idempotent plus: for each diagonal tile
+   kb, (1) close kb itself, (2) its row and column of tiles, in parallel, (3)
+   all remaining tiles, in parallel. the 3 * (# of tiles) steps are phases of
+   one parallelForPhases (threads created once).
+*/
+template <class Weight>
+void floydWarshallBlocked(Util::Matrix<Weight>* pdistances, AllPairsOptions const& opt = AllPairsOptions()) {
+  Util::Matrix<Weight>& dist = *pdistances;
+  std::size_t const n = dist.getNumRows();
+  assert(n == dist.getNumCols());
+  std::size_t const B = std::max((std::size_t)1, opt.blockSize);
+  std::size_t const nb = (n + B - 1) / B;
+  if (nb <= 1) {
+    floydWarshallRelaxTile(dist, 0, n, 0, n, 0, n);
+    return;
+  }
+  // tiles (kb, b) and (b, kb) for b != kb: [0, nb-1) are rows, [nb-1, 2nb-2) are columns
+  std::size_t const nOthers = nb - 1, phaseSizes[3] = {1, 2 * nOthers, nOthers * nOthers};
+  auto phaseSize = [&phaseSizes](std::size_t phase) { return phaseSizes[phase % 3]; };
+  auto relax = [&](std::size_t phase, std::size_t t) {
+    std::size_t const kb = phase / 3, k0 = kb * B, k1 = std::min(n, k0 + B);
+    if (phase % 3 == 0)
+      floydWarshallRelaxTile(dist, k0, k1, k0, k1, k0, k1);
+    else if (phase % 3 == 1) {
+      bool const col = t >= nOthers;
+      std::size_t b = col ? t - nOthers : t;
+      if (b >= kb) ++b;
+      std::size_t const b0 = b * B, b1 = std::min(n, b0 + B);
+      if (col)
+        floydWarshallRelaxTile(dist, b0, b1, k0, k1, k0, k1);
+      else
+        floydWarshallRelaxTile(dist, k0, k1, b0, b1, k0, k1);
+    } else {
+      std::size_t ib = t / nOthers, jb = t % nOthers;
+      if (ib >= kb) ++ib;
+      if (jb >= kb) ++jb;
+      std::size_t const i0 = ib * B, j0 = jb * B;
+      floydWarshallRelaxTile(dist, i0, std::min(n, i0 + B), j0, std::min(n, j0 + B), k0, k1);
+    }
+  };
+  Util::parallelForPhases(3 * nb, opt.numThreads, phaseSize, relax);
+}
+
+/**
+   same results as floydWarshallOverMatrix for any semiring: for each k, rows
+   i != k are updated in parallel (row k isn't modified while k is the
+   intermediate), one parallelForPhases phase per k. idempotent-plus weights
+   use floydWarshallBlocked instead.
+*/
+template <class Weight>
+void floydWarshallOverMatrix(Util::Matrix<Weight>* pdistances, AllPairsOptions const& opt) {
+  Util::Matrix<Weight>& dist = *pdistances;
+  std::size_t const n = dist.getNumRows();
+  if (n < opt.minParallelStates) {
+    floydWarshallOverMatrix(pdistances);
+    return;
+  }
+  if (WeightIdempotentPlus<Weight>::value) {
+    floydWarshallBlocked(pdistances, opt);
+    return;
+  }
+  if (Util::effectiveNumThreads(opt.numThreads) <= 1) {
+    floydWarshallOverMatrix(pdistances);
+    return;
+  }
+  auto phaseSize = [n](std::size_t) { return n; };
+  auto relaxRow = [&](std::size_t k, std::size_t i) {
+    if (k == i) return;
+    Weight const* rowk = dist.row(k);
+    Weight* rowi = dist.row(i);
+    Weight const& wik = rowi[k];
+    if (isZero(wik)) return;
+    for (StateId j = 0; j < n; ++j) {
+      if (i == j) continue;
+      Weight const& wkj = rowk[j];
+      if (isZero(wkj)) continue;
+      Hypergraph::plusBy(times(wik, wkj), rowi[j]);
+    }
+  };
+  Util::parallelForPhases(n, opt.numThreads, phaseSize, relaxRow, 16);
+}
+
 /**
    cubic time all-pairs (shortest) paths.
 
@@ -109,6 +260,149 @@ void floydWarshall(IHypergraph<Arc> const& hg, Util::Matrix<typename Arc::Weight
   floydWarshall(hg, distances, ArcWeight<typename Arc::Weight>());
 }
 
+template <class Arc, class ArcWtFn>
+void floydWarshall(IHypergraph<Arc> const& hg, Util::Matrix<typename ArcWtFn::Weight>* distances,
+                   ArcWtFn const& arcWtFn, AllPairsOptions const& opt) {
+  if (!hg.isFsm())
+    SDL_THROW_LOG(Hypergraph, ConfigException, "Current floydWarshall implementation needs FSM input");
+  floydWarshallInit(hg, distances, arcWtFn);
+  floydWarshallOverMatrix(distances, opt);
+}
+
+/**
+   Johnson's all-pairs shortest distance for Viterbi weights (real costs,
+   negative allowed but no negative cycles): Bellman-Ford from a virtual
+   source (0-cost arc to every state) gives potentials h, so that arc costs
+   c(u, v) + h(u) - h(v) are nonnegative, then a Dijkstra from each source
+   (run in parallel) gives d(s, v) = d'(s, v) - h(s) + h(v). O(VE log V)
+   rather than O(V^3).
+
+   distances (square, size = # of states considered) is completely
+   overwritten; like floydWarshall, the diagonal is Weight::one().
+*/
+template <class Arc, class ArcWtFn>
+void johnsonAllPairs(IHypergraph<Arc> const& hg, Util::Matrix<typename ArcWtFn::Weight>* pdistances,
+                     ArcWtFn const& arcWtFn, AllPairsOptions const& opt = AllPairsOptions()) {
+  typedef typename ArcWtFn::Weight Weight;
+  typedef typename Weight::FloatT Cost;
+  static_assert(std::is_same<Weight, ViterbiWeightTpl<Cost>>::value,
+                "johnsonAllPairs requires ViterbiWeight (min, +)");
+  if (!hg.isFsm())
+    SDL_THROW_LOG(Hypergraph, ConfigException, "johnsonAllPairs needs FSM input");
+  Util::Matrix<Weight>& dist = *pdistances;
+  StateId const n = (StateId)dist.getNumRows();
+  assert(n == dist.getNumCols());
+  Cost const kInf = std::numeric_limits<Cost>::infinity();
+
+  // compressed adjacency (out arcs of each state; min cost for parallel arcs isn't needed)
+  std::vector<std::size_t> firstArc(n + 1);
+  std::vector<StateId> heads;
+  std::vector<Cost> costs;
+  for (StateId tail = 0; tail < n; ++tail) {
+    firstArc[tail] = heads.size();
+    for (ArcId aid : hg.outArcIds(tail)) {
+      Arc* arc = hg.outArc(tail, aid);
+      StateId const head = arc->head();
+      if (head >= n) continue;
+      Cost const c = arcWtFn(arc).value_;
+      if (c == kInf) continue;
+      heads.push_back(head);
+      costs.push_back(c);
+    }
+  }
+  firstArc[n] = heads.size();
+
+  // Bellman-Ford potentials
+  std::vector<Cost> h(n, (Cost)0);
+  bool changed = true;
+  for (StateId iter = 0; changed; ++iter) {
+    if (iter > n)
+      SDL_THROW_LOG(Hypergraph.AllPairs, CycleException, "johnsonAllPairs: negative cost cycle");
+    changed = false;
+    for (StateId u = 0; u < n; ++u)
+      for (std::size_t a = firstArc[u], e = firstArc[u + 1]; a < e; ++a) {
+        Cost const via = h[u] + costs[a];
+        Cost& hv = h[heads[a]];
+        if (via < hv) {
+          hv = via;
+          changed = true;
+        }
+      }
+  }
+  for (StateId u = 0; u < n; ++u)
+    for (std::size_t a = firstArc[u], e = firstArc[u + 1]; a < e; ++a)
+      costs[a] = std::max((Cost)0, costs[a] + h[u] - h[heads[a]]);  // max: rounding
+
+  typedef std::pair<Cost, StateId> Queued;
+  Util::parallelForChunks(0, n, opt.numThreads, 16, [&](std::size_t sourceBegin, std::size_t sourceEnd) {
+    std::vector<Cost> d(n, kInf);
+    std::vector<StateId> reached;
+    std::priority_queue<Queued, std::vector<Queued>, std::greater<Queued>> queue;
+    for (StateId s = (StateId)sourceBegin; s < sourceEnd; ++s) {
+      for (StateId v : reached) d[v] = kInf;
+      reached.clear();
+      d[s] = 0;
+      reached.push_back(s);
+      queue.push(Queued(0, s));
+      while (!queue.empty()) {
+        Queued const top = queue.top();
+        queue.pop();
+        StateId const u = top.second;
+        if (top.first > d[u]) continue;  // stale
+        for (std::size_t a = firstArc[u], e = firstArc[u + 1]; a < e; ++a) {
+          StateId const v = heads[a];
+          Cost const via = top.first + costs[a];
+          if (via < d[v]) {
+            if (d[v] == kInf) reached.push_back(v);
+            d[v] = via;
+            queue.push(Queued(via, v));
+          }
+        }
+      }
+      Weight* row = dist.row(s);
+      std::fill(row, row + n, Weight::zero());
+      for (StateId v : reached) row[v] = Weight(d[v] - h[s] + h[v]);
+      row[s] = Weight::one();
+    }
+  });
+}
+
+template <class Arc, class ArcWtFn>
+void allPairsShortestDistance(IHypergraph<Arc> const& hg, Util::Matrix<typename ArcWtFn::Weight>* distances,
+                              ArcWtFn const& arcWtFn, AllPairsOptions const& opt, std::true_type isViterbi) {
+  if (opt.johnson)
+    johnsonAllPairs(hg, distances, arcWtFn, opt);
+  else
+    floydWarshall(hg, distances, arcWtFn, opt);
+}
+
+template <class Arc, class ArcWtFn>
+void allPairsShortestDistance(IHypergraph<Arc> const& hg, Util::Matrix<typename ArcWtFn::Weight>* distances,
+                              ArcWtFn const& arcWtFn, AllPairsOptions const& opt, std::false_type isViterbi) {
+  if (opt.johnson)
+    SDL_WARN(Hypergraph.AllPairs, "johnson all-pairs needs viterbi weights - using Floyd-Warshall");
+  floydWarshall(hg, distances, arcWtFn, opt);
+}
+
+/**
+   all-pairs for FSM: Johnson if requested (and Viterbi), else (parallel,
+   tiled if possible) Floyd-Warshall. distances must be square and initialized
+   to Weight::zero().
+*/
+template <class Arc, class ArcWtFn>
+void allPairsShortestDistance(IHypergraph<Arc> const& hg, Util::Matrix<typename ArcWtFn::Weight>* distances,
+                              ArcWtFn const& arcWtFn, AllPairsOptions const& opt = AllPairsOptions()) {
+  typedef typename ArcWtFn::Weight Weight;
+  allPairsShortestDistance(hg, distances, arcWtFn, opt,
+                           std::integral_constant<bool, IsViterbiWeight<Weight>::value>());
+}
+
+template <class Arc>
+void allPairsShortestDistance(IHypergraph<Arc> const& hg, Util::Matrix<typename Arc::Weight>* distances,
+                              AllPairsOptions const& opt = AllPairsOptions()) {
+  allPairsShortestDistance(hg, distances, ArcWeight<typename Arc::Weight>(), opt);
+}
+
 /**
 
    AllPairSortedDag is faster than floydWarshall (but works for DAG only).
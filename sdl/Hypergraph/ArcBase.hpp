@@ -20,6 +20,7 @@
 #include <sdl/Hypergraph/FwdDecls.hpp>
 #include <sdl/Hypergraph/Label.hpp>
 #include <sdl/Hypergraph/Types.hpp>
+#include <sdl/Util/Arena.hpp>
 #include <sdl/Util/ObjectCount.hpp>
 #include <boost/functional/hash.hpp>
 #include <algorithm>
@@ -66,6 +67,14 @@ struct ArcBase SDL_OBJECT_TRACK_BASE(ArcBase) {
   ArcBase(ArcBase const& o) = default;
   ArcBase& operator=(ArcBase const& o) = default;
 
+  /// new Arc(...) uses the thread's Util::ArenaScope arena, if any, else a
+  /// concurrent size-class pool (any thread may delete it). the sized delete
+  /// gets the most derived size via the virtual dtor
+  static void* operator new(std::size_t bytes) { return Util::pooledMalloc(bytes); }
+  static void operator delete(void* p, std::size_t bytes) { Util::pooledFree(p, bytes); }
+  static void* operator new(std::size_t, void* p) { return p; }
+  static void operator delete(void*, void*) {}
+
   friend inline std::ostream& operator<<(std::ostream& out, ArcBase const& self) {
     self.print(out);
     return out;
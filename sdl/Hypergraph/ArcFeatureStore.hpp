@@ -0,0 +1,176 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    columnar (CSR) copy of a feature-weighted hypergraph's arc features, for
+    recomputing every arc's cost sum {weights[id] * value} at once (Reweight
+    --weights, training's setFeatureWeights) without walking each arc's
+    feature map.
+
+    feature ids are renumbered to columns 0..numColumns()-1 (the distinct ids,
+    ascending), so a weight vector or map of any id range is gathered once into
+    numColumns() entries; then each arc's cost reads its entries' (column,
+    value) sequentially and the gathered weights by column.
+
+    an arc's entries are in its map's (ascending id) order, so sums come out
+    as the per-arc map loops computed them (for finite values).
+
+    the store holds Arc pointers and copies of the feature values: build it
+    again if arcs are added/removed or their features change (their costs may
+    change freely).
+*/
+
+#ifndef HYP__HYPERGRAPH_ARCFEATURESTORE_HPP
+#define HYP__HYPERGRAPH_ARCFEATURESTORE_HPP
+#pragma once
+
+#include <sdl/Hypergraph/IHypergraph.hpp>
+#include <sdl/Util/ParallelFor.hpp>
+#include <sdl/Exception.hpp>
+#include <sdl/IntTypes.hpp>
+#include <sdl/Types.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+
+template <class Arc>
+struct ArcFeatureStore {
+  typedef typename Arc::Weight Weight;
+  typedef typename Weight::FloatT FloatT;
+  typedef typename Weight::Map Map;
+  typedef typename Map::key_type Id;
+  typedef typename Map::mapped_type Value;
+  typedef uint32 Column;
+
+  /// arcs per parallel chunk
+  enum { kArcsPerChunk = 4096 };
+
+  ArcFeatureStore() {}
+  explicit ArcFeatureStore(IHypergraph<Arc> const& hg) { init(hg); }
+
+  /// arcs in hg.forArcsSafe order
+  void init(IHypergraph<Arc> const& hg) {
+    arcs_.clear();
+    hg.forArcsSafe([this](Arc* arc) { arcs_.push_back(arc); });
+    std::size_t const nArcs = arcs_.size();
+    firstEntry_.resize(nArcs + 1);
+    std::vector<Id> ids;
+    values_.clear();
+    for (std::size_t a = 0; a < nArcs; ++a) {
+      firstEntry_[a] = values_.size();
+      if (Map const* features = arcs_[a]->weight().maybeFeatures())
+        for (typename Map::const_iterator i = features->begin(), e = features->end(); i != e; ++i) {
+          ids.push_back(i->first);
+          values_.push_back(i->second);
+        }
+    }
+    firstEntry_[nArcs] = values_.size();
+    columnIds_ = ids;
+    std::sort(columnIds_.begin(), columnIds_.end());
+    columnIds_.erase(std::unique(columnIds_.begin(), columnIds_.end()), columnIds_.end());
+    columnIds_.shrink_to_fit();
+    columns_.resize(ids.size());
+    for (std::size_t k = 0, n = ids.size(); k < n; ++k)
+      columns_[k] = (Column)(std::lower_bound(columnIds_.begin(), columnIds_.end(), ids[k]) - columnIds_.begin());
+  }
+
+  std::size_t numArcs() const { return arcs_.size(); }
+  std::size_t numEntries() const { return values_.size(); }
+  std::size_t numColumns() const { return columnIds_.size(); }
+  Arc* arc(std::size_t a) const { return arcs_[a]; }
+  Id columnId(Column c) const { return columnIds_[c]; }
+
+  /// gathered[c] = weights[columnId(c)]. throws IndexException if a feature id is >= nWeights
+  template <class W>
+  void gather(W const* weights, FeatureId nWeights, std::vector<W>& gathered) const {
+    if (!columnIds_.empty() && columnIds_.back() >= nWeights)
+      SDL_THROW_LOG(Hypergraph.ArcFeatureStore, IndexException,
+                    "feature id " << columnIds_.back() << " has no weight (only " << nWeights << " weights)");
+    gathered.resize(columnIds_.size());
+    for (std::size_t c = 0, n = columnIds_.size(); c < n; ++c) gathered[c] = weights[columnIds_[c]];
+  }
+
+  /// gathered[c] = weights[columnId(c)], or 0 if absent (sparse weights map)
+  template <class WeightsMap>
+  void gather(WeightsMap const& weights, std::vector<typename WeightsMap::mapped_type>& gathered) const {
+    gathered.resize(columnIds_.size());
+    for (std::size_t c = 0, n = columnIds_.size(); c < n; ++c) {
+      typename WeightsMap::const_iterator i = weights.find(columnIds_[c]);
+      gathered[c] = i == weights.end() ? typename WeightsMap::mapped_type() : i->second;
+    }
+  }
+
+  /**
+     fn(a, sum) for each arc a in [begin, end), sum = (Sum) sum of
+     value * gathered[column] over a's features.
+  */
+  template <class Sum, class W, class Fn>
+  void dotProducts(W const* gathered, std::size_t begin, std::size_t end, Fn const& fn) const {
+    Value const* values = values_.data();
+    Column const* columns = columns_.data();
+    for (std::size_t a = begin; a < end; ++a) {
+      Sum sum = Sum();
+      for (std::size_t k = firstEntry_[a], kEnd = firstEntry_[a + 1]; k < kEnd; ++k)
+        sum += values[k] * gathered[columns[k]];
+      fn(a, sum);
+    }
+  }
+
+  /// dots[a] = dot product of arc a's features and weights map (as Reweight --weights)
+  template <class WeightsMap>
+  void dotProducts(WeightsMap const& weights, std::vector<double>& dots) const {
+    std::vector<typename WeightsMap::mapped_type> gathered;
+    gather(weights, gathered);
+    dots.resize(arcs_.size());
+    double* out = dots.data();
+    dotProducts<double>(gathered.data(), 0, arcs_.size(), [out](std::size_t a, double sum) { out[a] = sum; });
+  }
+
+  /**
+     set every arc's cost to sum {weights[id] * value} over its features (as
+     InsertWeightsVisitor), on up to numThreads threads.
+  */
+  void setCosts(FloatT const* weights, FeatureId nWeights, unsigned numThreads = 1) const {
+    std::vector<FloatT> gathered;
+    gather(weights, nWeights, gathered);
+    Arc* const* arcs = arcs_.data();
+    Util::parallelForChunks(0, arcs_.size(), numThreads, kArcsPerChunk,
+                            [&](std::size_t begin, std::size_t end) {
+                              dotProducts<FloatT>(gathered.data(), begin, end, [arcs](std::size_t a, FloatT sum) {
+                                arcs[a]->weight().value_ = sum;
+                              });
+                            });
+  }
+
+  /// bytes held
+  std::size_t bytes() const {
+    return arcs_.capacity() * sizeof(Arc*) + firstEntry_.capacity() * sizeof(std::size_t)
+           + columns_.capacity() * sizeof(Column) + values_.capacity() * sizeof(Value)
+           + columnIds_.capacity() * sizeof(Id);
+  }
+
+ private:
+  std::vector<Arc*> arcs_;
+  /// arc a's entries are [firstEntry_[a], firstEntry_[a+1])
+  std::vector<std::size_t> firstEntry_;
+  std::vector<Column> columns_;
+  std::vector<Value> values_;
+  /// distinct feature ids, ascending
+  std::vector<Id> columnIds_;
+};
+
+
+}}
+
+#endif
@@ -55,6 +55,7 @@
 */
 
 #include <sdl/Hypergraph/Derivation.hpp>
+#include <sdl/Hypergraph/FsmBest.hpp>
 #include <sdl/Hypergraph/GetString.hpp>
 #include <sdl/Hypergraph/HypergraphTraits.hpp>
 #include <sdl/Hypergraph/HypergraphWriter.hpp>
@@ -63,6 +64,7 @@
 #include <sdl/Hypergraph/SortStates.hpp>
 #include <sdl/Hypergraph/Transform.hpp>
 #include <sdl/Util/LogHelper.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/Output.hpp>
 #include <sdl/Util/Performance.hpp>
 #include <sdl/Types.hpp>
@@ -75,11 +77,13 @@
 #include <sdl/Hypergraph/Types.hpp>
 #include <sdl/Hypergraph/Visit.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
+#include <sdl/Util/BitSet.hpp>
 #include <sdl/Util/Delete.hpp>
 #include <sdl/Util/UninitializedArray.hpp>
 #include <sdl/Pool.hpp>
 #include <graehl/shared/os.hpp>
 #include <graehl/shared/pool_traits.hpp>
+#include <graehl/shared/priority_queue.hpp>
 #include <graehl/shared/teestream.hpp>
 
 namespace sdl {
@@ -336,6 +340,7 @@ struct BestPathOptions : graehl::BestTreeOptions {
   bool dupInput = false;
   bool dupOutput = true;
   bool acyclic = true;
+  bool goalDirected = false;
   bool bestfirst = true;
   bool random = false;
   LabelType dupLabels() const {
@@ -388,6 +393,14 @@ struct BestPathOptions : graehl::BestTreeOptions {
             "best-first bottom-up if it turns out to have cycles - enabling this is slower if you know your "
             "hypergraph has cycles. See INFO messages sdl.Hypergraph.BestPath.acyclic to see whether this "
             "is happening.");
+    c("goal-directed", &goalDirected)
+        .defaulted()(
+            "for 1-best of a hypergraph with cycles (when there are no negative-cost arcs), stop the "
+            "best-first search as soon as the final state's best cost is known instead of computing best "
+            "costs for every state. for a graph this also searches the hg's own out-arcs directly instead of "
+            "first building a tails-up index of every arc. then only the states popped before final have "
+            "exact best costs, so leave this off if you read every state's best cost (e.g. prune-to-best "
+            "beam)");
     c("acyclic-max-back-edges", &acyclicMaxBackEdges)
         .defaulted()(
             "accept acyclic best-path result if there are this many or fewer cycle-causing back edges - the "
@@ -1100,31 +1113,103 @@ struct BestPath : TransformBase<Transform::Inplace> {
        TODO: allow kbest w/ inarcs only
     */
     template <bool IsGraph>
-    bool acyclicBest() {
-      AcyclicBest<Arc, Mu, Pi, IsGraph> acyclic(hg, mu, pi, opt.acyclicMaxBackEdges);
-      if (acyclic.back_edges_ <= opt.acyclicMaxBackEdges) {
-        if (acyclic.back_edges_)
+    bool acyclicBest(MutableHypergraph<Arc> const* fsm = 0) {
+      std::size_t backEdges, selfLoops;
+      if (IsGraph && fsm)
+        backEdges = FsmBest<Arc>(*fsm, mu.get(), pi.get()).acyclic(opt.acyclicMaxBackEdges, selfLoops);
+      else {
+        AcyclicBest<Arc, Mu, Pi, IsGraph> acyclic(hg, mu, pi, opt.acyclicMaxBackEdges);
+        backEdges = acyclic.back_edges_;
+        selfLoops = acyclic.self_loops_;
+        if (backEdges > opt.acyclicMaxBackEdges) acyclic.resetPi();  // so we can use !acyclic case in visit_nbest
+      }
+      if (backEdges <= opt.acyclicMaxBackEdges) {
+        if (backEdges)
           SDL_INFO(Hypergraph.BestPath.acyclic,
                    "hypergraph was not acyclic - using almost-acyclic best path since there were "
-                       << acyclic.back_edges_ << " <= " << opt.acyclicMaxBackEdges
+                       << backEdges << " <= " << opt.acyclicMaxBackEdges
                        << "(acyclic-max-back-edges) cycle-causing edges");
         else
-          SDL_DEBUG(Hypergraph.BestPath, "hypergraph had no back edges (and " << acyclic.self_loops_
+          SDL_DEBUG(Hypergraph.BestPath, "hypergraph had no back edges (and " << selfLoops
                                                                               << " tail=head self-loops)");
         return true;
       } else {  // reset mu for non-acyclic version
         SDL_INFO(Hypergraph.BestPath.acyclic,
                  "You asked for acyclic best-path, but there were cycles due to "
-                     << acyclic.back_edges_ << " cycle-causing back edges during topological sort. "
-                                               "For greater speed in this case, set acyclic: false or else "
-                                               "(risking 1-best inaccuracy) increase the configured "
-                                               "acyclic-max-back-edges: "
+                     << backEdges << " cycle-causing back edges during topological sort. "
+                                     "For greater speed in this case, set acyclic: false or else "
+                                     "(risking 1-best inaccuracy) increase the configured "
+                                     "acyclic-max-back-edges: "
                      << opt.acyclicMaxBackEdges);
-        acyclic.resetPi();  // so we can use !acyclic case in visit_nbest
         return false;
       }
     }
 
+    /// \return whether any arc has a negative cost (so best-first search can't stop at final)
+    bool anyNegativeCost() const {
+      bool negative = false;
+      ReadEdgeCostMap<Arc> ec;
+      hg.forArcsAllowRepeats([&negative, &ec](Arc* a) {
+        if (get(ec, (ArcHandle)a) < 0) negative = true;
+      });
+      return negative;
+    }
+
+    /**
+       goal-directed best-first (Dijkstra) 1-best for a graph with a start
+       state and no negative-cost arcs: stops as soon as final is popped. the
+       search follows the hg's first-tail out-arcs directly, so there's no
+       tails-up index to build. afterwards mu and pi are exact only for the
+       popped states.
+    */
+    void graphBestFirstToFinal(StateId final) {
+      typedef std::pair<Cost, StateId> Queued;
+      graehl::priority_queue<std::vector<Queued>> queue;
+      StateId const N = hg.sizeForHeads();
+      for (StateId s = 0; s < N; ++s) put(mu, s, path_traits::unreachable());  // in case acyclicBest failed
+      Util::BitSet popped(N);
+      StateId const start = hg.start();
+      ReadEdgeCostMap<Arc> ec;
+      put(mu, start, path_traits::start());
+      queue.push(Queued(path_traits::start(), start));
+      while (!queue.empty()) {
+        Queued const top = queue.top();
+        queue.pop();
+        StateId const tail = top.second;
+        if (!Util::latch(popped, tail)) continue;  // stale (improved since queued)
+        ++stat.n_pop;
+        if (tail == final) {
+          stat.stopped_at_goal = true;
+          break;
+        }
+        for (ArcId i = 0, n = hg.numOutArcs(tail); i < n; ++i) {
+          Arc* a = hg.outArc(tail, i);
+          ++stat.n_relax;
+          StateId const head = a->head_;
+          Cost const cost = top.first + get(ec, (ArcHandle)a);
+          if (cost < get(mu, head)) {
+            put(mu, head, cost);
+            if (pi) put(pi, head, (ArcHandle)a);
+            ++stat.n_update;
+            queue.push(Queued(cost, head));
+          }
+        }
+      }
+      stat.n_unpopped = queue.size();
+    }
+
+    /// best-first search stats (not acyclic, which has no heap) for --metrics-path
+    void recordMetrics() const {
+      SDL_METRIC_ADD(hyp_bestpath_searches, "best-first 1-best searches", 1);
+      SDL_METRIC_ADD(hyp_bestpath_heap_pops, "best-first 1-best heap pops", stat.n_pop);
+      SDL_METRIC_ADD(hyp_bestpath_heap_updates, "best-first 1-best improved states (heap pushes)", stat.n_update);
+      SDL_METRIC_ADD(hyp_bestpath_relaxations, "best-first 1-best arcs relaxed", stat.n_relax);
+      SDL_METRIC_ADD(hyp_bestpath_blocked_rereaches, "best-first 1-best improvements blocked by --rereach",
+                     stat.n_blocked_rereach);
+      SDL_METRIC_ADD(hyp_bestpath_unpopped, "best-first 1-best states left on the heap", stat.n_unpopped);
+      SDL_METRIC_OBSERVE(hyp_bestpath_pops_per_search, "heap pops per best-first 1-best search", stat.n_pop);
+    }
+
     template <class Pmap>
     void logHeadDebug(char const* name, Pmap const& pmap, StateId N, StateId headN) {
       SDL_DEBUG(Hypergraph.BestPath, name << ": " << Util::printPrefix(&pmap[0], N, headN) << " ... (head "
@@ -1195,8 +1280,18 @@ struct BestPath : TransformBase<Transform::Inplace> {
         }
         bool const tryAcyclic
             = canAcyclic && (opt.acyclic || isAcyclic);  // might be acyclic even though not marked as such
-        bool const gotAcyclic = tryAcyclic && (simpleGraph ? acyclicBest<true>() : acyclicBest<false>());
-        if (!gotAcyclic) {
+        // the common case (Viterbi fsm in a MutableHypergraph w/ out-arcs) gets non-virtual kernels
+        MutableHypergraph<Arc> const* const fsm = canAcyclic ? fsmForBest(hg) : 0;
+        bool const gotAcyclic = tryAcyclic && (simpleGraph ? acyclicBest<true>(fsm) : acyclicBest<false>());
+        // (n>1)-best needs exact mu for every state
+        bool const goalDirected = !gotAcyclic && nbest == 1 && opt.goalDirected && !anyNegativeCost();
+        if (goalDirected && simpleGraph && hg.tryForceFirstTailOutArcs()) {
+          if (MutableHypergraph<Arc> const* const outFsm = fsm ? fsm : fsmForBest(hg))
+            FsmBest<Arc>(*outFsm, mu.get(), pi.get()).bestFirstToFinal(final, stat);
+          else
+            graphBestFirstToFinal(final);
+          SDL_DEBUG(Hypergraph.BestPath, stat);
+        } else if (!gotAcyclic) {
           typedef graehl::TailsUpHypergraph<HG> Tails;
           Tails tails(hg, vf, ef);
 
@@ -1205,6 +1300,7 @@ struct BestPath : TransformBase<Transform::Inplace> {
           BestTree b1(tails, mu, pi, ec, parsedOpt);
           b1.init_costs();
           hg.forAxiomIds(b1.axiom_adder());
+          if (goalDirected) b1.stop_at(final);
           b1.finish();
           stat = b1.stat;
           if (stat.n_blocked_rereach || stat.n_converged_inexact) {
@@ -1219,6 +1315,7 @@ struct BestPath : TransformBase<Transform::Inplace> {
           }
           SDL_DEBUG(Hypergraph.BestPath, stat);
         }
+        if (!gotAcyclic) recordMetrics();
 
         Cost bestCost = get(mu, final);
         SDL_DEBUG(Hypergraph.BestPath, "inside[final]=" << bestCost);
@@ -1682,6 +1779,9 @@ struct MaybeBestPathOutOptions : BestPathOutToOptions {
     c("enable-best", &enable)("print best path(s) if enabled; otherwise print hypergraph instead").defaulted();
   }
 
+  /// \return true if output() prints a hypergraph (rather than best path lines)
+  bool printsHypergraph() const { return !enable; }
+
   template <class Arc>
   void output(std::ostream& o, IHypergraph<Arc> const& hg, std::string const& id = "") {
     if (enable)
@@ -1689,9 +1789,9 @@ struct MaybeBestPathOutOptions : BestPathOutToOptions {
     else if (nbestHypergraph) {
       shared_ptr<IHypergraph<Arc>> nbestHg;
       outputForId(hg, id, &nbestHg);
-      o << *nbestHg;
+      HypergraphTextWriter(o).write(*nbestHg);
     } else
-      o << hg;
+      HypergraphTextWriter(o).write(hg);
   }
 };
 
@@ -1799,7 +1899,7 @@ DerivationPtr computeTrivialBestPath(IHypergraph<Arc> const& hg, StateId final,
           // hack for syntax-based labels-on-preterminals - once CM-450 is fixed we can simply favor axiom
           // case
           return Derivation::kAxiom;
-        DerivationPtr r(new Derivation(arc, tails.size()));
+        DerivationPtr r(Derivation::construct(arc, (TailId)tails.size()));
         DerivationChildren& children = r->children;
         for (TailId i = 0, n = tails.size(); i < n; ++i) {
           StateId const src = tails[i];
@@ -1832,7 +1932,7 @@ DerivationPtr computeTrivialGraphBestPathOutArcs(DerivationPtr const& prefix, IH
       Arc* arc = hg.outArc(start, 0);
       if (w) timesBy(arc->weight(), *w);
       TailId const ntails = arc->tails().size();
-      DerivationPtr succ(new Derivation(arc, ntails));
+      DerivationPtr succ(Derivation::construct(arc, ntails));
       DerivationChildren& children = succ->children;
       children[0] = prefix;
       std::fill(children.begin() + 1, children.end(), Derivation::kAxiom);
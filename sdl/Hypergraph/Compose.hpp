@@ -24,6 +24,7 @@
 #include <sdl/Hypergraph/HypergraphCopyBasic.hpp>
 #include <sdl/Hypergraph/HypergraphWriter.hpp>
 #include <sdl/Hypergraph/MutableHypergraph.hpp>
+#include <sdl/Hypergraph/OutArcsMatchIndex.hpp>
 #include <sdl/Hypergraph/Properties.hpp>
 #include <sdl/Hypergraph/SortArcs.hpp>
 #include <sdl/Hypergraph/Transform.hpp>
@@ -31,10 +32,12 @@
 #include <sdl/Hypergraph/WeightsFwdDecls.hpp>
 #include <sdl/Hypergraph/fs/Compose.hpp>
 #include <sdl/Vocabulary/SpecialSymbols.hpp>
+#include <sdl/Util/Arena.hpp>
 #include <sdl/Util/Compare.hpp>
 #include <sdl/Util/Hash.hpp>
 #include <sdl/Util/Input.hpp>
 #include <sdl/Util/IsDebugBuild.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/NonNullPointee.hpp>
 #include <sdl/Util/PrintRange.hpp>
 #include <sdl/Util/ThreadSpecific.hpp>
@@ -46,8 +49,10 @@
 #include <boost/unordered_set.hpp>
 #include <algorithm>
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <map>
+#include <mutex>
 #include <queue>
 #include <queue>
 #include <tuple>
@@ -157,8 +162,11 @@ class RegistryWithIds : public Registry<T> {
 struct EarleyParserOptions {
   bool enablePhiRhoMatch;
   bool sigmaPreventsPhiRhoMatch;
+  /// see fs::FstComposeOptions match-index-min-arcs
+  std::size_t matchIndexMinArcs;
 
-  explicit EarleyParserOptions() : enablePhiRhoMatch(true), sigmaPreventsPhiRhoMatch(false) {}
+  explicit EarleyParserOptions()
+      : enablePhiRhoMatch(true), sigmaPreventsPhiRhoMatch(false), matchIndexMinArcs(64) {}
 };
 
 
@@ -173,7 +181,7 @@ template <class A>
 struct EarleyParser {
   typedef A Arc;
   typedef typename Arc::Weight Weight;
-  struct Item {
+  struct Item : Util::PooledAllocated {
     Item()
         : from(kNoState)
         , to(kNoState)
@@ -266,7 +274,7 @@ struct EarleyParser {
      Groups an item (i.e., CFG rule and dot position) with the
      FST arcs that have matched up to the dot position.
   */
-  struct ItemAndMatchedArcs {
+  struct ItemAndMatchedArcs : Util::PooledAllocated {
     ItemAndMatchedArcs(Item* i, ArcVecPerDotPosPtr s, StateId h, StateIdContainer const& t)
         : item(i), stateIds(s), head(h), tails(t) {
       hashCode = (std::size_t)(item - (Item*)0);
@@ -365,12 +373,14 @@ struct EarleyParser {
 
   EarleyParserOptions options_;
   IVocabularyPtr pVoc_;
+  OutArcsMatchIndex fstMatchIndex_;
 
  public:
   EarleyParser(IHypergraph<A> const& cfg, IHypergraph<A> const& fst, IMutableHypergraph<A>* resultCfg,
                EarleyParserOptions opts = EarleyParserOptions())
       : fst_(fst), cfg_(cfg), result_(resultCfg), cfgPseudoStartArc_((A*)NULL), options_(opts) {
     pVoc_ = fst.getVocabulary();
+    fstMatchIndex_.init(fst, options_.matchIndexMinArcs);
   }
 
   ~EarleyParser() { delete cfgPseudoStartArc_; }
@@ -540,12 +550,17 @@ struct EarleyParser {
       }
     }
 
-    // Search for search label using binary search
+    // Search for search label using the index (high fanout s) or else binary search
     ArcIdRange arcIdsRange = fst_.outArcIds(s);
-    // binary search:
     ArcIdIterator arcEnd = boost::end(arcIdsRange);
-    ArcIdIterator matchingArcIdsIter
-        = boost::lower_bound(arcIdsRange, fakeArcId, CmpInputLabelWithSearchLabel<A>(fst_, s, searchLabel));
+    ArcIdIterator matchingArcIdsIter;
+    OutArcsMatchRange indexed;
+    if (fstMatchIndex_.find(s, searchLabel, indexed)) {
+      matchingArcIdsIter = ArcIdIterator(indexed.begin);
+      arcEnd = ArcIdIterator(indexed.end);
+    } else
+      matchingArcIdsIter
+          = boost::lower_bound(arcIdsRange, fakeArcId, CmpInputLabelWithSearchLabel<A>(fst_, s, searchLabel));
     for (; matchingArcIdsIter != arcEnd; ++matchingArcIdsIter, ++numMatches) {
       Arc* matchingArc = fst_.outArc(s, *matchingArcIdsIter);
       if (fst_.inputLabel(matchingArc->tails_[1]) != searchLabel) {
@@ -728,15 +743,18 @@ struct EarleyParser {
     using namespace Util;
     SDL_TRACE(Hypergraph.Compose, "buildChart");
     init();
+    std::size_t nPops = 0, nChartItems = 0;
     while (!agenda_.empty()) {
       Item* item = agenda_.front();
       agenda_.pop();
+      ++nPops;
       Weight agendaWeight = item->agendaWeight;
       setZero(item->agendaWeight);
       Weight oldChartWeight = item->chartWeight;
       plusBy(agendaWeight, item->chartWeight);
       // Enter into chart, unless already there
       if (isZero(oldChartWeight)) {
+        ++nChartItems;
         const bool isComplete = item->isComplete();
         const bool isFinalReached = isComplete && cfg_.final() == item->arc->head_
                                     && fst_.start() == item->from && fst_.final() == item->to;
@@ -753,6 +771,8 @@ struct EarleyParser {
         addConsequentsToAgenda(item);
       }
     }
+    SDL_METRIC_ADD(hyp_compose_earley_agenda_pops, "Earley compose agenda pops", nPops);
+    SDL_METRIC_ADD(hyp_compose_earley_items, "Earley compose items entered into the chart", nChartItems);
   }
 };
 
@@ -928,6 +948,7 @@ void composeImpl(IHypergraph<A> const& cfg, IHypergraph<A> const& fst, IMutableH
   SDL_DEBUG(Hypergraph.Compose, "Compose: fst = \n" << fst);
 
   EarleyParserOptions earleyOpts;
+  earleyOpts.matchIndexMinArcs = opts.matchIndexMinArcs;
   EarleyParser<A> p(cfg, fst, resultCfg, earleyOpts);
   p.parse();
   SDL_DEBUG(Hypergraph.Compose, "Compose: cfg*fst = \n" << *resultCfg);
@@ -1029,6 +1050,69 @@ struct ComposeTransform : TransformBase<Transform::Inout>, ComposeTransformOptio
 
   FstPtr& pFst() const { return ppFst.get(); }
 
+  typedef fs::CompactMatchFst<FstArc> CompactMatch;
+
+  /**
+     an fst's CompactMatchFst (for denseArcCopy), shared by every thread
+     composing with that fst: built once (std::call_once), then read only.
+  */
+  struct CompactFst {
+    /// the key; held so its address isn't reused while we're in compactFsts
+    FstPtr fst;
+    /// inputs composed with the fst so far (counts up to 2)
+    std::atomic<unsigned> uses;
+    std::once_flag built;
+    shared_ptr<CompactMatch> match;
+    explicit CompactFst(FstPtr const& fst) : fst(fst), uses() {}
+  };
+  typedef shared_ptr<CompactFst> CompactFstPtr;
+
+  mutable std::mutex compactFstsMutex;
+  mutable std::map<FST const*, CompactFstPtr> compactFsts;
+  /// this thread's entry of compactFsts for pFst() (so there's no lock per input)
+  mutable Util::ThreadSpecific<CompactFstPtr> compactFstForThread;
+
+  /// forget this thread's CompactFst of the previous fst, and any CompactFst
+  /// whose fst no thread holds any longer
+  void fstChanged() const {
+    compactFstForThread.get().reset();
+    std::lock_guard<std::mutex> lock(compactFstsMutex);
+    for (auto i = compactFsts.begin(); i != compactFsts.end();)
+      if (i->second->fst.use_count() == 1)
+        i = compactFsts.erase(i);
+      else
+        ++i;
+  }
+
+  /**
+     \return pFst() as a CompactMatchFst, built when the fst is composed with
+     a second input (a copy for just one input costs more than it saves),
+     else null. also null if the fst has annotations to keep.
+  */
+  shared_ptr<CompactMatch> compactFst() const {
+    CompactFstPtr& compact = compactFstForThread.get();
+    if (!compact) {
+      std::lock_guard<std::mutex> lock(compactFstsMutex);
+      CompactFstPtr& shared = compactFsts[pFst().get()];
+      if (!shared) shared = make_shared<CompactFst>(pFst());
+      compact = shared;
+    }
+    if (compact->uses.load(std::memory_order_relaxed) < 2 && ++compact->uses < 2) return shared_ptr<CompactMatch>();
+    CompactFst& c = *compact;
+    fs::FstComposeOptions const& opt = *this;
+    std::call_once(c.built, [&c, &opt]() {
+      if (!fs::fstCompactible(*c.fst, true)) return;
+      shared_ptr<CompactMatch> match = make_shared<CompactMatch>(*c.fst);
+      // everything composeFstsWithEpsilonFilter would compute on the match, so it's only read after
+      if (opt.usingBeam()) {
+        if (opt.beamMatchLevels) match->computeLevels();
+        if (opt.beamHeuristic) match->computeHeuristics();
+      }
+      c.match = match;
+    });
+    return c.match;
+  }
+
   mutable Util::ThreadSpecificBool resourceNeedsCheck_;
 
   template <class ResourceManager>
@@ -1040,6 +1124,7 @@ struct ComposeTransform : TransformBase<Transform::Inout>, ComposeTransformOptio
   void loadResourcesThread(ResourceManager& mgr) const {
     if (!fst.empty()) {
       mgr.getResource(fst, pFst());
+      fstChanged();
       resourceNeedsCheck_.set(true);
     }
   }
@@ -1062,6 +1147,7 @@ struct ComposeTransform : TransformBase<Transform::Inout>, ComposeTransformOptio
     vocab->freeze();
     sortArcs(phg);
     pFst().reset(phg);
+    fstChanged();
     checkFst();
   }
 
@@ -1090,6 +1176,7 @@ struct ComposeTransform : TransformBase<Transform::Inout>, ComposeTransformOptio
 
   void setFst(shared_ptr<FST> const& pFst_) const {
     pFst() = pFst_;
+    fstChanged();
     checkFst();
   }
   void setFst(FST& fst) const { setFst(ptrNoDelete(fst)); }
@@ -1142,7 +1229,13 @@ struct ComposeTransform : TransformBase<Transform::Inout>, ComposeTransformOptio
       else {
         SDL_DEBUG(Hypergraph.Compose, "input is mutable fst - using fst*fst composition");
         SDL_DEBUG(Hypergraph.Compose, hg);
-        fs::compose((IMutableHypergraph<Arc>&)(hg), *fst, pResultHg, (fs::FstComposeOptions const&)*this);
+        fs::FstComposeOptions const& fsOpt = *this;
+        if (denseArcCopy)
+          if (shared_ptr<CompactMatch> compact = compactFst()) {
+            fs::composeWithMatchFst((IMutableHypergraph<Arc>&)(hg), compact, pResultHg, fsOpt);
+            return;
+          }
+        fs::compose((IMutableHypergraph<Arc>&)(hg), *fst, pResultHg, fsOpt);
         return;
       }
     }
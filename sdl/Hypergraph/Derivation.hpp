@@ -38,6 +38,7 @@
 #include <sdl/Hypergraph/Types.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
 #include <sdl/Util/Add.hpp>
+#include <sdl/Util/Arena.hpp>
 #include <sdl/Util/Enum.hpp>
 #include <sdl/Util/PointerWithFlag.hpp>
 #include <sdl/Util/RefCount.hpp>
@@ -93,8 +94,9 @@ inline StateString statesFrom(DerivationYield const& dy) {
 // TODO: exclude axioms from derivation tree? i.e. derivation child i is the ith non-axiom tail in arc()? can
 // make some code (printing, visiting, etc) behave the same for either decision
 
-struct Derivation : graehl::shared_nary_tree<Derivation, Util::RefCount> {
-  typedef graehl::shared_nary_tree<Derivation, Util::RefCount> Tree;
+/// nodes come from the thread's Util::ArenaScope arena, if any
+struct Derivation : graehl::shared_nary_tree<Derivation, Util::RefCount, Util::ArenaUserAllocator> {
+  typedef graehl::shared_nary_tree<Derivation, Util::RefCount, Util::ArenaUserAllocator> Tree;
   typedef ArcBase Arc;
   typedef Tree::child_type child_type;  // intrusive shared pointer to Derivation
   typedef Tree::children_type children_type;  // vector
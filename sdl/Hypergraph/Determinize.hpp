@@ -82,6 +82,7 @@
 #include <sdl/Util/Compare.hpp>
 #include <sdl/Util/DefaultPrintRange.hpp>
 #include <sdl/Util/Latch.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/ShrinkVector.hpp>
 #include <sdl/Util/Sorted.hpp>
 #include <sdl/Util/Unordered.hpp>
@@ -310,6 +311,7 @@ struct DeterminizeFsa {
     Util::add(*s, i.start());
     o->setStart(subsetId(*s));
     finish_agenda();
+    SDL_METRIC_ADD(hyp_determinize_subsets, "subset states created by determinize", explored.size());
     StateId nf = (StateId)qfinals.size();
     if (nf == 0) {
       o->setEmpty();
@@ -91,9 +91,11 @@
 
 #include <sdl/Hypergraph/FeatureWeight.hpp>
 #include <sdl/Hypergraph/Weight.hpp>
+#include <sdl/Hypergraph/WeightUtil.hpp>
 #include <sdl/Util/Constants.hpp>
 #include <sdl/Util/LogHelper.hpp>
 #include <sdl/Util/LogMath.hpp>
+#include <sdl/Util/LogSumExp.hpp>
 #include <boost/static_assert.hpp>
 #include <boost/type_traits/is_same.hpp>
 #include <cassert>
@@ -221,6 +223,49 @@ inline FeatureWeightTpl<FloatT, MapT, Expectation> times(FeatureWeightTpl<FloatT
   return w3;
 }
 
+/**
+   sum of many ExpectationWeight (e.g. all the inarcs of a state): the
+   probabilities and each feature's joint expectation are neglogSum-ed once
+   each, instead of a mapAddNeglogPlus per feature per plusBy.
+*/
+template <class FloatT, class MapT>
+struct BatchPlusBy<FeatureWeightTpl<FloatT, MapT, Expectation>, void> {
+  typedef FeatureWeightTpl<FloatT, MapT, Expectation> W;
+  typedef std::pair<typename MapT::key_type, FloatT> FeatureCost;
+
+  void start(W& sum) {
+    sum_ = &sum;
+    costs_.clear();
+    featureCosts_.clear();
+    add(sum);
+  }
+
+  void add(W const& w) {
+    if (w.isZero()) return;
+    costs_.push_back(w.value_);
+    if (MapT const* map = w.maybeFeatures())
+      for (typename MapT::const_iterator i = map->begin(), e = map->end(); i != e; ++i)
+        featureCosts_.push_back(FeatureCost(i->first, i->second));
+  }
+
+  void finish() {
+    if (costs_.empty()) return;  // sum was and stays zero
+    sum_->value_ = Util::neglogSum(costs_);
+    if (featureCosts_.empty())
+      sum_->removeFeatures();
+    else {
+      shared_ptr<MapT> pMap(sdl::make_shared<MapT>());
+      Util::addNeglogSumsByKey(featureCosts_, *pMap, costs_);
+      sum_->setFeatures(pMap);
+    }
+  }
+
+ private:
+  W* sum_;
+  std::vector<FloatT> costs_;
+  std::vector<FeatureCost> featureCosts_;
+};
+
 
 }}
 
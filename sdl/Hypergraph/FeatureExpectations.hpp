@@ -28,6 +28,7 @@
 #include <sdl/Util/IsDebugBuild.hpp>
 #include <sdl/Util/LogHelper.hpp>
 #include <sdl/Util/LogMath.hpp>
+#include <sdl/Util/LogSumExp.hpp>
 #include <sdl/Util/Map.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <cassert>
@@ -53,21 +54,29 @@ inline void printMapInfo(Map const& map, int n = 10) {
    expected feature values (as neglog numbers) that it finds on
    them. Works correctly for both types of feature arcs (viterbi and
    expectation).
+
+   the (feature, neglog expectation) pairs are collected in *pFeatureCosts and
+   summed per feature all at once by addNeglogSumsByKey (see
+   computeFeatureExpectations).
 */
 template <class FloatT, class MapT>
 struct AccumulateExpectedValuesFct {
 
   typedef LogWeightTpl<FloatT> LogW;
   typedef MapT Map;
+  typedef std::vector<std::pair<typename Map::key_type, FloatT>> FeatureCosts;
 
   HypergraphBase const& hg_;
-  Map* pResultMap_;
-  mutable boost::ptr_vector<LogW> insideWeights_;
-  mutable boost::ptr_vector<LogW> outsideWeights_;
+  FeatureCosts* pFeatureCosts_;
+  boost::ptr_vector<LogW> const& insideWeights_;
+  boost::ptr_vector<LogW> const& outsideWeights_;
 
   AccumulateExpectedValuesFct(HypergraphBase const& hg, boost::ptr_vector<LogW> const& insideWeights,
-                              boost::ptr_vector<LogW> const& outsideWeights, Map* pResultMap)
-      : hg_(hg), insideWeights_(insideWeights), outsideWeights_(outsideWeights), pResultMap_(pResultMap) {}
+                              boost::ptr_vector<LogW> const& outsideWeights, FeatureCosts* pFeatureCosts)
+      : hg_(hg)
+      , pFeatureCosts_(pFeatureCosts)
+      , insideWeights_(insideWeights)
+      , outsideWeights_(outsideWeights) {}
 
   /**
      Accumulates feature expectations found on a feature
@@ -76,9 +85,8 @@ struct AccumulateExpectedValuesFct {
   void operator()(ArcTpl<FeatureWeightTpl<FloatT, Map, Expectation>> const* arc) const {
     FloatT posteriorArcWeight = computeInsideTimesOutside(arc).value_;
     typedef typename Map::value_type MapValueType;
-    Util::NeglogPlusFct<FloatT> logPlusBy;
     for (MapValueType const& idValue : arc->weight_)
-      updateBy(logPlusBy, *pResultMap_, idValue.first, posteriorArcWeight + idValue.second);  // times prob
+      pFeatureCosts_->emplace_back(idValue.first, posteriorArcWeight + idValue.second);  // times prob
   }
 
   /**
@@ -91,11 +99,9 @@ struct AccumulateExpectedValuesFct {
     SDL_DEBUG(Hypergraph.FeatureExpectations, "Accumulate feature expectations for "
                                                   << *arc << " with posterior weight " << posteriorArcWeight);
     typedef typename Map::value_type MapValueType;
-    Util::NeglogPlusFct<FloatT> logPlusBy;
     for (MapValueType const& idValue : arc->weight_)
-      updateBy(logPlusBy, *pResultMap_, idValue.first, posteriorArcWeight - log(idValue.second));
+      pFeatureCosts_->emplace_back(idValue.first, posteriorArcWeight - log(idValue.second));
     // times prob (which was in linear space, not -log,  because of TakeMin aka FeatureWeight)
-    if (Util::isDebugBuild()) printMapInfo(*pResultMap_);
   }
 
  private:
@@ -140,7 +146,11 @@ typename Arc::Weight::FloatT computeFeatureExpectations(IHypergraph<Arc> const&
   insideAlgorithm(logWeightHg, &insideWeights, false);
   outsideAlgorithm(logWeightHg, insideWeights, &outsideWeights, false);
 
-  hg.forArcs(AccumulateExpectedValuesFct<FloatT, Map>(hg, insideWeights, outsideWeights, pResultMap));
+  typedef AccumulateExpectedValuesFct<FloatT, Map> Accumulate;
+  typename Accumulate::FeatureCosts featureCosts;
+  hg.forArcs(Accumulate(hg, insideWeights, outsideWeights, &featureCosts));
+  std::vector<FloatT> costs;
+  Util::addNeglogSumsByKey(featureCosts, *pResultMap, costs);
 
   // Negative log of sum over all paths (used for global
   // normalization):
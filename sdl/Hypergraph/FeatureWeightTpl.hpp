@@ -33,6 +33,7 @@
 #include <sdl/Hypergraph/Types.hpp>
 #include <sdl/Hypergraph/Weight.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
+#include <sdl/Util/Arena.hpp>
 #include <sdl/Util/Constants.hpp>
 #include <sdl/Util/DefaultPrintRange.hpp>
 #include <sdl/Util/LogHelper.hpp>
@@ -40,6 +41,7 @@
 #include <sdl/Util/Math.hpp>
 #include <sdl/Exception.hpp>
 #include <functional>
+#include <memory>
 #include <type_traits>
 
 namespace sdl {
@@ -133,7 +135,7 @@ class FeatureWeightTpl : public FloatWeightTpl<T> {
 
   /** copy ctor that immediately makes a unique writable pointer */
   FeatureWeightTpl(FeatureWeightTpl const& cpfrom, bool)
-      : Base(cpfrom), pMap_(sdl::make_shared<Map>(cpfrom.features())) {}
+      : Base(cpfrom), pMap_(newMap(cpfrom.features())) {}
 
   FeatureWeightTpl(FloatT weight, shared_ptr<Map> const& pMap) : Base(weight), pMap_(pMap) {}
 
@@ -383,9 +385,15 @@ class FeatureWeightTpl : public FloatWeightTpl<T> {
   */
   void ownMap() {
     if (!pMap_)
-      pMap_ = sdl::make_shared<Map>();
+      pMap_ = newMap();
     else if (!pMap_.unique())
-      pMap_ = sdl::make_shared<Map>(*pMap_);
+      pMap_ = newMap(*pMap_);
+  }
+
+  /// from the thread's Util::ArenaScope arena, if any (the map's nodes still use std::allocator)
+  template <class... Args>
+  static shared_ptr<Map> newMap(Args&&... args) {
+    return std::allocate_shared<Map>(Util::ArenaAllocator<Map>(), std::forward<Args>(args)...);
   }
 
   /**
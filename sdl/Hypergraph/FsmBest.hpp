@@ -0,0 +1,151 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    1-best kernels for the common BestPath (and so PruneToBest) input: a
+    MutableHypergraph graph with a start state, out-arcs stored, and
+    ViterbiWeight. BestPath::Compute picks these once (see fsmForBest) instead
+    of AcyclicBest / graphBestFirstToFinal, which reach each state's arcs
+    through virtual IHypergraph calls.
+
+    MutableHypergraph is final, so its maybeOutArcs is an inline vector
+    lookup here; mu and pi are the plain arrays behind BestPath's property
+    maps. results (mu, pi, back edge and self-loop counts) are the same as the
+    generic versions'.
+*/
+
+#ifndef HYP__HYPERGRAPH_FSMBEST_HPP
+#define HYP__HYPERGRAPH_FSMBEST_HPP
+#pragma once
+
+#include <sdl/Hypergraph/HypergraphTraits.hpp>
+#include <sdl/Hypergraph/InArcs.hpp>
+#include <sdl/Hypergraph/MutableHypergraph.hpp>
+#include <sdl/Hypergraph/WeightsFwdDecls.hpp>
+#include <graehl/shared/tails_up_hypergraph.hpp>
+#include <graehl/shared/priority_queue.hpp>
+#include <sdl/Util/BitSet.hpp>
+#include <sdl/Util/Latch.hpp>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+
+/**
+   \return hg as a MutableHypergraph if the FsmBest kernels apply: Viterbi
+   weights (checked at compile time), a graph with a start state, storing
+   out-arcs. else NULL
+*/
+template <class Arc>
+MutableHypergraph<Arc> const* fsmForBest(IHypergraph<Arc> const& hg) {
+  if (!IsViterbiWeight<typename Arc::Weight>::value || !hg.isMutable() || hg.start() == kNoState
+      || !hg.storesOutArcs() || !hg.isGraph())
+    return 0;
+  return dynamic_cast<MutableHypergraph<Arc> const*>(&hg);
+}
+
+template <class Arc>
+struct FsmBest {
+  typedef MutableHypergraph<Arc> Hg;
+  typedef typename Arc::Weight::FloatT Cost;
+
+  static Cost unreachable() { return std::numeric_limits<Cost>::infinity(); }
+
+  Hg const& hg;
+  /// mu[s] = best cost from start to s (for s < hg.size())
+  Cost* mu;
+  /// pi[s] = last arc of a best path to s, unless NULL
+  ArcHandle* pi;
+  ReadEdgeCostMap<Arc> ec;
+
+  FsmBest(Hg const& hg, Cost* mu, ArcHandle* pi) : hg(hg), mu(mu), pi(pi) {}
+
+  /**
+     as AcyclicBest<Arc, Mu, Pi, true>: relax out-arcs in topological order
+     from start. \return # of back edges; if > maxBackEdges, mu and pi are
+     untouched.
+  */
+  std::size_t acyclic(std::size_t maxBackEdges, std::size_t& selfLoops) {
+    selfLoops = 0;
+    StateOrder orderReverse;
+    orderReverse.reserve(hg.sizeForHeads());
+    std::size_t const backEdges = orderTailsLast(hg, orderReverse, maxBackEdges, true);
+    if (backEdges > maxBackEdges || orderReverse.empty()) return backEdges;
+    StateId const start = hg.start();
+    for (StateId s = 0, N = hg.size(); s < N; ++s)  // (isAxiom)
+      mu[s] = s == start || hg.hasTerminalLabel(s) ? Cost() : unreachable();
+    for (StateOrder::const_reverse_iterator i = orderReverse.rbegin(), e = orderReverse.rend(); i != e; ++i) {
+      StateId const tail = *i;
+      ArcsContainer const* arcs = hg.maybeOutArcs(tail);
+      for (ArcsContainer::const_iterator a = arcs->begin(), ae = arcs->end(); a != ae; ++a) {
+        Arc const* arc = (Arc const*)*a;
+        StateId const head = arc->head_;
+        StateId const first = arc->tails_[0];
+        if (first == head) ++selfLoops;
+        Cost const cost = ec[(ArcHandle)arc] + mu[first];
+        if (cost < mu[head]) {
+          mu[head] = cost;
+          if (pi) pi[head] = (ArcHandle)arc;
+        }
+      }
+    }
+    if (!backEdges && !selfLoops) const_cast<Hg&>(hg).addProperties(kAcyclic);
+    return backEdges;
+  }
+
+  /**
+     as BestPath::Compute::graphBestFirstToFinal (no negative costs): mu and
+     pi are exact only for popped states.
+  */
+  void bestFirstToFinal(StateId final, graehl::BestTreeStats& stat) {
+    typedef std::pair<Cost, StateId> Queued;
+    graehl::priority_queue<std::vector<Queued>> queue;
+    StateId const N = hg.sizeForHeads();
+    std::fill(mu, mu + N, unreachable());
+    Util::BitSet popped(N);
+    StateId const start = hg.start();
+    mu[start] = Cost();
+    queue.push(Queued(Cost(), start));
+    while (!queue.empty()) {
+      Queued const top = queue.top();
+      queue.pop();
+      StateId const tail = top.second;
+      if (!Util::latch(popped, tail)) continue;
+      ++stat.n_pop;
+      if (tail == final) {
+        stat.stopped_at_goal = true;
+        break;
+      }
+      ArcsContainer const* arcs = hg.maybeOutArcs(tail);
+      for (ArcsContainer::const_iterator a = arcs->begin(), ae = arcs->end(); a != ae; ++a) {
+        Arc const* arc = (Arc const*)*a;
+        ++stat.n_relax;
+        StateId const head = arc->head_;
+        Cost const cost = top.first + ec[(ArcHandle)arc];
+        if (cost < mu[head]) {
+          mu[head] = cost;
+          if (pi) pi[head] = (ArcHandle)arc;
+          ++stat.n_update;
+          queue.push(Queued(cost, head));
+        }
+      }
+    }
+    stat.n_unpopped = queue.size();
+  }
+};
+
+
+}}
+
+#endif
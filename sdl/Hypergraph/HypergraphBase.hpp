@@ -36,6 +36,8 @@ namespace Hypergraph {
 
 using Vocabulary::WhichFstComposeSpecials;
 
+struct StructureCache;
+
 /**
    Parts of IHypergraph that relate to states and don't care about arc type.
 */
@@ -109,6 +111,10 @@ struct HypergraphBase : Resource {
   /** fast estimate for reserving storage for # of edges (getNumEdges may be linear time in #states) */
   virtual std::size_t estimatedNumEdges() const { return size(); }
 
+  /// \return NULL unless the hg maintains a StructureCache (see
+  /// StructureCache.hpp, MutableHypergraph::enableStructureCache)
+  virtual StructureCache* structureCache() const { return 0; }
+
   bool tryForceFirstTailOutArcs() const {
     if (storesFirstTailOutArcs()) return true;
     if (isMutable()) {
@@ -80,6 +80,7 @@ void copySubset(StateIdTranslation& stateRemap, IHypergraph<A> const& i, IMutabl
                 CopyArcs arcs = kArcs, CopyStartFinal startFinal = kStartFinal,
                 ClearAndSameProperties clearAndSameProperties = kClearAndSameProperties) {
   stateRemap.freeze();
+  stateRemap.denseForSourceStates(i.size());
   if (startFinal == kStartFinal) copyStartFinalSubset(stateRemap, i, o, clearAndSameProperties);
   if (arcs == kArcs) copyArcs(stateRemap, i, o);
   stateRemap.transferLabels(i, *o);
@@ -90,6 +91,7 @@ void copyFilter(StateIdTranslation& stateRemap, IHypergraph<A> const& i, IMutabl
                 typename A::ArcFilter const& keep = 0, CopyArcs arcs = kArcs,
                 CopyStartFinal startFinal = kStartFinal,
                 ClearAndSameProperties clearAndSameProperties = kClearAndSameProperties) {
+  stateRemap.denseForSourceStates(i.size());
   if (startFinal == kStartFinal) copyStartFinal(stateRemap, i, o, clearAndSameProperties);
   if (arcs == kArcs) copyArcs(stateRemap, i, o, keep);
   stateRemap.transferLabels(i, *o);
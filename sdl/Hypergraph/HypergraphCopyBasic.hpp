@@ -193,6 +193,11 @@ enum OnMissingProperties {
    see OnMissingProperties for alternatives to copying the input hg if
    properties aren't satisfied (e.g. kModifyOrThrowUnlessProperties)
 
+   a mutable hg with a structureCache() (see StructureCache.hpp) that lacks
+   only arc adjacencies (in-arcs, out-arcs) gets them added in place instead
+   of being copied; they're then kept up to date as arcs are added, so
+   repeated passes needing them don't each copy the hg.
+
    (e.g. if you want, for a graph/fsm, kStoreFirstTailOutArcs or kStoreOutArcs,
    call with forceOn = kStoreFirstTailOutArcs and orForceOn = kStoreOutArcs)
 */
@@ -211,6 +216,11 @@ IHypergraph<A> const& ensureProperties(IHypergraph<A> const& i, shared_ptr<IHype
   Properties switchOff = forceOff & ip;
   bool orSwitchOn = orForceOn & ~ip;
   if ((switchOn && orSwitchOn) || switchOff) {
+    if (!switchOff && !(switchOn & ~kStoreAnyArcs) && i.structureCache() && i.isMutable()) {
+      const_cast<IMutableHypergraph<A>&>(static_cast<IMutableHypergraph<A> const&>(i))
+          .forcePropertiesOnOff(switchOn, 0);
+      return i;
+    }
     if (onMissing & kMissingThrowMask)
       SDL_THROW_LOG(Hypergraph.HypergraphCopyBasic, HypergraphPropertiesException,
                     "copy not requested for input with properties" << PrintProperties(switchOn)
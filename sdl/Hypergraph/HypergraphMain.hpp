@@ -30,10 +30,12 @@
 #define GRAEHL_CMDLINE_MAIN_USE_CONFIGURE HG_MAIN_USE_CONFIGURE
 
 #include <sdl/Vocabulary/HelperFunctions.hpp>
+#include <sdl/Util/BlockStreambuf.hpp>
 #include <sdl/Util/FindFile.hpp>
 #include <sdl/Util/InitLogger.hpp>
 #include <sdl/Util/Input.hpp>
 #include <sdl/Util/Locale.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/ProgramOptions.hpp>
 #include <sdl/IVocabulary.hpp>
 #include <sdl/LexicalCast.hpp>
@@ -79,6 +81,7 @@ struct HypergraphMainOpt {
 struct HypergraphMainBase : graehl::main, HypergraphMainOpt, Util::Inputs {
   NO_INIT_OR_ASSIGN_MEMBER(HypergraphMainBase)
   Util::SearchDirs searchDirs;
+  Util::MetricsOptions metricsOpt;
   bool initlogger;
   IVocabularyPtr const& vocab() const {
     if (!pVoc) pVoc = Vocabulary::createDefaultVocab();
@@ -99,6 +102,16 @@ struct HypergraphMainBase : graehl::main, HypergraphMainOpt, Util::Inputs {
     this->opt.add_log_file = false;  // using log4cxx instead
     this->opt.add_quiet = false;
   }
+
+  /// writes --metrics-path (the main object lives for the whole run)
+  ~HypergraphMainBase() {
+    if (!Util::metricsEnabled()) return;
+    try {
+      metricsOpt.finish();
+    } catch (std::exception& e) {
+      std::cerr << "\nERROR: writing --metrics-path: " << e.what() << "\n";
+    }
+  }
   void multipleInputs(int maxin = 0) {
     assert(!configured);
     max_inputs = maxin;
@@ -119,9 +132,13 @@ struct HypergraphMainBase : graehl::main, HypergraphMainOpt, Util::Inputs {
   virtual void finish_configure_more() {}
 
   virtual void finish_configure_extra() {
-    if (inputEnabled) this->configurable((Util::Inputs*)this);
+    if (inputEnabled) {
+      this->configurable((Util::Inputs*)this);
+      this->configurable(&Util::inputBackend);
+    }
     if (initlogger) this->configurable(&logOpt);
     if (searchDirsOpt) this->configurable(&searchDirs);
+    this->configurable(&metricsOpt);
     finish_configure_more();
     configured = true;
   }
@@ -137,6 +154,7 @@ struct HypergraphMainBase : graehl::main, HypergraphMainOpt, Util::Inputs {
 
   virtual void validate_parameters_extra() {
     initlog();
+    metricsOpt.start();
     Util::Inputs::validate();
     validate_parameters_more();
   }
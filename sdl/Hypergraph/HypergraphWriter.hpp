@@ -11,6 +11,11 @@
 /** \file
 
     print a hypergraph.
+
+    HypergraphTextWriter produces the same text as out << hg, but formats into
+    a reusable buffer that's written to the ostream in large blocks, with
+    itoa state ids, printf (not ostream) float weights, and the quoted+escaped
+    form of each label computed once per symbol rather than once per use.
 */
 
 #ifndef HYP__HYPERGRAPH_HYPERGRAPHWRITER_HPP
@@ -20,17 +25,259 @@
 #include <sdl/Hypergraph/Empty.hpp>
 #include <sdl/Hypergraph/FeatureWeight.hpp>
 #include <sdl/Hypergraph/HypergraphBase.hpp>
+#include <sdl/Hypergraph/SymbolPrint.hpp>
 #include <sdl/Hypergraph/Weight.hpp>
+#include <sdl/Util/StringBuilder.hpp>
 #include <sdl/IVocabulary.hpp>
 #include <sdl/Printer.hpp>
+#include <cstdlib>
+#include <cstddef>
+#include <locale>
+#include <sstream>
+#include <vector>
 
 namespace sdl {
 namespace Hypergraph {
 
+/// the float value of weights printed as out << value (exact types only: e.g. FeatureWeightTpl prints more)
+template <class T>
+T const* floatWeightValue(ViterbiWeightTpl<T> const& w) {
+  return &w.value_;
+}
+template <class T>
+T const* floatWeightValue(LogWeightTpl<T> const& w) {
+  return &w.value_;
+}
+template <class T>
+T const* floatWeightValue(FloatWeightTpl<T> const& w) {
+  return &w.value_;
+}
+template <class Weight>
+void const* floatWeightValue(Weight const&) {
+  return 0;
+}
+
+/**
+   usage: HypergraphTextWriter writer(out); writer.write(hg1); writer.write(hg2);
+
+   output is flushed to out whenever more than flushBytes are buffered, and
+   finally by flush() or the destructor.
+
+   float weights are printed as out << value would be (default float format
+   with out.precision()) unless roundtripWeights, in which case we print the
+   shortest decimal that reads back as the same float. out's other float
+   flags or a non-classic locale are respected by formatting weights through
+   a stringstream copy of out's format instead.
+*/
+class HypergraphTextWriter {
+ public:
+  enum { kDefaultFlushBytes = 1 << 20 };
+
+  /// labels with (index within type) beyond this aren't cached
+  enum { kMaxCachedLabelIndex = 1 << 24 };
+
+  explicit HypergraphTextWriter(std::ostream& out, std::size_t flushBytes = kDefaultFlushBytes,
+                                bool roundtripWeights = false)
+      : roundtripWeights(roundtripWeights)
+      , out_(out)
+      , flushBytes_(flushBytes)
+      , precision_((int)out.precision())
+      , streamFloats_((out.flags() & (std::ios_base::floatfield | std::ios_base::showpoint
+                                      | std::ios_base::showpos | std::ios_base::uppercase))
+                      || out.getloc() != std::locale::classic())
+      , labelsVocab_() {
+    buf_.reserve(flushBytes + 4096);
+    weightText_.copyfmt(out);
+  }
+
+  ~HypergraphTextWriter() { flush(); }
+
+  bool roundtripWeights;
+
+  /// same text as out << hg
+  template <class Arc>
+  void write(IHypergraph<Arc> const& hg) {
+    resetLabels(hg.vocab());
+    StateId const nStates = hg.size();
+    writeStartOrFinal("START <- ", hg, hg.start(), nStates);
+    bool const inlineLabels = hg.hasGraphInlineLabels();
+    hg.forArcs([&](Arc const* arc) {
+      writeState(hg, arc->head_, nStates, false);
+      buf_(" <- ", 4);
+      bool again = false;
+      for (StateId tail : arc->tails_) {
+        if (again) buf_(' ');
+        writeState(hg, tail, nStates, inlineLabels && again);
+        again = true;
+      }
+      buf_(" / ", 3);
+      writeWeight(arc->weight_);
+      buf_('\n');
+      maybeFlush();
+    });
+    writeStartOrFinal("FINAL <- ", hg, hg.final(), nStates);
+    maybeFlush();
+  }
+
+  void flush() {
+    if (!buf_.empty()) {
+      out_.write(buf_.begin(), buf_.size());
+      buf_.clear();
+    }
+  }
+
+ private:
+  void maybeFlush() {
+    if (buf_.size() >= flushBytes_) flush();
+  }
+
+  void writeStartOrFinal(char const* prefix, HypergraphBase const& hg, StateId s, StateId nStates) {
+    if (s != kNoState) {
+      buf_(prefix);
+      writeState(hg, s, nStates, false);
+      buf_('\n');
+    }
+  }
+
+  /// as Hypergraph::printState
+  void writeState(HypergraphBase const& hg, StateId s, StateId nStates, bool inlineLabel) {
+    buf_(s);
+    if (inlineLabel || s > nStates) {
+      Sym sym;
+      sym.id_ = s;
+      buf_('(');
+      writeLabel(sym);
+      buf_(')');
+    } else {
+      LabelPair const io(hg.labelPair(s));
+      if (io.first || io.second) {
+        buf_('(');
+        if (io.first) {
+          writeLabel(io.first);
+          if (io.second && io.second != io.first) {
+            buf_(' ');
+            writeLabel(io.second);
+          }
+        } else {
+          buf_(' ');
+          writeLabel(io.second);
+        }
+        buf_(')');
+      }
+    }
+  }
+
+  template <class Weight>
+  void writeWeight(Weight const& w) {
+    if (streamFloats_)
+      writeStreamWeight(w);
+    else
+      writeFloat(floatWeightValue(w), w);
+  }
+
+  template <class Weight>
+  void writeStreamWeight(Weight const& w) {
+    weightText_.str(std::string());
+    weightText_ << w;
+    buf_(weightText_.str());
+  }
+
+  template <class Weight>
+  void writeFloat(void const*, Weight const& w) {
+    writeStreamWeight(w);
+  }
+
+  template <class Weight>
+  void writeFloat(float const* x, Weight const&) {
+    if (roundtripWeights)
+      writeRoundtrip((double)*x, 9, true);
+    else
+      buf_.nprintf(floatTextBytes(precision_), "%.*g", precision_, (double)*x);
+  }
+
+  template <class Weight>
+  void writeFloat(double const* x, Weight const&) {
+    if (roundtripWeights)
+      writeRoundtrip(*x, 17, false);
+    else
+      buf_.nprintf(floatTextBytes(precision_), "%.*g", precision_, *x);
+  }
+
+  /// room for %.*g of any double at precision (sign, digits, point, exponent, NUL); nprintf appends
+  /// nothing if the text doesn't fit
+  static unsigned floatTextBytes(int precision) { return (unsigned)(precision > 0 ? precision : 0) + 32; }
+
+  /// shortest %.*g (trying precision 6 first, which is already the shortest if
+  /// any <= 6 digit decimal reads back exactly) that reads back as x
+  void writeRoundtrip(double x, int maxPrecision, bool isFloat) {
+    std::size_t const sz = buf_.size();
+    for (int precision = 6;; ++precision) {
+      buf_.nprintf(floatTextBytes(precision), "%.*g", precision, x);
+      if (precision == maxPrecision) return;
+      buf_.push_back(0);
+      char const* text = buf_.begin() + sz;
+      double const back = std::strtod(text, 0);
+      buf_.pop_back();
+      if (isFloat ? (float)back == (float)x : back == x) return;
+      buf_.resize(sz);
+    }
+  }
+
+  /// as Hypergraph::writeLabel(out, sym, vocab) - but remembered per sym (for the rest of this write())
+  void writeLabel(Sym sym) {
+    SymInt const index = sym.id_ & kLabelIndexMask;
+    if (index >= kMaxCachedLabelIndex) {
+      Hypergraph::writeLabel(buf_, sym, labelsVocab_);
+      return;
+    }
+    std::vector<LabelText>& labels = labels_[sym.id_ >> kLabelTypeShift];
+    if (index >= labels.size()) labels.resize(index + 1);
+    LabelText& text = labels[index];
+    if (!text.len) {
+      std::size_t const begin = buf_.size();
+      Hypergraph::writeLabel(buf_, sym, labelsVocab_);
+      text.begin = labelChars_.size();
+      text.len = buf_.size() - begin;
+      labelChars_.append(buf_.begin() + begin, text.len);
+      if (text.len) labelsUsed_.push_back(sym);
+      return;
+    }
+    buf_(labelChars_.data() + text.begin, (unsigned)text.len);
+  }
+
+  /// non-persistent symbols may be reused for other strings between hgs
+  void resetLabels(IVocabulary const* vocab) {
+    for (Sym sym : labelsUsed_) labels_[sym.id_ >> kLabelTypeShift][sym.id_ & kLabelIndexMask].len = 0;
+    labelsUsed_.clear();
+    labelChars_.clear();
+    labelsVocab_ = vocab;
+  }
+
+  enum { kLabelTypeShift = 29, kLabelIndexMask = (1u << kLabelTypeShift) - 1 };
+
+  struct LabelText {
+    LabelText() : begin(), len() {}
+    std::size_t begin, len;
+  };
+
+  std::ostream& out_;
+  std::size_t flushBytes_;
+  int precision_;
+  bool streamFloats_;
+  Util::StringBuilder buf_;
+  std::ostringstream weightText_;
+
+  IVocabulary const* labelsVocab_;
+  /// indexed by sym type (high bits), then index within type
+  std::vector<LabelText> labels_[1u << (32 - kLabelTypeShift)];
+  std::vector<Sym> labelsUsed_;
+  std::string labelChars_;
+};
+
 template <class Arc>
 std::ostream& writeHypergraph(std::ostream& out, IHypergraph<Arc> const& hg, bool fullEmptyCheck = false) {
   if (fullEmptyCheck ? empty(hg) : hg.prunedEmpty()) return out;
-  out << hg;
+  HypergraphTextWriter(out).write(hg);
   return out;
 }
 
@@ -33,7 +33,11 @@ namespace Hypergraph {
 
 SDL_ENUM(InputHgType, 2, (FlatStringsHg, DashesSeparatedHg));
 
-/// pass arcs to #include <sdl/Hypergraph/ArcParserFct.hpp> parseText
+/// separates consecutive text-format hypergraphs in a single stream (kDashesSeparatedHg, InputHypergraphs streamHgs)
+char const* const kHypergraphSeparatorLine = "-----";
+
+/// read arcs (one per line) until a kHypergraphSeparatorLine line or end of
+/// input. pass arcs to #include <sdl/Hypergraph/ArcParserFct.hpp> parseText
 void readArcsUntil(std::istream& in, ParsedArcs& arcs, bool requireNfc = true);
 
 // fwd decls
@@ -56,15 +60,23 @@ struct IHypergraphsIteratorTpl {
   virtual ~IHypergraphsIteratorTpl() {}
 
   /**
-     Prepares the next hypergraph.
+     Prepares the next hypergraph, freeing the current one.
   */
   virtual void next() = 0;
 
   /**
-     Returns the current hypergraph.
+     Returns the current hypergraph. it's owned by the iterator and valid
+     only until the next call to next() (or the iterator's destruction).
   */
   virtual IHypergraph<Arc>* value() = 0;
 
+  /**
+     Returns the current hypergraph (as value()) and gives up ownership of
+     it: the caller deletes it. The following value() or release() reads the
+     next hypergraph (don't call next() in between, which would skip one).
+  */
+  virtual IHypergraph<Arc>* release() = 0;
+
   /**
      Returns true if no further hypergraph found in the stream.
   */
@@ -493,6 +493,10 @@ struct IMutableHypergraph : IHypergraph<A> {
   /// should call this so kGraph and kFsm will be recomputed properly
   virtual void notifyArcsModified() = 0;
 
+  /// keep (or stop keeping and free) a StructureCache so repeated passes
+  /// reuse topological orders and acyclicity. no-op unless implemented
+  virtual void enableStructureCache(bool enable = true) {}
+
   /// if arcs were modified in a way that disrespects invariants, we can rebuild
   /// the adjacencies after (similar to AddArcsLater, releaseArcs, but perhaps
   /// more efficient
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <sdl/Hypergraph/IMutableHypergraph.hpp>
+#include <sdl/Hypergraph/StructureCache.hpp>
 #include <sdl/Hypergraph/Types.hpp>
 #include <sdl/Util/DfsColor.hpp>
 #include <sdl/Util/SmallVector.hpp>
@@ -505,19 +506,47 @@ struct FirstTailOutArcs : AdjacentArcsBase<kMustStoreNatively> {
   ArcsContainer tmpOutArcs, emptyOutArcs;
 };
 
-/// reverse topological order on tail->head. \return #back edges
+/// reverse topological order on tail->head. \return #back edges. uses (and
+/// fills) the hg's structureCache() if any, so no adjacency need be built
 template <class Arc>
 std::size_t orderTailsLast(IHypergraph<Arc> const& hg, StateOrder& order, std::size_t maxBackEdges = 0,
                            bool isGraph = true) {
+  StructureCache* cache = order.empty() ? hg.structureCache() : 0;
+  StateId const start = hg.start();
+  if (!cache || start == kNoState) {
+    FirstTailOutArcs<Arc> adj(hg);
+    return adj.orderTailsLast(order, maxBackEdges, isGraph);
+  }
+  StateId const nStates = hg.sizeForHeads();
+  std::size_t nBackEdges;
+  if (cache->appendOrder(StructureCache::kTailsLastFromStart, start, nStates, order, &nBackEdges, maxBackEdges))
+    return nBackEdges;
   FirstTailOutArcs<Arc> adj(hg);
-  return adj.orderTailsLast(order, maxBackEdges, isGraph);
+  nBackEdges = adj.orderTailsLast(order, maxBackEdges, isGraph);
+  if (nBackEdges <= maxBackEdges)
+    cache->setOrder(StructureCache::kTailsLastFromStart, start, nStates, order, nBackEdges);
+  return nBackEdges;
 }
 
-template <class Arc, class StateOrder>
+/// as orderTailsLast but on head->tail (in-arcs)
+template <class Arc>
 std::size_t orderHeadsLast(IHypergraph<Arc> const& hg, StateOrder& order, std::size_t maxBackEdges = 0,
                            bool isGraph = true) {
+  StructureCache* cache = order.empty() ? hg.structureCache() : 0;
+  StateId const final = hg.final();
+  if (!cache || final == kNoState) {
+    InArcs<Arc> adj(hg);
+    return adj.orderHeadsLast(order, maxBackEdges, isGraph);
+  }
+  StateId const nStates = hg.sizeForHeads();
+  std::size_t nBackEdges;
+  if (cache->appendOrder(StructureCache::kHeadsLastFromFinal, final, nStates, order, &nBackEdges, maxBackEdges))
+    return nBackEdges;
   InArcs<Arc> adj(hg);
-  return adj.orderHeadsLast(order, maxBackEdges, isGraph);
+  nBackEdges = adj.orderHeadsLast(order, maxBackEdges, isGraph);
+  if (nBackEdges <= maxBackEdges)
+    cache->setOrder(StructureCache::kHeadsLastFromFinal, final, nStates, order, nBackEdges);
+  return nBackEdges;
 }
 
 
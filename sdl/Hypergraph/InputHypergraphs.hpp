@@ -19,6 +19,7 @@
 
 #include <sdl/Config/Init.hpp>
 #include <sdl/Hypergraph/ArcParserFct.hpp>
+#include <sdl/Hypergraph/IHypergraphsIteratorTpl.hpp>
 #include <sdl/Hypergraph/LineToHypergraph.hpp>
 #include <sdl/Util/Input.hpp>
 #include <sdl/Util/LineOptions.hpp>
@@ -39,6 +40,8 @@ namespace Hypergraph {
 struct InputHypergraphs : LineToHypergraph {
   bool multiple;
   bool lines;
+  /// input is a sequence of text-format hgs separated by kHypergraphSeparatorLine
+  bool streamHgs;
   void setLine() { lines = true; }
   void setLines() {
     multiple = true;
@@ -73,6 +76,16 @@ struct InputHypergraphs : LineToHypergraph {
     c("multiple-input-hgs", &multiple).init(true)("allow multiple consecutive inputs");
     c("lines", &lines)
         .defaulted()("plain text input lines converted to hg (instead of a single hypergraph file)");
+    c("stream-hgs", &streamHgs)
+        .init(false)("input is a sequence of text-format hypergraphs separated by '-----' lines. each is "
+                     "parsed, processed, and output (flushed) before the next is read, so memory is bounded by "
+                     "the largest single hypergraph. output hypergraphs are separated the same way");
+  }
+  void validate() {
+    if (lines && streamHgs)
+      SDL_THROW_LOG(Hypergraph.InputHypergraphs, ConfigException,
+                    "--stream-hgs reads '-----'-separated hypergraphs; it can't be combined with --lines "
+                    "(plain text input)");
   }
   void setIn(Util::InputStream const& newIn) {
     in.init(newIn);
@@ -81,8 +94,8 @@ struct InputHypergraphs : LineToHypergraph {
   /**
       parse the next input into hg. if lines, the input is a sequence of
       tokens (otherwise it's a text-format HG); if multiple-input-hgs, then the
-      entire in stream is consumed line by line (TODO: support some convention
-      for parsing a sequence of text-format HGs-none exists yet).
+      entire in stream is consumed line by line. if streamHgs, the next
+      text-format HG up to the next kHypergraphSeparatorLine is parsed.
      *
 
       \return true if there was another hg, false if there are no more
@@ -98,6 +111,13 @@ struct InputHypergraphs : LineToHypergraph {
       if (!getlineNormalized(*in, line)) return false;
       LineToHypergraph::toHypergraph(line, phg, lineno);
       return true;
+    } else if (streamHgs) {
+      hg.clear();
+      ParsedArcs arcs;
+      readArcsUntil(*in, arcs, nfc);
+      if (arcs.empty() && !*in) return false;
+      parsedArcsToHg(arcs, phg, in.name);
+      return true;
     } else {
       if (lineno > 1) return false;
       hg.clear();
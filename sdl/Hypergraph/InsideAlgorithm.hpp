@@ -84,6 +84,7 @@ struct ComputeDistanceStatesVisitor : IStatesVisitor, private ArcWtFn, private S
       return;
     }
     if (!IncludingAxioms && s > maxNonAxiom_) maxNonAxiom_ = s;
+    sumArcs_.start(sum);
     for (ArcId arcid = 0; arcid < cntInArcs; ++arcid) {
       Arc const& arc = *hg_.inArc(s, arcid);
       Weight prod(Weight::one());
@@ -111,9 +112,10 @@ struct ComputeDistanceStatesVisitor : IStatesVisitor, private ArcWtFn, private S
       SDL_TRACE(FinalOutput.InsideAlgorithm, "after arc wt for " << printer(arc, hg_) << " for " << s
                                                                  << " prod = " << prod);
 
-      Hypergraph::plusBy(prod, sum);
-      SDL_TRACE(FinalOutput.InsideAlgorithm, "for " << s << " sum " << sum << " = old + " << prod);
+      sumArcs_.add(prod);
     }
+    sumArcs_.finish();
+    SDL_TRACE(FinalOutput.InsideAlgorithm, "for " << s << " sum " << sum << " over " << cntInArcs << " arcs");
   }
 
   ~ComputeDistanceStatesVisitor() {
@@ -125,6 +127,7 @@ struct ComputeDistanceStatesVisitor : IStatesVisitor, private ArcWtFn, private S
   HG const& hg_;
   Distances& distances_;
   StateId maxNonAxiom_;
+  BatchPlusBy<Weight> sumArcs_;  // log-sum-exp over all inarcs at once for LogWeight
 };
 
 /**
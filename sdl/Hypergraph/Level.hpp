@@ -178,6 +178,7 @@ struct Levelization : Levels {
     } else {  // start==final or else there are cycles or else there are no paths from start->final
       // we don't actually know whether final is reachable by any path at all! but if it is, there are
       // infinitely many.
+      nLevels = 1;
       setZeroLevel();
     }
   }
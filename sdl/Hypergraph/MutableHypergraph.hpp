@@ -28,6 +28,7 @@
 #include <sdl/Hypergraph/IHypergraph.hpp>
 #include <sdl/Hypergraph/IMutableHypergraph.hpp>
 #include <sdl/Hypergraph/StateIdTranslation.hpp>
+#include <sdl/Hypergraph/StructureCache.hpp>
 #include <sdl/Hypergraph/src/IsGraphArc.ipp>
 #include <sdl/Util/Add.hpp>
 #include <sdl/Util/Interested.hpp>
@@ -143,11 +144,11 @@ struct MutableHypergraphLabels {
   }
 
   static inline void transferLabels(StateIdTranslation const& stateRemap, LabelForState const& lin,
-                                    LabelForState& lout)  //, StateId mastateRemapState
-  {
-    for (StateIdMap::value_type const& io : stateRemap.cache) {
-      if (io.first < lin.size()) setLabel(lout, io.second, lin[io.first]);
-    }
+                                    LabelForState& lout) {
+    StateId const nIn = (StateId)lin.size();
+    stateRemap.visitTranslations([&lin, &lout, nIn](StateId from, StateId to) {
+      if (from < nIn && to != kNoState) setLabel(lout, to, lin[from]);
+    });
   }
 
   static inline void setLabel(LabelForState& l, StateId s, Sym sym) {
@@ -218,6 +219,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
  public:
   void orderGraphStates(StateIds const& permutation, StateIds const& inversePermutation) override {
     assert(this->isGraph());
+    clearStructureCache();
     maybeTransform(inversePermutation, this->start_);
     maybeTransform(inversePermutation, this->final_);
     if (this->start_ == kNoState || this->final_ == kNoState) return;
@@ -303,11 +305,13 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   bool outputLabelFollowsInput() const override { return oLabelForState.empty(); }
 
   void removeDeletedArcs(Util::PointerSet const& deletedArcPointers) override {
+    arcsRemoved();
     removeDeletedArcs(deletedArcPointers, inArcsPerState_);
     removeDeletedArcs(deletedArcPointers, outArcsPerState_);
   }
 
   void addedTail(Arc* a, StateId tail) override {
+    clearStructureCache();
     if (this->properties_ & kStoreOutArcs) Util::atExpand(outArcsPerState_, tail).push_back(a);
   }
 
@@ -353,6 +357,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
     SDL_TRACE(PhraseBased.Hypergraph.deleteInArcsImpl, gseq << " clearing state " << state
                                                             << " #inarcs: " << numInArcs(state));
     if (state >= inArcsPerState_.size()) return;
+    arcsRemoved();
     ArcsContainer& arcs = inArcsPerState_[state];
     if (storesOutArcsImpl()) {
       if (this->properties_ & kStoreFirstTailOutArcs) {
@@ -402,6 +407,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
 
   void deleteOutArcsImpl(StateId state) override {
     if (state >= outArcsPerState_.size()) return;
+    arcsRemoved();
     ArcsContainer& arcs = outArcsPerState_[state];
     if (storesInArcs()) {
       Util::Once deleted;
@@ -435,7 +441,9 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   std::size_t restrict(StateIdTranslation& x, ArcFilter const& keep) override {
     ArcFilter keepa = keep ? keep : Arc::filterTrue();
     if (x.identity()) return restrict(keep);
+    clearStructureCache();
     bool adding = x.stateAdding();
+    x.denseForSourceStates(this->size());
     // TODO: special case !x.frozen - faster than checking when translating
     AllArcs arcs;
     this->fetchArcs(arcs);
@@ -482,6 +490,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   std::size_t restrict(ArcFilter const& keep) override {
     std::size_t ndel = 0;
     if (!keep) return ndel;
+    arcsRemoved();
     if (this->properties_ & kStoreInArcs) {
       outArcsPerState_.clear();
       StateId ns = (StateId)inArcsPerState_.size();
@@ -662,7 +671,22 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
     if (one) this->properties_ |= kOneLexical;
   }
 
+  void clearStructureCache() {
+    if (structureCache_) structureCache_->clear();
+  }
+
+  /// arcs may have been removed (but adjacencies otherwise untouched)
+  void arcsRemoved() {
+    if (structureCache_) structureCache_->arcsRemoved();
+  }
+
+  /// adjacencies were (re)built - state orders may differ
+  void dropStructureOrders() {
+    if (structureCache_) structureCache_->dropOrders();
+  }
+
   void notifyArcsModified() override {
+    clearStructureCache();
     notifyArcImpl();
     this->properties_ &= ~kSortedOutArcs;
     this->properties_ &= ~kAcyclic;
@@ -708,6 +732,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   }
 
   void rebuildArcAdjacencies() override {
+    clearStructureCache();
     AllArcs arcs;
     fetchArcs(arcs);
     releaseArcs();
@@ -820,6 +845,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   StateId size() const override { return numStates_; }
 
   void clearImpl(Properties prop) override {
+    clearStructureCache();
     this->deleteArcs();
     clearArcsPer(numStates_);
     clearLabelImpl(prop);
@@ -854,6 +880,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   void replaceFirstTailOutArcsMove(StateId from, ArcsContainer&& with) override {
     assert(this->properties_ & kStoreFirstTailOutArcs);
     assert(from < outArcsPerState_.size());
+    clearStructureCache();
     outArcsPerState_[from] = with;
   }
 
@@ -1140,6 +1167,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   }
 
   void releaseArcs() override {
+    clearStructureCache();
     Util::clearVector(inArcsPerState_);
     assert(inArcsPerState_.empty());
     Util::clearVector(outArcsPerState_);
@@ -1160,6 +1188,8 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
 
  private:
   Util::Interested<StateId> interested_;
+  /// see enableStructureCache
+  unique_ptr<StructureCache> structureCache_;
 
   void addArcIn(Arc* arc) {
     StateId const headId = arc->head();
@@ -1275,6 +1305,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   void addArc(ArcBase* arc) override {
     assert(this->storesArcs());
     notifyArcImpl();
+    if (structureCache_) structureCache_->arcAdded(arc->head_, arc->tails_);
     if (this->properties_ & kStoreInArcs) Util::atExpand(inArcsPerState_, arc->head_).push_back(arc);
     StateIdContainer const& tails = arc->tails_;
     if (this->properties_ & kStoreFirstTailOutArcs) {
@@ -1298,6 +1329,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
 
   void forceFirstTailOutArcs() override {
     if (!(this->properties_ & kStoreFirstTailOutArcs)) {
+      dropStructureOrders();
       this->properties_ |= kStoreFirstTailOutArcs;
       bool hadout = this->properties_ & kStoreOutArcs;
       if (!hadout)
@@ -1324,12 +1356,16 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   }
 
   void forceOutArcs() override {
-    if (!(this->properties_ & kStoreOutArcs)) buildOut<AddOut>();
+    if (!(this->properties_ & kStoreOutArcs)) {
+      dropStructureOrders();
+      buildOut<AddOut>();
+    }
   }
 
   void forceInArcs() override {
     assert(this->storesArcs());
     if (!(this->properties_ & kStoreInArcs)) {
+      dropStructureOrders();
       StateId ns = (StateId)outArcsPerState_.size();
       Util::reinit(inArcsPerState_, ns);
       // avoids pitfall of first-tail being a repeat
@@ -1340,7 +1376,10 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
   }
 
   void clearOutArcs(StateId state) override {
-    if (state < outArcsPerState_.size()) outArcsPerState_[state].clear();
+    if (state < outArcsPerState_.size()) {
+      arcsRemoved();
+      outArcsPerState_[state].clear();
+    }
   }
 
   bool forceCanonicalLex() override {
@@ -1373,6 +1412,15 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
     }
   }
 
+  StructureCache* structureCache() const override { return structureCache_.get(); }
+
+  void enableStructureCache(bool enable = true) override {
+    if (!enable)
+      structureCache_.reset();
+    else if (!structureCache_)
+      structureCache_.reset(new StructureCache);
+  }
+
   void setProperties(Properties p) override { this->properties_ = p; }
 
   Properties properties() const override {
@@ -1395,10 +1443,12 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
 
   ArcsContainer* maybeOutArcs(StateId state) override {
     assert(storesOutArcsImpl());
+    clearStructureCache();
     return state < outArcsPerState_.size() ? &outArcsPerState_[state] : 0;
   }
 
   void setOutArcs(StateId state, ArcsContainer&& arcs) override {
+    clearStructureCache();
     if (state >= outArcsPerState_.size()) outArcsPerState_.resize(state + 1);
     outArcsPerState_[state] = arcs;
   }
@@ -1411,6 +1461,7 @@ struct MutableHypergraph final : IMutableHypergraph<A>, private MutableHypergrap
 
   ArcsContainer* maybeInArcs(StateId state) override {
     assert(storesInArcs());
+    clearStructureCache();
     return state < inArcsPerState_.size() ? &inArcsPerState_[state] : 0;
   }
 
@@ -0,0 +1,238 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    interned ngrams (token sequences) for NgramWeight: each distinct ngram is
+    stored once, and referred to by a 32-bit NgramId that also encodes its
+    length.
+
+    storage is bucketed by length: the ngrams of length L are packed
+    contiguously (L syms each) in bucket L, so there's no per-ngram allocation
+    or header. an open-addressing hash table over the ids finds existing
+    ngrams, and concatenations (the inner loop of NgramWeight times) are
+    memoized by (id1, id2) so repeated products cost a single hash lookup.
+
+    one arena is meant to be shared by all the weights of a computation (e.g.
+    NgramWeightMapper creates one per hypergraph, and an NgramArenaScope
+    provides NgramWeight's default arena for one input); ids from different
+    arenas aren't comparable. all mutating operations take the arena mutex, so weights
+    may be multiplied concurrently (e.g. parallel all-pairs shortest distance).
+*/
+
+#ifndef HYP__HYPERGRAPH_NGRAMARENA_HPP
+#define HYP__HYPERGRAPH_NGRAMARENA_HPP
+#pragma once
+
+#include <sdl/Util/Hash.hpp>
+#include <sdl/Util/ThreadLocal.hpp>
+#include <sdl/Util/Unordered.hpp>
+#include <sdl/Exception.hpp>
+#include <sdl/IntTypes.hpp>
+#include <sdl/Syms.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+
+/// top kNgramLenBits bits: ngram length. rest: index within that length's bucket
+typedef uint32 NgramId;
+
+unsigned const kNgramLenBits = 6;
+unsigned const kNgramIndexBits = 32 - kNgramLenBits;
+std::size_t const kMaxNgramLen = (1u << kNgramLenBits) - 1;
+NgramId const kNgramIndexMask = ((NgramId)1 << kNgramIndexBits) - 1;
+
+/// the empty ngram has the same id (0, the smallest) in every arena
+NgramId const kEmptyNgramId = 0;
+
+inline std::size_t ngramLength(NgramId id) {
+  return id >> kNgramIndexBits;
+}
+
+inline NgramId ngramIndex(NgramId id) {
+  return id & kNgramIndexMask;
+}
+
+class NgramArena {
+ public:
+  typedef std::unique_lock<std::mutex> Lock;
+
+  NgramArena() : buckets_(1), nNgrams_(), slots_(kInitialSlots, kNoNgramId) {}
+
+  /// \return number of distinct (non-empty) ngrams interned so far
+  std::size_t size() const {
+    Lock lock(mutex_);
+    return nNgrams_;
+  }
+
+  /// \return number of Sym stored (over all lengths)
+  std::size_t numSyms() const {
+    Lock lock(mutex_);
+    std::size_t n = 0;
+    for (Bucket const& bucket : buckets_) n += bucket.size();
+    return n;
+  }
+
+  NgramId intern(Sym const* begin, std::size_t len) {
+    if (!len) return kEmptyNgramId;
+    Lock lock(mutex_);
+    return internLocked(begin, len);
+  }
+
+  NgramId intern(Syms const& ngram) { return intern(ngram.begin(), ngram.size()); }
+
+  NgramId unigram(Sym sym) { return intern(&sym, 1); }
+
+  /// \return id of ngram(a) followed by ngram(b)
+  NgramId concat(NgramId a, NgramId b) {
+    if (a == kEmptyNgramId) return b;
+    if (b == kEmptyNgramId) return a;
+    Lock lock(mutex_);
+    return concatLocked(a, b);
+  }
+
+  /// for a batch of concat: hold lock() while calling this
+  NgramId concatLocked(NgramId a, NgramId b) {
+    if (a == kEmptyNgramId) return b;
+    if (b == kEmptyNgramId) return a;
+    uint64 const key = (uint64)a << 32 | b;
+    NgramId& r = concat_[key];
+    if (r == kEmptyNgramId) {
+      std::size_t const lenA = ngramLength(a), lenB = ngramLength(b);
+      scratch_.resize(lenA + lenB);
+      Sym const* symsA = symsLocked(a);
+      std::copy(symsA, symsA + lenA, scratch_.begin());
+      Sym const* symsB = symsLocked(b);
+      std::copy(symsB, symsB + lenB, scratch_.begin() + lenA);
+      r = internLocked(scratch_.data(), scratch_.size());
+    }
+    return r;
+  }
+
+  Lock lock() const { return Lock(mutex_); }
+
+  /// forget all ngrams and concatenations. ids handed out before are invalid
+  /// after this, so call only when no weight using this arena is alive
+  void clear() {
+    Lock lock(mutex_);
+    std::vector<Bucket>(1).swap(buckets_);
+    nNgrams_ = 0;
+    std::vector<NgramId>(kInitialSlots, kNoNgramId).swap(slots_);
+    unordered_map<uint64, NgramId>().swap(concat_);
+    std::vector<Sym>().swap(scratch_);
+  }
+
+  /// \return copy of the tokens of id
+  Syms ngram(NgramId id) const {
+    Syms r;
+    appendNgram(id, r);
+    return r;
+  }
+
+  void appendNgram(NgramId id, Syms& out) const {
+    std::size_t const len = ngramLength(id);
+    if (!len) return;
+    Lock lock(mutex_);
+    Sym const* syms = symsLocked(id);
+    out.append(syms, syms + len);
+  }
+
+ private:
+  typedef std::vector<Sym> Bucket;
+  static NgramId const kNoNgramId = (NgramId)-1;
+  static std::size_t const kInitialSlots = 1024;
+
+  static std::size_t hashNgram(Sym const* syms, std::size_t len) {
+    return Util::MurmurHash(syms, (int)(len * sizeof(Sym)), len);
+  }
+
+  Sym const* symsLocked(NgramId id) const {
+    return buckets_[ngramLength(id)].data() + ngramLength(id) * ngramIndex(id);
+  }
+
+  bool equalLocked(NgramId id, Sym const* syms, std::size_t len) const {
+    return ngramLength(id) == len && std::equal(syms, syms + len, symsLocked(id));
+  }
+
+  NgramId internLocked(Sym const* syms, std::size_t len) {
+    if (len > kMaxNgramLen)
+      SDL_THROW_LOG(Hypergraph.NgramArena, IndexException,
+                    "ngram length " << len << " exceeds max " << kMaxNgramLen);
+    std::size_t const mask = slots_.size() - 1;
+    std::size_t i = hashNgram(syms, len) & mask;
+    for (;; i = (i + 1) & mask) {
+      NgramId const id = slots_[i];
+      if (id == kNoNgramId) break;
+      if (equalLocked(id, syms, len)) return id;
+    }
+    if (len >= buckets_.size()) buckets_.resize(len + 1);
+    Bucket& bucket = buckets_[len];
+    std::size_t const index = bucket.size() / len;
+    if (index > kNgramIndexMask)
+      SDL_THROW_LOG(Hypergraph.NgramArena, IndexException, "too many ngrams of length " << len);
+    bucket.insert(bucket.end(), syms, syms + len);
+    NgramId const id = (NgramId)len << kNgramIndexBits | (NgramId)index;
+    slots_[i] = id;
+    if (++nNgrams_ * 2 > slots_.size()) rehashLocked(slots_.size() * 2);
+    return id;
+  }
+
+  void rehashLocked(std::size_t nSlots) {
+    std::vector<NgramId> slots(nSlots, kNoNgramId);
+    std::size_t const mask = nSlots - 1;
+    for (NgramId id : slots_)
+      if (id != kNoNgramId) {
+        std::size_t i = hashNgram(symsLocked(id), ngramLength(id)) & mask;
+        while (slots[i] != kNoNgramId) i = (i + 1) & mask;
+        slots[i] = id;
+      }
+    slots_.swap(slots);
+  }
+
+  mutable std::mutex mutex_;
+  /// buckets_[len] holds the ngrams of length len, len syms each
+  std::vector<Bucket> buckets_;
+  std::size_t nNgrams_;
+  /// open addressing (linear probing), power of 2 size, at most half full
+  std::vector<NgramId> slots_;
+  /// (a << 32 | b) -> concat(a, b)
+  unordered_map<uint64, NgramId> concat_;
+  std::vector<Sym> scratch_;
+};
+
+
+/// innermost NgramArenaScope's arena on this thread, or null
+inline NgramArena*& scopedNgramArena() {
+  static THREADLOCAL NgramArena* arena;
+  return arena;
+}
+
+/**
+   while alive, NgramWeight's defaultArena() (on the constructing thread) is
+   an arena owned by this scope, freed with it - e.g. one per input
+   hypergraph, so a long-running process doesn't accumulate every ngram it
+   ever saw. weights made in the scope must not outlive it. scopes nest.
+*/
+struct NgramArenaScope {
+  NgramArenaScope() : setArena(scopedNgramArena(), &arena) {}
+  NgramArena arena;
+
+ private:
+  Util::SetLocal<NgramArena*> setArena;
+};
+
+
+}}
+
+#endif
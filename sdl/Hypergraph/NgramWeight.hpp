@@ -19,6 +19,7 @@
 #pragma once
 
 
+#include <sdl/Hypergraph/NgramArena.hpp>
 #include <sdl/Hypergraph/Weight.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
 #include <sdl/Vocabulary/HelperFunctions.hpp>
@@ -37,27 +38,12 @@
 #include <cstddef>
 #include <iterator>
 #include <limits>
-#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
 namespace sdl {
 
-struct PtrEqual {
-  template <class Ptr>
-  bool operator()(Ptr const& p1, Ptr const& p2) const {
-    return *p1 == *p2;
-  }
-};
-
-struct FirstPtrAndSecondEqual {
-  template <class Pair>
-  bool operator()(Pair const& p1, Pair const& p2) const {
-    return *p1.first == *p2.first && p1.second == p2.second;
-  }
-};
-
 namespace Hypergraph {
 
 /**
@@ -73,6 +59,7 @@ namespace Hypergraph {
 
    The times operation combines shorter ngrams into longer ones:
    (m1, m2, ...) x (n1, n2, ...) = (m1n1, m1n2, ..., m2n1, m2n2, ...).
+   Products that yield the same ngram (e.g. [a b][c] and [a][b c]) are summed.
 
    Note that the times operation is not commutative.
 
@@ -91,6 +78,11 @@ namespace Hypergraph {
 
    block symbols aren't included in ngrams
 
+   ngrams are NgramId interned in an NgramArena (which must outlive the
+   weights) and stored as a vector of (id, weight) sorted by id, so plus is a
+   merge and times is a cross product of (memoized) id concatenations - no
+   token vectors are allocated per ngram. weights combined by plus or times
+   must share an arena (one() and zero() have none and adopt the other's).
 */
 template <class W>
 class NgramWeightTpl {
@@ -111,24 +103,41 @@ class NgramWeightTpl {
   bool isEquivalentToOne() const {
     if (isOne()) return true;
     if (ngrams_.size() != 1) return false;
-    value_type const& val = *ngrams_.begin();
-    return val.first->empty() && Hypergraph::isOne(val.second);
+    value_type const& val = ngrams_.front();
+    return val.first == kEmptyNgramId && Hypergraph::isOne(val.second);
   }
   typedef void HasIsOne;
 
   typedef W Weight;
 
   typedef Syms Ngram;
-  typedef shared_ptr<Ngram> NgramPtr;
+
+  typedef std::pair<NgramId, Weight> value_type;
+  /// sorted by id (unique)
+  typedef std::vector<value_type> Ngrams;
+  typedef typename Ngrams::const_iterator const_iterator;
+  typedef typename Ngrams::iterator iterator;
+
+  /**
+     arena used by the constructors that don't take one: the innermost
+     NgramArenaScope's (on this thread). outside any scope, a process-wide
+     arena that only grows, so long-running processes should open a scope per
+     input (or give an arena explicitly, see NgramWeightMapper).
+  */
+  static NgramArena& defaultArena() {
+    if (NgramArena* scoped = scopedNgramArena()) return *scoped;
+    static NgramArena arena;
+    return arena;
+  }
 
   /**
-     default is insufficent because NgramPtr compare by pointer.
+     ngrams compare by id when both weights use the same arena, else by tokens.
   */
   bool operator==(Self const& b) const {
     if (zero_ != b.zero_) return false;
     if (ngrams_.size() != b.ngrams_.size()) return false;
-    return std::mismatch(ngrams_.begin(), ngrams_.end(), b.ngrams_.begin(), FirstPtrAndSecondEqual()).second
-           == b.ngrams_.end();
+    if (sameArena(b)) return ngrams_ == b.ngrams_;
+    return tokenNgrams() == b.tokenNgrams();
   }
 
   /**
@@ -140,13 +149,6 @@ class NgramWeightTpl {
     return operator==(b);
   }
 
-  // TODO: we could use a sorted single vector of bytes for the keys, and a parallel vector of weights, if
-  // profiling justifies more speedup. or drop shared ptrs per markus' review which was a 20% speedup
-  typedef std::map<NgramPtr, Weight, Util::LessByValue<Ngram>> NgramPtrMap;
-  typedef typename NgramPtrMap::value_type value_type;
-  typedef typename NgramPtrMap::const_iterator const_iterator;
-  typedef typename NgramPtrMap::iterator iterator;
-
 #if SDL_WEIGHT_USE_AT_STATIC_INIT
   // reasonably cheap construction. spare us the thread synch difficulty
   static inline constexpr Self one() { return Self(); }
@@ -155,8 +157,7 @@ class NgramWeightTpl {
   // The one weight has no ngram:
   static Self const& one() { return kOne; }
 
-  // The zero weight has an ngram of size 1 containing the '0' marker
-  // (TODO: better solution would be for zero to have a NULL vector of ngrams_):
+  // The zero weight has no ngrams and zero_ set
   static Self const& zero() { return kZero; }
 #endif
 
@@ -164,18 +165,20 @@ class NgramWeightTpl {
      Default constructor; the ngram maxlen will be unspecified
      (value 0).
   */
-  NgramWeightTpl() : zero_(), maxlen_() {}
+  NgramWeightTpl() : arena_(), maxlen_(), zero_() {}
 
-  explicit NgramWeightTpl(std::size_t maxlen) : zero_(), maxlen_(maxlen) {}
+  explicit NgramWeightTpl(std::size_t maxlen, NgramArena* arena = 0)
+      : arena_(arena), maxlen_(maxlen), zero_() {}
 
-  NgramWeightTpl(bool, bool) : zero_(true), maxlen_() {}  // for zero()
+  NgramWeightTpl(bool, bool) : arena_(), maxlen_(), zero_(true) {}  // for zero()
 
-  NgramWeightTpl(Sym lab, std::size_t maxlen) : zero_(), maxlen_(maxlen) {
-    if (lab != EPSILON::ID) ngrams_[make_shared<Ngram>(1, lab)] = Weight::one();
+  NgramWeightTpl(Sym lab, std::size_t maxlen) : arena_(&defaultArena()), maxlen_(maxlen), zero_() {
+    if (lab != EPSILON::ID) ngrams_.push_back(value_type(arena_->unigram(lab), Weight::one()));
   }
 
-  NgramWeightTpl(Sym lab, std::size_t maxlen, Weight const& weight) : zero_(), maxlen_(maxlen) {
-    ngrams_[lab == EPSILON::ID ? kEmptyNgram : make_shared<Ngram>(1, lab)] = weight;
+  NgramWeightTpl(Sym lab, std::size_t maxlen, Weight const& weight, NgramArena& arena = defaultArena())
+      : arena_(&arena), maxlen_(maxlen), zero_() {
+    ngrams_.push_back(value_type(lab == EPSILON::ID ? kEmptyNgramId : arena.unigram(lab), weight));
   }
 
   void plusBy(Self const& w2) {
@@ -188,22 +191,34 @@ class NgramWeightTpl {
       assert(!zero_);
       if (isOne()) setExplicitOne();
       if (w2.isOne()) {
-        updateBy(PlusBy<W>(), ngrams_, kEmptyNgram, W::one());
+        plusByNgram(kEmptyNgramId, W::one());
         return;
       }
       if (&w2 == this) {
         // should not really happen, ever, but just in case:
         for (iterator i = ngrams_.begin(), e = ngrams_.end(); i != e; ++i)
-          Hypergraph::plusBy(i->second, i->second);
+          Hypergraph::plusBy(W(i->second), i->second);
         // well, everybody better be ready for plusBy(*this) because I just did it.
         return;
       }
       if (maxlen_ < w2.maxlen_) maxlen_ = w2.maxlen_;
-      for (const_iterator i = w2.ngrams_.begin(), e = w2.ngrams_.end(); i != e; ++i) {
-        // we would ordinarly just do ngrams_[key(i->first)]+=i->second,
-        // except we want a default of Weight::zero(), which is != Weight()
-        updateBy(PlusBy<W>(), ngrams_, *i);
+      adoptArena(w2);
+      Ngrams sum;
+      sum.reserve(ngrams_.size() + w2.ngrams_.size());
+      const_iterator i = ngrams_.begin(), ie = ngrams_.end(), j = w2.ngrams_.begin(), je = w2.ngrams_.end();
+      while (i != ie && j != je) {
+        if (i->first < j->first)
+          sum.push_back(*i++);
+        else if (j->first < i->first)
+          sum.push_back(*j++);
+        else {
+          sum.push_back(*i++);
+          Hypergraph::plusBy(j++->second, sum.back().second);
+        }
       }
+      sum.insert(sum.end(), i, ie);
+      sum.insert(sum.end(), j, je);
+      ngrams_.swap(sum);
     }
   }
 
@@ -219,35 +234,37 @@ class NgramWeightTpl {
 
   std::size_t getMaxLen() const { return maxlen_; }
 
-  void setMaxLen(std::size_t len) const { maxlen_ = len; }
+  void setMaxLen(std::size_t maxlen) { maxlen_ = maxlen; }
+
+  /// may be null only if there are no nonempty ngrams
+  NgramArena* arena() const { return arena_; }
+
+  /// \return the tokens of ngram id (from this weight's arena)
+  Ngram ngram(NgramId id) const { return arena_ ? arena_->ngram(id) : Ngram(); }
 
   /**
      Removes all ngrams that match a predicate.
-     *
-
-     \pred Predicate on the value_type of NgramPtrMap, which is
-     std::pair<NgramPtr, Weight>.
-     *
 
-     \return The number of ngrams_ removed.
+     \pred Predicate on value_type, which is std::pair<NgramId, Weight>.
   */
   template <class Predicate>
   void removeNgramIf(Predicate const& pred) {
-    eraseIf(ngrams_, pred);
+    ngrams_.erase(std::remove_if(ngrams_.begin(), ngrams_.end(), pred), ngrams_.end());
   }
 
-  Weight& plusByNgram(NgramPtr const& pngram, Weight const& weight) {
-    updateBy(PlusBy<W>(), ngrams_, pngram, weight);
+  void plusByNgram(NgramId id, Weight const& weight) {
+    assert(id == kEmptyNgramId || arena_);
+    iterator i = std::lower_bound(ngrams_.begin(), ngrams_.end(), id, IdLess());
+    if (i != ngrams_.end() && i->first == id)
+      Hypergraph::plusBy(weight, i->second);
+    else
+      ngrams_.insert(i, value_type(id, weight));
   }
-  Weight& plusByNgram(value_type const& pngramWeight) { updateBy(PlusBy<W>(), ngrams_, pngramWeight); }
 
-  /**
-     \return An inserter which can be used for inserting into the set
-     of ngrams.
-  */
-  std::insert_iterator<NgramPtrMap> inserter() { return std::inserter(ngrams_, ngrams_.begin()); }
-
-  void setMaxLen(std::size_t maxlen) { maxlen_ = maxlen; }
+  void plusByNgram(Ngram const& ngram, Weight const& weight) {
+    if (!arena_) arena_ = &defaultArena();
+    plusByNgram(arena_->intern(ngram), weight);
+  }
 
   /**
      Returns number of ngrams_
@@ -256,34 +273,60 @@ class NgramWeightTpl {
 
   bool empty() const { return ngrams_.empty(); }
 
-  /**
-     Clones ngrams_ from an input iterator to an output
-     iterator.
-  */
-  template <class InputIter, class OutputIter>
-  static void deepCopy(InputIter firstNgramAndWeight, InputIter lastNgramAndWeight, OutputIter result) {
-    for (; firstNgramAndWeight != lastNgramAndWeight; ++firstNgramAndWeight)
-      *result++ = value_type(make_shared<Ngram>(*firstNgramAndWeight->first), firstNgramAndWeight->second);
-  }
-
-  static NgramPtr cloneNgramPtr(NgramPtr const& pNgram) { return make_shared<Ngram>(*pNgram); }
-
   bool operator<(Self const& other) const {
     SDL_THROW_LOG(Hypergraph.NgramWeightTpl, std::runtime_error, "Not implemented");
   }
 
+  /// (tokens, weight) sorted by tokens
+  typedef std::vector<std::pair<Ngram, Weight>> TokenNgrams;
+  TokenNgrams tokenNgrams() const {
+    TokenNgrams r;
+    r.reserve(ngrams_.size());
+    for (value_type const& ngramWeight : ngrams_) r.push_back(std::make_pair(ngram(ngramWeight.first), ngramWeight.second));
+    std::sort(r.begin(), r.end(), [](typename TokenNgrams::value_type const& a,
+                                     typename TokenNgrams::value_type const& b) { return a.first < b.first; });
+    return r;
+  }
+
  private:
+  struct IdLess {
+    bool operator()(value_type const& a, NgramId b) const { return a.first < b; }
+    bool operator()(value_type const& a, value_type const& b) const { return a.first < b.first; }
+  };
+
   /**
      NgramWeightTpl::one() effectively has this map contents.
   */
-
   void setExplicitOne() {
     assert(ngrams_.empty());
-    ngrams_.insert(value_type(kEmptyNgram, W::one()));
+    ngrams_.push_back(value_type(kEmptyNgramId, W::one()));
   }
 
-  NgramPtrMap ngrams_;
-  static NgramPtr kEmptyNgram;
+  bool sameArena(Self const& b) const { return !arena_ || !b.arena_ || arena_ == b.arena_; }
+
+  void adoptArena(Self const& b) {
+    if (!arena_)
+      arena_ = b.arena_;
+    else if (!sameArena(b))
+      SDL_THROW_LOG(Hypergraph.NgramWeightTpl, ProgrammerMistakeException,
+                    "NgramWeight plus/times of weights from different NgramArena");
+  }
+
+  /// sort by id and plus together entries with the same id
+  void sortAndCombine() {
+    if (ngrams_.size() < 2) return;
+    std::sort(ngrams_.begin(), ngrams_.end(), IdLess());
+    iterator out = ngrams_.begin();
+    for (iterator i = out + 1, e = ngrams_.end(); i != e; ++i)
+      if (i->first == out->first)
+        Hypergraph::plusBy(i->second, out->second);
+      else
+        *++out = *i;
+    ngrams_.erase(out + 1, ngrams_.end());
+  }
+
+  Ngrams ngrams_;
+  NgramArena* arena_;
   // C++ wart: must friend all or none of the template
   template <class W2>
   friend NgramWeightTpl<W2> times(NgramWeightTpl<W2> const& w1, NgramWeightTpl<W2> const& w2);
@@ -293,10 +336,6 @@ class NgramWeightTpl {
   bool zero_;
 };
 
-template <class W>
-typename NgramWeightTpl<W>::NgramPtr
-    NgramWeightTpl<W>::kEmptyNgram(make_shared<typename NgramWeightTpl<W>::Ngram>());
-
 template <class W>
 NgramWeightTpl<W> NgramWeightTpl<W>::kOne;
 
@@ -320,55 +359,40 @@ inline NgramWeightTpl<W> times(NgramWeightTpl<W> const& w1, NgramWeightTpl<W> co
   assert(!w1.isZero());
   assert(!w2.isZero());
   const std::size_t maxlen = std::max(w1.getMaxLen(), w2.getMaxLen());
-  Ngw product(maxlen);
+  Ngw product(maxlen, w1.arena_);
+  product.adoptArena(w2);
   assert(!product.isZero());
-  typedef typename Ngw::Ngram Ngram;
-  typedef typename Ngw::value_type NgramPtrAndWeight;
-  typedef typename Ngw::const_iterator Iter;
-  for (NgramPtrAndWeight const& p1 : w1) {
-    Ngram const& ngram1 = *p1.first;
-    std::size_t const len1 = ngram1.size();
-    assert(!Vocabulary::countBlockSymbols(ngram1));
-    assert(len1 == Vocabulary::countRuleSrcSymbols(ngram1));
+  typedef typename Ngw::value_type NgramIdAndWeight;
+  product.ngrams_.reserve(w1.size() * w2.size());
+  NgramArena* arena = product.arena_;
+  // (id1, id2) to concatenate for each product.ngrams_ entry; the arena is
+  // locked only for the concatenations, not the weight products
+  std::vector<std::pair<NgramId, NgramId>> concats;
+  if (arena) concats.reserve(w1.size() * w2.size());
+  for (NgramIdAndWeight const& p1 : w1) {
+    std::size_t const len1 = ngramLength(p1.first);
     assert(len1 <= w1.getMaxLen());
     assert(len1 <= maxlen);
     std::size_t maxlen2 = maxlen - len1;
-    for (Iter i2 = w2.begin(), e2 = w2.end(); i2 != e2; ++i2) {
-      NgramPtrAndWeight const& p2 = *i2;
-      Ngram const& ngram2 = *p2.first;
-      std::size_t const len2 = ngram2.size();
-      assert(!Vocabulary::countBlockSymbols(ngram2));
-      assert(len2 == Vocabulary::countRuleSrcSymbols(ngram2));
+    for (NgramIdAndWeight const& p2 : w2) {
+      std::size_t const len2 = ngramLength(p2.first);
       assert(len2 <= w2.getMaxLen());
       if (len2 > maxlen2) continue;
       W const& wtConcat = times(p1.second, p2.second);
       if (Hypergraph::isZero(wtConcat)) continue;
-      NgramPtrAndWeight concatNgWt(make_shared<Ngram>(ngram1.size() + ngram2.size()), wtConcat);
-      Util::copyConcatRanges(ngram1, ngram2, concatNgWt.first->begin());  //=n1+n2
-      assert(!Util::contains(product.ngrams_, concatNgWt.first));
-      product.ngrams_.insert(concatNgWt);
+      product.ngrams_.push_back(NgramIdAndWeight(kEmptyNgramId, wtConcat));
+      // arena is null only if every ngram is empty
+      if (arena) concats.push_back(std::make_pair(p1.first, p2.first));
     }
   }
   if (product.size() == 0) return Ngw::kZero;  // not one. once ngrams_ grow too long, you're done.
-  return product;
-}
-
-template <class W>
-bool operator==(NgramWeightTpl<W> const& w1, NgramWeightTpl<W> const& w2) {
-  typedef typename NgramWeightTpl<W>::Ngram Ngram;
-  typedef typename NgramWeightTpl<W>::NgramPtr NgramPtr;
-  if (w1.size() != w2.size()) return false;
-  typename NgramWeightTpl<W>::const_iterator it1 = w1.begin();
-  typename NgramWeightTpl<W>::const_iterator w1End = w1.end();
-  typename NgramWeightTpl<W>::const_iterator it2 = w2.begin();
-  for (; it1 != w1End; ++it1, ++it2) {
-    NgramPtr pNgram1 = it1->first;
-    NgramPtr pNgram2 = it2->first;
-    W const& w1 = it1->second;
-    W const& w2 = it2->second;
-    if (*pNgram1 != *pNgram2 || w1 != w2) return false;
+  if (arena) {
+    NgramArena::Lock lock(arena->lock());
+    for (std::size_t i = 0, n = concats.size(); i < n; ++i)
+      product.ngrams_[i].first = arena->concatLocked(concats[i].first, concats[i].second);
   }
-  return true;
+  product.sortAndCombine();
+  return product;
 }
 
 template <class W>
@@ -383,21 +407,16 @@ std::ostream& operator<<(std::ostream& out, NgramWeightTpl<W> const& w) {
     out << "Zero";
     return out;
   }
-  typedef typename NgramW::Ngram Ngram;
-  typedef typename NgramW::NgramPtr NgramPtr;
-  typedef std::pair<NgramPtr, W> NgramPtrAndWeight;
   bool first1 = true;
   out << "(";
-  for (NgramPtrAndWeight ngramPtrAndWeight : w) {
+  for (typename NgramW::TokenNgrams::value_type const& ngramAndWeight : w.tokenNgrams()) {
     bool first = true;
     out << (first1 ? "" : ", ") << "[";
-    NgramPtr pNgram = ngramPtrAndWeight.first;
-    W const& weight = ngramPtrAndWeight.second;
-    for (Sym const& label : *pNgram) {
+    for (Sym const& label : ngramAndWeight.first) {
       out << (first ? "" : " ") << label;
       first = false;
     }
-    out << " / " << weight;
+    out << " / " << ngramAndWeight.second;
     out << "]";
     first1 = false;
   }
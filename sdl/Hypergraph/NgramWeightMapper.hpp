@@ -21,6 +21,7 @@
 #include <sdl/Hypergraph/MutableHypergraph.hpp>
 #include <sdl/Hypergraph/NgramWeight.hpp>
 #include <sdl/Vocabulary/SpecialSymbols.hpp>
+#include <sdl/SharedPtr.hpp>
 #include <cstddef>
 
 namespace sdl {
@@ -28,7 +29,9 @@ namespace Hypergraph {
 
 /**
    For use in MapHypergraph; sets all weights be of type
-   NgramWeight, to keep track of ngram spans.
+   NgramWeight, to keep track of ngram spans. the weights' ngrams are interned
+   in an arena owned by the mapper (and its copies), so keep the mapper alive
+   as long as the weights.
 */
 template <class SourceArc>
 struct NgramWeightMapper {
@@ -36,7 +39,8 @@ struct NgramWeightMapper {
   typedef NgramWeightTpl<typename SourceArc::Weight> Tarweight;
   typedef ArcTpl<Tarweight> TargetArc;
 
-  NgramWeightMapper(IHypergraph<SourceArc> const& hg, std::size_t maxlen) : hg_(hg), maxlen_(maxlen) {}
+  NgramWeightMapper(IHypergraph<SourceArc> const& hg, std::size_t maxlen)
+      : hg_(hg), maxlen_(maxlen), arena_(make_shared<NgramArena>()) {}
 
   TargetArc* operator()(SourceArc const* sourceArc) const {
     assert(sourceArc->isFsmArc());
@@ -50,7 +54,7 @@ struct NgramWeightMapper {
     if (inputLabel == EPSILON::ID) {
       targetArc->setWeight(Tarweight::one());
     } else {
-      targetArc->setWeight(Tarweight(inputLabel, maxlen_, sourceArc->weight()));
+      targetArc->setWeight(Tarweight(inputLabel, maxlen_, sourceArc->weight(), *arena_));
     }
 
     return targetArc;
@@ -58,6 +62,7 @@ struct NgramWeightMapper {
 
   IHypergraph<SourceArc> const& hg_;
   std::size_t maxlen_;
+  shared_ptr<NgramArena> arena_;
 };
 
 
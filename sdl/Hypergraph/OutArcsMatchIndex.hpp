@@ -0,0 +1,209 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    O(1) lookup of the out-arcs of an fsm state that have a given input label,
+    for states with many out-arcs (e.g. the start state of a lexicon or trie
+    fsm, which is probed for every input token in compose).
+
+    the fsm must have kSortedOutArcs, so the arcs matching a label are a
+    contiguous [begin, end) range of out-arc positions; this is what we store.
+    states with fewer than minArcs out-arcs aren't indexed (binary search is
+    fast enough there) and find() returns false for them.
+
+    per indexed state, the (non-special) labels are either a dense jump table
+    indexed by Sym id - minimum id (when the ids are compact enough) or else an
+    open-addressing hash table at most half full. the few special labels
+    (epsilon, sigma, phi, rho) are kept in a short list.
+*/
+
+#ifndef HYP__HYPERGRAPH_OUTARCSMATCHINDEX_HPP
+#define HYP__HYPERGRAPH_OUTARCSMATCHINDEX_HPP
+#pragma once
+
+#include <sdl/Hypergraph/IHypergraph.hpp>
+#include <sdl/Util/LogHelper.hpp>
+#include <sdl/IntTypes.hpp>
+#include <sdl/Sym.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+
+/// [begin, end) positions (ArcId) in a state's sorted out-arcs
+struct OutArcsMatchRange {
+  uint32 begin, end;
+  bool empty() const { return begin == end; }
+};
+
+class OutArcsMatchIndex {
+ public:
+  /// dense table may have up to this many slots per distinct label
+  enum { kMaxDenseSlotsPerLabel = 4 };
+
+  OutArcsMatchIndex() : nIndexed_() {}
+
+  /// number of states indexed
+  std::size_t size() const { return nIndexed_; }
+
+  void clear() {
+    tableForState_.clear();
+    tables_.clear();
+    nIndexed_ = 0;
+  }
+
+  /**
+     index states of fsm (which must have sorted out-arcs) with at least
+     minArcs (>0) out-arcs. minArcs = 0 means index nothing
+  */
+  template <class Arc>
+  void init(IHypergraph<Arc> const& fsm, std::size_t minArcs) {
+    clear();
+    if (!minArcs || !fsm.storesOutArcs()) return;
+    std::vector<Slot> labels;
+    for (StateId s = 0, N = fsm.size(); s < N; ++s) {
+      ArcId const nArcs = fsm.numOutArcs(s);
+      if (nArcs < minArcs) continue;
+      labels.clear();
+      for (ArcId a = 0; a < nArcs; ++a) {
+        SymInt const sym = fsm.inputLabel(fsm.outArc(s, a)->fsmSymbolState()).id_;
+        if (!labels.empty() && labels.back().sym == sym)
+          labels.back().range.end = a + 1;
+        else {
+          Slot slot;
+          slot.sym = sym;
+          slot.range.begin = a;
+          slot.range.end = a + 1;
+          labels.push_back(slot);
+        }
+      }
+      if (s >= tableForState_.size()) tableForState_.resize(s + 1, kNoTable);
+      tableForState_[s] = (uint32)tables_.size();
+      tables_.push_back(Table());
+      tables_.back().init(labels);
+      ++nIndexed_;
+    }
+    SDL_DEBUG(Hypergraph.OutArcsMatchIndex, "indexed " << nIndexed_ << " states with >= " << minArcs
+                                                      << " out-arcs");
+  }
+
+  /**
+     \return false if state s isn't indexed. else set *range to the arcs
+     matching input (possibly empty) and return true
+  */
+  bool find(StateId s, Sym input, OutArcsMatchRange& range) const {
+    if (s >= tableForState_.size()) return false;
+    uint32 const t = tableForState_[s];
+    if (t == kNoTable) return false;
+    range = tables_[t].find(input);
+    return true;
+  }
+
+ private:
+  enum { kNoTable = (uint32)-1 };
+
+  struct Slot {
+    SymInt sym;
+    OutArcsMatchRange range;
+  };
+
+  struct Table {
+    /// dense: slots_[sym - minSym_]. else hash table of size mask_ + 1 = 2^(32 - shift_)
+    bool dense_;
+    SymInt minSym_;
+    SymInt mask_;
+    unsigned shift_;
+    std::vector<Slot> slots_;
+    std::vector<Slot> specials_;
+
+    /// fibonacci hashing: the high bits of sym * 2^32 / golden ratio
+    SymInt slotFor(SymInt sym) const { return (SymInt)(sym * 0x9E3779B1u) >> shift_; }
+
+    static bool isSpecial(SymInt sym) {
+      Sym s;
+      s.id_ = sym;
+      return s.isSpecialTerminal();
+    }
+
+    void init(std::vector<Slot> const& labels) {
+      Slot empty;
+      empty.sym = (SymInt)kNoSymbol;
+      empty.range.begin = empty.range.end = 0;
+      std::size_t nRegular = 0;
+      SymInt minSym = (SymInt)kNoSymbol, maxSym = 0;
+      for (Slot const& label : labels)
+        if (isSpecial(label.sym))
+          specials_.push_back(label);
+        else {
+          ++nRegular;
+          if (label.sym < minSym) minSym = label.sym;
+          if (label.sym > maxSym) maxSym = label.sym;
+        }
+      minSym_ = minSym;
+      std::size_t const span = nRegular ? (std::size_t)(maxSym - minSym) + 1 : 0;
+      dense_ = span <= kMaxDenseSlotsPerLabel * nRegular;
+      if (dense_) {
+        mask_ = 0;
+        shift_ = 0;
+        slots_.resize(span, empty);
+        for (Slot const& label : labels)
+          if (!isSpecial(label.sym)) slots_[label.sym - minSym_] = label;
+      } else {
+        std::size_t nSlots = 4;
+        shift_ = 30;
+        for (; nSlots < 2 * nRegular; nSlots *= 2) --shift_;
+        mask_ = (SymInt)(nSlots - 1);
+        slots_.resize(nSlots, empty);
+        for (Slot const& label : labels)
+          if (!isSpecial(label.sym)) {
+            SymInt i = slotFor(label.sym);
+            while (slots_[i].sym != (SymInt)kNoSymbol) i = (i + 1) & mask_;
+            slots_[i] = label;
+          }
+      }
+    }
+
+    OutArcsMatchRange find(Sym input) const {
+      SymInt const sym = input.id_;
+      if (input.isSpecialTerminal()) {
+        for (Slot const& special : specials_)
+          if (special.sym == sym) return special.range;
+        return noMatch();
+      }
+      if (dense_) {
+        SymInt const i = sym - minSym_;  // wraps for sym < minSym_
+        return i < slots_.size() ? slots_[i].range : noMatch();
+      }
+      for (SymInt i = slotFor(sym);; i = (i + 1) & mask_) {
+        Slot const& slot = slots_[i];
+        if (slot.sym == sym) return slot.range;
+        if (slot.sym == (SymInt)kNoSymbol) return noMatch();
+      }
+    }
+
+    static OutArcsMatchRange noMatch() {
+      OutArcsMatchRange r;
+      r.begin = r.end = 0;
+      return r;
+    }
+  };
+
+  /// index into tables_ or kNoTable
+  std::vector<uint32> tableForState_;
+  std::vector<Table> tables_;
+  std::size_t nIndexed_;
+};
+
+
+}}
+
+#endif
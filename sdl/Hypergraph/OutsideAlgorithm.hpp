@@ -50,12 +50,14 @@ template <class Arc>
 void outsideFromInside(StateId stateId, IHypergraph<Arc> const& hg,
                        boost::ptr_vector<typename Arc::Weight> const& insideScores,
                        boost::ptr_vector<typename Arc::Weight> const& outsideScores,
-                       typename Arc::Weight& sum, StateId final, bool haveInsideForAxiom = true) {
+                       typename Arc::Weight& sum, StateId final, bool haveInsideForAxiom,
+                       BatchPlusBy<typename Arc::Weight>& sumArcs) {
   SDL_TRACE(Hypergraph.OutsideAlgorithm, "Computing outside score for " << stateId << ", sum=" << sum);
   typedef typename Arc::Weight Weight;
   if (stateId == final)
     sum = Weight::one();
   else {
+    sumArcs.start(sum);
     for (ArcId aid : hg.outArcIds(stateId)) {
       Arc const& arc = *hg.outArc(stateId, aid);
       SDL_TRACE(Hypergraph.OutsideAlgorithm, " Found out arc: " << arc);
@@ -76,12 +78,22 @@ void outsideFromInside(StateId stateId, IHypergraph<Arc> const& hg,
         }
       }
       SDL_TRACE(Hypergraph.OutsideAlgorithm, " prod=" << prod << " (add #self=" << nself << " times)");
-      while (nself--) plusBy(prod, sum);
+      while (nself--) sumArcs.add(prod);
     }
+    sumArcs.finish();
   }
   SDL_TRACE(Hypergraph.OutsideAlgorithm, " sum now " << sum);
 }
 
+template <class Arc>
+void outsideFromInside(StateId stateId, IHypergraph<Arc> const& hg,
+                       boost::ptr_vector<typename Arc::Weight> const& insideScores,
+                       boost::ptr_vector<typename Arc::Weight> const& outsideScores,
+                       typename Arc::Weight& sum, StateId final, bool haveInsideForAxiom = true) {
+  BatchPlusBy<typename Arc::Weight> sumArcs;
+  outsideFromInside(stateId, hg, insideScores, outsideScores, sum, final, haveInsideForAxiom, sumArcs);
+}
+
 /**
    A states visitor that computes the distance to each particular state
    that it's called with
@@ -106,7 +118,8 @@ struct ComputeOutsideScoreStatesVisitor : public IStatesVisitor {
   void visit(StateId stateId) {
     assert(outsideScores_);
     Weight& outside = Util::atExpandPtr(*outsideScores_, stateId, kZero);
-    outsideFromInside(stateId, hg_, insideScores_, *outsideScores_, outside, final, haveInsideForAxiom_);
+    outsideFromInside(stateId, hg_, insideScores_, *outsideScores_, outside, final, haveInsideForAxiom_,
+                      sumArcs_);
     SDL_TRACE(Hypergraph.InsideAlgorithm, "Stored outside distance: " << (*outsideScores_)[stateId]
                                                                       << " to state " << stateId);
   }
@@ -117,6 +130,7 @@ struct ComputeOutsideScoreStatesVisitor : public IStatesVisitor {
   boost::ptr_vector<Weight> const& insideScores_;
   boost::ptr_vector<Weight>* outsideScores_;
   bool haveInsideForAxiom_;
+  BatchPlusBy<Weight> sumArcs_;
 };
 
 /**
@@ -29,6 +29,11 @@ namespace Hypergraph {
 
 struct QueueDistance {};
 
+/// for outsideCosts on a graph: the outside of a tail doesn't depend on the inside of the other (lexical) tails
+struct ZeroInsideCosts {
+  SdlFloat operator[](StateId) const { return 0; }
+};
+
 template <class Arc, class InsideCost>
 void outsideCosts(IHypergraph<Arc> const& hg, SdlFloat* outside, InsideCost const& inside,
                   StateId N = kNoState, SdlFloat onlyCostsBelow = HUGE_VAL, bool insideHasAxioms = true) {
@@ -0,0 +1,146 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    a sequence of unary transforms (see Transform.hpp) applied in place to one
+    hypergraph, in one process:
+
+    PipelineOptions pipeline;
+    pipeline.stages = {kPrune, kPushWeights, kPruneToBest};
+    pipeline.inplace(hg);
+
+    is the in-memory equivalent of 'hyp prune | hyp pushweights | hyp
+    prunetobest' - no text is written or reparsed between stages, and every
+    stage uses the input hg's vocabulary.
+
+    with structureCache (default), the hg keeps a StructureCache during the
+    stages, so the topological orders, acyclicity and in-arcs one stage (or
+    its inside and outside passes) computes are reused by the next until arcs
+    change. in-arcs that the cache's stages added to the hg in place (where,
+    without the cache, they'd have worked on a copy) are removed again
+    afterwards, so the hg is written the same either way.
+
+    (see src/HypPipeline.cpp for the command line version, which also composes
+    any further inputs before the stages)
+*/
+
+#ifndef HYP__HYPERGRAPH_PIPELINE_HPP
+#define HYP__HYPERGRAPH_PIPELINE_HPP
+#pragma once
+
+#include <sdl/Hypergraph/Determinize.hpp>
+#include <sdl/Hypergraph/Invert.hpp>
+#include <sdl/Hypergraph/Project.hpp>
+#include <sdl/Hypergraph/Prune.hpp>
+#include <sdl/Hypergraph/PruneToBest.hpp>
+#include <sdl/Hypergraph/PushWeights.hpp>
+#include <sdl/Hypergraph/Reweight.hpp>
+#include <sdl/Hypergraph/RmEpsilon.hpp>
+#include <sdl/Hypergraph/Transform.hpp>
+#include <sdl/Util/Enum.hpp>
+#include <sdl/Util/LogHelper.hpp>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+
+SDL_ENUM(PipelineStage, 8, (Prune, PruneToBest, PushWeights, Determinize, Project, Reweight, Invert, RmEpsilon));
+
+struct PipelineOptions {
+  static char const* caption() {
+    return "apply a sequence of transforms to each input hypergraph in memory (no text between stages)";
+  }
+  static char const* type() { return "Pipeline"; }
+
+  std::vector<PipelineStage> stages;
+
+  PruneOptions prune;
+  PruneToBestOptions pruneToBest;
+  PushWeights pushWeights;
+  DeterminizeOptions determinize;
+  Project project;
+  Reweight reweight;
+  RmEpsilon rmEpsilon;
+
+  bool structureCache;
+
+  PipelineOptions() : structureCache(true) {}
+
+  template <class Config>
+  void configure(Config& c) {
+    c.is(type());
+    c(caption());
+    c("stages", &stages)("transforms applied in order (each may be repeated): " + allowed_values(kPrune));
+    c("prune", &prune)("options for prune stages");
+    c("prune-to-best", &pruneToBest)("options for prune-to-best stages");
+    c("push-weights", &pushWeights)("options for push-weights stages");
+    c("determinize", &determinize)("options for determinize stages");
+    c("project", &project)("options for project stages");
+    c("reweight", &reweight)("options for reweight stages");
+    c("rm-epsilon", &rmEpsilon)("options for rm-epsilon stages");
+    c("structure-cache", &structureCache)
+        .defaulted()("reuse topological orders, acyclicity and in-arcs across stages until arcs change");
+  }
+
+  /// hg <- stages[n-1](...stages[0](hg))
+  template <class Arc>
+  void inplace(IMutableHypergraph<Arc>& hg) const {
+    StructureCacheScope<Arc> cacheScope(hg, structureCache && !hg.structureCache());
+    for (PipelineStage stage : stages) {
+      SDL_DEBUG(Hypergraph.Pipeline, "stage " << stage << " on hg with " << hg.size() << " states");
+      switch (stage) {
+        case kPrune: inplaceStage(prune, hg); break;
+        case kPruneToBest: inplaceStage(pruneToBest, hg); break;
+        case kPushWeights: inplaceStage(pushWeights, hg); break;
+        case kDeterminize: inplaceStage(determinize, hg); break;
+        case kProject: inplaceStage(project, hg); break;
+        case kReweight: inplaceStage(reweight, hg); break;
+        case kInvert: invert(hg); break;
+        case kRmEpsilon: inplaceStage(rmEpsilon, hg); break;
+        default: assertValid(stage);
+      }
+    }
+    cacheScope.restoreArcStorage();
+  }
+
+ private:
+  /// hg's StructureCache on for the stages (if enable) and off again after, even if a stage throws
+  template <class Arc>
+  struct StructureCacheScope {
+    IMutableHypergraph<Arc>& hg;
+    bool const enabled;
+    /// hg's kStoreAnyArcs bits before the stages
+    Properties const storage;
+    StructureCacheScope(IMutableHypergraph<Arc>& hg, bool enable)
+        : hg(hg), enabled(enable), storage(hg.properties() & kStoreAnyArcs) {
+      if (enabled) hg.enableStructureCache();
+    }
+    /// remove in-arcs added while the cache was on (if hg still has out-arcs to keep)
+    void restoreArcStorage() {
+      if (enabled && !(storage & kStoreInArcs) && hg.storesInArcs() && hg.storesOutArcs())
+        hg.forceProperties(kStoreInArcs, false);
+    }
+    ~StructureCacheScope() {
+      if (enabled) hg.enableStructureCache(false);
+    }
+  };
+
+  template <class Options, class Arc>
+  static void inplaceStage(Options const& opt, IMutableHypergraph<Arc>& hg) {
+    TransformHolder holder(transformFor<Arc>(opt));
+    Hypergraph::inplace(hg, useTransform<Arc, Options>(holder));
+  }
+};
+
+
+}}
+
+#endif
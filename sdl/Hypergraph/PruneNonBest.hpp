@@ -135,10 +135,16 @@ struct ArcInBest {
   ArcInBest(ArcInBest const& o) : pi(o.pi) {}
   ArcInBest(IHypergraph<A> const& hg, PruneNonBestOptions const& opt)
       : phg(&dynamic_cast<MutableHypergraph<A> const&>(hg))
-      , pi(ComputeBest(BestPathOptions(), hg).predecessors())
+      , pi(ComputeBest(bestPathOptions(opt), hg).predecessors())
       , start(hg.start()) {
     init(opt, hg);
   }
+  /// single keeps only the final state's best path, so it can stop early once final is popped
+  static BestPathOptions bestPathOptions(PruneNonBestOptions const& opt) {
+    BestPathOptions r;
+    r.goalDirected = opt.single;
+    return r;
+  }
   void init(PruneNonBestOptions const& opt, IHypergraph<A> const& hg)  // pi must be set already
   {
     inarcs = hg.storesInArcs();
@@ -210,7 +210,10 @@ struct ArcInBest {
     N = hg.sizeForHeads();
     empty = !N;
     if (empty) return;
-    ComputeBest best(opt, hg);
+    BestPathOptions bestOpt(opt);
+    // the beam needs every state's inside cost, not just those popped before final
+    if (beaming) bestOpt.goalDirected = false;
+    ComputeBest best(bestOpt, hg);
     if (beaming) empty = !best.best(false, single);
     if (empty) return;
     inarcs = hg.storesInArcs();
@@ -10,23 +10,37 @@
 // limitations under the License.
 /** \file
 
-    for acyclic FSM only, push costs as far toward arcs leaving the start state
-    (or arcs leaving states) as possible, without changing the structure or
-    changing the weight of any derivation[1]. for weights with inverse (so not
-    Feature) - e.g. log or viterbi only
+    push weights as far as possible toward the final state (for any hg) or the
+    start state (for graphs only), without changing the structure or the weight
+    of any derivation[1]. for weights with inverse (so not Feature) - e.g. log
+    or viterbi only.
 
-    related but not yet implemented: (for HG or FSM): push costs toward final state
+    both directions reweight every arc by a potential p (state -> weight):
 
-    note: [1] because we don't have initial or final state weights, we might have
-    some constant weight that's been factored out (e.g. when using
-    probabilities). by default we attempt to put this weight back on the arcs
-    but if the graph isn't acyclic we may have to leave it off. you can retrieve
-    the weight and insert a new state with an epsilon arc using that wieght if
-    you like.
+    toward final: arc.w' = arc.w * prod{p[tails]} / p[head], p = inside
+    toward start: arc.w' = arc.w * p[head] / p[tail], p = outside
 
-    acyclic restriction can be removed by use of viterbi best-paths algs instead
-    of DAG-only inside/outside (or a more expensive algorithm, or approximate
-    solution, for log weight)
+    where p is taken as one for axioms (start and lexical states) and, toward
+    final, for the final state. the potentials telescope over any derivation, so
+    derivation weights are preserved for *any* p; inside/outside are the choice
+    that leaves the hg locally normalized (toward final, the in-arcs of each
+    state but final sum to one; toward start, the out-arcs).
+
+    acyclic hg: inside/outside in the hg's semiring (InsideAlgorithm.hpp,
+    OutsideAlgorithm.hpp), so log weights are normalized by sum, not max.
+
+    cycles only among states on no derivation of final (e.g. unreachable ones):
+    as acyclic, with potentials from a copy without those states.
+
+    cyclic hg: viterbi weights only. best-path costs are used as potentials:
+    inside from BestPath (best-first with cycles), outside from OutsideCosts.hpp
+    (dijkstra from final). with negative-cost cycles these may be inexact, which
+    costs normalization but not correctness.
+
+    note: [1] because we don't have initial or final state weights, we have some
+    constant weight that's been factored out (the total weight). toward final
+    it ends up on the arcs into final, and toward start on the arcs leaving
+    start.
 
     TODO: define multiplicative right-inverse to handle noncommutative semirings. for
     now this is only for viterbi and log weight
@@ -36,13 +50,19 @@
 #define PUSHWEIGHTS_JG2013220_HPP
 #pragma once
 
+#include <sdl/Hypergraph/BestPath.hpp>
 #include <sdl/Hypergraph/IHypergraph.hpp>
 #include <sdl/Hypergraph/InsideAlgorithm.hpp>
-#include <sdl/Hypergraph/InsideCosts.hpp>
+#include <sdl/Hypergraph/OutsideAlgorithm.hpp>
 #include <sdl/Hypergraph/OutsideCosts.hpp>
+#include <sdl/Hypergraph/Prune.hpp>
+#include <sdl/Hypergraph/StatesTraversal.hpp>
 #include <sdl/Hypergraph/Transform.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
-#include <graehl/shared/nan.hpp>
+#include <sdl/Hypergraph/WeightsFwdDecls.hpp>
+#include <sdl/Util/Delete.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <type_traits>
 
 namespace sdl {
 namespace Hypergraph {
@@ -69,118 +89,129 @@ struct PushWeights : SimpleTransform<PushWeights, Transform::Inplace, false> {
   void configure(Config& config) {
     config.is(type());
     config(
-        "for acyclic hg, push weights to final state; for acyclic graph only, push weights to start state "
-        "keeping local normalization [sum(arc weight)=1] except for start state which gets the residual");
+        "for hg, push weights to final state; for graph only, push weights to start state "
+        "keeping local normalization [sum(arc weight)=1] except for start state which gets the residual. "
+        "cyclic inputs need viterbi weights");
     config("push-to-final", &pushToFinal)
-        .defaulted()("push weights toward final state instead of start state (also supports acyclic HG)");
+        .defaulted()("push weights toward final state instead of start state (also supports HG)");
   }
 };
 
-
 /**
-   for acyclic FSM only (so far), push costs as far toward arcs leaving the start state (or arcs leaving
-   states) as possible, without changing the structure
-
-   for arcs that aren't connected through start->final, set weight to 0
-
-   commutative semirings (w/ division) only
+   computes potentials (see file comment) then reweights every arc of hg by
+   them. an arc whose potentials are zero (it's on no derivation) gets weight
+   zero. if there's no derivation at all, a mutable hg is setEmpty.
 
-   usage: PushCostsToStart<Arc>(hg, PushWeightsOptions());
+   usage: PushWeightsByPotential<Arc>(hg, pushToFinal);
 */
-
 template <class Arc>
-struct PushCostsToStart {
+struct PushWeightsByPotential {
   typedef typename Arc::Weight Weight;
   typedef IHypergraph<Arc> HG;
-  HG& hg;
   typedef IMutableHypergraph<Arc> MHG;
+  typedef boost::ptr_vector<Weight> PtrWeights;
+  HG& hg;
   MHG* mhg;
+  bool toFinal;
   StateId N, start, final;
-  Util::AutoDeleteArray<SdlFloat> inside, outside;
-  SdlFloat* outside0;
-  PushCostsToStart(HG& hg, PushWeights const& = PushWeights())
+  Weight const kZero, kOne;
+  /// inside (toFinal) or outside; missing entries (unreached states) are zero
+  PtrWeights potential;
+
+  PushWeightsByPotential(HG& hg, bool toFinal)
       : hg(hg)
       , mhg(hg.isMutable() ? static_cast<MHG*>(&hg) : 0)
+      , toFinal(toFinal)
       , N(hg.sizeForHeads())
       , start(hg.start())
       , final(hg.final())
-      , inside(N)
-      , outside(N, HUGE_VAL) {
+      , kZero(Weight::zero())
+      , kOne(Weight::one()) {
     if (hg.prunedEmpty()) return;
-    if (!hg.isGraph() || start == kNoState)
-      SDL_THROW_LOG(Hypergraph.PushCostsToStart, ConfigException,
-                    "PushWeights=>start requires an acyclic graph");
-    hg.forceFirstTailOutArcs();
-    if (!N) goto empty;
-    insideCosts(hg, &inside[0], N);
-    if (graehl::is_inf(inside[final])) {
-    empty:
+    if (!toFinal && (!hg.isGraph() || start == kNoState))
+      SDL_THROW_LOG(Hypergraph.PushWeights, ConfigException,
+                    "PushWeights=>start requires a graph with a start state (use push-to-final for hg)");
+    if (!hg.storesInArcs()) {
+      if (!mhg)
+        SDL_THROW_LOG(Hypergraph.PushWeights, ConfigException, "PushWeights needs in-arcs for non-mutable hg");
+      mhg->forceInArcs();
+    }
+    if (!isAcyclic(hg))
+      cyclicPotential(std::integral_constant<bool, IsViterbiWeight<Weight>::value>());
+    else if (isAcyclic(hg, true))
+      acyclicPotential(hg);
+    else
+      usefulAcyclicPotential();
+    if (isZero(total())) {
       if (mhg)
         mhg->setEmpty();
       else
-        SDL_THROW_LOG(Hypergraph.PushCostsToStart, ConfigException,
-                      "non-mutable hg had no finite-cost paths - can't PushCostsToStart");
+        SDL_THROW_LOG(Hypergraph.PushWeights, ConfigException,
+                      "non-mutable hg had no finite-cost paths - can't PushWeights");
       return;
     }
-    outside0 = outside;
-    assert(graehl::is_posinf(*outside0));
-    outsideCosts(hg, outside0, inside, N, (float)HUGE_VAL, false);
-    assert(start < N);
-    outside0[start] = inside[final];
-    assert(outside0[final] == 0);
     hg.forArcs(*this);
   }
 
-  void operator()(Arc* pArc) const {
-    Arc& arc = *pArc;
-    StateId head = arc.head_;
-    StateId tail = arc.tails_[0];
-    SdlFloat& cost = arc.weight_.value_;
-    assert(head < N);
-    assert(tail < N);
-    // we want the new outsides to be as small as possible without going
-    // negative. TODO: prove correct for cyclic graphs
-    cost += outside0[head] - (tail != start ? outside0[tail] : 0);
+  /// weight of all derivations (the residual left on arcs into final or out of start)
+  Weight const& total() const { return rawPotential(toFinal ? final : start); }
+
+  Weight const& rawPotential(StateId s) const { return s < potential.size() ? potential[s] : kZero; }
+
+  /// one for axioms and (toward final) for final
+  Weight const& operator[](StateId s) const {
+    return hg.isAxiom(s) || (toFinal && s == final) ? kOne : rawPotential(s);
   }
-};
 
-/**
-   as with PushCostsToStart, but works on acyclic hg, moving inside costs up
-   toward final (toward heads). commutative semirings (w/ division) only
+  void acyclicPotential(HG& acyclic) {
+    if (toFinal)
+      insideAlgorithm(acyclic, &potential, kPushWeightsInsideAxiom);
+    else {
+      if (!acyclic.storesOutArcs()) acyclic.forceFirstTailOutArcs();
+      PtrWeights inside;  // for a graph, outside needs no inside of (lexical) other tails
+      outsideAlgorithm(acyclic, inside, &potential, false);
+    }
+  }
 
-   usage: PushWeightsToFinal<Arc>(hg, PushWeights());
+  /// cycles only among states on no derivation: potentials from a copy
+  /// without them (same state ids)
+  void usefulAcyclicPotential() {
+    MutableHypergraph<Arc> useful(kStoreInArcs | (toFinal ? 0 : kStoreFirstTailOutArcs));
+    PruneOptions keepStateIds;
+    keepStateIds.packStates = false;
+    pruneUnreachable(hg, &useful, keepStateIds);
+    acyclicPotential(useful);
+  }
 
-*/
-template <class Arc>
-struct PushWeightsToFinal {
-  typedef typename Arc::Weight Weight;
-  typedef IHypergraph<Arc> HG;
-  typedef boost::ptr_vector<Weight> PtrWeights;
-  HG& hg;
-  typedef IMutableHypergraph<Arc> MHG;
-  MHG* mhg;
-  StateId N, final;
-  Weight const kZero;
-  PtrWeights inside;
-  PushWeightsToFinal(HG& hg, PushWeights const& = PushWeights())
-      : hg(hg)
-      , mhg(hg.isMutable() ? static_cast<MHG*>(&hg) : 0)
-      , N(hg.sizeForHeads())
-      , final(hg.final())
-      , kZero(Weight::zero())
-      , inside(N) {
-    insideAlgorithm(hg, &inside, kPushWeightsInsideAxiom);
-    if (isZero(inside[final])) {
-      if (mhg)
-        mhg->setEmpty();
-      else
-        SDL_THROW_LOG(Hypergraph.PushCostsToStart, ConfigException,
-                      "non-mutable hg had no finite-cost paths - can't PushCostsToStart");
+  void cyclicPotential(std::false_type) {
+    SDL_THROW_LOG(Hypergraph.PushWeights, ConfigException,
+                  "PushWeights on a cyclic hg requires viterbi weights (best-path potentials)");
+  }
+
+  void cyclicPotential(std::true_type) {
+    SDL_DEBUG(Hypergraph.PushWeights, "cyclic hg: pushing toward " << (toFinal ? "final" : "start")
+                                                                   << " by best-path costs");
+    if (toFinal) {
+      typedef BestPath::Compute<Arc> ComputeBest;
+      ComputeBest best(BestPathOptions(), hg);
+      if (!best.best()) return;
+      setPotentialCosts(best.mu);
+    } else {
+      Util::AutoDeleteArray<SdlFloat> outside(N, (SdlFloat)HUGE_VAL);
+      outsideCosts(hg, &outside[0], ZeroInsideCosts(), N);
+      setPotentialCosts(&outside[0]);
     }
-    hg.forArcs(*this);
   }
+
+  template <class Costs>
+  void setPotentialCosts(Costs const& costs) {
+    potential.clear();
+    potential.reserve(N);
+    for (StateId s = 0; s < N; ++s) potential.push_back(new Weight(costs[s]));
+  }
+
   /**
-     telescoping: for best hyperpath F(C, D) wf, C(A, B) wc, leaf arcs A wa, B wb, D wd, we have:
+     toward final: for best hyperpath F(C, D) wf, C(A, B) wc, leaf arcs A wa, B wb, D wd, we have:
 
      for the best arcs into each state, the relationship between inside and arc weight is simple:
 
@@ -200,49 +231,49 @@ struct PushWeightsToFinal {
      head and a tail in the derivation, except for the leaves, which have inside
      of one, by definition.
 
-
-     remember that inside[F]=wf*(inside[C]*inside[D]), inside[A]=wa, etc.
-
-     so the weight for any path is the same (commutative semiring w/ division, e.g. log or viterbi)
-
-     that is, for any arc, the new weight is inside[head] / prod(inside[tails]))
+     toward start is the mirror image: arc.w' = arc.w*outside[head]/outside[tail]
   */
   void operator()(ArcBase* pArc) const {
     Arc& arc = *(Arc*)pArc;
-    StateId head = arc.head_;
     Weight& weight = arc.weight();
-    StateId ninside = inside.size();
-    assert(ninside <= N);
-    if (head < ninside) {
-      if (head != final) {
-        Weight const& divhead = inside[head];
-        if (isZero(divhead)) {  // avoid zero division
-          setZero(weight);
-          return;
-        }
-        divideBy(divhead, weight);
-      }
-      StateIdContainer const& tails = arc.tails();
-      for (typename StateIdContainer::const_iterator i = tails.begin(), e = tails.end(); i != e; ++i) {
-        StateId const tail = *i;
-        if (!hg.isAxiom(tail)) timesBy(inside[tail], weight);
+    PushWeightsByPotential const& p = *this;
+    Weight const& phead = p[arc.head_];
+    if (isZero(phead)) {
+      setZero(weight);
+      return;
+    }
+    if (toFinal)
+      divideBy(phead, weight);
+    else
+      timesBy(phead, weight);
+    for (StateId tail : arc.tails()) {
+      if (hg.isAxiom(tail)) continue;
+      Weight const& ptail = p[tail];
+      if (isZero(ptail)) {  // avoid zero division
+        setZero(weight);
+        return;
       }
-    } else
-      weight = kZero;
+      if (toFinal)
+        timesBy(ptail, weight);
+      else
+        divideBy(ptail, weight);
+    }
   }
 };
 
 template <class Arc>
-void pushWeightsToStart(IHypergraph<Arc>& hg, PushWeights const& config = PushWeights()) {
-  PushCostsToStart<Arc> push(hg, config);
+void pushWeightsToStart(IHypergraph<Arc>& hg) {
+  PushWeightsByPotential<Arc>(hg, false);
+}
+
+template <class Arc>
+void pushWeightsToFinal(IHypergraph<Arc>& hg) {
+  PushWeightsByPotential<Arc>(hg, true);
 }
 
 template <class Arc>
 void PushWeights::inplace(IMutableHypergraph<Arc>& hg) const {
-  if (pushToFinal)
-    PushWeightsToFinal<Arc>(hg, *this);
-  else
-    PushCostsToStart<Arc> push(hg, *this);
+  PushWeightsByPotential<Arc>(hg, pushToFinal);
 }
 
 
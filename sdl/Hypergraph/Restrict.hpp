@@ -99,6 +99,7 @@ struct RestrictPrepare : Restrict<A> {
     StateIdMapping* map = p->mapping(h, m);
     if (map) {
       this->stateRemap.resetNew(map);
+      this->stateRemap.denseForSourceStates(h.size());
       p->preparePost(h, m);
       return true;
     } else
@@ -17,6 +17,7 @@
 #define HYP__HG_REWEIGHT_HPP
 #pragma once
 
+#include <sdl/Hypergraph/ArcFeatureStore.hpp>
 #include <sdl/Hypergraph/FeatureWeightUtil.hpp>
 #include <sdl/Hypergraph/IHypergraph.hpp>
 #include <sdl/Hypergraph/IsFeatureWeight.hpp>
@@ -37,6 +38,7 @@ struct ReweightOptions : TransformOptionsBase {
   static char const* caption() {
     return "Modify Arc Weights (real-valued costs), optionally (in order 1-5):";
   }
+  static char const* type() { return "Reweight"; }
   ReweightOptions() {
     head_normalize = fsm_normalize = false;
     set_null(set);
@@ -131,14 +133,23 @@ struct ReweightOptions : TransformOptionsBase {
 
   template <class Weight>
   void reweight(Weight& wt, Util::Random01& rng) const {
-    double cost = wt.getValue();
-    double newcost = cost;
-    maybeSet(newcost);
+    double weighted = 0;
     if (!weights.empty()) {
       if (!IsFeatureWeight<Weight>::value)
         SDL_THROW_LOG(Hypergraph.Reweight, ConfigException,
                       "supplied (unusable) feature weights for non-feature hypergraph");
-      double weighted = FeatureDotProduct<Weight, double>::dotProduct(wt, weights);
+      weighted = FeatureDotProduct<Weight, double>::dotProduct(wt, weights);
+    }
+    reweight(wt, rng, weighted);
+  }
+
+  /// as above but with weighted = dotProduct(wt, weights) already computed (e.g. by ArcFeatureStore)
+  template <class Weight>
+  void reweight(Weight& wt, Util::Random01& rng, double weighted) const {
+    double cost = wt.getValue();
+    double newcost = cost;
+    maybeSet(newcost);
+    if (!weights.empty()) {
       if (weightsAdd)
         newcost += weighted;
       else
@@ -164,10 +175,25 @@ struct ReweightNormalize {
 
   ReweightNormalize(ReweightOptions const& opt, IMutableHypergraph<A>& hg)
       : opt(opt), normsum(opt.normalize() ? hg.size() : 0, Weight::zero()), norm(opt.normalize()), rng(opt.seed) {
-    hg.forArcsSafe(*this);
+    if (opt.weights.empty() || !reweightByColumns(hg, IsFeatureWeight<Weight>()))
+      hg.forArcsSafe(*this);
     if (opt.normalize()) hg.forArcsSafe(NormalizePass(*this));
   }
 
+  /**
+     all arcs' dotProduct(features, opt.weights) at once from an
+     ArcFeatureStore, then the rest of reweight per arc (in the same
+     forArcsSafe order, so random-add draws the same numbers)
+  */
+  bool reweightByColumns(IMutableHypergraph<A>& hg, std::true_type) {
+    ArcFeatureStore<A> store(hg);
+    std::vector<double> weighted;
+    store.dotProducts(opt.weights, weighted);
+    for (std::size_t a = 0, n = store.numArcs(); a < n; ++a) visit(*store.arc(a), weighted[a]);
+    return true;
+  }
+  bool reweightByColumns(IMutableHypergraph<A>&, std::false_type) { return false; }
+
   typedef ReweightNormalize Self;
 
   struct NormalizePass {
@@ -187,8 +213,17 @@ struct ReweightNormalize {
   }
   void operator()(A* ap) const {
     A& a = *ap;
+    opt.reweight(a.weight(), rng);
+    addNorm(a);
+  }
+
+  void visit(A& a, double weighted) const {
+    opt.reweight(a.weight(), rng, weighted);
+    addNorm(a);
+  }
+
+  void addNorm(A& a) const {
     Weight& wt = a.weight();
-    opt.reweight(wt, rng);
     if (norm) {
       if (opt.valueNormalize)
         Hypergraph::plusBy(Weight((typename Weight::FloatT)wt.getValue()), normFor(a));
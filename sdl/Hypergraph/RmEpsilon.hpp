@@ -0,0 +1,271 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    weighted epsilon removal for graphs (fsm, fst) preserving the weight of
+    every (input:output) string.
+
+    for each state p that can begin a non-epsilon arc in the result (the start
+    state, and the heads of non-epsilon arcs), the epsilon closure
+    {(q, d[p, q])} is computed by generic single-source shortest distance
+    (Mohri 2002) over the epsilon arcs: d[p, q] is the plus-sum over epsilon
+    paths p->q of their weights (for viterbi weights, the best such path). then
+    every non-epsilon arc q->r (label L, weight w) becomes p->r (L, d[p, q] *
+    w), and, since we have no final weights, if final is in the closure of r,
+    also p->final (L, d[p, q] * w * d[r, final]). the empty string
+    (d[start, final]) is kept as a single epsilon arc start->final.
+
+    closures may optionally be pruned (closure-beam, max-closure-states) - this
+    changes the result weights, like any pruning. convergence for non-idempotent
+    (log) weights is to within delta; an epsilon cycle with weight >= one (cost <=
+    0) in the log semiring has no finite closure, and we throw once
+    max-relaxations is exceeded.
+*/
+
+#ifndef HYP__HYPERGRAPH_RMEPSILON_HPP
+#define HYP__HYPERGRAPH_RMEPSILON_HPP
+#pragma once
+
+#include <sdl/Hypergraph/IMutableHypergraph.hpp>
+#include <sdl/Hypergraph/Prune.hpp>
+#include <sdl/Hypergraph/Transform.hpp>
+#include <sdl/Hypergraph/WeightUtil.hpp>
+#include <sdl/Util/LogHelper.hpp>
+#include <sdl/Util/Math.hpp>
+#include <sdl/Exception.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+
+struct RmEpsilon : SimpleTransform<RmEpsilon, Transform::Inplace, false> {
+  template <class Arc>
+  void inplace(IMutableHypergraph<Arc>& hg) const;
+
+  Properties inAddProps() const { return kStoreFirstTailOutArcs; }
+  static char const* type() { return "RmEpsilon"; }
+  static char const* caption() {
+    return "Remove epsilon arcs from a graph (fsm), preserving the weight of every string (viterbi or log "
+           "weights)";
+  }
+
+  Properties inputProperties() const { return inAddProps(); }
+  void validate() {}
+
+  RmEpsilon()
+      : delta(1e-6)
+      , closureBeam(std::numeric_limits<SdlFloat>::infinity())
+      , maxClosureStates()
+      , maxRelaxations(1000000)
+      , pruneUnreachable(true) {}
+
+  SdlFloat delta;
+  SdlFloat closureBeam;
+  std::size_t maxClosureStates;
+  std::size_t maxRelaxations;
+  bool pruneUnreachable;
+
+  template <class Config>
+  void configure(Config& config) {
+    config.is(type());
+    config(caption());
+    config("delta", &delta)
+        .defaulted()("epsilon closure shortest distance converges when no distance (cost) changes by more than this");
+    config("closure-beam", &closureBeam)
+        .defaulted()("drop epsilon closure members whose epsilon-path cost exceeds this (inf: exact)");
+    config("max-closure-states", &maxClosureStates)
+        .defaulted()("keep only the best this-many members of each epsilon closure (0: unlimited)");
+    config("max-relaxations", &maxRelaxations)
+        .defaulted()("throw if one epsilon closure needs more than this many relaxations (divergent cycle)");
+    config("prune-unreachable", &pruneUnreachable)
+        .defaulted()("remove states no longer on any start->final path afterwards");
+  }
+};
+
+/**
+   computes every needed epsilon closure (see file comment) from the original
+   arcs, then replaces all the arcs of hg.
+
+   usage: RmEpsilonImpl<Arc>(opt, hg);
+*/
+template <class Arc>
+struct RmEpsilonImpl {
+  typedef typename Arc::Weight Weight;
+  typedef typename Weight::FloatT FloatT;
+  typedef std::pair<StateId, Weight> Member;
+  typedef std::vector<Member> Closure;
+
+  RmEpsilon const& opt;
+  IMutableHypergraph<Arc>& hg;
+  StateId N, final;
+
+  /// closure scratch, indexed by state; reset via touched after each closure
+  std::vector<Weight> distance, residual;
+  std::vector<char> queued, seen;
+  std::vector<StateId> touched;
+
+  RmEpsilonImpl(RmEpsilon const& opt, IMutableHypergraph<Arc>& hg) : opt(opt), hg(hg) {
+    if (hg.prunedEmpty()) return;
+    if (!hg.isGraph() || hg.start() == kNoState)
+      SDL_THROW_LOG(Hypergraph.RmEpsilon, ConfigException, "RmEpsilon requires a graph with a start state");
+    hg.forceFirstTailOutArcsOnly();
+    final = hg.final();
+    ArcsContainer* finalArcs = hg.maybeOutArcs(final);
+    if (finalArcs && !finalArcs->empty()) {
+      // paths may continue through final; give them a fresh sink to end in
+      StateId const sink = hg.addState();
+      hg.addArcEpsilon(final, sink);
+      hg.setFinal(final = sink);
+    }
+    N = hg.size();
+    distance.resize(N, Weight::zero());
+    residual.resize(N, Weight::zero());
+    queued.resize(N);
+    seen.resize(N);
+
+    StateId const start = hg.start();
+    std::vector<char> needed(N);
+    needed[start] = true;
+    std::size_t nEpsilon = 0;
+    for (StateId q = 0; q < N; ++q) {
+      if (ArcsContainer* arcs = hg.maybeOutArcs(q)) {
+        for (ArcBase* a : *arcs) {
+          if (isEpsilonLikeGraphArcAnyWeight(hg, *a))
+            ++nEpsilon;
+          else
+            needed[a->head()] = true;
+        }
+      }
+    }
+    SDL_DEBUG(Hypergraph.RmEpsilon, "removing " << nEpsilon << " epsilon arcs");
+    if (!nEpsilon) return;
+
+    std::vector<Closure> closures(N);
+    /// rho[r] = d[r, final]
+    std::vector<Weight> rho(N, Weight::zero());
+    for (StateId p = 0; p < N; ++p)
+      if (needed[p]) {
+        computeClosure(p, closures[p]);
+        for (Member const& m : closures[p])
+          if (m.first == final) rho[p] = m.second;
+      }
+
+    std::vector<Arc*> added;
+    for (StateId p = 0; p < N; ++p)
+      for (Member const& m : closures[p])
+        if (ArcsContainer* arcs = hg.maybeOutArcs(m.first))
+          for (ArcBase* a : *arcs)
+            if (!isEpsilonLikeGraphArcAnyWeight(hg, *a)) {
+              Arc const& arc = *(Arc const*)a;
+              StateId const r = arc.head(), label = arc.tails_[1];
+              Weight const w = times(m.second, arc.weight_);
+              added.push_back(new Arc(HeadAndWeight(), r, w, p, label));
+              if (r != final && !isZero(rho[r]))
+                added.push_back(new Arc(HeadAndWeight(), final, times(w, rho[r]), p, label));
+            }
+
+    for (StateId q = 0; q < N; ++q)
+      if (ArcsContainer* arcs = hg.maybeOutArcs(q)) {
+        for (ArcBase* a : *arcs) delete (Arc*)a;
+        hg.clearOutArcs(q);
+      }
+    hg.clearProperties(kSortedOutArcs);
+    for (Arc* a : added) hg.addArc(a);
+    if (start != final && !isZero(rho[start])) hg.addArcEpsilon(start, final, rho[start]);
+    SDL_DEBUG(Hypergraph.RmEpsilon, "added " << added.size() << " non-epsilon arcs");
+    if (opt.pruneUnreachable) Hypergraph::pruneUnreachable(hg);
+  }
+
+  /// generic single-source shortest distance from p over epsilon arcs
+  void computeClosure(StateId p, Closure& closure) {
+    std::deque<StateId> queue;
+    reach(p);
+    distance[p] = residual[p] = Weight::one();
+    queue.push_back(p);
+    queued[p] = true;
+    std::size_t nRelaxations = 0;
+    while (!queue.empty()) {
+      StateId const q = queue.front();
+      queue.pop_front();
+      queued[q] = false;
+      Weight const r = residual[q];
+      residual[q] = Weight::zero();
+      ArcsContainer* arcs = hg.maybeOutArcs(q);
+      if (!arcs) continue;
+      for (ArcBase* a : *arcs)
+        if (isEpsilonLikeGraphArcAnyWeight(hg, *a)) {
+          if (++nRelaxations > opt.maxRelaxations)
+            SDL_THROW_LOG(Hypergraph.RmEpsilon, ConfigException,
+                          "epsilon closure of state "
+                              << p << " didn't converge after " << opt.maxRelaxations
+                              << " relaxations (epsilon cycle with weight >= one in a non-viterbi semiring?)");
+          StateId const head = a->head();
+          reach(head);
+          Weight const rw = times(r, ((Arc const*)a)->weight_);
+          Weight const sum = plus(distance[head], rw);
+          if (!Util::floatEqual(sum.getValue(), distance[head].getValue(), (FloatT)opt.delta)) {
+            distance[head] = sum;
+            plusBy(rw, residual[head]);
+            if (!queued[head]) {
+              queued[head] = true;
+              queue.push_back(head);
+            }
+          }
+        }
+    }
+
+    closure.clear();
+    for (StateId q : touched) {
+      if (!isZero(distance[q]) && distance[q].getValue() <= opt.closureBeam)
+        closure.push_back(Member(q, distance[q]));
+      distance[q] = residual[q] = Weight::zero();
+      seen[q] = false;
+    }
+    touched.clear();
+    if (opt.maxClosureStates && closure.size() > opt.maxClosureStates) {
+      std::nth_element(closure.begin(), closure.begin() + opt.maxClosureStates, closure.end(), BetterMember());
+      closure.resize(opt.maxClosureStates);
+    }
+  }
+
+  struct BetterMember {
+    bool operator()(Member const& a, Member const& b) const {
+      return a.second.getValue() < b.second.getValue();
+    }
+  };
+
+  void reach(StateId q) {
+    if (!seen[q]) {
+      seen[q] = true;
+      touched.push_back(q);
+    }
+  }
+};
+
+template <class Arc>
+void rmEpsilon(IMutableHypergraph<Arc>& hg, RmEpsilon const& opt = RmEpsilon()) {
+  RmEpsilonImpl<Arc>(opt, hg);
+}
+
+template <class Arc>
+void RmEpsilon::inplace(IMutableHypergraph<Arc>& hg) const {
+  RmEpsilonImpl<Arc>(*this, hg);
+}
+
+
+}}
+
+#endif
@@ -57,6 +57,11 @@
     kCanonicalLex : in-place: if you want same state for same labelpair, then build the original hg w/
    kCanonicalLex. copy: no problem.
 
+    storage: once the source stateid range [0, n) is known (denseForSourceStates(n) - called for you by
+   copy, restrict, and RestrictPrepare transforms e.g. prune and sortStates), the cache is a vector indexed
+   by source state with kNoState for unmapped. source states outside that range (rare) fall back to the
+   StateIdMap hash table.
+
 */
 
 #ifndef STATEIDTRANSLATION_LW20111212_HPP
@@ -69,19 +74,15 @@
 #include <sdl/Util/Unordered.hpp>
 #include <boost/noncopyable.hpp>
 #include <graehl/shared/os.hpp>
+#include <vector>
 
 namespace sdl {
 namespace Hypergraph {
 
-// TODO: use vector? kNoState for unset
-
 // map stateids from source to copy or compacted hg. this is either a lazy complete mapping or partial
 
 // TODO: version of this that supports kCanonicalLex
 
-// TODO: use dynamically expanded, or prealloced, vector w/ explicit kNoState mapping - more
-// efficient except in very sparse cases
-
 // note: for 2-best and worse, you don't have the same derivation for each instance of a vertex, necessarily.
 // so this might not make sense
 
@@ -197,16 +198,51 @@ struct SubsetIdentityMapping : public StateIdMapping {
 };
 
 struct StateIdTranslation : boost::noncopyable {
-  StateIdMap cache;
   typedef StateIdTranslation self_type;
 
  private:
+  /// dense[s] for s < dense.size() (kNoState: not yet mapped), else cache
+  std::vector<StateId> dense;
+  StateId nDense;
+  StateIdMap cache;
   StateIdMapping* map;
   StateIdMappingPtr impl;
   bool partialMap, identityMap, stateAddingMap;
 
  public:
-  std::size_t size() const { return cache.size(); }
+  /// number of source states translated so far
+  std::size_t size() const { return nDense + cache.size(); }
+
+  /// \return whether s's translation is stored in the dense vector
+  bool isDense(StateId s) const { return s < dense.size(); }
+
+  /**
+     source states will be (mostly) in [0, nSourceStates): index translations
+     by a vector of that size instead of hashing. existing translations are
+     kept.
+  */
+  void denseForSourceStates(StateId nSourceStates) {
+    if (nSourceStates <= dense.size()) return;
+    dense.resize(nSourceStates, kNoState);
+    for (StateIdMap::iterator i = cache.begin(); i != cache.end();)
+      if (isDense(i->first)) {
+        if (i->second != kNoState) {
+          dense[i->first] = i->second;
+          ++nDense;
+        }
+        i = cache.erase(i);
+      } else
+        ++i;
+  }
+
+  /// call v(from, to) for every mapped source state (in increasing order of 'from', for the dense part)
+  template <class Visitor>
+  void visitTranslations(Visitor const& v) const {
+    for (StateId from = 0, N = (StateId)dense.size(); from < N; ++from)
+      if (dense[from] != kNoState) v(from, dense[from]);
+    for (StateIdMap::value_type const& io : cache) v(io.first, io.second);
+  }
+
   bool partial() const { return partialMap; }
   bool identity() const { return identityMap; }
   bool stateAdding() const { return stateAddingMap; }
@@ -228,6 +264,8 @@ struct StateIdTranslation : boost::noncopyable {
       identityMap = map->identity();
       stateAddingMap = map->stateAdding();
     }
+    dense.clear();
+    nDense = 0;
     cache.clear();
     frozenMap = false;  // if true, partial mapping and cache is authoratitive.
   }
@@ -258,12 +296,20 @@ struct StateIdTranslation : boost::noncopyable {
   }
   bool frozen() const { return frozenMap; }
   StateId existingState(StateId s) const {
-    return Util::getOrElse(cache, s, kNoState);
+    return isDense(s) ? dense[s] : Util::getOrElse(cache, s, kNoState);
     //    if (s==kNoState) return s; // handled above already
   }
 
   /// be careful: make sure 'to' is a value obtained by stateFor or an existing state
-  void add(StateId from, StateId to) { cache.insert(std::pair<StateId, StateId>(from, to)); }
+  void add(StateId from, StateId to) {
+    if (isDense(from)) {
+      if (dense[from] == kNoState && to != kNoState) {
+        dense[from] = to;
+        ++nDense;
+      }
+    } else
+      cache.insert(std::pair<StateId, StateId>(from, to));
+  }
   void setSameAs(StateId a, StateId b) { add(a, stateFor(b)); }
 
   /// this could be used to predict stateids for a previously empty hypergraph. usually the other version is
@@ -271,6 +317,11 @@ struct StateIdTranslation : boost::noncopyable {
   StateId stateForImpl(StateId s) {
     if (s == kNoState) return s;
     if (frozenMap) return existingState(s);
+    if (isDense(s)) {
+      StateId& r = dense[s];
+      if (r == kNoState && (r = map->remap(s)) != kNoState) ++nDense;
+      return r;
+    }
     StateId* r;
     if (Util::update(cache, s, r)) {
       return (*r = map->remap(s));
@@ -294,6 +345,11 @@ struct StateIdTranslation : boost::noncopyable {
   // for axioms (lexical states w/ no arcs)
   StateId addStateImpl(StateId s, LabelPair const& io) {
     if (frozenMap) return existingState(s);
+    if (isDense(s)) {
+      StateId& r = dense[s];
+      if (r == kNoState && (r = map->remapForLabelPair(s, io)) != kNoState) ++nDense;
+      return r;
+    }
     StateId* r;
     if (Util::update(cache, s, r)) {
       return (*r = map->remapForLabelPair(s, io));
@@ -350,7 +406,9 @@ struct StateIdTranslation : boost::noncopyable {
 
   template <class A>
   void transferLabelsPartial(IHypergraph<A> const& ihg, IMutableHypergraph<A>& ohg) {
-    for (StateIdMap::value_type const& io : cache) ohg.setLabelPair(io.second, ihg.labelPair(io.first));
+    visitTranslations([&ihg, &ohg](StateId from, StateId to) {
+      if (to != kNoState) ohg.setLabelPair(to, ihg.labelPair(from));
+    });
   }
 
   template <class A>
@@ -380,7 +438,9 @@ struct StateIdTranslation : boost::noncopyable {
       o << "=Identity";
     } else {
       if (frozenMap) o << "(frozen)";
-      o << "= {" << printer(cache, Util::multiLine()) << "}";
+      o << "= {";
+      visitTranslations([&o](StateId from, StateId to) { o << "\n " << from << " -> " << to; });
+      o << "\n}";
     }
   }
 
@@ -21,12 +21,14 @@
 
 #include <sdl/Hypergraph/IHypergraph.hpp>
 #include <sdl/Hypergraph/InArcs.hpp>
+#include <sdl/Hypergraph/StructureCache.hpp>
 #include <sdl/Hypergraph/Types.hpp>
 #include <sdl/Util/LogHelper.hpp>
 #include <sdl/Util/ShrinkVector.hpp>
 #include <queue>
 #include <set>
 #include <stdexcept>
+#include <vector>
 
 namespace sdl {
 namespace Hypergraph {
@@ -57,6 +59,9 @@ struct PrintStatesVisitor : public IStatesVisitor {
    Traverses all states (that are reachable from the root) in
    topological order, calling the visitor on every state.
 
+   if the hg has a structureCache(), the order is computed once (then
+   visited) and reused until the hg's arcs change.
+
    TODO: Ignores cycles. TODO: Throw error on cycle.
 */
 template <class Arc>
@@ -93,7 +98,28 @@ class TopsortStatesTraversal {
     StateId final = hg_.final();
     if (final == Hypergraph::kNoState) return;
     assert(final < nStates_);
-    traverse(final);
+    if (StructureCache* cache = hg_.structureCache())
+      acceptCached(*cache, final, visitor);
+    else
+      traverse(final);
+  }
+
+  struct AppendStates : IStatesVisitor {
+    std::vector<StateId>& order;
+    explicit AppendStates(std::vector<StateId>& order) : order(order) {}
+    void visit(StateId s) { order.push_back(s); }
+  };
+
+  void acceptCached(StructureCache& cache, StateId final, IStatesVisitor* visitor) {
+    std::vector<StateId> order;
+    if (!cache.appendOrder(StructureCache::kTopsortFromFinal, final, nStates_, order)) {
+      AppendStates append(order);
+      visitor_ = &append;
+      traverse(final);
+      visitor_ = visitor;
+      cache.setOrder(StructureCache::kTopsortFromFinal, final, nStates_, order);
+    }
+    for (StateId s : order) visitor->visit(s);
   }
 
   // TODO@MD from JG: this uses O(path-length) stack. might be bad for many threads and (pathological) large
@@ -208,6 +234,164 @@ void visitGraphOutArcsTopsort(IHypergraph<Arc> const& hg, Visitor& visitor, std:
   }
 }
 
+/**
+   useful: the states in some derivation of final, i.e. reachable bottom-up
+   from the axioms (start and terminal-labeled states) and reachable from final
+   through in-arcs whose tails are all reachable. needs in-arcs. iterative (no
+   recursion on long chains)
+
+   \return whether every state is useful
+*/
+template <class Arc>
+bool usefulStates(IHypergraph<Arc> const& hg, StateSet& useful) {
+  StateId const N = hg.size();
+  useful.clear();
+  useful.resize(N);
+  // bottom-up reach: arcs are numbered in order of (head, in-arc), tailsLeft
+  // counts each arc's tails (with repeats) not yet reached
+  std::vector<std::size_t> firstArc(N + 1);
+  std::vector<std::size_t> nOut(N + 1);
+  for (StateId s = 0; s < N; ++s) {
+    firstArc[s + 1] = firstArc[s] + hg.numInArcs(s);
+    for (ArcId a = 0, na = hg.numInArcs(s); a != na; ++a)
+      for (StateId tail : hg.inArc(s, a)->tails())
+        if (tail < N) ++nOut[tail + 1];
+  }
+  std::size_t const nArcs = firstArc[N];
+  for (StateId s = 0; s < N; ++s) nOut[s + 1] += nOut[s];
+  std::vector<std::size_t> outArcs(nOut[N]);
+  std::vector<TailId> tailsLeft(nArcs);
+  std::vector<StateId> arcHead(nArcs);
+  std::vector<StateId> stack;
+  StateSet reached(N);
+  for (StateId s = 0; s < N; ++s)
+    for (ArcId a = 0, na = hg.numInArcs(s); a != na; ++a) {
+      std::size_t const arc = firstArc[s] + a;
+      arcHead[arc] = s;
+      for (StateId tail : hg.inArc(s, a)->tails())
+        if (tail < N) {
+          outArcs[nOut[tail]++] = arc;
+          ++tailsLeft[arc];
+        }
+      if (!tailsLeft[arc] && Util::latch(reached, s)) stack.push_back(s);
+    }
+  for (StateId s = N; s > 0; --s) nOut[s] = nOut[s - 1];  // back to the start of each tail's arcs
+  nOut[0] = 0;
+  for (StateId s = 0; s < N; ++s)
+    if (hg.isAxiom(s) && Util::latch(reached, s)) stack.push_back(s);
+  while (!stack.empty()) {
+    StateId const s = stack.back();
+    stack.pop_back();
+    for (std::size_t i = nOut[s], e = nOut[s + 1]; i != e; ++i) {
+      std::size_t const arc = outArcs[i];
+      if (!--tailsLeft[arc] && Util::latch(reached, arcHead[arc])) stack.push_back(arcHead[arc]);
+    }
+  }
+  // top-down from final through arcs whose tails are all reached
+  StateId const final = hg.final();
+  if (final < N && Util::test(reached, final)) {
+    useful.set(final);
+    stack.push_back(final);
+  }
+  StateId nUseful = (StateId)stack.size();
+  while (!stack.empty()) {
+    StateId const s = stack.back();
+    stack.pop_back();
+    for (ArcId a = 0, na = hg.numInArcs(s); a != na; ++a)
+      if (!tailsLeft[firstArc[s] + a])
+        for (StateId tail : hg.inArc(s, a)->tails())
+          if (tail < N && Util::latch(useful, tail)) {
+            ++nUseful;
+            stack.push_back(tail);
+          }
+  }
+  return nUseful == N;
+}
+
+/**
+   dfs (with an explicit stack) through in-arcs from head, coloring states 1
+   while on the dfs path and 2 when done. if useful, only arcs whose tails are
+   all useful are followed.
+
+   \return false if a cycle was found
+*/
+template <class Arc>
+bool acyclicFromHead(IHypergraph<Arc> const& hg, StateId head, std::vector<char>& color,
+                     StateSet const* useful = 0) {
+  struct Frame {
+    StateId state;
+    ArcId arc;
+    TailId tail;
+  };
+  std::vector<Frame> stack;
+  color[head] = 1;
+  stack.push_back(Frame{head, 0, 0});
+  while (!stack.empty()) {
+    Frame& f = stack.back();
+    if (f.arc == hg.numInArcs(f.state)) {
+      color[f.state] = 2;
+      stack.pop_back();
+      continue;
+    }
+    StateIdContainer const& tails = hg.inArc(f.state, f.arc)->tails();
+    if (useful && !f.tail)
+      for (StateId tail : tails)
+        if (!(tail < color.size() && Util::test(*useful, tail))) {
+          f.tail = (TailId)tails.size();  // skip arc
+          break;
+        }
+    if (f.tail == tails.size()) {
+      ++f.arc;
+      f.tail = 0;
+      continue;
+    }
+    StateId const tail = tails[f.tail++];
+    if (tail >= color.size()) continue;
+    char const c = color[tail];
+    if (c == 1) return false;
+    if (!c) {
+      color[tail] = 1;
+      stack.push_back(Frame{tail, 0, 0});
+    }
+  }
+  return true;
+}
+
+/**
+   \return true iff no useful state (see usefulStates) is on a cycle; a
+   head=tail self-loop counts as a cycle. cycles among states that aren't in
+   any derivation of final (e.g. left unreachable by pruning) don't count
+   unless allStates. needs in-arcs (unless the answer is in the hg's
+   structureCache()). trusts the kAcyclic property; when every state is
+   checked, sets it (mutable hg) and the structureCache() answer
+*/
+template <class Arc>
+bool isAcyclic(IHypergraph<Arc> const& hg, bool allStates = false) {
+  if (hg.properties() & kAcyclic) return true;
+  StructureCache* cache = hg.structureCache();
+  if (cache && cache->acyclic == StructureCache::kYes) return true;
+  if (!hg.storesInArcs())
+    SDL_THROW_LOG(Hypergraph.StatesTraversal, ConfigException, "isAcyclic needs incoming arcs");
+  StateId const N = hg.size();
+  std::vector<char> color(N);  // 0: unvisited, 1: on dfs path, 2: done
+  if (!allStates) {
+    StateSet useful;
+    if (!usefulStates(hg, useful)) {
+      StateId const final = hg.final();
+      return final >= N || !Util::test(useful, final) || acyclicFromHead(hg, final, color, &useful);
+    }
+  } else if (cache && cache->acyclic == StructureCache::kNo)
+    return false;
+  for (StateId s = 0; s < N; ++s)
+    if (!color[s] && !acyclicFromHead(hg, s, color)) {
+      if (cache) cache->acyclic = StructureCache::kNo;
+      return false;
+    }
+  if (cache) cache->acyclic = StructureCache::kYes;
+  if (hg.isMutable()) hg.promiseAcyclic();
+  return true;
+}
+
 template <class Arc, class Visitor>
 void visitTopsort(IHypergraph<Arc> const& hg, Visitor& visitor) {
   if (hg.storesInArcs())
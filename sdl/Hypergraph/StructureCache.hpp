@@ -0,0 +1,165 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    structure facts about a hypergraph that several passes over the same hg
+    (inside, outside, best path, pruning, push weights) would otherwise each
+    recompute from scratch: the state orders of TopsortStatesTraversal,
+    orderTailsLast and orderHeadsLast, and whether the hg has any cycle.
+
+    a MutableHypergraph keeps one if you enableStructureCache() (off by
+    default). it's maintained as arcs change:
+
+    - addArc keeps an order unless the order already visited the state the
+      new arc would be followed from (its head for in-arcs orders, a tail for
+      out-arcs orders); a known cycle stays known, and known-acyclic becomes
+      unknown (or known cyclic, for a self-loop).
+
+    - removing arcs drops all orders; known-acyclic stays known.
+
+    - anything else that changes arcs or adjacency order (renumbering states,
+      sorting or rebuilding adjacencies, notifyArcsModified, access to the
+      mutable ArcsContainer of a state) drops everything.
+
+    an order is keyed on its root (final or start) and number of states, so
+    changing final/start or adding states just makes it miss. a cached order
+    is exactly what recomputing would give (same adjacencies, same dfs).
+
+    like the kAcyclic property bit, this is updated through const access to
+    the hg, so don't enable it for an hg read by several threads at once.
+*/
+
+#ifndef HYP__HYPERGRAPH_STRUCTURECACHE_HPP
+#define HYP__HYPERGRAPH_STRUCTURECACHE_HPP
+#pragma once
+
+#include <sdl/Hypergraph/Types.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+
+struct StructureCache {
+  /// which traversal produced a cached order
+  enum OrderKind {
+    /// TopsortStatesTraversal (in-arcs dfs from final)
+    kTopsortFromFinal,
+    /// orderTailsLast (first-tail out-arcs dfs from start)
+    kTailsLastFromStart,
+    /// orderHeadsLast (in-arcs dfs from final)
+    kHeadsLastFromFinal,
+    kNumOrderKinds
+  };
+
+  enum Known { kUnknown, kNo, kYes };
+
+  struct Order {
+    bool valid;
+    StateId root, nStates;
+    std::size_t nBackEdges;
+    std::vector<StateId> states;
+    /// member[s] iff s in states (for addArc)
+    std::vector<char> member;
+
+    Order() : valid() {}
+
+    bool matches(StateId root_, StateId nStates_) const {
+      return valid && root == root_ && nStates == nStates_;
+    }
+
+    void set(StateId root_, StateId nStates_, std::size_t nBackEdges_) {
+      valid = true;
+      root = root_;
+      nStates = nStates_;
+      nBackEdges = nBackEdges_;
+      member.assign(nStates, 0);
+      for (StateId s : states)
+        if (s < nStates) member[s] = 1;
+    }
+
+    bool has(StateId s) const { return s < member.size() && member[s]; }
+
+    void drop() {
+      valid = false;
+      states.clear();
+      member.clear();
+    }
+  };
+
+  Known acyclic;
+  Order orders[kNumOrderKinds];
+  /// # of times a cached order was used instead of recomputed
+  std::size_t nReused;
+
+  StructureCache() : acyclic(kUnknown), nReused() {}
+
+  /**
+     \return false if there's no cached order (with at most maxBackEdges back
+     edges), else append it to states (a copy, so it stays valid even if the
+     hg is modified while the caller visits it)
+  */
+  bool appendOrder(OrderKind kind, StateId root, StateId nStates, std::vector<StateId>& states,
+                   std::size_t* nBackEdges = 0, std::size_t maxBackEdges = (std::size_t)-1) {
+    Order const& o = orders[kind];
+    if (!o.matches(root, nStates) || o.nBackEdges > maxBackEdges) return false;
+    ++nReused;
+    if (nBackEdges) *nBackEdges = o.nBackEdges;
+    states.insert(states.end(), o.states.begin(), o.states.end());
+    return true;
+  }
+
+  /// remember states as the kind order
+  void setOrder(OrderKind kind, StateId root, StateId nStates, std::vector<StateId> const& states,
+                std::size_t nBackEdges = 0) {
+    Order& o = orders[kind];
+    o.states = states;
+    o.set(root, nStates, nBackEdges);
+  }
+
+  void arcAdded(StateId head, StateIdContainer const& tails) {
+    for (StateId t : tails)
+      if (t == head) {
+        acyclic = kNo;
+        break;
+      }
+    if (acyclic == kYes) acyclic = kUnknown;
+    Order& fromFinal = orders[kTopsortFromFinal];
+    if (fromFinal.has(head)) fromFinal.drop();
+    Order& headsLast = orders[kHeadsLastFromFinal];
+    if (headsLast.has(head)) headsLast.drop();
+    Order& tailsLast = orders[kTailsLastFromStart];
+    for (StateId t : tails)
+      if (tailsLast.has(t)) {
+        tailsLast.drop();
+        break;
+      }
+  }
+
+  void arcsRemoved() {
+    if (acyclic == kNo) acyclic = kUnknown;
+    dropOrders();
+  }
+
+  void dropOrders() {
+    for (Order& o : orders) o.drop();
+  }
+
+  void clear() {
+    acyclic = kUnknown;
+    dropOrders();
+  }
+};
+
+
+}}
+
+#endif
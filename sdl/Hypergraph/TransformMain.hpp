@@ -25,8 +25,14 @@
    TODO: make instantiated best-path-printing for each ArcTpl<Weight> so it's not compiled for each cmdline
    prog
 
-   TODO: separator for multiple HG output to same file '\0' or other? and for multiple HG input from same
-   file?
+   streaming: with --stream-hgs the first input is a sequence of text-format
+   hypergraphs separated by '-----' lines (kHypergraphSeparatorLine). each is
+   parsed, transformed, and its output written and flushed before the next is
+   read; the other inputs (e.g. the right side of compose) stay resident. so
+   memory is bounded by the largest single input, and output hypergraphs are
+   separated the same way so another hyp --stream-hgs can consume them:
+
+   hyp compose --stream-hgs lattices.hgs grammar.hg | hyp prunetobest --stream-hgs | hyp best --stream-hgs
 
    Transform.hpp provides caching of weight-specific setup across invocations
    (but doesn't handle command line); since we so far run for one arc/weight
@@ -64,8 +70,10 @@
 #include <sdl/Hypergraph/Weight.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
 #include <sdl/Hypergraph/WeightsFwdDecls.hpp>
+#include <sdl/Util/Arena.hpp>
 #include <sdl/Util/Flag.hpp>
 #include <sdl/Util/LogHelper.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/PrintRange.hpp>
 #include <sdl/Util/StringBuilder.hpp>
 #include <sdl/LexicalCast.hpp>
@@ -105,6 +113,7 @@ struct TransformMainBase : HypergraphMainBase {
  protected:
   void init() {
     firstInputFileHasMultipleHgs = false;
+    arenaPerInput = false;
     logname = "sdl.Hypergraph.TransformMain";
   }
 
@@ -177,10 +186,15 @@ struct TransformMainBase : HypergraphMainBase {
       c("reload", &reloadOnMultiple)(
           "for each of the inputs, re-read the rest of the transducers again each time (saves memory) if "
           "there are more than 2 inputs");
+    c("arena", &arenaPerInput)
+        .defaulted()(
+            "allocate each input's arcs, derivations, feature maps and compose intermediates from a monotonic "
+            "arena that's freed all at once after its output (ignored if inputs 2...n are kept resident)");
   }
 
   bool firstInputFileHasMultipleHgs;  // multiple inputs[0] lines or hgs
   bool reloadOnMultiple;  // for inputs 2...n, free then re-parse for each input (saves memory if n is large)
+  bool arenaPerInput;
 
   void finish_configure_more() override {
     this->configurable(this);
@@ -252,6 +266,12 @@ struct TransformMain : TransformMainBase {
 
   void before_finish_configure() override { configureInputs(); }
 
+  /// not a configure-library validate: that runs from a destructor, where a throw terminates
+  void validate_parameters_extra() override {
+    TransformMainBase::validate_parameters_extra();
+    optInputs.validate();
+  }
+
   OD inputOptDesc;
   CRTP& impl() { return *static_cast<CRTP*>(this); }
   CRTP const& impl() const { return *static_cast<CRTP const*>(this); }
@@ -418,6 +438,18 @@ struct TransformMain : TransformMainBase {
     CRTP& impl() { return main.impl(); }
     CRTP const& impl() const { return main.impl(); }
 
+    void clear() {
+      for (Hp& h : cascade) h.reset();
+    }
+
+    /// clear() when leaving a scope early (so no hg outlives its --arena scope)
+    struct ClearOnExit {
+      Cascade* cascade;
+      ~ClearOnExit() {
+        if (cascade) cascade->clear();
+      }
+    };
+
     // cascade[0] is an in/out hg.
     bool transformInput(unsigned inputLine, bool reload, bool free) {
       Hp olast;  // o: recent output
@@ -472,13 +504,24 @@ struct TransformMain : TransformMainBase {
         bool finalok = impl().transform1InplaceP(olast);
         if (!finalok) return false;
       }
-      if (impl().printFinal()) {
-        main.optBestOutputs.output(main.out(), *olast, graehl::utos(inputLine));
-      }
+      if (impl().printFinal()) main.printOutput(*olast, inputLine);
       return true;
     }
   };
 
+  std::size_t nOutputs;
+
+  /// with streamHgs, output hgs are separated by kHypergraphSeparatorLine and flushed as soon as they're done
+  template <class Arc>
+  void printOutput(IHypergraph<Arc> const& hg, std::size_t inputLine) {
+    std::ostream& o = out();
+    bool const streaming = optInputs.streamHgs;
+    if (streaming && nOutputs && optBestOutputs.printsHypergraph()) o << kHypergraphSeparatorLine << '\n';
+    ++nOutputs;
+    optBestOutputs.output(o, hg, graehl::utos(inputLine));
+    if (streaming) o.flush();
+  }
+
   /// Override if desired: it's guaranteed that impl().prepare will be
   /// called for exactly one Arc type - the same as in all the
   /// transform* calls.  this may e.g. create a TransformHolder or
@@ -495,15 +538,25 @@ struct TransformMain : TransformMainBase {
 
     bool t3 = inputs.size() > 2 && impl().has2();
     bool reload = (t3 && reloadOnMultiple);
-    bool free = optInputs.single() || reload;
+    // streaming: keep inputs 2...n resident across the sequence of first inputs
+    bool free = (optInputs.single() && !optInputs.streamHgs) || reload;
+    nOutputs = 0;
 
     Cascade<Weight> cascade(*this);
 
     typedef shared_ptr<IMutableHypergraph<Arc>> Hp;
     Hp& h = cascade.cascade[0];
+    // every hg of an input must be gone before its arena scope closes
+    bool const useArena = arenaPerInput && (free || cascade.cascade.size() == 1);
+    if (arenaPerInput && !useArena)
+      SDL_WARN(Hypergraph.TransformMain, "ignoring --arena because inputs 2..." << cascade.cascade.size()
+                                                                                << " are kept resident");
+    Util::Arena arena;
     bool allok = true;
     unsigned ninputs = 0;
     for (;;) {
+      Util::ArenaScope arenaScope(useArena ? &arena : 0);
+      typename Cascade<Weight>::ClearOnExit clearOnExit = {useArena ? &cascade : 0};
       h.reset(new MutableHypergraph<Arc>(inputProperties(0)));
       SDL_TRACE(TransformMain, "reading hypergraph with properties " << PrintProperties(h->properties()));
       h->setVocabulary(this->vocab());
@@ -517,6 +570,12 @@ struct TransformMain : TransformMainBase {
         SDL_TRACE(Hypergraph.TransformMain, "input: " << input << ", post-transform");
       }
       if (!cascade.transformInput((unsigned)optInputs.lineno, reload, free)) allok = false;
+      if (useArena) {
+        cascade.clear();
+        SDL_METRIC_OBSERVE(hyp_arena_bytes_per_input, "bytes allocated from the --arena per input",
+                           arena.bytesAllocated());
+        arena.release();  // nothing of this input is left to free
+      }
     }
     return allok && ninputs;
   }
@@ -28,7 +28,9 @@
 
 #include <sdl/Hypergraph/Weight.hpp>
 #include <sdl/Hypergraph/WeightsFwdDecls.hpp>
+#include <sdl/Util/LogSumExp.hpp>
 #include <cmath>
+#include <vector>
 
 namespace sdl {
 namespace Hypergraph {
@@ -138,6 +140,39 @@ inline void plusBy(W const& b, W& a) {
   PlusBy<W>::plusBy(b, a);
 }
 
+/**
+   sum many weights into one: start(sum), add(w) for each, finish(). the
+   default just calls plusBy as you go. weights with a batched plus
+   (Util::neglogSum for log semiring) specialize this to defer the work to
+   finish(). keep one of these around (e.g. as a member of a states visitor) to
+   reuse its buffers.
+*/
+template <class W, class Enable = void>
+struct BatchPlusBy {
+  void start(W& sum) { sum_ = &sum; }
+  void add(W const& w) { plusBy(w, *sum_); }
+  void finish() {}
+
+ private:
+  W* sum_;
+};
+
+template <class T>
+struct BatchPlusBy<LogWeightTpl<T>, void> {
+  typedef LogWeightTpl<T> W;
+  void start(W& sum) {
+    sum_ = &sum;
+    costs_.clear();
+    costs_.push_back(sum.value_);
+  }
+  void add(W const& w) { costs_.push_back(w.value_); }
+  void finish() { sum_->value_ = Util::neglogSum(costs_); }
+
+ private:
+  W* sum_;
+  std::vector<T> costs_;
+};
+
 
 /**
    timesBy(delta, accum) is faster for any Weight with:
@@ -77,6 +77,13 @@ struct WeightIdempotentPlus<FeatureWeightTpl<FloatT, MapT, TakeMin>> : IsIdempot
 
 // TODO: figure out whether any others are idempotent-plus
 
+/// Weight is ViterbiWeightTpl (plain real-valued (min, +) costs)
+template <class Weight>
+struct IsViterbiWeight : std::false_type {};
+
+template <class F>
+struct IsViterbiWeight<ViterbiWeightTpl<F>> : std::true_type {};
+
 // plus/times
 
 BlockWeight plus(BlockWeight const&, BlockWeight const&);
@@ -0,0 +1,274 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    CompactFst: an fsm hypergraph's arcs copied into one array of
+    CompactFstArc {head, src, label, weight} grouped by src state (16 bytes
+    for Viterbi/Log weight with 32-bit StateId, vs. a heap-allocated ArcTpl with
+    vtable and StateIdContainer behind an ArcsContainer pointer). a drop-in for
+    HypergraphFst as the input of fs::compose or LazyBest; CompactMatchFst
+    (arcs sorted by input label, found by binary search) for the match side.
+
+    chosen by LazyBestOptions (and so FstComposeOptions) dense-arc-copy: see
+    fstCompactible. this is a cache-density option, not a memory saving: the
+    copy is made alongside the hypergraph, so it costs memory to make the
+    search's arc reads contiguous. fs::compose copies only its input this way;
+    a ComposeTransform composing its fst with more than one input builds the
+    fst's CompactMatchFst once, shared by all threads (fs::composeWithMatchFst).
+
+    levels, heuristics and the vocabulary still come from the hypergraph, which
+    must outlive this (as for HypergraphFst). annotations aren't kept.
+*/
+
+#ifndef SDL_HYPERGRAPH_FS_COMPACTFST_HPP
+#define SDL_HYPERGRAPH_FS_COMPACTFST_HPP
+#pragma once
+
+#include <sdl/Hypergraph/IHypergraph.hpp>
+#include <sdl/Hypergraph/LabelPair.hpp>
+#include <sdl/Hypergraph/Weight.hpp>
+#include <sdl/Hypergraph/fs/Fst.hpp>
+#include <sdl/Util/Generator.hpp>
+#include <sdl/Vocabulary/SpecialSymbols.hpp>
+#include <sdl/Exception.hpp>
+#include <sdl/SharedPtr.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+namespace fs {
+
+template <class WeightT>
+struct CompactFstArc {
+  typedef WeightT Weight;
+  StateId head;
+  StateId src;
+  /// index into CompactFst::labels: the lexical tail state, or past those, a label pair for arcs without one
+  StateId label;
+  Weight weight;
+};
+
+#if !SDL_64BIT_STATE_ID
+static_assert(sizeof(CompactFstArc<ViterbiWeightTpl<float>>) == 16, "CompactFstArc should be 16 bytes");
+#endif
+
+/**
+   \return whether CompactFst can stand in for HypergraphFst(hg, annotations):
+   hg is fsm-like and, if annotations, has no annotation labels.
+*/
+template <class Arc>
+bool fstCompactible(IHypergraph<Arc> const& hg, bool annotations) {
+  if (!hg.isFsmLike()) return false;
+#if SDL_HYPERGRAPH_FS_ANNOTATIONS
+  if (annotations)
+    for (StateId s = 0, n = hg.sizeForLabels(); s < n; ++s)
+      if (Vocabulary::isAnnotation(hg.inputLabel(s))) return false;
+#endif
+  return true;
+}
+
+template <class HgArcT>
+struct CompactFst : HypergraphFst<HgArcT> {
+  typedef StateId State;
+  typedef HgArcT HgArc;
+  typedef typename HgArc::Weight Weight;
+  typedef FstArc<Weight, State> Arc;
+  typedef typename Weight::FloatT Distance;
+  typedef IHypergraph<HgArc> Hg;
+  typedef HypergraphFst<HgArc> Base;
+  typedef CompactFstArc<Weight> CompactArc;
+  typedef std::vector<CompactArc> CompactArcs;
+
+  /// out arcs [i, end) of a state as FstArc
+  struct Arcs : Util::GeneratorBase<Arcs, Arc, Util::NonPeekableT> {
+    typedef Arc result_type;
+    CompactArc const *i, *end;
+    LabelPair const* labels;
+    Arcs() : i(), end(), labels() {}
+    Arcs(CompactArc const* i, CompactArc const* end, LabelPair const* labels) : i(i), end(end), labels(labels) {}
+    operator bool() const { return i != end; }
+    Arc operator()() {
+      CompactArc const& arc = *i++;
+      Arc r;
+      r.dst = arc.head;
+      r.labelPair = labels[arc.label];
+      r.weight = arc.weight;
+      return r;
+    }
+  };
+
+  /**
+     \param annotations if true, hg may not have annotation labels (see
+     fstCompactible) since CompactFstArc has no room for them
+  */
+  explicit CompactFst(shared_ptr<Hg const> const& pHg, bool annotations = true) { init(pHg, annotations); }
+  explicit CompactFst(Hg const& hg, bool annotations = true) { init(ptrNoDelete(hg), annotations); }
+
+  Arcs outArcs(StateId s) const {
+    assert(s != kNoState);
+    if (s + 1 >= firstOut.size()) return Arcs();
+    return Arcs(arcs.data() + firstOut[s], arcs.data() + firstOut[s + 1], labels.data());
+  }
+
+  ArcId numOutArcs(StateId s) const { return s + 1 < firstOut.size() ? firstOut[s + 1] - firstOut[s] : 0; }
+
+  /// all arcs, grouped by src in state order
+  CompactArcs const& compactArcs() const { return arcs; }
+
+  LabelPair const& labelPair(CompactArc const& arc) const { return labels[arc.label]; }
+
+  /// bytes of arcs, labels and offsets
+  std::size_t bytes() const {
+    return arcs.capacity() * sizeof(CompactArc) + labels.capacity() * sizeof(LabelPair)
+           + firstOut.capacity() * sizeof(ArcId);
+  }
+
+ protected:
+  CompactFst() {}
+
+  void init(shared_ptr<Hg const> const& pHg, bool annotations) {
+    Base::init(pHg, false);
+    Hg const& hg = *pHg;
+    if (annotations && !fstCompactible(hg, annotations))
+      SDL_THROW_LOG(Hypergraph.fs.CompactFst, ConfigException,
+                    "CompactFst can't keep annotations - use HypergraphFst");
+    StateId const N = hg.size();
+    StateId const nLabels = hg.sizeForLabels();
+    labels.resize(nLabels + 1);
+    for (StateId s = 0; s < nLabels; ++s) labels[s] = hg.labelPair(s);
+    StateId const epsLabel = nLabels;
+    labels[epsLabel] = getEpsilonLabelPair();
+
+    arcs.reserve(hg.estimatedNumEdges());
+    firstOut.assign(N + 1, 0);
+    if (hg.storesOutArcs()) {
+      // keep each state's out-arc order (e.g. best-first or by input label)
+      for (StateId s = 0; s < N; ++s) {
+        firstOut[s] = (ArcId)arcs.size();
+        for (ArcId a = 0, f = hg.numOutArcs(s); a < f; ++a) {
+          HgArc const* arc = hg.outArc(s, a);
+          if (arc->tails_[0] == s) add(arc, epsLabel, nLabels);
+        }
+      }
+      firstOut[N] = (ArcId)arcs.size();
+    } else {
+      hg.forArcsSafe([&](HgArc const* arc) { add(arc, epsLabel, nLabels); });
+      groupBySrc(N);
+    }
+  }
+
+  void add(HgArc const* arc, StateId epsLabel, StateId nLabels) {
+    CompactArc r;
+    r.head = arc->head_;
+    StateIdContainer const& tails = arc->tails_;
+    r.src = tails[0];
+    r.weight = arc->weight_;
+    if (tails.size() == 2)
+      r.label = tails[1] < nLabels ? tails[1] : epsLabel;
+    else {
+      LabelPair const labelPair = this->hg().firstLexicalLabelPairOrEps(arc);
+      if (labelPair == labels[epsLabel])
+        r.label = epsLabel;
+      else {
+        r.label = (StateId)labels.size();
+        labels.push_back(labelPair);
+      }
+    }
+    arcs.push_back(r);
+  }
+
+  /// stable counting sort of arcs by src, setting firstOut
+  void groupBySrc(StateId N) {
+    for (CompactArc const& arc : arcs) ++firstOut[arc.src + 1];
+    for (StateId s = 0; s < N; ++s) firstOut[s + 1] += firstOut[s];
+    CompactArcs grouped(arcs.size());
+    std::vector<ArcId> next(firstOut.begin(), firstOut.end() - 1);
+    for (CompactArc const& arc : arcs) grouped[next[arc.src]++] = arc;
+    arcs.swap(grouped);
+  }
+
+  CompactArcs arcs;
+  /// arcs of state s are [firstOut[s], firstOut[s+1])
+  std::vector<ArcId> firstOut;
+  /// labels[s] = hg.labelPair(s) for s < hg.sizeForLabels(); then epsilon, then any others
+  std::vector<LabelPair> labels;
+};
+
+/**
+   CompactFst as the match fst of compose (as HypergraphMatchFst): each
+   state's arcs sorted by input label.
+*/
+template <class HgArcT>
+struct CompactMatchFst : CompactFst<HgArcT> {
+  typedef CompactFst<HgArcT> Base;
+  typedef typename Base::Hg Hg;
+  typedef typename Base::Arcs Matches;
+  typedef typename Base::CompactArc CompactArc;
+  typedef typename Base::Distance Distance;
+  typedef StateId State;
+
+  CompactMatchFst(Hg const& hg, WhichFstComposeSpecials which = WhichFstComposeSpecials::undefined()) {
+    init(ptrNoDelete(hg), which);
+  }
+  CompactMatchFst(shared_ptr<Hg const> const& pHg,
+                  WhichFstComposeSpecials which = WhichFstComposeSpecials::undefined()) {
+    init(pHg, which);
+  }
+
+  /// as HypergraphMatchFst
+  Level combinedLevel(Level inputLevel, State st) const {
+    if (this->nLevels == 1 || inputLevel == kNoLevel) return inputLevel;
+    Level const matchLevel = this->level(st);
+    return matchLevel == kNoLevel ? kNoLevel : (inputLevel * this->nLevels) + matchLevel;
+  }
+
+  /// arcs of s with input label in (binary search)
+  Matches arcsMatchingInput(StateId s, Sym in) const {
+    if (s == kNoState || s + 1 >= this->firstOut.size()) return Matches();
+    CompactArc const* begin = this->arcs.data() + this->firstOut[s];
+    CompactArc const* end = this->arcs.data() + this->firstOut[s + 1];
+    InputLess less(this->labels.data());
+    return Matches(std::lower_bound(begin, end, in, less), std::upper_bound(begin, end, in, less),
+                   this->labels.data());
+  }
+
+  /// (binary search is already over contiguous arcs)
+  void indexMatches(std::size_t) {}
+
+  WhichFstComposeSpecials whichSpecials;
+
+ private:
+  struct InputLess {
+    LabelPair const* labels;
+    explicit InputLess(LabelPair const* labels) : labels(labels) {}
+    bool operator()(CompactArc const& a, Sym in) const { return labels[a.label].first < in; }
+    bool operator()(Sym in, CompactArc const& a) const { return in < labels[a.label].first; }
+    bool operator()(CompactArc const& a, CompactArc const& b) const {
+      return labels[a.label].first < labels[b.label].first;
+    }
+  };
+
+  void init(shared_ptr<Hg const> const& pHg, WhichFstComposeSpecials which) {
+    Base::init(pHg, false);
+    whichSpecials = which.defined() ? which : pHg->whichInputFstComposeSpecials();
+    if (pHg->properties() & kSortedOutArcs && pHg->storesOutArcs()) return;
+    InputLess less(this->labels.data());
+    for (StateId s = 0, N = (StateId)this->firstOut.size() - 1; s < N; ++s)
+      std::stable_sort(this->arcs.begin() + this->firstOut[s], this->arcs.begin() + this->firstOut[s + 1],
+                       less);
+  }
+};
+
+
+}}}
+
+#endif
@@ -19,7 +19,10 @@
     labels only.
 
     M2 is a "Match" fst - it provides generators of out arcs from a state matching a
-    given input symbol (including special symbols <eps> <phi> <sigma> <rho>)
+    given input symbol (including special symbols <eps> <phi> <sigma> <rho>).
+    HypergraphMatchFst does this by binary search over sorted out-arcs, or in
+    O(1) for states with many out-arcs (see OutArcsMatchIndex.hpp and option
+    match-index-min-arcs)
 
     notation:
 
@@ -103,14 +106,18 @@
 #include <sdl/Hypergraph/Exception.hpp>
 #include <sdl/Hypergraph/IMutableHypergraph.hpp>
 #include <sdl/Hypergraph/MixFeature.hpp>
+#include <sdl/Hypergraph/OutArcsMatchIndex.hpp>
 #include <sdl/Hypergraph/SortArcs.hpp>
 #include <sdl/Hypergraph/WeightUtil.hpp>
 #include <sdl/Hypergraph/WeightsFwdDecls.hpp>
+#include <sdl/Hypergraph/fs/CompactFst.hpp>
 #include <sdl/Hypergraph/fs/Fst.hpp>
 #include <sdl/Hypergraph/fs/LazyBest.hpp>
 #include <sdl/Hypergraph/fs/SaveFst.hpp>
+#include <sdl/Util/Arena.hpp>
 #include <sdl/Util/FlattenGenerators.hpp>
 #include <sdl/Util/LogHelper.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/RefCount.hpp>
 #include <sdl/Util/SharedGenerator.hpp>
 #include <sdl/Util/Valgrind.hpp>
@@ -132,7 +139,9 @@ struct FstComposeOptions : SaveFstOptions {
       , allowDuplicatePaths(false)
       , sortBestFirst(true)
       , epsilonMatchingFilter(true)
-      , allowDuplicatePathsIf1Best(false) {}
+      , allowDuplicatePathsIf1Best(false)
+      , matchIndexMinArcs(64)
+      , beamMatchLevels(true) {}
 
   template <class Arc>
   bool willLazyFsCompose(Hypergraph::IHypergraph<Arc> const& hg) const {
@@ -161,6 +170,15 @@ struct FstComposeOptions : SaveFstOptions {
             "allow-duplicate-paths only if prune-to-nbest=1 (because the downside of allow-duplicate-paths "
             "is "
             "extra paths)");
+    config("match-index-min-arcs", &matchIndexMinArcs)
+        .defaulted()(
+            "states of the 2nd (match) fst with at least this many out-arcs get a hash (or dense) index "
+            "from input label to arcs, built once per compose, instead of a binary search per lookup. 0 "
+            "means never");
+    config("beam-match-levels", &beamMatchLevels)
+        .defaulted()(
+            "for beam/max-states-per-level: levels are (input level, match level) pairs if the match fst is "
+            "acyclic (false: input levels only, which saves levelizing the match fst)");
     config("mix-fst", &mix)(
         "a MixFeature for scaling the fst1 arc weight into the fst2 arc weight (and assigning feature id if "
         "fst1 is FeatureWeight). if fst1 and fst2 are both FHG, then you have fst1*(fst^scale) - the "
@@ -172,6 +190,8 @@ struct FstComposeOptions : SaveFstOptions {
   bool allowDuplicatePaths, allowDuplicatePathsIf1Best;
   bool sortBestFirst;
   bool epsilonMatchingFilter;
+  std::size_t matchIndexMinArcs;
+  bool beamMatchLevels;
   bool allowDuplicatesEffective() const {
     return allowDuplicatePaths || allowDuplicatePathsIf1Best && pruneToNbest == 1;
   }
@@ -355,10 +375,12 @@ struct HypergraphMatchFst : HypergraphFst<ArcT> {
   /**
      if we know levels of input and match (both are acyclic), then we can do
      perfect beamed search. of course, we might want to use per-input-level
-     beams only (which is fine
+     beams only (which is fine - then don't computeLevels() on the match)
   */
   Level combinedLevel(Level inputLevel, State st) const {
-    return this->nLevels == 1 ? inputLevel : (inputLevel * this->nLevels) + this->level(st);
+    if (this->nLevels == 1 || inputLevel == kNoLevel) return inputLevel;
+    Level const matchLevel = this->level(st);
+    return matchLevel == kNoLevel ? kNoLevel : (inputLevel * this->nLevels) + matchLevel;
   }
 
   Hg const& hg() const { return static_cast<Hg const&>(*this->pHg); }
@@ -386,10 +408,23 @@ struct HypergraphMatchFst : HypergraphFst<ArcT> {
   */
   typedef typename Base::Arcs Matches;
   Matches arcsMatchingInput(StateId s, Sym in) const {
+    OutArcsMatchRange range;
+    if (matchIndex.find(s, in, range)) {
+      if (range.empty()) return Matches(typename Base::HgArcs(), this->arcFn);
+      ArcsContainer const& arcs = *hg().maybeOutArcs(s);
+      return Matches(typename Base::HgArcs(arcs.begin() + range.begin, arcs.begin() + range.end), this->arcFn);
+    }
     return Matches(hg().outArcsMatchingInput(s, in), this->arcFn);
   }
 
+  /**
+     index (for arcsMatchingInput) the states with at least minArcs out-arcs
+     (0: none).
+  */
+  void indexMatches(std::size_t minArcs) { matchIndex.init(hg(), minArcs); }
+
   WhichFstComposeSpecials whichSpecials;
+  OutArcsMatchIndex matchIndex;
 
  protected:
   template <class Hg>
@@ -635,10 +670,12 @@ struct ComposeFst : TimesFn {
      2b: a:b b:c => a:c, else sigma:c
      3: (if no matches at all in 2b), <phi>:...
   */
-  struct ArcsGenGen : Util::intrusive_refcount<ArcsGenGen, unsigned>,
+  struct ArcsGenGen : Util::intrusive_refcount<ArcsGenGen, unsigned, Util::ArenaUserAllocator>,
                       Util::GeneratorBase<ArcsGenGen, ArcsGen, Util::NonPeekableT>,
+                      Util::ArenaAllocated,
                       Times
-  // non-atomic count because these are only held by one thread
+  // non-atomic count because these are only held by one thread. one per expanded state, so from the
+  // thread's Util::ArenaScope arena if any
   {
     typedef ArcsGen result_type;
     enum ConcatState { matchEpsilon, matchRegular, matchDone };
@@ -676,7 +713,7 @@ struct ComposeFst : TimesFn {
           if (matchSym == EPSILON::ID) {
             // input epsilons don't cause us to exclude a phi in the match transducer.
             if (filter.allowInputMatchEpsilon()
-                && (r.matchedArcs = match->arcsMatchingInput(src.match, matchSym))) {
+                && (++nMatchProbes, r.matchedArcs = match->arcsMatchingInput(src.match, matchSym))) {
               filter.inputMatchEpsilon();
               assert(filter.allowInputEpsilon());
               // will also generate input epsilon (permitted by all 3 filters)
@@ -687,6 +724,7 @@ struct ComposeFst : TimesFn {
             } else
               continue;  // skip this arc; filter doesn't allow input epsilon
           } else {
+            ++nMatchProbes;
             if ((r.matchedArcs = match->arcsMatchingInput(src.match, matchSym)))
               anyStandardMatch = true;  // will initSigma inside r after standard are exhausted
             else if (r.initRho() || r.initSigma()) {
@@ -699,6 +737,8 @@ struct ComposeFst : TimesFn {
       }
 
       concatState = matchDone;
+      SDL_METRIC_ADD(hyp_fs_compose_match_probes, "fs::compose lookups of match-fst arcs by input symbol",
+                     nMatchProbes);
       if (!anyStandardMatch && filter.allowMatchEpsilon() && match->whichSpecials.test(PHI::id)
           && (r.matchedArcs = match->arcsMatchingInput(src.match, PHI::ID))) {
         filter.matchEpsilon();
@@ -728,6 +768,7 @@ struct ComposeFst : TimesFn {
         , match(match)
         , concatState(matchEpsilon)
         , anyStandardMatch()
+        , nMatchProbes()
         , epsilon(match->whichSpecials.test(EPSILON::id) && src.allowMatchEpsilon()
                       ? match->arcsMatchingInput(src.match, EPSILON::ID)
                       : MatchArcs())  // nonconsuming wildcard
@@ -737,6 +778,7 @@ struct ComposeFst : TimesFn {
     MatchPtr match;
     ConcatState concatState;  // because we want to emit 3 different types of arcs
     bool anyStandardMatch;
+    std::size_t nMatchProbes;  // lookups by input-arc symbol; recorded once all are done
     MatchArcs epsilon;  // we don't save phi because it's not subject to reuse; it's the last thing we do
     friend inline std::ostream& operator<<(std::ostream& out, ArcsGenGen const& self) {
       out << "ArcsGenGen[";
@@ -769,10 +811,7 @@ struct ComposeFst : TimesFn {
 
   bool final(State const& st) const { return input->final(st.input) && match->final(st.match); }
 
-  Level level(State const& st) const {
-    return input->level(st.input);
-    // TODO: return match->combinedLevel(input->level(st.input), st.match);
-  }
+  Level level(State const& st) const { return match->combinedLevel(input->level(st.input), st.match); }
 
   Distance heuristic(State const& st) const {
     return input->heuristic(st.input) + match->heuristic(st.match);
@@ -794,24 +833,65 @@ struct AllowDuplicateFilter<Weight, typename std::enable_if<WeightIdempotentPlus
 };
 
 
-template <template <class> class FstForArc, class Filter, class InHg, class MatchHg, class ArcOut>
-void composeWithEpsilonFilterImpl(InHg const& inHg, MatchHg& matchHg, IMutableHypergraph<ArcOut>* outHg,
-                                  FstComposeOptions const& opt,
-                                  WhichFstComposeSpecials which = WhichFstComposeSpecials::undefined()) {
-  typedef typename InHg::Arc Arc1;
-  typedef typename MatchHg::Arc Arc2;
-  IVocabularyPtr const& vocab = matchHg.getVocabulary();
+/**
+   compose lazy fsts input and match (e.g. a DeterminizeFst from
+   Determinize.hpp), saving the result per opt. match must have whichSpecials,
+   arcsMatchingInput and indexMatches as HypergraphMatchFst.
+*/
+template <class Filter, class Input, class Match, class ArcOut>
+void composeFstsWithEpsilonFilter(shared_ptr<Input> const& input, shared_ptr<Match> const& match,
+                                  IMutableHypergraph<ArcOut>* outHg, FstComposeOptions const& opt) {
+  IVocabularyPtr const& vocab = match->getVocabulary();
   outHg->setVocabulary(vocab);
-  if (vocab != inHg.getVocabulary())
+  if (vocab != input->getVocabulary())
     SDL_THROW_LOG(Hypergraph.fs.Compose, ConfigException, "input*match FST compose vocabularies must match");
-  typedef FstForArc<Arc1> Input;
-  typedef HypergraphMatchFst<Arc2> Match;
-  typedef ComposeFst<Input, Match, Filter, TimesByMix<typename Arc1::Weight, typename Arc2::Weight>> ComposedLazy;
+  typedef ComposeFst<Input, Match, Filter, TimesByMix<typename Input::Weight, typename Match::Weight>>
+      ComposedLazy;
   ComposedLazy composedLazy;
-  composedLazy.input.reset(new Input(inHg, opt.annotations));
-  composedLazy.match.reset(new Match(matchHg, which));
+  composedLazy.input = input;
+  composedLazy.match = match;
+  if (opt.usingBeam()) {
+    composedLazy.input->computeLevels();
+    if (opt.beamMatchLevels) composedLazy.match->computeLevels();
+    if (opt.beamHeuristic) {
+      composedLazy.input->computeHeuristics();
+      composedLazy.match->computeHeuristics();
+    }
+  }
+  composedLazy.match->indexMatches(opt.matchIndexMinArcs);
   composedLazy.mix = opt.mix;
   saveFst(composedLazy, *outHg, opt);
+  SDL_METRIC_ADD(hyp_fs_compose_runs, "fs::compose calls", 1);
+  SDL_METRIC_ADD(hyp_fs_compose_states, "states created by fs::compose", outHg->size());
+  SDL_METRIC_ADD(hyp_fs_compose_arcs, "arcs created by fs::compose", outHg->getNumEdges());
+}
+
+/**
+   compose lazy fst input (e.g. HypergraphFst, or UnionFst from Rational.hpp)
+   with matchHg, saving the result per opt.
+*/
+template <class Filter, class Input, class MatchHg, class ArcOut>
+void composeInputFstWithEpsilonFilter(shared_ptr<Input> const& input, MatchHg& matchHg,
+                                      IMutableHypergraph<ArcOut>* outHg, FstComposeOptions const& opt,
+                                      WhichFstComposeSpecials which = WhichFstComposeSpecials::undefined()) {
+  typedef HypergraphMatchFst<typename MatchHg::Arc> Match;
+  composeFstsWithEpsilonFilter<Filter>(input, make_shared<Match>(matchHg, which), outHg, opt);
+}
+
+template <template <class> class FstForArc, class Filter, class InHg, class MatchHg, class ArcOut>
+void composeWithEpsilonFilterImpl(InHg const& inHg, MatchHg& matchHg, IMutableHypergraph<ArcOut>* outHg,
+                                  FstComposeOptions const& opt,
+                                  WhichFstComposeSpecials which = WhichFstComposeSpecials::undefined()) {
+  // (the match side stays a HypergraphMatchFst: a CompactMatchFst copy per call would cost more than it
+  // saves - a ComposeTransform reusing its fst keeps one instead, see composeWithMatchFst)
+  if (opt.denseArcCopy && fstCompactible(inHg, opt.annotations)) {
+    composeInputFstWithEpsilonFilter<Filter>(make_shared<CompactFst<typename InHg::Arc>>(inHg, opt.annotations),
+                                             matchHg, outHg, opt, which);
+    return;
+  }
+  typedef FstForArc<typename InHg::Arc> Input;
+  composeInputFstWithEpsilonFilter<Filter>(make_shared<Input>(inHg, opt.annotations), matchHg, outHg, opt,
+                                           which);
 }
 
 /**
@@ -863,6 +943,53 @@ void compose(InHg& inHg, MatchHg& matchHg, IMutableHypergraph<ArcOut>* outHg, Fs
     composeWithEpsilonFilter<Epsilon1First>(inHg, matchHg, outHg, opt, which);
 }
 
+/**
+   as compose, but input is a lazy fst (e.g. a UnionFst of several hgs
+   from Rational.hpp) rather than a hypergraph.
+*/
+template <class Input, class MatchHg, class ArcOut>
+void composeInputFst(shared_ptr<Input> const& input, MatchHg& matchHg, IMutableHypergraph<ArcOut>* outHg,
+                     FstComposeOptions const& opt) {
+  WhichFstComposeSpecials which = matchHg.whichInputFstComposeSpecials();
+  if (opt.allowDuplicatesEffective())
+    composeInputFstWithEpsilonFilter<typename AllowDuplicateFilter<typename Input::Weight>::type>(
+        input, matchHg, outHg, opt, which);
+  else if (opt.epsilonMatchingFilter)
+    composeInputFstWithEpsilonFilter<EpsilonCombine>(input, matchHg, outHg, opt, which);
+  else
+    composeInputFstWithEpsilonFilter<Epsilon1First>(input, matchHg, outHg, opt, which);
+}
+
+
+/**
+   as composeInputFst, but match is also a lazy fst (e.g. DeterminizeFst)
+*/
+template <class Input, class Match, class ArcOut>
+void composeFsts(shared_ptr<Input> const& input, shared_ptr<Match> const& match,
+                 IMutableHypergraph<ArcOut>* outHg, FstComposeOptions const& opt) {
+  if (opt.allowDuplicatesEffective())
+    composeFstsWithEpsilonFilter<typename AllowDuplicateFilter<typename Input::Weight>::type>(input, match,
+                                                                                            outHg, opt);
+  else if (opt.epsilonMatchingFilter)
+    composeFstsWithEpsilonFilter<EpsilonCombine>(input, match, outHg, opt);
+  else
+    composeFstsWithEpsilonFilter<Epsilon1First>(input, match, outHg, opt);
+}
+
+/**
+   as compose, but with a match fst built ahead of time (e.g. a
+   CompactMatchFst reused across inputs) instead of a hypergraph.
+*/
+template <class Arc1, class Match, class ArcOut>
+void composeWithMatchFst(IMutableHypergraph<Arc1>& inHg, shared_ptr<Match> const& match,
+                         IMutableHypergraph<ArcOut>* outHg, FstComposeOptions const& opt) {
+  if (opt.sortBestFirst && opt.usingLazyBest()) inHg.forceBestFirstArcs();
+  if (opt.denseArcCopy && fstCompactible(inHg, opt.annotations))
+    composeFsts(make_shared<CompactFst<Arc1>>(inHg, opt.annotations), match, outHg, opt);
+  else
+    composeFsts(make_shared<HypergraphFst<Arc1>>(inHg, opt.annotations), match, outHg, opt);
+}
+
 
 }}}
 
@@ -0,0 +1,300 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    DeterminizeFst: lazy (on demand) determinization of an unweighted fsa, as
+    an Fst. same result as ../Determinize.hpp (epsilon removed by closure, rho
+    means "else"; phi and sigma unsupported unless treated as ordinary
+    symbols), but a subset state's out arcs are computed only when asked for,
+    so composing with (or finding the best path in) a small part of the
+    determinized automaton is cheap.
+
+    state ids are assigned to subsets as they're first reached and never
+    change. the out arcs of at most maxCachedStates subsets are kept (least
+    recently used are evicted and recomputed if asked for again); an Arcs
+    generator already handed out stays valid after its state is evicted.
+
+    usable as the input of composeInputFst or the match of composeFsts (its
+    out arcs are sorted by label, one per label), or with LazyBest/saveFst.
+
+    not thread safe (even const access mutates the cache).
+*/
+
+#ifndef SDL_HYPERGRAPH_FS_DETERMINIZE_HPP
+#define SDL_HYPERGRAPH_FS_DETERMINIZE_HPP
+#pragma once
+
+#include <sdl/Hypergraph/Determinize.hpp>
+#include <sdl/Hypergraph/IHypergraph.hpp>
+#include <sdl/Hypergraph/Level.hpp>
+#include <sdl/Hypergraph/fs/Fst.hpp>
+#include <sdl/Util/Generator.hpp>
+#include <sdl/Util/LogHelper.hpp>
+#include <sdl/Util/Metrics.hpp>
+#include <sdl/Util/Unordered.hpp>
+#include <sdl/Exception.hpp>
+#include <sdl/SharedPtr.hpp>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+namespace fs {
+
+template <class HgArc>
+struct DeterminizeFst {
+  typedef StateId State;
+  typedef typename HgArc::Weight Weight;
+  typedef typename Weight::FloatT Distance;
+  typedef FstArc<Weight, State> Arc;
+  typedef IHypergraph<HgArc> Hg;
+
+  /// epsilon-closed subset of input states, sorted
+  typedef std::vector<StateId> Subset;
+
+  /// out arcs of a subset state, sorted by label
+  typedef std::vector<Arc> Expansion;
+  typedef shared_ptr<Expansion const> ExpansionPtr;
+
+  /// arcs [i, end) of an Expansion that we keep alive
+  struct Arcs : Util::GeneratorBase<Arcs, Arc, Util::NonPeekableT> {
+    typedef Arc result_type;
+    ExpansionPtr expansion;
+    Arc const *i, *end;
+    Arcs() : i(), end() {}
+    Arcs(ExpansionPtr const& expansion, Arc const* i, Arc const* end) : expansion(expansion), i(i), end(end) {}
+    operator bool() const { return i != end; }
+    Arc const& operator()() { return *i++; }
+  };
+  typedef Arcs Matches;
+
+  /**
+     \param hg must store out arcs, and stay valid as long as this
+
+     \param flags as for determinize (DETERMINIZE_INPUT or _OUTPUT, and which
+     special symbols to treat as ordinary)
+
+     \param maxCachedStates keep out arcs of at most this many subset states (0: unlimited)
+  */
+  DeterminizeFst(Hg const& hg, DeterminizeFlags flags = DETERMINIZE_INPUT, std::size_t maxCachedStates = 0)
+      : hg(hg), flags(flags), maxCachedStates(maxCachedStates), nExpanded(), nEvicted() {
+    if (!hg.isFsm())
+      SDL_THROW_LOG(Hypergraph.fs.DeterminizeFst, InvalidInputException,
+                    "DeterminizeFst: input hypergraph must be an FSA/FST (isFsm())");
+    if (!hg.storesOutArcs())
+      SDL_THROW_LOG(Hypergraph.fs.DeterminizeFst, ConfigException, "DeterminizeFst: input must store out arcs");
+    if ((flags & DETERMINIZE_OUTPUT) && (flags & DETERMINIZE_INPUT) || (flags & DETERMINIZE_FST))
+      SDL_THROW_LOG(Hypergraph.fs.DeterminizeFst, InvalidInputException,
+                    "DeterminizeFst: choose one of DETERMINIZE_INPUT or DETERMINIZE_OUTPUT");
+    byOutput = flags & DETERMINIZE_OUTPUT;
+    final_ = hg.final();
+    inClosure.resize(hg.size());
+    if (DET_SPECIAL_SYMBOL(flags, RHO)) whichSpecials.set(RHO::ID);
+    if (!DET_SPECIAL_SYMBOL(flags, EPSILON)) whichSpecials.set(EPSILON::ID);
+    if (hg.start() != kNoState && final_ != kNoState) {
+      Subset start(1, hg.start());
+      start_ = subsetId(start);
+    } else
+      start_ = kNoState;
+  }
+
+  ~DeterminizeFst() {
+    SDL_METRIC_ADD(hyp_fs_determinize_subsets, "subset states created by lazy DeterminizeFst", subsets.size());
+    SDL_METRIC_ADD(hyp_fs_determinize_expansions, "lazy DeterminizeFst subset out-arc expansions", nExpanded);
+    SDL_METRIC_ADD(hyp_fs_determinize_evictions, "lazy DeterminizeFst subset cache evictions", nEvicted);
+  }
+
+  State startState() const { return start_; }
+  bool final(State s) const { return isFinal[s]; }
+  Subset const& subset(State s) const { return *subsets[s]; }
+  /// # of subset states reached so far
+  StateId size() const { return (StateId)subsets.size(); }
+
+  Arcs outArcs(State s) const {
+    ExpansionPtr e(expansion(s));
+    return Arcs(e, e->data(), e->data() + e->size());
+  }
+
+  /// the (at most one, since we're deterministic) out arc of s labeled in
+  Matches arcsMatchingInput(State s, Sym in) const {
+    ExpansionPtr e(expansion(s));
+    Arc const* begin = e->data();
+    Arc const* end = begin + e->size();
+    Arc const* i = std::lower_bound(begin, end, in, LabelLess());
+    return Matches(e, i, i != end && i->labelPair.first == in ? i + 1 : i);
+  }
+
+  /// (for compose; we don't compute levels or heuristics)
+  void computeLevels() {}
+  void computeHeuristics() {}
+  void indexMatches(std::size_t) {}
+  Level level(State) const { return 0; }
+  Level combinedLevel(Level inputLevel, State) const { return inputLevel; }
+  Distance heuristic(State) const { return 0; }
+
+  IVocabularyPtr getVocabulary() const { return hg.getVocabulary(); }
+
+  WhichFstComposeSpecials whichSpecials;
+
+  Hg const& hg;
+  DeterminizeFlags flags;
+  std::size_t maxCachedStates;
+  /// # of subset states whose out arcs were computed (again, if evicted)
+  mutable std::size_t nExpanded, nEvicted;
+
+ private:
+  struct LabelLess {
+    bool operator()(Arc const& a, Sym in) const { return a.labelPair.first < in; }
+  };
+
+  typedef unordered_map<Subset, StateId, boost::hash<Subset>> SubsetIds;
+  typedef std::list<State> Lru;
+  struct Cached {
+    ExpansionPtr expansion;
+    typename Lru::iterator lru;
+  };
+
+  bool byOutput;
+  StateId final_, start_;
+  mutable SubsetIds subsetIds;
+  /// keys of subsetIds, by id
+  mutable std::vector<Subset const*> subsets;
+  mutable std::vector<char> isFinal;
+  mutable std::vector<Cached> cached;
+  /// most recently used first
+  mutable Lru lru;
+  mutable std::vector<char> inClosure;
+
+  ExpansionPtr expansion(State s) const {
+    assert(s < subsets.size());
+    if (ExpansionPtr const& e = cached[s].expansion) {
+      lru.splice(lru.begin(), lru, cached[s].lru);
+      return e;
+    }
+    ExpansionPtr e(expand(*subsets[s]));  // may grow cached
+    ++nExpanded;
+    lru.push_front(s);
+    Cached& c = cached[s];
+    c.expansion = e;
+    c.lru = lru.begin();
+    if (maxCachedStates && lru.size() > maxCachedStates) {
+      State const evict = lru.back();
+      lru.pop_back();
+      cached[evict].expansion.reset();
+      ++nEvicted;
+    }
+    return e;
+  }
+
+  Sym label(ArcBase const* a) const {
+    LabelPair const labels(hg.fsmLabelPair(*a));
+    return byOutput ? output(labels) : input(labels);
+  }
+  bool isEpsilon(Sym sym) const { return (!sym || sym == EPSILON::ID) && DET_SPECIAL_SYMBOL(flags, EPSILON); }
+
+  /// add to subset (sorted) everything reachable from it by epsilon arcs
+  void closeEpsilon(Subset& subset) const {
+    for (StateId q : subset) inClosure[q] = true;
+    for (std::size_t i = 0; i < subset.size(); ++i) {
+      StateId const q = subset[i];
+      for (ArcId a = 0, n = hg.numOutArcs(q); a != n; ++a) {
+        ArcBase const* arc = hg.outArc(q, a);
+        if (!isEpsilon(label(arc))) continue;
+        StateId const head = arc->head();
+        if (!inClosure[head]) {
+          inClosure[head] = true;
+          subset.push_back(head);
+        }
+      }
+    }
+    for (StateId q : subset) inClosure[q] = false;
+    std::sort(subset.begin(), subset.end());
+  }
+
+  /// \param subset (not yet epsilon-closed) is consumed
+  StateId subsetId(Subset& subset) const {
+    std::sort(subset.begin(), subset.end());
+    subset.erase(std::unique(subset.begin(), subset.end()), subset.end());
+    closeEpsilon(subset);
+    StateId const id = (StateId)subsets.size();
+    std::pair<typename SubsetIds::iterator, bool> inserted = subsetIds.insert(typename SubsetIds::value_type(subset, id));
+    if (!inserted.second) return inserted.first->second;
+    subsets.push_back(&inserted.first->first);
+    isFinal.push_back(std::binary_search(subset.begin(), subset.end(), final_));
+    cached.push_back(Cached());
+    return id;
+  }
+
+  /// a state of the subset that has rho (else) arcs
+  struct RhoSource {
+    std::vector<Sym> normals;
+    std::vector<StateId> heads;
+  };
+
+  ExpansionPtr expand(Subset const& qs) const {
+    typedef std::map<Sym, Subset> Delta;
+    Delta delta;
+    std::vector<RhoSource> rhoSources;
+    for (StateId q : qs) {
+      RhoSource rho;
+      for (ArcId a = 0, n = hg.numOutArcs(q); a != n; ++a) {
+        HgArc const* arc = hg.outArc(q, a);
+        Sym const sym = label(arc);
+        if (isEpsilon(sym)) continue;
+        if (arc->weight_ != Weight::one())
+          SDL_THROW_LOG(Hypergraph.fs.DeterminizeFst, InvalidInputException,
+                        "DeterminizeFst: only unweighted input is supported (all arcs should have Weight::one())");
+        StateId const head = arc->head();
+        if (IS_DET_SPECIAL_SYM(sym, flags, RHO))
+          rho.heads.push_back(head);
+        else if (IS_DET_SPECIAL_SYM(sym, flags, PHI) || IS_DET_SPECIAL_SYM(sym, flags, SIGMA))
+          SDL_THROW_LOG(Hypergraph.fs.DeterminizeFst, InvalidInputException,
+                        "DeterminizeFst: input must have only EPSILON and RHO special symbols");
+        else {
+          rho.normals.push_back(sym);
+          delta[sym].push_back(head);
+        }
+      }
+      if (!rho.heads.empty()) {
+        std::sort(rho.normals.begin(), rho.normals.end());
+        rhoSources.push_back(rho);
+      }
+    }
+    // a symbol not labeling any arc of q takes q's rho arcs
+    if (!rhoSources.empty()) {
+      for (typename Delta::value_type& symHeads : delta)
+        for (RhoSource const& rho : rhoSources)
+          if (!std::binary_search(rho.normals.begin(), rho.normals.end(), symHeads.first))
+            symHeads.second.insert(symHeads.second.end(), rho.heads.begin(), rho.heads.end());
+      Subset& rhoHeads = delta[RHO::ID];
+      for (RhoSource const& rho : rhoSources) rhoHeads.insert(rhoHeads.end(), rho.heads.begin(), rho.heads.end());
+    }
+    shared_ptr<Expansion> r(make_shared<Expansion>());
+    r->reserve(delta.size());
+    for (typename Delta::value_type& symHeads : delta) {
+      r->push_back(Arc());
+      Arc& arc = r->back();
+      arc.labelPair = LabelPair(symHeads.first, symHeads.first);
+      arc.weight = Weight::one();
+      arc.dst = subsetId(symHeads.second);
+    }
+    return r;
+  }
+};
+
+
+}}}
+
+#endif
@@ -22,10 +22,13 @@
 #pragma once
 
 #include <sdl/Hypergraph/Level.hpp>
+#include <sdl/Hypergraph/OutsideCosts.hpp>
 #include <sdl/Hypergraph/Types.hpp>
 #include <sdl/Util/GeneratorTransform.hpp>
 #include <sdl/SharedPtr.hpp>
 #include <boost/optional.hpp>
+#include <cmath>
+#include <vector>
 
 namespace sdl {
 namespace Hypergraph {
@@ -102,26 +105,44 @@ struct HypergraphFst {
  protected:
   Levels levels;  // for beam search (optional)
   Level nLevels;
+  std::vector<SdlFloat> heuristics;  // for beam search (optional)
 
  public:
   /**
      useful for acyclic hg + beamed best-first search. otherwise, a waste of
      time (everything will be at level 0 for a cyclic hg; no need to compute if
-     you already know it's cyclic)
+     you already know it's cyclic). computed once (so an fst shared by threads
+     can be prepared ahead of time and then only read)
   */
   void computeLevels() {
+    if (!levels.empty()) return;
     Levelization levelize(*pHg);
     nLevels = levelize.numLevels();
     levelize.moveTo(levels);
   }
 
-  Level level(State s) const { return levels(s); }
+  Level numLevels() const { return nLevels; }
+
+  /// kNoLevel for states the levelization couldn't reach
+  Level level(State s) const { return Hypergraph::level(levels, s); }
+
+  /**
+     heuristic(s) = best cost from s to final (HUGE_VAL if final can't be
+     reached). exact, so admissible as long as whatever we're composed with
+     doesn't have negative costs. computed once, as levels
+  */
+  void computeHeuristics() {
+    if (!heuristics.empty()) return;
+    StateId const N = pHg->size();
+    heuristics.assign(N, (SdlFloat)HUGE_VAL);
+    if (N) outsideCosts(*pHg, &heuristics[0], ZeroInsideCosts(), N);
+  }
 
   /**
      should be a (nearly) admissible heuristic for shortest distance from state to any final state. if you
      have no idea, return 0.
   */
-  Distance heuristic(State s) const { return pHg->heuristic(s); }
+  Distance heuristic(State s) const { return s < heuristics.size() ? heuristics[s] : pHg->heuristic(s); }
 
 
   /**
@@ -28,6 +28,7 @@
 #pragma once
 
 #include <sdl/Hypergraph/HypergraphCopyBasic.hpp>
+#include <sdl/Hypergraph/fs/CompactFst.hpp>
 #include <sdl/Hypergraph/fs/Fst.hpp>
 #include <sdl/Hypergraph/fs/Path.hpp>
 #include <sdl/Pool/object_pool.hpp>
@@ -47,10 +48,12 @@ struct LazyBestOptions {
   bool removeEpsilon;
   bool projectOutput;
   bool annotations;
+  bool denseArcCopy;
 
   std::string logNumWordsName;
 
-  LazyBestOptions() : expandMoreArcs(), removeEpsilon(true), projectOutput(false), annotations(true) {}
+  LazyBestOptions()
+      : expandMoreArcs(), removeEpsilon(true), projectOutput(false), annotations(true), denseArcCopy(false) {}
 
   /**
      if you'll be using lazy-best on a hg that isn't best-first sorted.
@@ -83,6 +86,13 @@ struct LazyBestOptions {
 #else
     config("annotations", &annotations).init(false)("(not enabled in this build; must be false)").verbose();
 #endif
+    config("dense-arc-copy", &denseArcCopy)
+        .defaulted()(
+            "for speed, at the cost of memory: copy the input fst's arcs into a contiguous 16-byte-per-arc "
+            "array (CompactFst) before searching, so the search reads them with fewer cache misses (and for a "
+            "compose transform used on several inputs, its fst's arcs, once, shared by all threads). the copy "
+            "is held alongside the hypergraph, not instead of it. ignored if keeping annotations that are "
+            "present");
   }
 };
 
@@ -340,7 +350,10 @@ bool lazyBestForHgPtr(HgPtr const& sortedHg, FstPath& path, LazyBestOptions cons
   typedef typename Hg::Arc Arc;
   typedef typename Hg::FstArcT FstArc;
   typedef IMutableHypergraph<Arc> MutableHg;
-  if (sortedHg->isMutable()) {
+  if (opt.denseArcCopy && fstCompactible(*sortedHg, opt.annotations)) {
+    CompactFst<Arc> fst(sortedHg, opt.annotations);
+    lazyBest(fst, path, opt);
+  } else if (sortedHg->isMutable()) {
     typedef HypergraphFst<Arc> Fst;
     Fst fst(dynamic_pointer_cast<MutableHg const>(sortedHg), opt.annotations);
     lazyBest(fst, path, opt);
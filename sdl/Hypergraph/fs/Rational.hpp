@@ -0,0 +1,407 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    lazy (on the fly) union, concatenation and closure of fsts (e.g. several
+    HypergraphFst): nothing is copied; a state is (part index, part state) and
+    its out arcs are generated from the parts' out arcs when asked for. use as
+    the input of ComposeFst (see composeInputFst) or with LazyBest/saveFst like
+    any other Fst.
+
+    unlike Union.hpp and Concat.hpp, no epsilon arcs are added. instead the out
+    arcs of a part's start state are spliced in where an epsilon would have led
+    to it:
+
+    - UnionFst: a new start state has the out arcs of every part's start
+
+    - ConcatFst: a final state of part i also has the out arcs of part i+1's
+      start (and of part i+2's if part i+1's start is final, etc.)
+
+    - ClosureFst: a final state also has the out arcs of the start; a new
+      start state (final iff star) has the start's out arcs
+
+    where arcs from several parts (or several places in one part) are
+    generated for one state, they're merged best first, so a best-first sorted
+    part (kOutArcsSortedBestFirst) gives a best-first sorted result.
+
+    all parts should share a vocabulary.
+*/
+
+#ifndef SDL_HYPERGRAPH_FS_RATIONAL_HPP
+#define SDL_HYPERGRAPH_FS_RATIONAL_HPP
+#pragma once
+
+#include <sdl/Hypergraph/fs/Annotations.hpp>
+#include <sdl/Hypergraph/fs/Fst.hpp>
+#include <sdl/Hypergraph/IMutableHypergraph.hpp>
+#include <sdl/Util/Generator.hpp>
+#include <sdl/SharedPtr.hpp>
+#include <graehl/shared/is_null.hpp>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+namespace sdl {
+namespace Hypergraph {
+namespace fs {
+
+/**
+   state of a union/concat/closure: a state of parts[part], or (part ==
+   parts.size()) a new start state.
+*/
+template <class PartStateT>
+struct PartState {
+  typedef PartStateT Part;
+  unsigned part;
+  Part state;
+
+  PartState() {}
+  PartState(unsigned part, Part const& state) : part(part), state(state) {}
+
+  bool operator==(PartState const& o) const { return part == o.part && state == o.state; }
+  bool operator!=(PartState const& o) const { return !(*this == o); }
+
+  friend inline std::size_t hash_value(PartState const& x) {
+    std::size_t h = boost::hash<Part>()(x.state);
+    boost::hash_combine(h, x.part);
+    return h;
+  }
+  friend inline void set_null(PartState& x) {
+    x.part = (unsigned)-1;
+    ::adl::adl_set_null(x.state);
+  }
+  friend inline std::ostream& operator<<(std::ostream& out, PartState const& self) {
+    return out << self.part << '.' << self.state;
+  }
+};
+
+/**
+   out arcs of several part states, merged best first (ties: in the order
+   added).
+*/
+template <class PartFst>
+struct PartsArcs
+    : Util::GeneratorBase<PartsArcs<PartFst>,
+                          FstArc<typename PartFst::Weight, PartState<typename PartFst::State>>,
+                          Util::NonPeekableT> {
+  typedef typename PartFst::Arcs Arcs;
+  typedef typename PartFst::Arc PartArc;
+  typedef PartState<typename PartFst::State> State;
+  typedef FstArc<typename PartFst::Weight, State> Arc;
+  typedef Arc result_type;
+
+  struct Next {
+    unsigned part;
+    Arcs arcs;
+    PartArc arc;
+    Next(unsigned part, Arcs const& arcs_) : part(part), arcs(arcs_) { pop(); }
+    /// \return false if there are no more arcs
+    bool pop() {
+      if (!arcs) return false;
+      arc = arcs.get();
+      arcs.got();
+      return true;
+    }
+  };
+  std::vector<Next> nexts;
+
+  void add(unsigned part, Arcs const& arcs) {
+    if (arcs) nexts.push_back(Next(part, arcs));
+  }
+
+  operator bool() const { return !nexts.empty(); }
+
+  Arc operator()() {
+    assert(!nexts.empty());
+    std::size_t best = 0;
+    for (std::size_t i = 1, n = nexts.size(); i < n; ++i)
+      if (nexts[i].arc.getDistance() < nexts[best].arc.getDistance()) best = i;
+    Next& next = nexts[best];
+    PartArc const& arc = next.arc;
+    Arc r;
+    r.dst = State(next.part, arc.dst);
+    r.labelPair = arc.labelPair;
+    r.weight = arc.weight;
+    IF_SDL_HYPERGRAPH_FS_ANNOTATIONS(r.annotations = arc.annotations;)
+    if (!next.pop()) nexts.erase(nexts.begin() + best);
+    return r;
+  }
+};
+
+/**
+   what UnionFst, ConcatFst and ClosureFst have in common. PartFst is e.g.
+   HypergraphFst<Arc>.
+*/
+template <class PartFst>
+struct PartsFstBase {
+  typedef typename PartFst::State PartStateId;
+  typedef PartState<PartStateId> State;
+  typedef typename PartFst::Weight Weight;
+  typedef typename PartFst::Distance Distance;
+  typedef FstArc<Weight, State> Arc;
+  typedef PartsArcs<PartFst> Arcs;
+  typedef shared_ptr<PartFst> PartPtr;
+  typedef std::vector<PartPtr> Parts;
+
+  Parts parts;
+
+  PartsFstBase() {}
+  explicit PartsFstBase(Parts const& parts) : parts(parts) {}
+
+  unsigned size() const { return (unsigned)parts.size(); }
+  PartFst& part(unsigned i) const { return *parts[i]; }
+
+  /// null if parts[i] is empty (has no start state)
+  PartStateId partStart(unsigned i) const { return parts[i]->startState(); }
+  bool partEmpty(unsigned i) const { return ::adl::adl_is_null(partStart(i)); }
+
+  /// the new start state
+  State newStart() const {
+    State r;
+    r.part = size();
+    ::adl::adl_set_null(r.state);
+    return r;
+  }
+  bool isNewStart(State const& s) const { return s.part == size(); }
+
+  void addArcs(Arcs& arcs, unsigned i, PartStateId const& s) const { arcs.add(i, parts[i]->outArcs(s)); }
+  void addStartArcs(Arcs& arcs, unsigned i) const {
+    if (!partEmpty(i)) addArcs(arcs, i, partStart(i));
+  }
+
+  bool partFinal(unsigned i, PartStateId const& s) const { return parts[i]->final(s); }
+  bool partStartFinal(unsigned i) const { return !partEmpty(i) && partFinal(i, partStart(i)); }
+
+  /// for beam search; see HypergraphFst
+  void computeHeuristics() {
+    for (PartPtr const& p : parts) p->computeHeuristics();
+  }
+
+  Distance partStartHeuristic(unsigned i) const {
+    return partEmpty(i) ? std::numeric_limits<Distance>::infinity() : parts[i]->heuristic(partStart(i));
+  }
+
+  IVocabularyPtr getVocabulary() const {
+    return parts.empty() ? IVocabularyPtr() : parts[0]->getVocabulary();
+  }
+};
+
+/**
+   union of parts (the union of the empty set of parts is empty).
+*/
+template <class PartFst>
+struct UnionFst : PartsFstBase<PartFst> {
+  typedef PartsFstBase<PartFst> Base;
+  typedef typename Base::State State;
+  typedef typename Base::Arcs Arcs;
+  typedef typename Base::Distance Distance;
+
+  explicit UnionFst(typename Base::Parts const& parts) : Base(parts) {}
+
+  State startState() const { return this->newStart(); }
+
+  bool final(State const& s) const {
+    if (!this->isNewStart(s)) return this->partFinal(s.part, s.state);
+    for (unsigned i = 0, n = this->size(); i < n; ++i)
+      if (this->partStartFinal(i)) return true;
+    return false;
+  }
+
+  Arcs outArcs(State const& s) const {
+    Arcs r;
+    if (this->isNewStart(s))
+      for (unsigned i = 0, n = this->size(); i < n; ++i) this->addStartArcs(r, i);
+    else
+      this->addArcs(r, s.part, s.state);
+    return r;
+  }
+
+  /// the new start and each part's start are on level 0 (a part's start can be reached again only by a
+  /// cycle, and then all that part's levels are 0)
+  void computeLevels() {
+    for (typename Base::PartPtr const& p : this->parts) p->computeLevels();
+  }
+  Level level(State const& s) const { return this->isNewStart(s) ? 0 : this->part(s.part).level(s.state); }
+
+  Distance heuristic(State const& s) const {
+    if (!this->isNewStart(s)) return this->part(s.part).heuristic(s.state);
+    Distance r = std::numeric_limits<Distance>::infinity();
+    for (unsigned i = 0, n = this->size(); i < n; ++i) r = std::min(r, this->partStartHeuristic(i));
+    return r;
+  }
+};
+
+/**
+   concatenation of parts in order (the concatenation of no parts is empty).
+*/
+template <class PartFst>
+struct ConcatFst : PartsFstBase<PartFst> {
+  typedef PartsFstBase<PartFst> Base;
+  typedef typename Base::State State;
+  typedef typename Base::Arcs Arcs;
+  typedef typename Base::Distance Distance;
+
+  explicit ConcatFst(typename Base::Parts const& parts) : Base(parts), startFinalFrom(parts.size() + 1) {
+    unsigned const n = this->size();
+    empty = !n;
+    for (unsigned i = 0; i < n; ++i)
+      if (this->partEmpty(i)) empty = true;
+    restHeuristic.assign(n, 0);
+    startFinalFrom[n] = true;
+    for (unsigned i = n; i > 0;) {
+      --i;
+      startFinalFrom[i] = !empty && startFinalFrom[i + 1] && this->partStartFinal(i);
+    }
+  }
+
+  /// (parts[0] start; a new start if there are no parts)
+  State startState() const { return this->size() ? State(0, this->partStart(0)) : this->newStart(); }
+
+  bool final(State const& s) const {
+    return !empty && !this->isNewStart(s) && this->partFinal(s.part, s.state) && startFinalFrom[s.part + 1];
+  }
+
+  Arcs outArcs(State const& s) const {
+    Arcs r;
+    if (empty) return r;
+    unsigned i = s.part;
+    this->addArcs(r, i, s.state);
+    if (this->partFinal(i, s.state))
+      for (unsigned n = this->size(); ++i < n;) {
+        this->addStartArcs(r, i);
+        if (!this->partStartFinal(i)) break;
+      }
+    return r;
+  }
+
+  /// parts[i] levels follow all of parts[i-1]'s
+  void computeLevels() {
+    unsigned const n = this->size();
+    levelOffset.resize(n);
+    Level offset = 0;
+    for (unsigned i = 0; i < n; ++i) {
+      PartFst& p = this->part(i);
+      p.computeLevels();
+      levelOffset[i] = offset;
+      offset += p.numLevels();
+    }
+  }
+  Level level(State const& s) const {
+    if (levelOffset.empty() || this->isNewStart(s)) return 0;
+    Level const l = this->part(s.part).level(s.state);
+    return l == kNoLevel ? l : levelOffset[s.part] + l;
+  }
+
+  void computeHeuristics() {
+    Base::computeHeuristics();
+    unsigned const n = this->size();
+    restHeuristic.assign(n, 0);
+    for (unsigned i = n; i > 1;) {
+      --i;
+      restHeuristic[i - 1] = restHeuristic[i] + this->partStartHeuristic(i);
+    }
+  }
+  /// best cost to the end of s's part, plus to the end of each later part from its start
+  Distance heuristic(State const& s) const {
+    if (empty || this->isNewStart(s)) return 0;
+    return this->part(s.part).heuristic(s.state) + restHeuristic[s.part];
+  }
+
+ private:
+  bool empty;
+  /// startFinalFrom[i]: the empty string is in the concatenation of parts[i...]
+  std::vector<char> startFinalFrom;
+  std::vector<Level> levelOffset;
+  std::vector<Distance> restHeuristic;
+};
+
+/**
+   Kleene closure of one part: star (any number of repetitions, including
+   none) or plus (at least one).
+*/
+template <class PartFst>
+struct ClosureFst : PartsFstBase<PartFst> {
+  typedef PartsFstBase<PartFst> Base;
+  typedef typename Base::State State;
+  typedef typename Base::Arcs Arcs;
+  typedef typename Base::Distance Distance;
+
+  bool star;
+
+  ClosureFst(typename Base::PartPtr const& part, bool star = true) : Base(typename Base::Parts(1, part)), star(star) {}
+
+  State startState() const { return this->newStart(); }
+
+  bool final(State const& s) const {
+    return this->isNewStart(s) ? star || this->partStartFinal(0) : this->partFinal(0, s.state);
+  }
+
+  Arcs outArcs(State const& s) const {
+    Arcs r;
+    if (this->isNewStart(s))
+      this->addStartArcs(r, 0);
+    else {
+      this->addArcs(r, 0, s.state);
+      if (this->partFinal(0, s.state)) this->addStartArcs(r, 0);
+    }
+    return r;
+  }
+
+  /// cyclic, so all states are on level 0
+  void computeLevels() {}
+  Level level(State const&) const { return 0; }
+
+  Distance heuristic(State const& s) const {
+    return this->isNewStart(s) ? (star ? 0 : this->partStartHeuristic(0)) : this->part(0).heuristic(s.state);
+  }
+};
+
+/**
+   \return shared_ptr<UnionFst<HypergraphFst<Arc>>> of hgs (or ConcatFst, ClosureFst likewise)
+*/
+template <template <class> class PartsFst, class HgPtr>
+shared_ptr<PartsFst<HypergraphFst<typename HgPtr::element_type::Arc>>>
+partsFstForHgs(std::vector<HgPtr> const& hgs, bool annotations = true) {
+  typedef HypergraphFst<typename HgPtr::element_type::Arc> PartFst;
+  typedef PartsFst<PartFst> Fst;
+  typename Fst::Parts parts;
+  parts.reserve(hgs.size());
+  for (HgPtr const& hg : hgs)
+    parts.push_back(make_shared<PartFst>(shared_ptr<typename PartFst::MutableHg const>(hg), annotations));
+  return make_shared<Fst>(parts);
+}
+
+template <class HgPtr>
+shared_ptr<UnionFst<HypergraphFst<typename HgPtr::element_type::Arc>>>
+unionFst(std::vector<HgPtr> const& hgs, bool annotations = true) {
+  return partsFstForHgs<UnionFst>(hgs, annotations);
+}
+
+template <class HgPtr>
+shared_ptr<ConcatFst<HypergraphFst<typename HgPtr::element_type::Arc>>>
+concatFst(std::vector<HgPtr> const& hgs, bool annotations = true) {
+  return partsFstForHgs<ConcatFst>(hgs, annotations);
+}
+
+template <class Arc>
+shared_ptr<ClosureFst<HypergraphFst<Arc>>> closureFst(shared_ptr<IMutableHypergraph<Arc> const> const& hg,
+                                                      bool star = true, bool annotations = true) {
+  typedef HypergraphFst<Arc> PartFst;
+  return make_shared<ClosureFst<PartFst>>(make_shared<PartFst>(hg, annotations), star);
+}
+
+
+}}}
+
+#endif
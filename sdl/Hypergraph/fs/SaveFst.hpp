@@ -10,7 +10,8 @@
 // limitations under the License.
 /** \file
 
-    save fst (or lazy nbest of it) in mutable hypergraph.
+    save fst (or lazy nbest of it, or the part of it a beam search keeps) in
+    mutable hypergraph.
 */
 
 #ifndef SAVEFST_JG2013122_HPP
@@ -25,6 +26,13 @@
 #include <sdl/Util/Unordered.hpp>
 #include <graehl/shared/hex_int.hpp>
 #include <graehl/shared/is_null.hpp>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
 
 namespace sdl {
 namespace Hypergraph {
@@ -33,10 +41,22 @@ namespace fs {
 struct SaveFstOptions : LazyBestOptions, PruneToNbestOptions {
   std::size_t reserveStates;
   bool forceOutArcs;
+  SdlFloat beam;
+  std::size_t maxStatesPerLevel;
+  bool beamHeuristic;
 
   bool usingLazyBest() const { return pruneToNbest == 1; }
 
-  SaveFstOptions() : PruneToNbestOptions(0), reserveStates(1000000), forceOutArcs(true) {}
+  /// (lazy best takes precedence)
+  bool usingBeam() const { return !usingLazyBest() && (beam < HUGE_VAL || maxStatesPerLevel); }
+
+  SaveFstOptions()
+      : PruneToNbestOptions(0)
+      , reserveStates(1000000)
+      , forceOutArcs(true)
+      , beam(std::numeric_limits<SdlFloat>::infinity())
+      , maxStatesPerLevel()
+      , beamHeuristic() {}
   template <class Config>
   void configure(Config& config) {
     LazyBestOptions::configure(config);
@@ -46,6 +66,16 @@ struct SaveFstOptions : LazyBestOptions, PruneToNbestOptions {
         "copying")
         .defaulted();
     config("force-out-arcs", &forceOutArcs)("make result store (first-tail-only) fst out arcs").defaulted();
+    config("beam", &beam)
+        .defaulted()(
+            "(unless prune-to-nbest: 1) expand only states within this cost of the best state in their level "
+            "(inf: no beam)");
+    config("max-states-per-level", &maxStatesPerLevel)
+        .defaulted()("(unless prune-to-nbest: 1) expand at most this many (best) states per level (0: unlimited)");
+    config("beam-heuristic", &beamHeuristic)
+        .defaulted()(
+            "for beam/max-states-per-level, rank states by cost from start plus best cost to final (outside "
+            "cost) instead of cost from start alone");
   }
   friend inline void validate(SaveFstOptions& x) { x.validate(); }
 };
@@ -126,6 +156,159 @@ struct SaveFst {
   }
 };
 
+/**
+   store the part of a lazy fst kept by a level-synchronous beam search in an
+   IMutableHypergraph<Arc>.
+
+   fst.level(state) must not decrease along arcs (an arc into a lower level is
+   treated as staying in the same level; kNoLevel also means the same
+   level). levels are expanded in increasing order; within a level, states are
+   expanded best first by the cost of their best path from start (plus
+   fst.heuristic(state) if opt.beamHeuristic) as known so far. a level stops
+   at the first state scoring worse than the level's first (best) by more than
+   opt.beam, or after opt.maxStatesPerLevel states. states never expanded
+   aren't saved, nor are arcs into them.
+
+   the cost of a path is the sum of arc getDistance(), so a later better path
+   into an already expanded state (possible only through a same-level arc or a
+   heuristic that isn't consistent) doesn't re-expand it; its arcs are saved
+   all the same.
+*/
+template <class Fst>
+struct SaveFstBeam {
+  typedef typename Fst::Weight Weight;
+  typedef typename Fst::State State;
+  typedef typename Fst::Arc FstArc;
+  typedef typename Fst::Arcs FstArcs;
+  typedef typename Weight::FloatT Distance;
+  typedef ArcTpl<Weight> HgArc;
+  typedef IMutableHypergraph<HgArc> Hg;
+
+  struct Item {
+    Distance cost, score;
+    StateId outId;
+    Item() : cost(std::numeric_limits<Distance>::infinity()), score(cost), outId(kNoState) {}
+  };
+  typedef unordered_map<State, Item> Items;
+
+  typedef std::pair<Distance, State> Queued;
+  struct WorseQueued {
+    bool operator()(Queued const& a, Queued const& b) const { return a.first > b.first; }
+  };
+  typedef std::priority_queue<Queued, std::vector<Queued>, WorseQueued> Queue;
+  typedef std::map<Level, Queue> Agenda;
+
+  Fst& fst;
+  Hg& out;
+  SaveFstOptions const& opt;
+  Items items;
+  Agenda agenda;
+  /// from, arc - saved after the search, once we know which dst were expanded
+  std::vector<std::pair<StateId, FstArc>> arcs;
+  boost::optional<StateId> outFinal;
+  std::size_t nExpanded, nPrunedLevels;
+
+  SaveFstBeam(Fst& fst, Hg& out, SaveFstOptions const& opt)
+      : fst(fst), out(out), opt(opt), nExpanded(), nPrunedLevels() {
+    State empty;
+    ::adl::adl_set_null(empty);
+    Util::setEmptyKey(items, empty);
+    out.setVocabulary(fst.getVocabulary());
+    out.setEmpty();
+    if (opt.forceOutArcs) out.forceFirstTailOutArcs();
+    State const start = fst.startState();
+    reach(start, 0, 0);
+    while (!agenda.empty()) expandLevel();
+    Item const& startItem = items[start];
+    if (startItem.outId == kNoState) return;
+    out.setStart(startItem.outId);
+    for (std::pair<StateId, FstArc>& fromArc : arcs) {
+      FstArc& fstArc = fromArc.second;
+      typename Items::const_iterator i = items.find(fstArc.dst);
+      if (i == items.end() || i->second.outId == kNoState) continue;
+      if (opt.projectOutput) setInputAsOutput(fstArc.labelPair);
+      addAnnotatedArc(out, i->second.outId, fromArc.first, fstArc.labelPair, fstArc.weight
+#if SDL_HYPERGRAPH_FS_ANNOTATIONS
+                      ,
+                      &fstArc.annotations, opt.annotations
+#endif
+                      );
+    }
+    SDL_DEBUG(Hypergraph.fs.SaveFstBeam, "expanded " << nExpanded << " of " << items.size()
+                                                     << " reached states; pruned " << nPrunedLevels
+                                                     << " levels");
+  }
+
+  void reach(State const& state, Distance cost, Level fromLevel) {
+    Item& item = items[state];
+    if (item.outId != kNoState || !(cost < item.cost)) return;
+    item.cost = cost;
+    item.score = opt.beamHeuristic ? cost + fst.heuristic(state) : cost;
+    Level level = fst.level(state);
+    if (level == kNoLevel || level < fromLevel) level = fromLevel;
+    agenda[level].push(Queued(item.score, state));
+  }
+
+  void expandLevel() {
+    typename Agenda::iterator first = agenda.begin();
+    Level const level = first->first;
+    Queue& queue = first->second;
+    Distance worst = std::numeric_limits<Distance>::infinity();
+    std::size_t nLevelExpanded = 0;
+    while (!queue.empty()) {
+      Queued const top = queue.top();
+      queue.pop();
+      Item& item = items[top.second];
+      if (item.outId != kNoState || top.first != item.score) continue;  // stale
+      if (!nLevelExpanded)
+        worst = top.first + opt.beam;
+      else if (top.first > worst || nLevelExpanded == opt.maxStatesPerLevel) {
+        ++nPrunedLevels;
+        break;
+      }
+      ++nLevelExpanded;
+      expand(top.second, item, level);
+    }
+    agenda.erase(first);
+  }
+
+  /// item.outId is set before reach (which may rehash items)
+  void expand(State const& state, Item& item, Level level) {
+    StateId const from = out.addState();
+    item.outId = from;
+    Distance const cost = item.cost;
+    ++nExpanded;
+    FstArcs genArcs((fst.outArcs(state)));
+    unsigned nOut = 0;
+    while (genArcs) {
+      arcs.push_back(std::pair<StateId, FstArc>(from, genArcs.get()));
+      genArcs.got();
+      FstArc const& fstArc = arcs.back().second;
+      reach(fstArc.dst, cost + fstArc.getDistance(), level);
+      ++nOut;
+    }
+    if (fst.final(state)) {
+      if (!outFinal) {
+        bool const needsEpsilon = nOut;
+        StateId const finalSt = needsEpsilon ? out.addState() : from;
+        outFinal = finalSt;
+        out.setFinal(finalSt);
+        if (!needsEpsilon) return;
+      }
+      out.addArcEpsilon(from, *outFinal);
+    }
+  }
+};
+
+/**
+   save the part of fst kept by beam search (see SaveFstBeam).
+*/
+template <class Fst>
+void saveFstBeam(Fst& fst, IMutableHypergraph<ArcTpl<typename Fst::Weight>>& outHg, SaveFstOptions const& opt) {
+  SaveFstBeam<Fst> save(fst, outHg, opt);
+  if (opt.projectOutput) outHg.projectOutput();
+}
+
 /**
    save whole fst.
 */
@@ -136,14 +319,16 @@ void saveFstComplete(Fst& fst, IMutableHypergraph<ArcTpl<typename Fst::Weight>>&
 }
 
 /**
-   save fst after wrapping with LazyBest if requested in options.
+   save fst after wrapping with LazyBest (or beam pruning) if requested in options.
 */
 template <class Fst>
 void saveFst(Fst& fst, IMutableHypergraph<ArcTpl<typename Fst::Weight>>& outHg, SaveFstOptions const& opt) {
   if (opt.usingLazyBest()) {
     outHg.setEmpty();
     lazyBestToHg(fst, outHg, opt);
-  } else
+  } else if (opt.usingBeam())
+    saveFstBeam(fst, outHg, opt);
+  else
     saveFstComplete(fst, outHg, opt);
 }
 
@@ -13,6 +13,7 @@
 #include <sdl/Hypergraph/IHypergraphsIteratorTpl.hpp>
 #include <sdl/Hypergraph/Label.hpp>
 #include <sdl/Hypergraph/OperateOn.hpp>
+#include <sdl/Hypergraph/Pipeline.hpp>
 #include <sdl/Hypergraph/PrintOptions.hpp>
 #include <sdl/Hypergraph/Project.hpp>
 
@@ -29,6 +30,7 @@ SDL_NAME_ENUM(SymbolTypes);
 SDL_NAME_ENUM(SymbolEpsilonSkip);
 SDL_NAME_ENUM(SymbolBlockSkip);
 SDL_NAME_ENUM(ProjectType);
+SDL_NAME_ENUM(PipelineStage);
 
 
 }}
@@ -53,8 +53,10 @@
 #include <sdl/Hypergraph/src/HypCompose.cpp>
 #include <sdl/Hypergraph/src/HypEmpty.cpp>
 #include <sdl/Hypergraph/src/HypInside.cpp>
+#include <sdl/Hypergraph/src/HypPipeline.cpp>
 #include <sdl/Hypergraph/src/HypPruneToBest.cpp>
 #include <sdl/Hypergraph/src/HypPushWeights.cpp>
+#include <sdl/Hypergraph/src/HypRmEpsilon.cpp>
 #include <sdl/Util/QuickExit.hpp>
 
 #if SDL_FIX_LOCALE
@@ -68,7 +70,8 @@ sdl::Util::DefaultLocaleFastCout initCout;
 #endif
 
 #define SDL_HYP_FOR_MAINS_MINIMAL(x) \
-  x(HypBest) x(HypCompose) x(HypInside) x(HypEmpty) x(HypPruneToBest) x(HypPushWeights)
+  x(HypBest) x(HypCompose) x(HypInside) x(HypEmpty) x(HypPipeline) x(HypPruneToBest) x(HypPushWeights) \
+      x(HypRmEpsilon)
 
 #if SDL_MINIMAL_HYP_MAIN
 #define SDL_HYP_FOR_MAINS(x) SDL_HYP_FOR_MAINS_MINIMAL(x)
@@ -45,7 +45,7 @@ namespace Hypergraph {
 
 template <class Arc>
 void printDistances(IHypergraph<Arc> const& hg, bool allPairs, bool dag, StateIdTranslation& stateRemap,
-                    StateId partBoundary) {
+                    StateId partBoundary, AllPairsOptions const& allPairsOptions) {
   typedef typename Arc::Weight Weight;
   if (allPairs) {
     // TODO: test
@@ -69,7 +69,7 @@ void printDistances(IHypergraph<Arc> const& hg, bool allPairs, bool dag, StateId
         }
       }
     } else {
-      floydWarshall(hg, &D);
+      allPairsShortestDistance(hg, &D, allPairsOptions);
       for (StateId i = 0; i < n; ++i)
         for (StateId j = 0; j < n; ++j) {
           if (i == j) continue;
@@ -88,8 +88,10 @@ void printDistances(IHypergraph<Arc> const& hg, bool allPairs, bool dag, StateId
 }
 
 template <class Arc>
-void process(std::string const& file, unsigned ngramMax = 0, bool allPairs = false, bool dag = false) {
+void process(std::string const& file, unsigned ngramMax = 0, bool allPairs = false, bool dag = false,
+             AllPairsOptions const& allPairsOptions = AllPairsOptions()) {
   std::cerr << "file=" << file << " ngramMax=" << ngramMax << "\n";
+  NgramArenaScope ngramArena;  // NgramWeight default arena freed after this input
   Util::Input in(file);
   MutableHypergraph<Arc> hg(kDefaultProperties
                             | (allPairs ? (kStoreFirstTailOutArcs | (dag ? kStoreInArcs : 0)) : kStoreInArcs));
@@ -115,9 +117,9 @@ void process(std::string const& file, unsigned ngramMax = 0, bool allPairs = fal
     typedef NgramWeightMapper<Arc> Mapper;
     typedef typename Mapper::TargetArc TargetArc;
     MapHypergraph<Arc, TargetArc, Mapper> ngramhg(hg, Mapper(hg, ngramMax));
-    printDistances(ngramhg, allPairs, dag, sort.stateRemap, sort.partBoundary);
+    printDistances(ngramhg, allPairs, dag, sort.stateRemap, sort.partBoundary, allPairsOptions);
   } else
-    printDistances(hg, allPairs, dag, sort.stateRemap, sort.partBoundary);
+    printDistances(hg, allPairs, dag, sort.stateRemap, sort.partBoundary, allPairsOptions);
 }
 
 struct HypInside {
@@ -128,6 +130,7 @@ struct HypInside {
       bool help = false;
       unsigned ngramMax = 0;
       bool allPairs = false, dag = false;
+      AllPairsOptions allPairsOptions;
       string file = "-", arcType = "log";
       po::options_description generic("Allowed options");
       sdl::AddOption opt(generic);
@@ -141,6 +144,15 @@ struct HypInside {
       opt("all-pairs,p", po::bool_switch(&allPairs),
           "output all-pairs shortest paths (s -> d = w) - fsm only");
       opt("dag,d", po::bool_switch(&dag), "for all-pairs, assume input is a DAG (no cycles)");
+      opt("num-threads,j", po::value(&allPairsOptions.numThreads)->default_value(1),
+          "for all-pairs (not dag), threads to use (0: one per cpu)");
+      opt("johnson", po::bool_switch(&allPairsOptions.johnson),
+          "for all-pairs (not dag) with viterbi arc-type, use Johnson's algorithm (Dijkstra from each state) - "
+          "faster for sparse graphs");
+      opt("block-size", po::value(&allPairsOptions.blockSize)->default_value(64),
+          "for all-pairs (not dag) with viterbi arc-type, tile size (states) for blocked Floyd-Warshall");
+      opt("min-parallel-states", po::value(&allPairsOptions.minParallelStates)->default_value(256),
+          "for all-pairs (not dag), use plain single-threaded Floyd-Warshall for fewer states than this");
 
       po::options_description cmdline_options;
       cmdline_options.add(generic);
@@ -172,17 +184,17 @@ struct HypInside {
       typedef ViterbiWeightTpl<float> Viterbi;
       if (arcType == "log") {
         typedef ArcTpl<LogWeightTpl<float>> Arc;
-        process<Arc>(file, ngramMax, allPairs, dag);
+        process<Arc>(file, ngramMax, allPairs, dag, allPairsOptions);
         // TODO: test all but log
       } else if (arcType == "viterbi") {
         typedef ArcTpl<Viterbi> Arc;
-        process<Arc>(file, ngramMax, allPairs, dag);
+        process<Arc>(file, ngramMax, allPairs, dag, allPairsOptions);
       } else if (arcType == "expectation") {
         typedef ArcTpl<ExpectationWeight> Arc;
-        process<Arc>(file, ngramMax, allPairs, dag);
+        process<Arc>(file, ngramMax, allPairs, dag, allPairsOptions);
       } else if (arcType == "feature") {
         typedef ArcTpl<FeatureWeight> Arc;
-        process<Arc>(file, ngramMax, allPairs, dag);
+        process<Arc>(file, ngramMax, allPairs, dag, allPairsOptions);
       } else {
         std::cerr << "unknown arc-type " << arcType << "\n";
         return EXIT_FAILURE;
@@ -0,0 +1,67 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define HG_TRANSFORM_MAIN
+#include <sdl/Hypergraph/Compose.hpp>
+#include <sdl/Hypergraph/Pipeline.hpp>
+#include <sdl/Hypergraph/TransformMain.hpp>
+
+namespace sdl {
+namespace Hypergraph {
+
+#define USAGE_HypPipeline                                                                                     \
+  "compose input*fsm*...*fsm (if more than one input), then apply --stages in order, all in one process. "    \
+  "e.g. 'hyp pipeline --stages prune pushweights --enable-best 1 -- in.hg fsm.hg' instead of "                \
+  "'hyp compose in.hg fsm.hg | hyp prune | hyp pushweights | hyp best'"
+
+struct HypPipeline : TransformMain<HypPipeline> {
+  static bool nbestHypergraphDefault() { return false; }
+
+  HypPipeline() : TransformMain<HypPipeline>(PipelineOptions::type(), USAGE_HypPipeline) {
+    composeOpt.addFstOption = false;
+    composeOpt.fstCompose = true;
+    this->configureProperties = true;
+  }
+
+  void declare_configurable() {
+    this->configurable(&pipeline);
+    this->configurable(&composeOpt);
+  }
+
+  static BestOutput bestOutput() { return kBestOutput; }
+  static LineInputs lineInputs() { return kNoLineInputs; }
+
+  // as for HypCompose. stages force whatever further properties they need
+  Properties properties(int i) const { return i == 1 ? (kStoreInArcs | kStoreOutArcs) : kStoreOutArcs; }
+
+  PipelineOptions pipeline;
+  ComposeTransformOptions composeOpt;
+
+  enum { has_transform1 = false, has_inplace_transform1 = true, has_transform2 = true };
+
+  template <class Arc>
+  bool transform2mm(IMutableHypergraph<Arc>& hg1, IMutableHypergraph<Arc>& hg2, IMutableHypergraph<Arc>* result) {
+    ComposeTransform<Arc> c(composeOpt);
+    c.setFst(hg2);
+    c.inout(hg1, result);
+    return true;
+  }
+
+  template <class Arc>
+  bool transform1Inplace(IMutableHypergraph<Arc>& hg) {
+    pipeline.inplace(hg);
+    return true;
+  }
+};
+
+
+}}
+
+HYPERGRAPH_NAMED_MAIN(Pipeline)
@@ -62,10 +62,12 @@ struct HypToMosesLattice {
                                                            ptrNoDelete(voc));
     pHgIter->setHgProperties(Hypergraph::kStoreFirstTailOutArcs);
     while (!pHgIter->done()) {
-      Hypergraph::IHypergraph<Arc>* pHg = pHgIter->value();
-      pHgIter->next();
+      Hypergraph::IHypergraph<Arc>* pHg = pHgIter->value();  // owned by pHgIter until next()
+      if (!pHg) break;
       Hypergraph::printHgAsMosesLattice(*pHg);
+      pHgIter->next();
     }
+    delete pHgIter;
     return 0;
   }
 };
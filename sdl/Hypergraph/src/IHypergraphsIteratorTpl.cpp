@@ -45,6 +45,8 @@ class FlatStringHypergraphsIterator : public IHypergraphsIteratorTpl<Arc> {
     toHypergraphOpt.inputFeatures = feats;
   }
 
+  ~FlatStringHypergraphsIterator() { delete pHg_; }
+
   StringToHypergraphOptions toHypergraphOpt;
   Util::NormalizeUtf8 normalize;
 
@@ -70,6 +72,12 @@ class FlatStringHypergraphsIterator : public IHypergraphsIteratorTpl<Arc> {
     return static_cast<IHypergraph<Arc>*>(pHg_);
   }
 
+  virtual IHypergraph<Arc>* release() {
+    IHypergraph<Arc>* hg = value();
+    pHg_ = NULL;
+    return hg;
+  }
+
   virtual void setHgProperties(Properties prop) { hgProp_ = prop; }
 
   virtual bool done() const { return done_; }
@@ -83,7 +91,7 @@ class FlatStringHypergraphsIterator : public IHypergraphsIteratorTpl<Arc> {
 };
 
 namespace {
-std::string const kHgSeparator("-----");
+std::string const kHgSeparator(kHypergraphSeparatorLine);
 std::string const kTextSourceName("<string>");
 }
 
@@ -94,11 +102,15 @@ class FormattedHypergraphsIterator : public IHypergraphsIteratorTpl<Arc> {
   FormattedHypergraphsIterator(std::istream& in, shared_ptr<IPerThreadVocabulary> const& perThreadVocab)
       : in_(in), perThreadVocab_(perThreadVocab), pHg_(), done_(), hgProp_(kStoreOutArcs) {}
 
+  ~FormattedHypergraphsIterator() { delete pHg_; }
+
+  /// frees the previous hypergraph, so memory is bounded by the largest single input
   virtual void next() {
+    delete pHg_;
+    pHg_ = 0;
 
     if (!in_) {
       SDL_DEBUG(Hypergraph, "next(): We're done");
-      pHg_ = 0;
       done_ = true;
       return;
     }
@@ -117,6 +129,12 @@ class FormattedHypergraphsIterator : public IHypergraphsIteratorTpl<Arc> {
     return static_cast<IHypergraph<Arc>*>(pHg_);
   }
 
+  virtual IHypergraph<Arc>* release() {
+    IHypergraph<Arc>* hg = value();
+    pHg_ = 0;
+    return hg;
+  }
+
   virtual bool done() const { return done_; }
 
   virtual void setHgProperties(Properties prop) { hgProp_ = prop; }
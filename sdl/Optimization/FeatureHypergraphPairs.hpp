@@ -25,6 +25,7 @@
 #define SDL_OPTIMIZATION_FEATUREHYPERGRAPHPAIRS_HPP
 #pragma once
 
+#include <sdl/Hypergraph/ArcFeatureStore.hpp>
 #include <sdl/Hypergraph/ArcVisitors.hpp>
 #include <sdl/Hypergraph/IMutableHypergraph.hpp>
 #include <sdl/Optimization/IOriginalFeatureIds.hpp>
@@ -98,6 +99,11 @@ class IFeatureHypergraphPairs {
 
   virtual FeatureId getNumFeatures() = 0;
   virtual void setNumFeatures(FeatureId) = 0;
+
+  /**
+      Threads setFeatureWeights may use (the optimizer's num-threads).
+   */
+  virtual void setNumThreads(std::size_t) {}
 };
 
 /**
@@ -113,14 +119,14 @@ class InMemoryFeatureHypergraphPairs : public IFeatureHypergraphPairs<ArcT> {
   typedef std::vector<value_type> Vector;
   typedef shared_ptr<Vector> VectorPtr;
 
-  InMemoryFeatureHypergraphPairs() : pPairs_(new std::vector<value_type>()) {}
+  InMemoryFeatureHypergraphPairs() : pPairs_(new std::vector<value_type>()), numParams_(0), numThreads_(1) {}
 
   /**
       \param pPairs Pointer to all hypergraph pairs (i.e., complete
       training data incl. features); takes ownership and will delete at
       end.
    */
-  InMemoryFeatureHypergraphPairs(VectorPtr const& pPairs) : pPairs_(pPairs), numParams_(0) {}
+  InMemoryFeatureHypergraphPairs(VectorPtr const& pPairs) : pPairs_(pPairs), numParams_(0), numThreads_(1) {}
 
   value_type operator[](TrainingDataIndex index) override {
     SDL_ASSERT_MSG(pPairs_->size() >= index, "index out of bounds");
@@ -129,9 +135,6 @@ class InMemoryFeatureHypergraphPairs : public IFeatureHypergraphPairs<ArcT> {
 
   /**
       Inserts the feature weights into all stored hypergraphs.
-     *
-      TODO: This could be made more efficient by having a map from
-      feature IDs to arcs that use them.
    */
   void setFeatureWeights(FloatT const* featWeights, FeatureId numParams) override {
     SDL_DEBUG(Optimization.HypergraphCrfObjFct, "Setting feature weights");
@@ -142,18 +145,30 @@ class InMemoryFeatureHypergraphPairs : public IFeatureHypergraphPairs<ArcT> {
       \param begin First hypergraph pair index
 
       \param end Last hypergraph pair index plus one
+
+      the first call for a pair copies its arcs' features into an
+      ArcFeatureStore per hypergraph (kept until this is destroyed), so later
+      calls compute the costs from those columns instead of each arc's map. the
+      pairs' arcs and features mustn't change after that.
    */
   void setFeatureWeights(TrainingDataIndex begin, TrainingDataIndex end, FloatT const* featWeights,
                          FeatureId numParams) override {
     SDL_DEBUG(Optimization.HypergraphCrfObjFct, "Setting feature weights for HGs (" << begin << ", " << end
                                                                                     << "]");
+    if (!featWeights) return;
+    if (stores_.size() < end) stores_.resize(end);
     for (TrainingDataIndex i = begin; i < end; ++i) {
-      value_type const& hgpair = (*pPairs_)[i];
-      assert(hgpair.first->isMutable());
-      assert(hgpair.second->isMutable());
-      typedef Hypergraph::IMutableHypergraph<Arc> MHg;
-      detail::insertFeatureWeights(static_cast<MHg*>(hgpair.first.get()), featWeights, numParams);
-      detail::insertFeatureWeights(static_cast<MHg*>(hgpair.second.get()), featWeights, numParams);
+      shared_ptr<StorePair>& stores = stores_[i];
+      if (!stores) {
+        value_type const& hgpair = (*pPairs_)[i];
+        assert(hgpair.first->isMutable());
+        assert(hgpair.second->isMutable());
+        stores.reset(new StorePair());
+        stores->first.init(*hgpair.first);
+        stores->second.init(*hgpair.second);
+      }
+      stores->first.setCosts(featWeights, numParams, numThreads_);
+      stores->second.setCosts(featWeights, numParams, numThreads_);
     }
   }
 
@@ -165,9 +180,18 @@ class InMemoryFeatureHypergraphPairs : public IFeatureHypergraphPairs<ArcT> {
   FeatureId getNumFeatures() override { return numParams_; }
   void setNumFeatures(FeatureId n) override { numParams_ = n; }
 
+  /// (each hypergraph's costs are split over the threads, if it has enough arcs)
+  void setNumThreads(std::size_t n) override { numThreads_ = (unsigned)n; }
+
  private:
   VectorPtr pPairs_;
   FeatureId numParams_;
+  unsigned numThreads_;
+
+  typedef Hypergraph::ArcFeatureStore<Arc> Store;
+  typedef std::pair<Store, Store> StorePair;
+  /// parallel to *pPairs_ (built on demand by setFeatureWeights)
+  std::vector<shared_ptr<StorePair>> stores_;
 };
 
 /**
@@ -47,6 +47,11 @@ class HypergraphCrfObjFct : public Optimization::DataObjectiveFunction<typename
 
   std::size_t getNumExamples() override { return pHgTrainingPairs_->size(); }
 
+  void setNumThreads(std::size_t n) override {
+    Base::setNumThreads(n);
+    pHgTrainingPairs_->setNumThreads(n);
+  }
+
   /**
       Inserts feature weights into all training examples
    */
@@ -0,0 +1,615 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+   \file
+
+   Dense linear-chain CRF training examples: instead of a (clamped,
+   unclamped) pair of hypergraphs, an example is a trellis of positions x
+   candidate labels, where each candidate has binary (value 1) emission
+   features and label bigrams share the transition features of a
+   LinearChainModel.
+
+   LinearChainCrfObjFct computes the same objective and gradients as
+   HypergraphCrfObjFct would on the equivalent hypergraphs (sentence
+   lattice composed with a unigram or bigram label model), but with a
+   scaled forward-backward over contiguous arrays rather than inside/outside
+   over Arc pointers.
+
+   A search space offers dense examples by also implementing
+   ILinearChainExamples (OptimizationProcedure checks with dynamic_cast, as
+   for IOriginalFeatureIds).
+ */
+
+#ifndef SDL_OPTIMIZATION_LINEARCHAINCRF_HPP
+#define SDL_OPTIMIZATION_LINEARCHAINCRF_HPP
+#pragma once
+
+#include <sdl/Optimization/ObjectiveFunction.hpp>
+#include <sdl/Optimization/Types.hpp>
+#include <sdl/Util/LogHelper.hpp>
+#include <sdl/SharedPtr.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sdl {
+namespace Optimization {
+
+/// index into LinearChainModel labels
+typedef unsigned LabelIndex;
+
+typedef std::vector<FeatureId> LinearChainFeatures;
+
+/**
+   label transitions shared by all examples. with bigram, a label sequence l_0
+   ... l_{n-1} has the features of transitions (start, l_0), (l_0, l_1), ...
+   and of end(l_{n-1}); without, labels are independent given the input.
+ */
+struct LinearChainModel {
+  LinearChainModel(LabelIndex nLabels = 0, bool bigram = false)
+      : nLabels(nLabels)
+      , bigram(bigram)
+      , transitions(bigram ? (nLabels + 1) * nLabels : 0)
+      , ends(bigram ? nLabels : 0) {}
+
+  /// prev == start() for the first label
+  LinearChainFeatures& transition(LabelIndex prev, LabelIndex label) {
+    assert(bigram);
+    return transitions[prev * nLabels + label];
+  }
+  LinearChainFeatures const& transition(LabelIndex prev, LabelIndex label) const {
+    return transitions[prev * nLabels + label];
+  }
+  LinearChainFeatures& end(LabelIndex label) {
+    assert(bigram);
+    return ends[label];
+  }
+  LabelIndex start() const { return nLabels; }
+
+  LabelIndex nLabels;
+  bool bigram;
+  /// (nLabels + 1) x nLabels, row start() last
+  std::vector<LinearChainFeatures> transitions;
+  std::vector<LinearChainFeatures> ends;
+  /// for printing label sequences
+  std::vector<std::string> labelNames;
+};
+
+/**
+   one sentence: for each position, candidate labels, each with its emission
+   features. build by addPosition, then addCandidate (and addFeature) for
+   each of its candidates.
+ */
+struct LinearChainExample {
+  enum { kNoGold = (std::size_t)-1 };
+
+  LinearChainExample() : candidatesBegin(1, 0), featuresBegin(1, 0) {}
+
+  std::size_t size() const { return gold.size(); }
+  std::size_t candidatesEnd(std::size_t position) const { return candidatesBegin[position + 1]; }
+
+  void addPosition() {
+    gold.push_back(kNoGold);
+    candidatesBegin.push_back(candidates.size());
+  }
+
+  void addCandidate(LabelIndex label, bool isGold = false) {
+    assert(!gold.empty());
+    if (isGold) gold.back() = candidates.size();
+    candidates.push_back(label);
+    featuresBegin.push_back(features.size());
+    ++candidatesBegin.back();
+  }
+
+  /// (for the last candidate added) a feature already present is ignored, as for FeatureWeight::insert
+  void addFeature(FeatureId id) {
+    assert(!candidates.empty());
+    std::size_t const begin = featuresBegin[featuresBegin.size() - 2];
+    if (std::find(features.begin() + begin, features.end(), id) != features.end()) return;
+    features.push_back(id);
+    ++featuresBegin.back();
+  }
+
+  /// whether every position's observed label is a candidate (needed for training)
+  bool hasGold() const { return std::find(gold.begin(), gold.end(), (std::size_t)kNoGold) == gold.end(); }
+
+  /// candidates of position t are [candidatesBegin[t], candidatesBegin[t + 1])
+  std::vector<std::size_t> candidatesBegin;
+  std::vector<LabelIndex> candidates;
+  /// emission features of candidate c are features[featuresBegin[c] ... featuresBegin[c + 1])
+  std::vector<std::size_t> featuresBegin;
+  LinearChainFeatures features;
+  /// per position, the candidate that was observed (or kNoGold)
+  std::vector<std::size_t> gold;
+};
+
+struct LinearChainData {
+  LinearChainModel model;
+  std::vector<LinearChainExample> examples;
+};
+
+/**
+   a search space (ICreateSearchSpace) may implement this too, if it can
+   build dense linear-chain examples instead of hypergraph pairs.
+ */
+struct ILinearChainExamples {
+  virtual ~ILinearChainExamples() {}
+  /// null if this search space built hypergraph pairs instead
+  virtual shared_ptr<LinearChainData> getLinearChainData() const = 0;
+};
+
+/**
+   transition costs (feature weights dot features) for some feature weights,
+   and their exps (shifted by the min cost, so they don't underflow) for
+   forward-backward.
+ */
+struct LinearChainTransitionCosts {
+  template <class FloatT>
+  void set(LinearChainModel const& model, FloatT const* params) {
+    LabelIndex const nLabels = model.nLabels;
+    minCost = minEndCost = costRange = 0;
+    if (!model.bigram) return;
+    cost.resize(model.transitions.size());
+    endCost.resize(nLabels);
+    for (std::size_t i = 0, n = cost.size(); i < n; ++i) cost[i] = dot(model.transitions[i], params);
+    for (LabelIndex l = 0; l < nLabels; ++l) endCost[l] = dot(model.ends[l], params);
+    minCost = *std::min_element(cost.begin(), cost.end());
+    minEndCost = *std::min_element(endCost.begin(), endCost.end());
+    costRange = std::max(*std::max_element(cost.begin(), cost.end()) - minCost,
+                         *std::max_element(endCost.begin(), endCost.end()) - minEndCost);
+    expCost.resize(cost.size());
+    for (std::size_t i = 0, n = cost.size(); i < n; ++i) expCost[i] = std::exp(minCost - cost[i]);
+    expEndCost.resize(nLabels);
+    for (LabelIndex l = 0; l < nLabels; ++l) expEndCost[l] = std::exp(minEndCost - endCost[l]);
+  }
+
+  template <class FloatT>
+  static double dot(LinearChainFeatures const& features, FloatT const* params) {
+    double r = 0;
+    for (FeatureId id : features) r += params[id];
+    return r;
+  }
+
+  std::vector<double> cost, endCost, expCost, expEndCost;
+  double minCost, minEndCost;
+  /// max - min of cost, or of endCost
+  double costRange;
+};
+
+/**
+   forward-backward and viterbi over one LinearChainExample at a time;
+   reuses its buffers across examples (one per thread).
+ */
+template <class FloatT>
+struct LinearChainTrellis {
+  typedef double Real;
+
+  LinearChainTrellis(LinearChainModel const& model, LinearChainTransitionCosts const& transitionCosts,
+                     FeatureId numFeatures, FloatT const* params = 0)
+      : model(model)
+      , transitionCosts(transitionCosts)
+      , params(params)
+      , delta(numFeatures)
+      , pairPosterior(model.bigram ? model.transitions.size() : 0) {}
+
+  /**
+     \return cost of gold path - cost of all paths (i.e. -log p(gold)), and
+     add (gold - expected) feature counts to updates
+  */
+  FloatT update(LinearChainExample const& example, IUpdate<FloatT>& updates) {
+    assert(example.size());
+    emissionCosts(example);
+    FloatT const goldCost = addGold(example);
+    FloatT const pathsCost = forwardBackward(example);
+    for (FeatureId id : touched) {
+      updates.update(id, (FloatT)delta[id]);
+      delta[id] = 0;
+    }
+    touched.clear();
+    return goldCost - pathsCost;
+  }
+
+  /**
+     \return cost of the best path, whose candidate labels are placed in labels
+  */
+  FloatT viterbi(LinearChainExample const& example, std::vector<LabelIndex>& labels) {
+    std::size_t const n = example.size();
+    labels.clear();
+    if (!n) return 0;
+    emissionCosts(example);
+    std::size_t const nCandidates = example.candidates.size();
+    best.resize(nCandidates);
+    backPointer.resize(nCandidates);
+    LabelIndex const nLabels = model.nLabels;
+    for (std::size_t c = 0, e = example.candidatesEnd(0); c < e; ++c)
+      best[c] = emit[c] + transitionCost(model.start(), example.candidates[c]);
+    for (std::size_t t = 1; t < n; ++t) {
+      std::size_t const pb = example.candidatesBegin[t - 1], pe = example.candidatesBegin[t];
+      for (std::size_t c = pe, e = example.candidatesEnd(t); c < e; ++c) {
+        LabelIndex const label = example.candidates[c];
+        Real bestPrev = std::numeric_limits<Real>::infinity();
+        std::size_t argPrev = pb;
+        for (std::size_t j = pb; j < pe; ++j) {
+          Real const cost = best[j] + (model.bigram ? transitionCosts.cost[example.candidates[j] * nLabels + label] : 0);
+          if (cost < bestPrev) {
+            bestPrev = cost;
+            argPrev = j;
+          }
+        }
+        best[c] = bestPrev + emit[c];
+        backPointer[c] = argPrev;
+      }
+    }
+    Real bestCost = std::numeric_limits<Real>::infinity();
+    std::size_t arg = example.candidatesBegin[n - 1];
+    for (std::size_t c = arg, e = example.candidatesEnd(n - 1); c < e; ++c) {
+      Real const cost = best[c] + endCost(example.candidates[c]);
+      if (cost < bestCost) {
+        bestCost = cost;
+        arg = c;
+      }
+    }
+    labels.resize(n);
+    for (std::size_t t = n; t--;) {
+      labels[t] = example.candidates[arg];
+      arg = backPointer[arg];
+    }
+    return (FloatT)bestCost;
+  }
+
+  LinearChainModel const& model;
+  LinearChainTransitionCosts const& transitionCosts;
+  /// the weights transitionCosts were computed from
+  FloatT const* params;
+
+ private:
+  Real transitionCost(LabelIndex prev, LabelIndex label) const {
+    return model.bigram ? transitionCosts.cost[prev * model.nLabels + label] : 0;
+  }
+  Real endCost(LabelIndex label) const { return model.bigram ? transitionCosts.endCost[label] : 0; }
+
+  void emissionCosts(LinearChainExample const& example) {
+    std::size_t const nCandidates = example.candidates.size();
+    emit.resize(nCandidates);
+    for (std::size_t c = 0; c < nCandidates; ++c) {
+      Real cost = 0;
+      for (std::size_t f = example.featuresBegin[c], e = example.featuresBegin[c + 1]; f < e; ++f)
+        cost += params[example.features[f]];
+      emit[c] = cost;
+    }
+  }
+
+  void add(FeatureId id, Real count) {
+    if (delta[id] == 0) touched.push_back(id);
+    delta[id] += count;
+  }
+
+  void add(LinearChainFeatures const& features, Real count) {
+    for (FeatureId id : features) add(id, count);
+  }
+
+  void addEmission(LinearChainExample const& example, std::size_t c, Real count) {
+    for (std::size_t f = example.featuresBegin[c], e = example.featuresBegin[c + 1]; f < e; ++f)
+      add(example.features[f], count);
+  }
+
+  /// \return cost of gold path, after adding its features
+  FloatT addGold(LinearChainExample const& example) {
+    Real cost = 0;
+    LabelIndex prev = model.start();
+    for (std::size_t t = 0, n = example.size(); t < n; ++t) {
+      std::size_t const c = example.gold[t];
+      assert(c != (std::size_t)LinearChainExample::kNoGold);
+      LabelIndex const label = example.candidates[c];
+      cost += emit[c];
+      addEmission(example, c, 1);
+      if (model.bigram) {
+        cost += transitionCost(prev, label);
+        add(model.transition(prev, label), 1);
+      }
+      prev = label;
+    }
+    if (model.bigram) {
+      cost += endCost(prev);
+      add(model.ends[prev], 1);
+    }
+    return (FloatT)cost;
+  }
+
+  /**
+     if a transition cost plus an emission cost can exceed the cheapest by
+     more than this, exps of the shifted costs (and products of them with
+     normalized alphas) could underflow, losing paths that matter; we use
+     forwardBackwardCosts instead.
+  */
+  static Real maxScaledCostRange() { return 250; }
+
+  /// \return -log sum over paths of exp(-cost), after subtracting expected features
+  FloatT forwardBackward(LinearChainExample const& example) {
+    std::size_t const n = example.size();
+    std::size_t const nCandidates = example.candidates.size();
+    LabelIndex const nLabels = model.nLabels;
+    bool const bigram = model.bigram;
+    Real const* expCost = bigram ? transitionCosts.expCost.data() : 0;
+    Real const* expEndCost = bigram ? transitionCosts.expEndCost.data() : 0;
+    std::vector<std::size_t> const& begin = example.candidatesBegin;
+    LabelIndex const* candidates = example.candidates.data();
+
+    expEmit.resize(nCandidates);
+    alpha.resize(nCandidates);
+    beta.resize(nCandidates);
+    scale.resize(n);
+
+    // costs are shifted so the cheapest candidate (and transition) has exp 1
+    Real shift = bigram ? n * transitionCosts.minCost + transitionCosts.minEndCost : 0;
+    Real const maxEmitRange = maxScaledCostRange() - transitionCosts.costRange;
+    for (std::size_t t = 0; t < n; ++t) {
+      std::size_t const b = begin[t], e = begin[t + 1];
+      assert(b < e);
+      std::pair<std::vector<Real>::const_iterator, std::vector<Real>::const_iterator> const minMax
+          = std::minmax_element(emit.begin() + b, emit.begin() + e);
+      Real const minEmit = *minMax.first;
+      if (*minMax.second - minEmit > maxEmitRange) return forwardBackwardCosts(example);
+      shift += minEmit;
+      for (std::size_t c = b; c < e; ++c) expEmit[c] = std::exp(minEmit - emit[c]);
+    }
+
+    // forward (alpha normalized to sum 1 at each position)
+    Real logScale = 0;
+    for (std::size_t t = 0; t < n; ++t) {
+      std::size_t const b = begin[t], e = begin[t + 1];
+      Real* a = alpha.data();
+      if (t == 0) {
+        Real const* row = bigram ? expCost + model.start() * nLabels : 0;
+        for (std::size_t c = b; c < e; ++c) a[c] = bigram ? row[candidates[c]] : 1;
+      } else {
+        std::size_t const pb = begin[t - 1];
+        if (bigram) {
+          std::fill(a + b, a + e, 0);
+          for (std::size_t j = pb; j < b; ++j) {
+            Real const aj = a[j];
+            Real const* row = expCost + candidates[j] * nLabels;
+            for (std::size_t c = b; c < e; ++c) a[c] += aj * row[candidates[c]];
+          }
+        } else
+          std::fill(a + b, a + e, 1);  // previous alpha sums to 1
+      }
+      Real sum = 0;
+      for (std::size_t c = b; c < e; ++c) sum += (a[c] *= expEmit[c]);
+      scale[t] = sum;
+      logScale += std::log(sum);
+      Real const inv = 1 / sum;
+      for (std::size_t c = b; c < e; ++c) a[c] *= inv;
+    }
+
+    std::size_t const lastBegin = begin[n - 1];
+    Real final = 0;
+    for (std::size_t c = lastBegin; c < nCandidates; ++c)
+      final += alpha[c] * (bigram ? expEndCost[candidates[c]] : 1);
+
+    // backward (scaled by the same factors)
+    for (std::size_t c = lastBegin; c < nCandidates; ++c) beta[c] = bigram ? expEndCost[candidates[c]] : 1;
+    for (std::size_t t = n - 1; t > 0; --t) {
+      std::size_t const b = begin[t], e = begin[t + 1], pb = begin[t - 1];
+      Real const inv = 1 / scale[t];
+      if (bigram) {
+        for (std::size_t j = pb; j < b; ++j) {
+          Real const* row = expCost + candidates[j] * nLabels;
+          Real sum = 0;
+          for (std::size_t c = b; c < e; ++c) sum += row[candidates[c]] * expEmit[c] * beta[c];
+          beta[j] = sum * inv;
+        }
+      } else {
+        Real sum = 0;
+        for (std::size_t c = b; c < e; ++c) sum += expEmit[c] * beta[c];
+        std::fill(beta.begin() + pb, beta.begin() + b, sum * inv);
+      }
+    }
+
+    // expected features
+    Real const invFinal = 1 / final;
+    for (std::size_t c = 0; c < nCandidates; ++c) {
+      Real const posterior = alpha[c] * beta[c] * invFinal;
+      if (posterior) addEmission(example, c, -posterior);
+    }
+    if (bigram) {
+      std::fill(pairPosterior.begin(), pairPosterior.end(), 0);
+      Real* start = pairPosterior.data() + model.start() * nLabels;
+      for (std::size_t c = 0, e = begin[1]; c < e; ++c) start[candidates[c]] += alpha[c] * beta[c] * invFinal;
+      for (std::size_t t = 1; t < n; ++t) {
+        std::size_t const b = begin[t], e = begin[t + 1], pb = begin[t - 1];
+        Real const norm = invFinal / scale[t];
+        for (std::size_t j = pb; j < b; ++j) {
+          LabelIndex const prev = candidates[j];
+          Real const* row = expCost + prev * nLabels;
+          Real* pairs = pairPosterior.data() + prev * nLabels;
+          Real const aj = alpha[j] * norm;
+          for (std::size_t c = b; c < e; ++c) pairs[candidates[c]] += aj * row[candidates[c]] * expEmit[c] * beta[c];
+        }
+      }
+      for (std::size_t i = 0, e = pairPosterior.size(); i < e; ++i)
+        if (pairPosterior[i]) add(model.transitions[i], -pairPosterior[i]);
+      for (std::size_t c = lastBegin; c < nCandidates; ++c)
+        add(model.ends[candidates[c]], -alpha[c] * beta[c] * invFinal);
+    }
+
+    return (FloatT)(shift - logScale - std::log(final));
+  }
+
+  /// -log (sum of exp(-cost)) of the costs added
+  struct CostSum {
+    CostSum() : min(std::numeric_limits<Real>::infinity()), sum() {}
+    void add(Real cost) {
+      if (cost < min) {
+        sum = sum * std::exp(cost - min) + 1;
+        min = cost;
+      } else
+        sum += std::exp(min - cost);
+    }
+    Real cost() const { return min - std::log(sum); }
+    Real min, sum;
+  };
+
+  /**
+     as forwardBackward, but with alpha and beta as costs (-log), so any
+     range of weights is fine (but there are nCandidates^2 exps per position
+     instead of multiplies).
+  */
+  FloatT forwardBackwardCosts(LinearChainExample const& example) {
+    std::size_t const n = example.size();
+    std::size_t const nCandidates = example.candidates.size();
+    std::vector<std::size_t> const& begin = example.candidatesBegin;
+    LabelIndex const* candidates = example.candidates.data();
+    alpha.resize(nCandidates);
+    beta.resize(nCandidates);
+
+    // alpha[c]: cost of prefixes through c, including c's emission
+    for (std::size_t c = 0, e = begin[1]; c < e; ++c)
+      alpha[c] = transitionCost(model.start(), candidates[c]) + emit[c];
+    for (std::size_t t = 1; t < n; ++t) {
+      std::size_t const b = begin[t], e = begin[t + 1], pb = begin[t - 1];
+      for (std::size_t c = b; c < e; ++c) {
+        CostSum prefixes;
+        for (std::size_t j = pb; j < b; ++j) prefixes.add(alpha[j] + transitionCost(candidates[j], candidates[c]));
+        alpha[c] = prefixes.cost() + emit[c];
+      }
+    }
+
+    // beta[c]: cost of suffixes after c, including end
+    std::size_t const lastBegin = begin[n - 1];
+    CostSum paths;
+    for (std::size_t c = lastBegin; c < nCandidates; ++c) {
+      beta[c] = endCost(candidates[c]);
+      paths.add(alpha[c] + beta[c]);
+    }
+    Real const pathsCost = paths.cost();
+    for (std::size_t t = n - 1; t > 0; --t) {
+      std::size_t const b = begin[t], e = begin[t + 1], pb = begin[t - 1];
+      for (std::size_t j = pb; j < b; ++j) {
+        CostSum suffixes;
+        for (std::size_t c = b; c < e; ++c)
+          suffixes.add(transitionCost(candidates[j], candidates[c]) + emit[c] + beta[c]);
+        beta[j] = suffixes.cost();
+      }
+    }
+
+    // expected features
+    for (std::size_t c = 0; c < nCandidates; ++c) {
+      Real const posterior = std::exp(pathsCost - alpha[c] - beta[c]);
+      if (posterior) addEmission(example, c, -posterior);
+    }
+    if (model.bigram) {
+      for (std::size_t c = 0, e = begin[1]; c < e; ++c)
+        add(model.transition(model.start(), candidates[c]), -std::exp(pathsCost - alpha[c] - beta[c]));
+      for (std::size_t t = 1; t < n; ++t) {
+        std::size_t const b = begin[t], e = begin[t + 1], pb = begin[t - 1];
+        for (std::size_t j = pb; j < b; ++j)
+          for (std::size_t c = b; c < e; ++c) {
+            Real const posterior = std::exp(pathsCost - alpha[j] - transitionCost(candidates[j], candidates[c])
+                                            - emit[c] - beta[c]);
+            if (posterior) add(model.transition(candidates[j], candidates[c]), -posterior);
+          }
+      }
+      for (std::size_t c = lastBegin; c < nCandidates; ++c)
+        add(model.ends[candidates[c]], -std::exp(pathsCost - alpha[c] - beta[c]));
+    }
+    return (FloatT)pathsCost;
+  }
+
+  /// gold - expected feature counts for the current example, nonzero for touched
+  std::vector<Real> delta;
+  LinearChainFeatures touched;
+  std::vector<Real> emit, expEmit, alpha, beta, scale, pairPosterior, best;
+  std::vector<std::size_t> backPointer;
+};
+
+/**
+   CRF objective (negative log likelihood of the observed labels) over dense
+   linear-chain examples.
+
+   setFeatureWeights keeps the params pointer (valid until the following
+   getUpdates, as DataObjectiveFunction and the online optimizer use it).
+
+   getUpdates may be called from several threads at once
+   (getUpdatesParallel); each call borrows its own LinearChainTrellis (the
+   gradient scratch is numFeatures long, so trellises are kept for reuse
+   rather than allocated per call).
+ */
+template <class FloatT>
+class LinearChainCrfObjFct : public DataObjectiveFunction<FloatT> {
+ public:
+  explicit LinearChainCrfObjFct(shared_ptr<LinearChainData> const& data, FeatureId numFeatures)
+      : data_(data), numFeatures_(numFeatures), params_() {}
+
+  std::size_t getNumExamples() override { return data_->examples.size(); }
+
+  void setFeatureWeights(FloatT const* params, FeatureId numParams) override {
+    params_ = params;
+    transitionCosts_.set(data_->model, params);
+  }
+
+  void setFeatureWeights(TrainingDataIndex, TrainingDataIndex, FloatT const* params, FeatureId numParams) override {
+    setFeatureWeights(params, numParams);
+  }
+
+  void accept(IObjectiveFunctionVisitor<FloatT>* visitor) override { visitor->visit(this); }
+
+  FloatT getUpdates(TrainingDataIndex begin, TrainingDataIndex end, IUpdate<FloatT>& updates) override {
+    assert(params_);
+    unique_ptr<Trellis> trellis(borrowTrellis());
+    trellis->params = params_;
+    FloatT fctValDelta = 0;
+    for (TrainingDataIndex i = begin; i < end; ++i) {
+      LinearChainExample const& example = data_->examples[i];
+      if (example.size()) fctValDelta += trellis->update(example, updates);
+    }
+    returnTrellis(trellis);
+    return fctValDelta;
+  }
+
+ private:
+  typedef LinearChainTrellis<FloatT> Trellis;
+
+  Trellis* borrowTrellis() {
+    {
+      std::lock_guard<std::mutex> lock(trellisesMutex_);
+      if (!trellises_.empty()) {
+        Trellis* r = trellises_.back().release();
+        trellises_.pop_back();
+        return r;
+      }
+    }
+    return new Trellis(data_->model, transitionCosts_, numFeatures_);
+  }
+
+  void returnTrellis(unique_ptr<Trellis>& trellis) {
+    std::lock_guard<std::mutex> lock(trellisesMutex_);
+    trellises_.push_back(std::move(trellis));
+  }
+
+  shared_ptr<LinearChainData> data_;
+  FeatureId numFeatures_;
+  FloatT const* params_;
+  LinearChainTransitionCosts transitionCosts_;
+  std::mutex trellisesMutex_;
+  std::vector<unique_ptr<Trellis>> trellises_;
+};
+
+
+}}
+
+#endif
@@ -26,6 +26,7 @@
 #include <sdl/Util/Delete.hpp>
 #include <sdl/Util/Equal.hpp>
 #include <sdl/Util/IsDebugBuild.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/Sleep.hpp>
 #include <sdl/Util/Unordered.hpp>
 #include <sdl/Exception.hpp>
@@ -37,6 +38,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <functional>
 #include <functional>
 #include <iomanip>
@@ -294,11 +296,22 @@ class DataObjectiveFunction : public IObjectiveFunction<FloatT> {
                  : (Update*)new GradientUpdate<FloatT>(resultingGradients));
 
     // Get updates from all training examples:
+    typedef std::chrono::steady_clock Clock;
+    bool const timed = Util::metricsEnabled();
+    Clock::time_point const started = timed ? Clock::now() : Clock::time_point();
     FloatT fctValUpdate = (FloatT)0.0;
     if (numThreads_ == 1)
       fctValUpdate = getUpdates(0, getNumExamples(), *update);
     else
       fctValUpdate = getUpdatesParallel(0, getNumExamples(), *update);
+    if (timed) {
+      // examples/sec = examples / (microseconds / 1e6)
+      SDL_METRIC_ADD(optimize_objective_evaluations, "objective function (and gradient) evaluations", 1);
+      SDL_METRIC_ADD(optimize_objective_examples, "training examples evaluated by the objective function",
+                     getNumExamples());
+      SDL_METRIC_ADD(optimize_objective_microseconds, "wall time evaluating training examples",
+                     std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+    }
 
     if (doScale_) fctValUpdate /= getNumExamples();
 
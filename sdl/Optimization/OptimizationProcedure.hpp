@@ -31,6 +31,7 @@
 #include <sdl/Optimization/HypergraphCrfObjFct.hpp>
 #include <sdl/Optimization/ICreateSearchSpace.hpp>
 #include <sdl/Optimization/LbfgsOptimizer.hpp>
+#include <sdl/Optimization/LinearChainCrf.hpp>
 #include <sdl/Optimization/OnlineOptimizer.hpp>
 #include <sdl/Util/Input.hpp>
 #include <sdl/Util/LogHelper.hpp>
@@ -124,6 +125,11 @@ class OptimizationProcedure {
   void test();
 
  private:
+  void optimize(DataObjectiveFunction<FloatT>& objFct);
+  void testLinearChain(LinearChainData const& data);
+  /// null unless the search space built dense linear-chain examples (ILinearChainExamples)
+  shared_ptr<LinearChainData> getLinearChainData() const;
+
   OptimizationProcedureOptions opts_;
 
   shared_ptr<ICreateSearchSpace<Arc>> pSearchSpace_;
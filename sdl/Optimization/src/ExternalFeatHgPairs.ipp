@@ -61,17 +61,19 @@ typename ExternalFeatHgPairs<Arc>::value_type ExternalFeatHgPairs<Arc>::operator
   Hypergraph::IHypergraphsIteratorTpl<Arc>* iter
       = Hypergraph::IHypergraphsIteratorTpl<Arc>::create(in, Hypergraph::kDashesSeparatedHg, voc);
   iter->setHgProperties(Hypergraph::kStoreInArcs | Hypergraph::kStoreOutArcs);
-  IHg* hg1 = iter->value();
-  iter->next();
-  assert(!iter->done());
-  IHg* hg2 = iter->value();
+  // release: the pair outlives iter, which would otherwise free both hgs
+  IHgPtr hg1(iter->release());
+  IHgPtr hg2(iter->release());
   delete iter;
+  if (!hg1 || !hg2)
+    SDL_THROW_LOG(Optimization.ExternalFeatHgPairs, FileFormatException,
+                  "Expected two '-----'-separated hypergraphs in " << pth.string());
 
   typedef Hypergraph::IMutableHypergraph<Arc> MHg;
-  detail::insertFeatureWeights(static_cast<MHg*>(hg1), weights_, numParams_);
-  detail::insertFeatureWeights(static_cast<MHg*>(hg2), weights_, numParams_);
+  detail::insertFeatureWeights(static_cast<MHg*>(hg1.get()), weights_, numParams_);
+  detail::insertFeatureWeights(static_cast<MHg*>(hg2.get()), weights_, numParams_);
 
-  return value_type(IHgPtr(hg1), IHgPtr(hg2));
+  return value_type(hg1, hg2);
 }
 
 template <class Arc>
@@ -21,6 +21,7 @@
 #include <sdl/Hypergraph/MutableHypergraph.hpp>
 #include <sdl/Optimization/Exception.hpp>
 #include <sdl/Optimization/IOriginalFeatureIds.hpp>
+#include <sdl/Optimization/LinearChainCrf.hpp>
 #include <sdl/Optimization/LoadFeatureWeights.hpp>
 #include <sdl/Optimization/OptimizationProcedure.hpp>
 #include <sdl/Vocabulary/HelperFunctions.hpp>
@@ -157,6 +158,10 @@ OptimizationProcedure::OptimizationProcedure(shared_ptr<ICreateSearchSpace<Arc>>
 void OptimizationProcedure::test() {
   SDL_DEBUG(Optimization.OptimizationProcedure, "Starting test()");
   loadFeatureWeightsFile(opts_.weightsPath, &weightsmap_);
+  if (shared_ptr<LinearChainData> data = getLinearChainData()) {
+    testLinearChain(*data);
+    return;
+  }
   Hypergraph::InsertSparseWeightsVisitor<Arc> addDotProduct(weightsmap_);
 
   typedef IFeatureHypergraphPairs<Arc> Pairs;
@@ -184,11 +189,54 @@ void OptimizationProcedure::test() {
   }
 }
 
+/**
+   best label sequence of each example (dense linear-chain examples instead
+   of unclamped hypergraphs)
+*/
+void OptimizationProcedure::testLinearChain(LinearChainData const& data) {
+  if (opts_.testModeOutputHypergraph)
+    SDL_THROW_LOG(Optimization.OptimizationProcedure, ConfigException,
+                  "test-mode-output-hypergraph: there are no hypergraphs for dense linear-chain examples");
+  std::vector<FloatT> params(pSearchSpace_->getNumFeatures());
+  for (Weight::Map::const_iterator i = weightsmap_.begin(), end = weightsmap_.end(); i != end; ++i) {
+    if (i->first >= params.size()) params.resize(i->first + 1);
+    params[i->first] = i->second;
+  }
+  LinearChainTransitionCosts transitionCosts;
+  transitionCosts.set(data.model, params.data());
+  LinearChainTrellis<FloatT> trellis(data.model, transitionCosts, 0, params.data());
+  std::vector<LabelIndex> labels;
+  for (LinearChainExample const& example : data.examples) {
+    FloatT const cost = trellis.viterbi(example, labels);
+    if (opts_.testModeDetailed) std::cout << cost << "\t";
+    for (std::size_t t = 0, n = labels.size(); t < n; ++t) {
+      if (t) std::cout << ' ';
+      std::cout << data.model.labelNames[labels[t]];
+    }
+    std::cout << '\n';
+  }
+}
+
+shared_ptr<LinearChainData> OptimizationProcedure::getLinearChainData() const {
+  ILinearChainExamples* examples = dynamic_cast<ILinearChainExamples*>(pSearchSpace_.get());
+  return examples ? examples->getLinearChainData() : shared_ptr<LinearChainData>();
+}
+
 void OptimizationProcedure::optimize() {
   SDL_DEBUG(Optimization.OptimizationProcedure, "Starting optimize() for " << pSearchSpace_->getNumFeatures()
                                                                            << " feature weights");
+  if (shared_ptr<LinearChainData> data = getLinearChainData()) {
+    SDL_INFO(Optimization.OptimizationProcedure, "Training on " << data->examples.size()
+                                                                << " dense linear-chain examples");
+    LinearChainCrfObjFct<FloatT> objFct(data, pSearchSpace_->getNumFeatures());
+    optimize(objFct);
+  } else {
+    HypergraphCrfObjFct<Arc> objFct(pSearchSpace_->getFeatureHypergraphPairs());
+    optimize(objFct);
+  }
+}
 
-  HypergraphCrfObjFct<Arc> objFct(pSearchSpace_->getFeatureHypergraphPairs());
+void OptimizationProcedure::optimize(DataObjectiveFunction<FloatT>& objFct) {
   objFct.setRegularizeFct(new L2RegularizeFct<FloatT>(opts_.variance));
   objFct.setNumThreads(opts_.numThreads);
 
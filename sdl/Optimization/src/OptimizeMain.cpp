@@ -32,6 +32,7 @@
 #include <sdl/Util/LoadLibrary.hpp>
 #include <sdl/Util/Locale.hpp>
 #include <sdl/Util/LogHelper.hpp>
+#include <sdl/Util/Metrics.hpp>
 #include <sdl/Util/Performance.hpp>
 #include <sdl/Util/ProgramOptions.hpp>
 #include <sdl/Util/QuickExit.hpp>
@@ -85,6 +86,8 @@ int main(int ac, char* av[]) {
     bool checkGradients;
     std::string logConfigFile;
     bool testMode;
+    Util::MetricsOptions metricsOpt;
+    std::string metricsFormat;
     sdl::AddOption opt(generic);
 
     opt("config,c", po::value(&configFile)->default_value("./XMTConfig.yml"),
@@ -105,6 +108,11 @@ int main(int ac, char* av[]) {
         "Checks gradients computation (for debugging -- expensive)");
     opt("test-mode", po::bool_switch(&testMode)->default_value(false),
         "Test mode (will just decode the data given the weights specified in yaml config file)");
+    opt("metrics-path", po::value(&metricsOpt.path),
+        "if set, count objective function examples and time (and any hypergraph metrics) and write them to "
+        "this file ('-' for stdout) when done");
+    opt("metrics-format", po::value(&metricsFormat)->default_value("json"),
+        "format of metrics-path: json or prometheus (text exposition)");
     opt("help,h", po::bool_switch(&help)->default_value(false), "Display help information");
 
     po::options_description options;
@@ -132,6 +140,9 @@ int main(int ac, char* av[]) {
       return Util::normalExit(0);
     }
 
+    string_to_impl(metricsFormat, metricsOpt.format);
+    metricsOpt.start();
+
     Resources::ResourceManager& resourceManager = Resources::mockResourceManager;
 
     // Load YAML config file and construct SDL instance (in order to
@@ -210,6 +221,7 @@ int main(int ac, char* av[]) {
       optimizer.setCheckGradients(checkGradients);
       optimizer.optimize();
     }
+    metricsOpt.finish();
   } catch (std::exception const& e) {
     std::cerr << e.what() << '\n';
     Util::quickExit(1);
@@ -0,0 +1,270 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef POOL__CONCURRENT_POOL_HPP
+#define POOL__CONCURRENT_POOL_HPP
+#pragma once
+
+/*!
+  \file
+  \brief Provides \ref concurrent_pool: a fixed-size chunk allocator that any number of threads may
+  malloc from and free to at once - including freeing a chunk on a thread other than the one that
+  allocated it (e.g. a hypergraph built by one pipeline stage and destroyed by the next).
+*/
+
+#include <Pool/poolfwd.hpp>
+#include <Pool/pool.hpp>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace Pool {
+
+namespace details {  //! Implemention only.
+
+//! small process-wide thread indices: a thread takes one on first use and gives it back when it exits,
+//! so the indices in use are < the max # of threads that ever used a concurrent_pool at once.
+struct thread_index_registry {
+  std::mutex mutex;
+  std::vector<unsigned> free_indices;
+  unsigned next_index;
+
+  thread_index_registry() : next_index() {}
+
+  unsigned acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_indices.empty()) return next_index++;
+    unsigned const r = free_indices.back();
+    free_indices.pop_back();
+    return r;
+  }
+
+  void release(unsigned index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_indices.push_back(index);
+  }
+};
+
+//! never destroyed (threads may free during static destruction)
+inline thread_index_registry& thread_indices() {
+  static thread_index_registry* r = new thread_index_registry;
+  return *r;
+}
+
+enum { no_thread_index = ~0u, exited_thread_index = ~0u - 1 };
+
+inline unsigned& thread_index_slot() {
+  static thread_local unsigned index = no_thread_index;
+  return index;
+}
+
+struct thread_index_holder {
+  ~thread_index_holder() {
+    unsigned& index = thread_index_slot();
+    thread_indices().release(index);
+    index = exited_thread_index;  // later frees by this thread (other thread_local dtors) go to the depot
+  }
+};
+
+inline unsigned this_thread_index() {
+  unsigned& index = thread_index_slot();
+  if (index == no_thread_index) {
+    index = thread_indices().acquire();
+    static thread_local thread_index_holder holder;
+    (void)holder;
+  }
+  return index;
+}
+
+}  // namespace details
+
+/*! \brief A fixed-size chunk allocator safe for concurrent use, with per-thread free lists.
+
+\details
+
+Each thread (up to \c max_cached_threads at once) has its own free list (cache) in the pool. malloc
+pops from the calling thread's cache and free pushes onto it - no lock, no atomic read-modify-write.
+Chunks move between caches and a shared, locked depot only in whole batches of \c batch_size: an empty
+cache takes a batch from the depot (or a new block from UserAllocator), and a cache that reaches
+2 * batch_size gives a batch back. So the lock is taken at most about once per batch_size
+mallocs/frees, and a thread that frees more than it allocates (a consumer freeing a producer's
+chunks) feeds the producer's refills through the depot.
+
+The cache of a thread that exits is inherited by the next new thread. Threads beyond
+\c max_cached_threads share one locked free list.
+
+Memory goes back to UserAllocator only in ~concurrent_pool (like \ref pool::purge_memory), which
+must not run concurrently with any other use. UserAllocator::malloc/free must be thread safe (they're
+called under the pool's lock, but other pools may call them at the same time).
+
+Chunks are aligned for any type (std::max_align_t).
+*/
+template <typename UserAllocator>
+class concurrent_pool {
+ public:
+  typedef UserAllocator user_allocator;  //!< User allocator.
+  typedef typename UserAllocator::size_type size_type;  //!< An unsigned integral type.
+  typedef typename UserAllocator::difference_type difference_type;  //!< A signed integral type.
+
+  enum { max_cached_threads = 64 };
+  enum { default_batch_size = 32 };
+  enum { min_alloc_size = alignof(std::max_align_t) };
+
+  explicit concurrent_pool(size_type requested_size, size_type batch_size = default_batch_size,
+                           size_type chunks_per_block = 0)
+      : requested_size_(requested_size)
+      , chunk_size_(round_up(requested_size < sizeof(void*) ? sizeof(void*) : requested_size))
+      , batch_size_(batch_size ? batch_size : 1)
+      , block_chunks_(block_chunks(chunks_per_block))
+      , overflow_()
+      , caches_() {
+    //! \param requested_size bytes per chunk
+    //! \param batch_size # of chunks moved at once between a thread's cache and the depot
+    //! \param chunks_per_block # of chunks requested from UserAllocator at once (rounded up to a
+    //! multiple of batch_size); 0 means about POOL_MALLOC_BLOCK_TARGET bytes
+  }
+
+  ~concurrent_pool() {
+    for (char* block : blocks_) (UserAllocator::free)(block);
+  }
+
+  concurrent_pool(concurrent_pool const&) = delete;
+  concurrent_pool& operator=(concurrent_pool const&) = delete;
+
+  //! \returns a free chunk of get_requested_size() bytes, or 0 if out of memory. amortized O(1)
+  void* malloc BOOST_PREVENT_MACRO_SUBSTITUTION() {
+    unsigned const t = details::this_thread_index();
+    if (t >= (unsigned)max_cached_threads) return malloc_overflow();
+    cache& c = caches_[t];
+    if (!c.head) {
+      c.head = take_batch();
+      if (!c.head) return 0;
+      c.n = batch_size_;
+    }
+    void* const r = c.head;
+    c.head = nextof(r);
+    --c.n;
+    return r;
+  }
+
+  //! \pre chunk came from malloc() on this pool (by any thread). amortized O(1)
+  void free BOOST_PREVENT_MACRO_SUBSTITUTION(void* const chunk) {
+    unsigned const t = details::this_thread_index();
+    if (t >= (unsigned)max_cached_threads) {
+      free_overflow(chunk);
+      return;
+    }
+    cache& c = caches_[t];
+    nextof(chunk) = c.head;
+    c.head = chunk;
+    if (++c.n >= 2 * batch_size_) give_batch(c);
+  }
+
+  size_type get_requested_size() const { return requested_size_; }
+  size_type get_chunk_size() const { return chunk_size_; }
+  size_type get_batch_size() const { return batch_size_; }
+
+  //! \returns bytes obtained from UserAllocator so far
+  size_type get_reserved_size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blocks_.size() * block_chunks_ * chunk_size_;
+  }
+
+ private:
+  //! a thread's free list, padded to a cache line so threads don't share lines
+  struct cache {
+    void* head;
+    size_type n;
+    char pad[64 - sizeof(void*) - sizeof(size_type)];
+  };
+
+  static void*& nextof(void* const ptr) { return *(static_cast<void**>(ptr)); }
+
+  static size_type round_up(size_type bytes) {
+    return (bytes + (min_alloc_size - 1)) / min_alloc_size * min_alloc_size;
+  }
+
+  size_type block_chunks(size_type chunks_per_block) const {
+    size_type n = chunks_per_block ? chunks_per_block : POOL_MALLOC_BLOCK_TARGET / chunk_size_;
+    n = (n + batch_size_ - 1) / batch_size_ * batch_size_;
+    return n ? n : batch_size_;
+  }
+
+  //! \returns a null-terminated list of batch_size_ chunks from the depot or a new block, or 0 if out of
+  //! memory
+  void* take_batch() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (depot_.empty() && !new_block()) return 0;
+    void* const r = depot_.back();
+    depot_.pop_back();
+    return r;
+  }
+
+  //! move batch_size_ chunks from c to the depot. O(batch_size_) outside the lock, O(1) in it
+  void give_batch(cache& c) {
+    void* const batch = c.head;
+    void* last = batch;
+    for (size_type i = 1; i < batch_size_; ++i) last = nextof(last);
+    c.head = nextof(last);
+    nextof(last) = 0;
+    c.n -= batch_size_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    depot_.push_back(batch);
+  }
+
+  //! \pre mutex_ held. carve a new block into batches in the depot
+  bool new_block() {
+    size_type const bytes = block_chunks_ * chunk_size_;
+    char* const block = (UserAllocator::malloc)(bytes);
+    if (!block) return false;
+    blocks_.push_back(block);
+    for (char* batch = block, *end = block + bytes; batch < end;) {
+      depot_.push_back(batch);
+      char* const batch_end = batch + batch_size_ * chunk_size_;
+      for (; batch + chunk_size_ < batch_end; batch += chunk_size_) nextof(batch) = batch + chunk_size_;
+      nextof(batch) = 0;
+      batch = batch_end;
+    }
+    return true;
+  }
+
+  void* malloc_overflow() {
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    if (!overflow_ && !(overflow_ = take_batch())) return 0;
+    void* const r = overflow_;
+    overflow_ = nextof(r);
+    return r;
+  }
+
+  void free_overflow(void* const chunk) {
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    nextof(chunk) = overflow_;
+    overflow_ = chunk;
+  }
+
+  size_type const requested_size_, chunk_size_, batch_size_, block_chunks_;
+
+  //! guards depot_ and blocks_
+  std::mutex mutex_;
+  //! heads of full batches
+  std::vector<void*> depot_;
+  std::vector<char*> blocks_;
+
+  //! free list shared by threads beyond max_cached_threads
+  std::mutex overflow_mutex_;
+  void* overflow_;
+
+  cache caches_[max_cached_threads];
+};
+
+}
+
+#endif
@@ -54,6 +54,12 @@ class pool;
 template <typename T, typename UserAllocator = default_user_allocator_new_delete>
 class object_pool;
 
+//
+// Location: <Pool/concurrent_pool.hpp>
+//
+template <typename UserAllocator = default_user_allocator_new_delete>
+class concurrent_pool;
+
 
 }
 
@@ -0,0 +1,206 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    per-request monotonic arena, and a thread-local allocation context that
+    opted-in types (hypergraph arcs, derivations, FeatureWeight maps, compose
+    intermediates) allocate from:
+
+      Util::Arena arena;
+      for (each request) {
+        {
+          Util::ArenaScope scope(&arena);
+          ... read, transform, print; destroy the request's hypergraphs ...
+        }
+        arena.release();  // all the request's memory at once
+      }
+
+    while a scope is open, arenaMalloc bumps a pointer in the arena (no lock,
+    no shared heap). with no scope open it's ::operator new. arenaFree of
+    memory in any live Arena does nothing, else it's ::operator delete. arena
+    memory is recognized by address, without a lock: blocks are aligned to
+    and sized in 64KiB granules, flagged in a process-wide page map.
+
+    contract: an object allocated under a scope may be destroyed by any thread
+    (e.g. parallelFor workers, which have no scope and otherwise use the heap
+    as usual), but before the arena's release() or destruction (or not at all -
+    its memory goes with release()).
+
+    pooledMalloc/pooledFree (arcs, Earley items) are the same but with no
+    scope open take small sizes from process-wide Pool::concurrent_pools (one
+    per 16-byte size class): per-thread free lists, so threads building and
+    destroying hypergraphs at once don't contend, and an object may be freed
+    by a thread other than the one that allocated it (hypergraphs handed
+    between pipeline stages).
+*/
+
+#ifndef SDL_UTIL_ARENA_HPP
+#define SDL_UTIL_ARENA_HPP
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace sdl {
+namespace Util {
+
+/**
+   monotonic allocator: allocate() bumps a pointer through blocks that double
+   in size (up to maxBlockBytes, both rounded up to kGranuleBytes); nothing is
+   freed until release(). not thread safe.
+*/
+class Arena {
+ public:
+  enum { kAlign = alignof(std::max_align_t) };
+  /// blocks are aligned to and a multiple of kGranuleBytes
+  enum { kGranuleShift = 16, kGranuleBytes = 1 << kGranuleShift };
+  enum { kDefaultFirstBlockBytes = 64 * 1024, kDefaultMaxBlockBytes = 16 * 1024 * 1024 };
+
+  explicit Arena(std::size_t firstBlockBytes = kDefaultFirstBlockBytes,
+                 std::size_t maxBlockBytes = kDefaultMaxBlockBytes);
+  ~Arena();
+  Arena(Arena const&) = delete;
+  Arena& operator=(Arena const&) = delete;
+
+  void* allocate(std::size_t bytes) {
+    bytes = (bytes + (kAlign - 1)) & ~(std::size_t)(kAlign - 1);
+    if (bytes <= (std::size_t)(end_ - next_)) {
+      void* r = next_;
+      next_ += bytes;
+      return r;
+    }
+    return allocateSlow(bytes);
+  }
+
+  /// whether p was returned by allocate() since the last release()
+  bool owns(void const* p) const {
+    char const* c = (char const*)p;
+    return (c >= current_ && c < end_) || ownsSlow(c);
+  }
+
+  /// frees everything allocated; keeps the first block for reuse. O(# blocks)
+  void release();
+
+  /// bytes handed out by allocate() since release()
+  std::size_t bytesAllocated() const { return allocated_ + (next_ - current_); }
+
+  /// bytes of blocks held
+  std::size_t bytesReserved() const { return reserved_; }
+
+ private:
+  struct Block {
+    char* begin;
+    char* end;
+    /// from ::operator new; begin is raw rounded up to kGranuleBytes
+    char* raw;
+    bool operator<(Block const& o) const { return begin < o.begin; }
+  };
+
+  void* allocateSlow(std::size_t bytes);
+  bool ownsSlow(char const* p) const;
+  char* newBlock(std::size_t bytes);
+  static void deleteBlock(Block const& block);
+
+  std::size_t firstBlockBytes_, maxBlockBytes_, nextBlockBytes_;
+  /// all blocks, sorted by address (for owns)
+  std::vector<Block> blocks_;
+  /// bump region of the current block
+  char *current_, *next_, *end_;
+  /// bytes allocated in blocks other than the current one
+  std::size_t allocated_, reserved_;
+};
+
+/**
+   while alive, arenaMalloc on this thread allocates from arena (a null arena
+   opens no scope). scopes nest.
+*/
+class ArenaScope {
+ public:
+  explicit ArenaScope(Arena* arena);
+  ~ArenaScope();
+  ArenaScope(ArenaScope const&) = delete;
+  ArenaScope& operator=(ArenaScope const&) = delete;
+
+  Arena* arena() const { return arena_; }
+  ArenaScope* outer() const { return outer_; }
+
+ private:
+  Arena* arena_;
+  ArenaScope* outer_;
+};
+
+/// the innermost open scope's arena on this thread, or null
+Arena* currentArena();
+
+/// from currentArena() if any, else ::operator new
+void* arenaMalloc(std::size_t bytes);
+
+/// no-op if p belongs to a live Arena (on any thread), else ::operator delete
+void arenaFree(void* p);
+
+/// arenaMalloc, except without a scope small sizes come from concurrent pools
+void* pooledMalloc(std::size_t bytes);
+
+/// \pre p from pooledMalloc(bytes) (on any thread); as arenaFree for arena memory
+void pooledFree(void* p, std::size_t bytes);
+
+/// user allocator (static malloc/free) as for graehl::intrusive_refcount and Pool
+struct ArenaUserAllocator {
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+  static char* malloc(size_type bytes) { return (char*)arenaMalloc(bytes); }
+  static void free(char* p) { arenaFree(p); }
+};
+
+/// base class giving a type class-specific new/delete via arenaMalloc/arenaFree
+struct ArenaAllocated {
+  static void* operator new(std::size_t bytes) { return arenaMalloc(bytes); }
+  static void operator delete(void* p) { arenaFree(p); }
+  static void* operator new(std::size_t, void* p) { return p; }
+  static void operator delete(void*, void*) {}
+};
+
+/**
+   as ArenaAllocated but via pooledMalloc/pooledFree. the sized delete needs
+   the size new got: delete only through the most derived type, or give the
+   base a virtual destructor.
+*/
+struct PooledAllocated {
+  static void* operator new(std::size_t bytes) { return pooledMalloc(bytes); }
+  static void operator delete(void* p, std::size_t bytes) { pooledFree(p, bytes); }
+  static void* operator new(std::size_t, void* p) { return p; }
+  static void operator delete(void*, void*) {}
+};
+
+/// std allocator via arenaMalloc/arenaFree (e.g. for std::allocate_shared)
+template <class T>
+struct ArenaAllocator {
+  typedef T value_type;
+  ArenaAllocator() {}
+  template <class U>
+  ArenaAllocator(ArenaAllocator<U> const&) {}
+  T* allocate(std::size_t n) { return (T*)arenaMalloc(n * sizeof(T)); }
+  void deallocate(T* p, std::size_t) { arenaFree(p); }
+  template <class U>
+  bool operator==(ArenaAllocator<U> const&) const {
+    return true;
+  }
+  template <class U>
+  bool operator!=(ArenaAllocator<U> const&) const {
+    return false;
+  }
+};
+
+
+}}
+
+#endif
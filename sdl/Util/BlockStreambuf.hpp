@@ -0,0 +1,248 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    input streambufs that hand out large contiguous blocks, so lines can be
+    found in place (LineReader) rather than char by char through
+    std::getline:
+
+    - MappedFileStreambuf: a plain file, memory-mapped (one block)
+
+    - GunzipStreambuf: a .gz file, decompressed by a background thread that
+      stays up to kReadAheadBlocks blocks ahead of the reader. BGZF files
+      (concatenated gzip members of at most 64k, each with its compressed size
+      in the header - e.g. from bgzip) are decompressed by several threads at
+      once. other multi-member gzip files are read ahead but decompressed
+      serially.
+
+    Input::init uses these when the process-wide inputBackend options ask for
+    them (the hyp tools' --input-mmap and --input-read-ahead-gunzip; both off
+    by default), so getline, visitChompedLines etc. on an Input get the
+    benefit without change. a decompression error (corrupt .gz) is rethrown
+    by the reading istream, not just left as badbit.
+*/
+
+#ifndef SDL_UTIL_BLOCKSTREAMBUF_HPP
+#define SDL_UTIL_BLOCKSTREAMBUF_HPP
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace sdl {
+namespace Util {
+
+/**
+   how Input::init opens named files (not stdin or pipes). by default
+   (everything off) they're plain ifstreams.
+*/
+struct InputBackend {
+  /// memory-map plain files
+  bool mmap;
+  /// decompress .gz files in a background thread
+  bool readAheadGunzip;
+  /// threads for BGZF decompression (0: one per core)
+  unsigned gunzipThreads;
+  /// bytes of decompressed text per read-ahead block (approximate for BGZF)
+  std::size_t blockBytes;
+
+  InputBackend() : mmap(false), readAheadGunzip(false), gunzipThreads(), blockBytes(4 << 20) {}
+
+  template <class Config>
+  void configure(Config& config) {
+    config.is("InputBackend");
+    config("input-mmap", &mmap)
+        .defaulted()("memory-map plain input files (faster line reading; the file must not change while read)");
+    config("input-read-ahead-gunzip", &readAheadGunzip)
+        .defaulted()("decompress .gz input files in background threads, ahead of the reader");
+    config("input-gunzip-threads", &gunzipThreads)
+        .defaulted()("threads decompressing BGZF (bgzip) input in parallel (0: one per core)");
+    config("input-block-bytes", &blockBytes)
+        .defaulted()("decompressed .gz input is handed over in blocks this large");
+  }
+};
+
+/// process-wide; change before opening inputs
+extern InputBackend inputBackend;
+
+/**
+   a streambuf whose get area is exposed: [begin(), end()) is the unread rest
+   of the current block.
+*/
+class BlockStreambuf : public std::streambuf {
+ public:
+  char const* begin() const { return gptr(); }
+  char const* end() const { return egptr(); }
+
+  /// mark [begin(), upto) as read
+  void consume(char const* upto) { setg(eback(), const_cast<char*>(upto), egptr()); }
+
+  /// \return false at eof, else [begin(), end()) is nonempty
+  bool more() { return gptr() != egptr() || sgetc() != traits_type::eof(); }
+};
+
+class MappedFileStreambuf : public BlockStreambuf {
+ public:
+  /// \return NULL if filename isn't a nonempty file we can map
+  static MappedFileStreambuf* open(std::string const& filename);
+  ~MappedFileStreambuf();
+
+ protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+ private:
+  MappedFileStreambuf();
+  struct Mapping;
+  std::unique_ptr<Mapping> mapping_;
+};
+
+class GunzipStreambuf : public BlockStreambuf {
+ public:
+  enum { kReadAheadBlocks = 2 };
+
+  /// throws FileException if filename can't be opened
+  GunzipStreambuf(std::string const& filename, std::size_t blockBytes, unsigned numThreads);
+
+  /// stops the decompressing thread
+  ~GunzipStreambuf();
+
+ protected:
+  int_type underflow() override;
+
+ private:
+  void produce(std::istream& file);
+  void decompressSerial(std::istream& file);
+  void decompressBgzf(std::istream& file);
+  /// false if we should stop
+  bool push(std::string& block);
+
+  std::string filename_;
+  std::size_t blockBytes_;
+  unsigned numThreads_;
+
+  std::string current_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<std::string> ready_;
+  bool done_, stop_;
+  std::exception_ptr error_;
+  std::thread thread_;
+};
+
+/**
+   an istream reading from (and owning) a BlockStreambuf. an exception from
+   the streambuf (e.g. GunzipStreambuf's decompression error) propagates to
+   the reader instead of being swallowed into badbit.
+*/
+class BlockIstream : public std::istream {
+ public:
+  explicit BlockIstream(BlockStreambuf* buf) : std::istream(buf), buf_(buf) { exceptions(std::ios_base::badbit); }
+
+ private:
+  std::unique_ptr<BlockStreambuf> buf_;
+};
+
+/**
+   the lines of a BlockStreambuf without copying them, except for lines that
+   span blocks (copied to a reused buffer). each line is valid until the next
+   call to next().
+*/
+class LineReader {
+ public:
+  typedef std::pair<char const*, char const*> Slice;
+
+  explicit LineReader(BlockStreambuf& buf) : buf_(buf), newline_() {}
+
+  /// \return false at eof, else set line to the next line (without its '\n')
+  bool next(Slice& line) {
+    if (!buf_.more()) return false;
+    char const* b = buf_.begin();
+    char const* e = buf_.end();
+    char const* nl = (char const*)std::memchr(b, '\n', e - b);
+    if (nl) {
+      line = Slice(b, nl);
+      buf_.consume(nl + 1);
+      newline_ = true;
+      return true;
+    }
+    carry_.assign(b, e);
+    buf_.consume(e);
+    newline_ = false;
+    while (buf_.more()) {
+      b = buf_.begin();
+      e = buf_.end();
+      nl = (char const*)std::memchr(b, '\n', e - b);
+      if (nl) {
+        carry_.append(b, nl);
+        buf_.consume(nl + 1);
+        newline_ = true;
+        break;
+      }
+      carry_.append(b, e);
+      buf_.consume(e);
+    }
+    line = Slice(carry_.data(), carry_.data() + carry_.size());
+    return true;
+  }
+
+  /// whether the last line was ended by '\n' (rather than eof)
+  bool newline() const { return newline_; }
+
+  /// as std::getline(in, line) (same stream state afterwards), where in.rdbuf() is our streambuf
+  bool getline(std::istream& in, std::string& line) {
+    if (!in.good()) {
+      in.setstate(std::ios_base::failbit);
+      return false;
+    }
+    Slice s;
+    if (!next(s)) {
+      line.clear();
+      in.setstate(std::ios_base::eofbit | std::ios_base::failbit);
+      return false;
+    }
+    line.assign(s.first, s.second);
+    if (!newline_) in.setstate(std::ios_base::eofbit);
+    return true;
+  }
+
+ private:
+  BlockStreambuf& buf_;
+  std::string carry_;
+  bool newline_;
+};
+
+/// \return in.rdbuf() if it's a BlockStreambuf, else NULL
+inline BlockStreambuf* blockStreambuf(std::istream& in) {
+  return dynamic_cast<BlockStreambuf*>(in.rdbuf());
+}
+
+/// std::getline, or (faster) LineReader::getline if in is a BlockIstream and until is '\n'
+inline bool getline(std::istream& in, std::string& line, char until = '\n') {
+  if (until == '\n')
+    if (BlockStreambuf* blocks = blockStreambuf(in)) return LineReader(*blocks).getline(in, line);
+  return (bool)std::getline(in, line, until);
+}
+
+
+}}
+
+#endif
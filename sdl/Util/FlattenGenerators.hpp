@@ -37,6 +37,7 @@
 #pragma once
 
 #include <sdl/Pool/object_pool.hpp>
+#include <sdl/Util/Arena.hpp>
 #include <sdl/Util/Generator.hpp>
 #include <sdl/Util/PriorityQueue.hpp>
 #include <sdl/Util/RefCount.hpp>
@@ -51,7 +52,8 @@ template <class GenGen, class WeightFn, class Result = typename GenGen::result_t
 struct FlattenGenerators
     : WeightFn,
       GeneratorTraits<FlattenGenerators<GenGen, WeightFn, Result, WeightT>, Result, PeekableT>,
-      intrusive_refcount<FlattenGenerators<GenGen, WeightFn, Result, WeightT>, RefCount> {
+      intrusive_refcount<FlattenGenerators<GenGen, WeightFn, Result, WeightT>, RefCount, ArenaUserAllocator>,
+      ArenaAllocated {
   typedef boost::intrusive_ptr<FlattenGenerators> Ptr;
   GenGen gengen;
   typedef typename GenGen::result_type Generator;
@@ -73,7 +75,8 @@ struct FlattenGenerators
     typedef Tip* key_type;
     friend inline reference get(TipPriorityPmap const&, key_type pTip) { return pTip->weight; }
   };
-  typedef Pool::object_pool<Tip> TipPool;  // Generator, Weight may not be pod, so we use object_pool not pool
+  // Generator, Weight may not be pod, so we use object_pool not pool
+  typedef Pool::object_pool<Tip, ArenaUserAllocator> TipPool;
   typedef shared_ptr<TipPool> TipPoolPtr;
   TipPoolPtr pTipPool;
   FlattenGenerators(GenGen const& gengen, WeightFn const& weightFn, TipPoolPtr pTipPool =
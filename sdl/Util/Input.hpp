@@ -12,6 +12,9 @@
 
     Input from stdin or filename as an istream smartpointer (.gz extension = gunzipped transparently).
 
+    files are memory-mapped and .gz decompressed in a background thread per
+    Util::inputBackend (see BlockStreambuf.hpp).
+
     - for STDIN/STDOUT, -2 for STDERR, -0 for none, x.gz for gzipped
 */
 
@@ -110,6 +113,9 @@ struct Input : InputStream {
 
   void init(std::string const& filename, bool mayDecrypt = kMayDecrypt, bool allowNullFile = true);
 
+  /// as InputStream::set(filename), but per inputBackend (mmap, or background gunzip)
+  void setFile(std::string const& filename);
+
   Input(InputStream const& in, bool mayDecrypt = kMayDecrypt) { init(in, mayDecrypt); }
 
   Input(Input const& o) : InputStream(o), decrypted(o.decrypted) {}
@@ -70,7 +70,7 @@ struct LineOptions : NormalizeUtf8 {
   }
 
   bool getlineNormalized(std::istream& in, std::string& line, char until = '\n') const {
-    if ((bool)std::getline(in, line, until)) {
+    if (Util::getline(in, line, until)) {
       normalize(line);
       return true;
     } else
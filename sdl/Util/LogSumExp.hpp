@@ -0,0 +1,189 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    batched add of neglog probs (log-sum-exp): many costs into one, and
+    elementwise over two arrays.
+
+    rather than one log1p(exp()) per pairwise neglogPlus, neglogSum shifts by
+    the min cost and does one exp per item and a single log for the whole
+    array. the inner loops are branch-free so the compiler can vectorize them;
+    with kFastLogSum (float only) exp and log1p are replaced by polynomial
+    approximations (relative error ~1e-7 for exp, ~1e-6 absolute for log1p) that
+    vectorize without calling libm.
+*/
+
+#ifndef SDL_UTIL_LOGSUMEXP_HPP
+#define SDL_UTIL_LOGSUMEXP_HPP
+#pragma once
+
+#include <sdl/Util/LogMath.hpp>
+#include <sdl/IntTypes.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#ifndef SDL_FAST_LOG_SUM
+#define SDL_FAST_LOG_SUM 0
+#endif
+
+namespace sdl {
+namespace Util {
+
+enum LogSumAccuracy {
+  /// std::exp and std::log1p (same results as repeated neglogPlus up to rounding)
+  kExactLogSum,
+  /// polynomial exp/log1p approximations for float; double is always exact
+  kFastLogSum
+};
+
+LogSumAccuracy const kDefaultLogSumAccuracy = SDL_FAST_LOG_SUM ? kFastLogSum : kExactLogSum;
+
+/// below this many items, neglogSum uses pairwise neglogPlus
+std::size_t const kMinBatchLogSum = 3;
+
+/// \return approximately exp(x) for x <= 0 (0 is returned as ~1e-38 for very negative x)
+inline float expNonPositiveFast(float x) {
+  x = x < -87.f ? -87.f : x;
+  float const t = x * 1.44269504088896341f;  // log2(e)
+  int32 i = (int32)t;  // truncates toward 0
+  i -= (t < (float)i);  // floor
+  float const f = t - (float)i;  // [0, 1)
+  float p = 1.535336188319500e-4f;
+  p = p * f + 1.339887440266574e-3f;
+  p = p * f + 9.618437357674640e-3f;
+  p = p * f + 5.550332471162809e-2f;
+  p = p * f + 2.402264791363012e-1f;
+  p = p * f + 6.931472028550421e-1f;
+  p = p * f + 1.f;
+  uint32 const bits = (uint32)(i + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+/// \return approximately log(1 + y) for y in [0, 1]
+inline float log1plusUnitFast(float y) {
+  // log(1+y) = 2 atanh(y / (2 + y)); t <= 1/3 so the series converges quickly
+  float const t = y / (2.f + y);
+  float const t2 = t * t;
+  float p = 1.f / 9;
+  p = p * t2 + 1.f / 7;
+  p = p * t2 + 1.f / 5;
+  p = p * t2 + 1.f / 3;
+  p = p * t2 + 1.f;
+  return 2.f * t * p;
+}
+
+namespace impl {
+
+template <class Float, bool Fast>
+struct LogSumKernel {
+  static inline Float expNonPositive(Float x) { return std::exp(x); }
+  static inline Float log1plusUnit(Float y) { return log1plus(y); }
+};
+
+template <>
+struct LogSumKernel<float, true> {
+  static inline float expNonPositive(float x) { return expNonPositiveFast(x); }
+  static inline float log1plusUnit(float y) { return log1plusUnitFast(y); }
+};
+
+template <bool Fast, class Float>
+Float neglogSum(Float const* costs, std::size_t n) {
+  typedef LogSumKernel<Float, Fast> K;
+  Float const kInf = std::numeric_limits<Float>::infinity();
+  Float m = kInf;
+  for (std::size_t i = 0; i < n; ++i) m = costs[i] < m ? costs[i] : m;
+  if (m == kInf) return kInf;
+  Float sum = 0;
+  for (std::size_t i = 0; i < n; ++i) sum += K::expNonPositive(m - costs[i]);
+  // sum >= 1 (the min term); log1plus keeps precision when the rest is tiny
+  return m - log1plus(sum - 1);
+}
+
+template <bool Fast, class Float>
+void neglogPlusArrays(Float const* a, Float const* b, Float* out, std::size_t n) {
+  typedef LogSumKernel<Float, Fast> K;
+  Float const kInf = std::numeric_limits<Float>::infinity();
+  for (std::size_t i = 0; i < n; ++i) {
+    Float const x = a[i], y = b[i];
+    Float const lo = x < y ? x : y;
+    Float const hi = x < y ? y : x;
+    Float const d = hi == kInf ? -kInf : lo - hi;  // avoid inf-inf
+    out[i] = lo - K::log1plusUnit(K::expNonPositive(d));
+  }
+}
+
+}
+
+/**
+   \return -log(sum_i exp(-costs[i])), i.e. neglogPlus of all costs (+inf for n=0).
+*/
+template <class Float>
+Float neglogSum(Float const* costs, std::size_t n, LogSumAccuracy accuracy = kDefaultLogSumAccuracy) {
+  if (n < kMinBatchLogSum) {
+    if (!n) return std::numeric_limits<Float>::infinity();
+    return n == 1 ? costs[0] : neglogPlus(costs[0], costs[1]);
+  }
+  return accuracy == kFastLogSum ? impl::neglogSum<true>(costs, n) : impl::neglogSum<false>(costs, n);
+}
+
+template <class Float>
+Float neglogSum(std::vector<Float> const& costs, LogSumAccuracy accuracy = kDefaultLogSumAccuracy) {
+  return neglogSum(costs.data(), costs.size(), accuracy);
+}
+
+/**
+   out[i] = neglogPlus(a[i], b[i]) for i in [0, n). out may alias a or b.
+*/
+template <class Float>
+void neglogPlusArrays(Float const* a, Float const* b, Float* out, std::size_t n,
+                      LogSumAccuracy accuracy = kDefaultLogSumAccuracy) {
+  if (accuracy == kFastLogSum)
+    impl::neglogPlusArrays<true>(a, b, out, n);
+  else
+    impl::neglogPlusArrays<false>(a, b, out, n);
+}
+
+/// a[i] = neglogPlus(a[i], b[i])
+template <class Float>
+void neglogPlusByArray(Float const* b, Float* a, std::size_t n, LogSumAccuracy accuracy = kDefaultLogSumAccuracy) {
+  neglogPlusArrays(a, b, a, n, accuracy);
+}
+
+/**
+   for (key, cost) pairs (keys may repeat): mapAddNeglogPlus(map, key,
+   neglogSum(costs for key)). keyCosts is sorted (by key) in place; costs is
+   scratch space (reuse it across calls to avoid allocation).
+*/
+template <class KeyCosts, class Map, class Float>
+void addNeglogSumsByKey(KeyCosts& keyCosts, Map& map, std::vector<Float>& costs,
+                        LogSumAccuracy accuracy = kDefaultLogSumAccuracy) {
+  typedef typename KeyCosts::value_type KeyCost;
+  std::sort(keyCosts.begin(), keyCosts.end(),
+            [](KeyCost const& x, KeyCost const& y) { return x.first < y.first; });
+  for (typename KeyCosts::const_iterator i = keyCosts.begin(), e = keyCosts.end(); i != e;) {
+    typename KeyCosts::const_iterator run = i;
+    costs.clear();
+    for (; i != e && i->first == run->first; ++i) costs.push_back(i->second);
+    mapAddNeglogPlus(map, run->first, neglogSum(costs, accuracy));
+  }
+}
+
+
+}}
+
+#endif
@@ -0,0 +1,160 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    process-wide named counters and (power of 2 bucket) histograms for hot
+    paths, dumped as JSON or Prometheus text.
+
+    usage (the metric is registered the first time it's recorded while
+    enabled):
+
+      SDL_METRIC_ADD(hyp_compose_arcs, "arcs created by fs::compose", nArcs);
+      SDL_METRIC_OBSERVE(hyp_bestpath_pops, "states popped per 1-best", stat.n_pop);
+
+    metrics are off unless enableMetrics() (e.g. hyp --metrics-path); then
+    each thread adds to its own shard of slots (no atomic read-modify-write,
+    no lock), and writeMetrics sums the shards. when off, recording costs a
+    relaxed atomic load and a branch. with SDL_METRICS 0, nothing at all.
+
+    for loops, count into a local and record once at the end.
+*/
+
+#ifndef SDL_UTIL_METRICS_HPP
+#define SDL_UTIL_METRICS_HPP
+#pragma once
+
+#include <sdl/Util/Enum.hpp>
+#include <sdl/IntTypes.hpp>
+#include <atomic>
+#include <iosfwd>
+#include <string>
+
+#ifndef SDL_METRICS
+#define SDL_METRICS 1
+#endif
+
+namespace sdl {
+namespace Util {
+
+SDL_ENUM(MetricsFormat, 2, (Json, Prometheus));
+
+extern std::atomic<bool> gMetricsEnabled;
+
+inline bool metricsEnabled() {
+  return SDL_METRICS && gMetricsEnabled.load(std::memory_order_relaxed);
+}
+
+void enableMetrics(bool enable = true);
+
+/// zero all metrics (names stay registered)
+void resetMetrics();
+
+/// sums over threads of all metrics recorded so far, sorted by name
+void writeMetrics(std::ostream& out, MetricsFormat format = kJson);
+
+enum MetricType { kCounterMetric, kHistogramMetric };
+
+/// histogram bucket b > 0 holds values in [2^(b-1), 2^b); bucket 0 holds 0
+enum { kMetricHistogramBuckets = 65 };
+
+namespace detail {
+/// \return first slot of a new metric (or of the already registered metric of that name and type)
+unsigned registerMetric(char const* name, char const* help, MetricType type);
+/// this thread's slots (allocated on first use)
+std::atomic<uint64>* metricSlots();
+
+inline void addToSlot(std::atomic<uint64>* slots, unsigned slot, uint64 n) {
+  std::atomic<uint64>& s = slots[slot];
+  // only this thread writes its shard; readers (writeMetrics) may see a stale value
+  s.store(s.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline unsigned histogramBucket(uint64 x) {
+  unsigned b = 0;
+  for (; x; x >>= 1) ++b;
+  return b;
+}
+}
+
+/// a monotonic count. record only if metricsEnabled()
+struct MetricCounter {
+  MetricCounter(char const* name, char const* help) : slot(detail::registerMetric(name, help, kCounterMetric)) {}
+  void add(uint64 n = 1) const { detail::addToSlot(detail::metricSlots(), slot, n); }
+  unsigned slot;
+};
+
+/// count and sum of observed values, and counts per power of 2. record only if metricsEnabled()
+struct MetricHistogram {
+  MetricHistogram(char const* name, char const* help)
+      : slot(detail::registerMetric(name, help, kHistogramMetric)) {}
+  void observe(uint64 x) const {
+    std::atomic<uint64>* slots = detail::metricSlots();
+    detail::addToSlot(slots, slot, x);  // sum
+    detail::addToSlot(slots, slot + 1 + detail::histogramBucket(x), 1);
+  }
+  unsigned slot;
+};
+
+/**
+   options for a main: if metrics-path is set, start() enables metrics and
+   finish() writes them there.
+*/
+struct MetricsOptions {
+  std::string path;
+  MetricsFormat format;
+
+  MetricsOptions() : format(kJson) {}
+
+  template <class Config>
+  void configure(Config& config) {
+    config.is("Metrics");
+    config("metrics-path", &path)(
+        "if set, count hot-path events (compose states/arcs, best-path heap pops, ...) and write them to this "
+        "file ('-' for stdout) on exit");
+    config("metrics-format", &format)("format of metrics-path: json or prometheus (text exposition)").init(kJson);
+  }
+
+  void start() const {
+    if (!path.empty()) enableMetrics();
+  }
+
+  /// write metrics if metrics-path
+  void finish() const;
+};
+
+
+}}
+
+#if SDL_METRICS
+#define SDL_METRIC_ADD(name, help, n)                                          \
+  do {                                                                         \
+    if (::sdl::Util::metricsEnabled()) {                                       \
+      static ::sdl::Util::MetricCounter const sdlMetric_##name(#name, help); \
+      sdlMetric_##name.add(n);                                                \
+    }                                                                          \
+  } while (0)
+#define SDL_METRIC_OBSERVE(name, help, x)                                        \
+  do {                                                                           \
+    if (::sdl::Util::metricsEnabled()) {                                         \
+      static ::sdl::Util::MetricHistogram const sdlMetric_##name(#name, help); \
+      sdlMetric_##name.observe(x);                                              \
+    }                                                                            \
+  } while (0)
+#else
+#define SDL_METRIC_ADD(name, help, n) \
+  do {                                \
+  } while (0)
+#define SDL_METRIC_OBSERVE(name, help, x) \
+  do {                                    \
+  } while (0)
+#endif
+
+#endif
@@ -17,6 +17,7 @@
 #define NORMALIZEUTF8_JG_2014_02_15_HPP
 #pragma once
 
+#include <sdl/Util/BlockStreambuf.hpp>
 #include <sdl/Util/Chomp.hpp>
 #include <sdl/Util/Nfc.hpp>
 #include <sdl/Util/Utf8.hpp>
@@ -51,12 +52,35 @@ struct NormalizeUtf8 : NfcOptions, FixUnicode {
   void normalize(std::string const& str, std::string& out) const;
 
   bool getlineNormalized(std::istream& in, std::string& utf8) const {
-    if ((bool)std::getline(in, utf8)) {
+    if (Util::getline(in, utf8)) {
       normalize(utf8);
       return true;
     } else
       return false;
   }
+
+  /// as above for in whose BlockStreambuf lines is reading
+  bool getlineNormalized(std::istream& in, LineReader& lines, std::string& utf8) const {
+    if (lines.getline(in, utf8)) {
+      normalize(utf8);
+      return true;
+    } else
+      return false;
+  }
+};
+
+/// reads lines from in: directly from its buffer if it's a BlockStreambuf, else via std::getline
+struct NormalizedLines {
+  NormalizedLines(std::istream& in, NormalizeUtf8 const& opt) : in(in), opt(opt), blocks(blockStreambuf(in)) {
+    if (blocks) lines.reset(new LineReader(*blocks));
+  }
+  bool operator()(std::string& line) const {
+    return lines ? opt.getlineNormalized(in, *lines, line) : opt.getlineNormalized(in, line);
+  }
+  std::istream& in;
+  NormalizeUtf8 const& opt;
+  BlockStreambuf* blocks;
+  std::unique_ptr<LineReader> lines;
 };
 
 
@@ -65,7 +89,8 @@ inline std::size_t visitChompedLines(std::istream& in, StringConsumer const& con
                                      NormalizeUtf8 const& opt = NormalizeUtf8()) {
   std::string line;
   std::size_t nlines = 0;
-  while (opt.getlineNormalized(in, line)) {
+  NormalizedLines getline(in, opt);
+  while (getline(line)) {
     chomp(line);
     ++nlines;
     SDL_TRACE(Util.visitChompedLinesUntil, ":" << nlines << ": " << line);
@@ -81,7 +106,8 @@ inline std::size_t visitChompedLinesUntil(std::istream& in, std::string const& s
                                           NormalizeUtf8 const& opt = NormalizeUtf8()) {
   std::string line;
   std::size_t nlines = 0;
-  while (opt.getlineNormalized(in, line)) {
+  NormalizedLines getline(in, opt);
+  while (getline(line)) {
     chomp(line);
     if (line == separatorLine) break;
     ++nlines;
@@ -0,0 +1,183 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    run a function over [begin, end) on several threads. work is handed out
+    dynamically in chunks (an atomic counter), so uneven per-index costs don't
+    leave threads idle. the first exception thrown by any worker is rethrown
+    after all threads join.
+
+    parallelForPhases runs a sequence of such loops (each depending on the
+    previous) on one set of threads that meet at a Barrier between phases.
+*/
+
+#ifndef SDL_UTIL_PARALLELFOR_HPP
+#define SDL_UTIL_PARALLELFOR_HPP
+#pragma once
+
+#include <graehl/shared/thread_group.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace sdl {
+namespace Util {
+
+/// \return numThreads, or hardware concurrency if 0
+inline unsigned effectiveNumThreads(unsigned numThreads) {
+  if (numThreads) return numThreads;
+  unsigned const hw = std::thread::hardware_concurrency();
+  return hw ? hw : 1;
+}
+
+/**
+   calls chunkFn(chunkBegin, chunkEnd) for disjoint chunks covering [begin,
+   end), of size chunkSize (except perhaps the last). with numThreads <= 1 (or
+   a single chunk) everything runs on the calling thread.
+
+   chunkFn must be safe to call concurrently from numThreads threads.
+*/
+template <class ChunkFn>
+void parallelForChunks(std::size_t begin, std::size_t end, unsigned numThreads, std::size_t chunkSize,
+                       ChunkFn const& chunkFn) {
+  if (end <= begin) return;
+  if (!chunkSize) chunkSize = 1;
+  std::size_t const nChunks = (end - begin + chunkSize - 1) / chunkSize;
+  numThreads = effectiveNumThreads(numThreads);
+  if (numThreads > nChunks) numThreads = (unsigned)nChunks;
+  if (numThreads <= 1) {
+    chunkFn(begin, end);
+    return;
+  }
+  std::atomic<std::size_t> next(begin);
+  std::exception_ptr firstException;
+  std::mutex exceptionMutex;
+  auto worker = [&]() {
+    try {
+      for (;;) {
+        std::size_t const chunkBegin = next.fetch_add(chunkSize);
+        if (chunkBegin >= end) return;
+        chunkFn(chunkBegin, std::min(end, chunkBegin + chunkSize));
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(exceptionMutex);
+      if (!firstException) firstException = std::current_exception();
+      next = end;
+    }
+  };
+  graehl::thread_group threads;
+  for (unsigned i = 1; i < numThreads; ++i) threads.create_thread(std::ref(worker));
+  worker();
+  threads.join_all();
+  if (firstException) std::rethrow_exception(firstException);
+}
+
+/**
+   calls fn(i) for i in [begin, end), see parallelForChunks.
+*/
+template <class Fn>
+void parallelFor(std::size_t begin, std::size_t end, unsigned numThreads, Fn const& fn,
+                 std::size_t chunkSize = 1) {
+  parallelForChunks(begin, end, numThreads, chunkSize, [&fn](std::size_t chunkBegin, std::size_t chunkEnd) {
+    for (std::size_t i = chunkBegin; i < chunkEnd; ++i) fn(i);
+  });
+}
+
+/**
+   reusable rendezvous for a fixed number of threads: wait() returns once all
+   have called it. the last thread to arrive runs lastArrives() before
+   releasing the others.
+*/
+struct Barrier {
+  explicit Barrier(unsigned nThreads) : nThreads(nThreads), nWaiting(), generation() {}
+
+  template <class LastArrives>
+  void wait(LastArrives const& lastArrives) {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::size_t const arrivedIn = generation;
+    if (++nWaiting == nThreads) {
+      lastArrives();
+      nWaiting = 0;
+      ++generation;
+      released.notify_all();
+    } else
+      released.wait(lock, [this, arrivedIn] { return generation != arrivedIn; });
+  }
+
+  void wait() {
+    wait([] {});
+  }
+
+ private:
+  unsigned const nThreads;
+  unsigned nWaiting;
+  std::size_t generation;
+  std::mutex mutex;
+  std::condition_variable released;
+};
+
+/**
+   for phase in [0, nPhases): calls fn(phase, i) for i in [0, phaseSize(phase))
+   (chunked as in parallelForChunks), finishing each phase before starting the
+   next. the threads are created once and meet at a Barrier after every
+   phase, rather than being spawned and joined per phase.
+
+   phaseSize must be a pure function of phase (every thread calls it).
+*/
+template <class PhaseSizeFn, class Fn>
+void parallelForPhases(std::size_t nPhases, unsigned numThreads, PhaseSizeFn const& phaseSize, Fn const& fn,
+                       std::size_t chunkSize = 1) {
+  if (!chunkSize) chunkSize = 1;
+  numThreads = effectiveNumThreads(numThreads);
+  if (numThreads <= 1) {
+    for (std::size_t phase = 0; phase < nPhases; ++phase)
+      for (std::size_t i = 0, end = phaseSize(phase); i < end; ++i) fn(phase, i);
+    return;
+  }
+  std::atomic<std::size_t> next(0);
+  std::atomic<bool> failed(false);
+  std::exception_ptr firstException;
+  std::mutex exceptionMutex;
+  Barrier barrier(numThreads);
+  auto worker = [&]() {
+    for (std::size_t phase = 0; phase < nPhases; ++phase) {
+      try {
+        std::size_t const end = phaseSize(phase);
+        while (!failed) {
+          std::size_t const chunkBegin = next.fetch_add(chunkSize);
+          if (chunkBegin >= end) break;
+          for (std::size_t i = chunkBegin, chunkEnd = std::min(end, chunkBegin + chunkSize); i < chunkEnd; ++i)
+            fn(phase, i);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(exceptionMutex);
+        if (!firstException) firstException = std::current_exception();
+        failed = true;
+      }
+      barrier.wait([&next] { next = 0; });  // keep meeting the others even after a failure
+    }
+  };
+  graehl::thread_group threads;
+  for (unsigned i = 1; i < numThreads; ++i) threads.create_thread(std::ref(worker));
+  worker();
+  threads.join_all();
+  if (firstException) std::rethrow_exception(firstException);
+}
+
+
+}}
+
+#endif
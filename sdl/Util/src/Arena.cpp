@@ -0,0 +1,249 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    Arena blocks, the process-wide map of granules in live blocks, and the
+    thread-local ArenaScope chain (see Arena.hpp).
+*/
+
+#include <sdl/Util/Arena.hpp>
+#include <sdl/Pool/concurrent_pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+#ifndef SDL_CONCURRENT_SMALL_POOLS
+/// 0: pooledMalloc without an arena scope is just ::operator new
+#define SDL_CONCURRENT_SMALL_POOLS 1
+#endif
+
+namespace sdl {
+namespace Util {
+
+namespace {
+
+/**
+   which kGranuleBytes-aligned granules of the address space are in a live
+   arena block, so a free on any thread (with no scope open, or after the
+   allocating scope closed) recognizes arena memory without a lock: one or
+   two atomic loads. a two-level radix map (as a malloc page map) over 48-bit
+   addresses; leaves are created on first use and never freed. zero
+   initialized and never destroyed (objects may be freed during static
+   destruction)
+*/
+struct ArenaGranules {
+  enum { kLeafBits = 16, kRootBits = 48 - Arena::kGranuleShift - kLeafBits };
+  enum { kLeafSize = 1 << kLeafBits, kRootSize = 1 << kRootBits };
+  typedef std::atomic<unsigned char> Flag;
+
+  std::atomic<Flag*> root[kRootSize];
+
+  static std::uint64_t granule(void const* p) {
+    return (std::uint64_t)(std::uintptr_t)p >> Arena::kGranuleShift;
+  }
+
+  bool covers(void const* end) const { return !((granule(end) - 1) >> (kRootBits + kLeafBits)); }
+
+  Flag* leaf(std::uint64_t g) {
+    std::atomic<Flag*>& r = root[g >> kLeafBits];
+    Flag* l = r.load(std::memory_order_acquire);
+    if (l) return l;
+    Flag* created = new Flag[kLeafSize]();
+    if (r.compare_exchange_strong(l, created, std::memory_order_acq_rel)) return created;
+    delete[] created;
+    return l;
+  }
+
+  /// \pre begin, end granule aligned, covers(end)
+  void mark(char const* begin, char const* end, bool live) {
+    for (std::uint64_t g = granule(begin), e = granule(end); g < e; ++g)
+      leaf(g)[g & (kLeafSize - 1)].store(live, std::memory_order_release);
+  }
+
+  bool marked(void const* p) const {
+    std::uint64_t g = granule(p);
+    if (g >> (kRootBits + kLeafBits)) return false;
+    Flag const* l = root[g >> kLeafBits].load(std::memory_order_acquire);
+    return l && l[g & (kLeafSize - 1)].load(std::memory_order_acquire);
+  }
+};
+
+ArenaGranules arenaGranules;
+
+std::size_t roundUpToGranule(std::size_t bytes) {
+  return (bytes + (Arena::kGranuleBytes - 1)) & ~(std::size_t)(Arena::kGranuleBytes - 1);
+}
+}
+
+Arena::Arena(std::size_t firstBlockBytes, std::size_t maxBlockBytes)
+    : firstBlockBytes_(roundUpToGranule(std::max(firstBlockBytes, (std::size_t)1)))
+    , maxBlockBytes_(roundUpToGranule(std::max(maxBlockBytes, firstBlockBytes_)))
+    , nextBlockBytes_(firstBlockBytes_)
+    , current_()
+    , next_()
+    , end_()
+    , allocated_()
+    , reserved_() {}
+
+Arena::~Arena() {
+  for (Block const& block : blocks_) deleteBlock(block);
+}
+
+char* Arena::newBlock(std::size_t bytes) {
+  bytes = roundUpToGranule(bytes);
+  Block block;
+  block.raw = (char*)::operator new(bytes + kGranuleBytes - 1);
+  block.begin = (char*)(((std::uintptr_t)block.raw + (kGranuleBytes - 1)) & ~(std::uintptr_t)(kGranuleBytes - 1));
+  block.end = block.begin + bytes;
+  if (!arenaGranules.covers(block.end)) {
+    ::operator delete(block.raw);
+    throw std::bad_alloc();
+  }
+  arenaGranules.mark(block.begin, block.end, true);
+  blocks_.insert(std::upper_bound(blocks_.begin(), blocks_.end(), block), block);
+  reserved_ += bytes;
+  return block.begin;
+}
+
+void Arena::deleteBlock(Block const& block) {
+  arenaGranules.mark(block.begin, block.end, false);
+  ::operator delete(block.raw);
+}
+
+void* Arena::allocateSlow(std::size_t bytes) {
+  if (bytes > nextBlockBytes_ / 4) {
+    // big: a block of its own, so the current block isn't abandoned
+    allocated_ += bytes;
+    return newBlock(bytes);
+  }
+  allocated_ += next_ - current_;
+  current_ = next_ = newBlock(nextBlockBytes_);
+  end_ = current_ + nextBlockBytes_;
+  nextBlockBytes_ = std::min(2 * nextBlockBytes_, maxBlockBytes_);
+  void* r = next_;
+  next_ += bytes;
+  return r;
+}
+
+bool Arena::ownsSlow(char const* p) const {
+  Block key;
+  key.begin = const_cast<char*>(p);
+  std::vector<Block>::const_iterator i = std::upper_bound(blocks_.begin(), blocks_.end(), key);
+  return i != blocks_.begin() && p < (--i)->end;
+}
+
+void Arena::release() {
+  Block keep = Block();
+  for (Block const& block : blocks_)
+    if (!keep.begin && (std::size_t)(block.end - block.begin) == firstBlockBytes_)
+      keep = block;
+    else
+      deleteBlock(block);
+  blocks_.clear();
+  allocated_ = reserved_ = 0;
+  nextBlockBytes_ = firstBlockBytes_;
+  current_ = next_ = end_ = 0;
+  if (keep.begin) {
+    current_ = next_ = keep.begin;
+    end_ = keep.end;
+    blocks_.push_back(keep);
+    reserved_ = firstBlockBytes_;
+    nextBlockBytes_ = std::min(2 * firstBlockBytes_, maxBlockBytes_);
+  }
+}
+
+namespace {
+thread_local ArenaScope* tArenaScope = 0;
+}
+
+ArenaScope::ArenaScope(Arena* arena) : arena_(arena), outer_(tArenaScope) {
+  if (arena_) tArenaScope = this;
+}
+
+ArenaScope::~ArenaScope() {
+  if (arena_) {
+    assert(tArenaScope == this);
+    tArenaScope = outer_;
+  }
+}
+
+Arena* currentArena() {
+  return tArenaScope ? tArenaScope->arena() : 0;
+}
+
+void* arenaMalloc(std::size_t bytes) {
+  if (ArenaScope const* scope = tArenaScope) return scope->arena()->allocate(bytes);
+  return ::operator new(bytes);
+}
+
+namespace {
+/// in any live Arena, whichever thread allocated it
+inline bool inArena(void const* p) {
+  return arenaGranules.marked(p);
+}
+}
+
+void arenaFree(void* p) {
+  if (p && !inArena(p)) ::operator delete(p);
+}
+
+#if SDL_CONCURRENT_SMALL_POOLS
+namespace {
+
+enum { kSizeClassBytes = 16, kSizeClasses = 16 };  // pooled up to 256 bytes
+
+typedef Pool::concurrent_pool<Pool::default_user_allocator_new_delete> SizeClassPool;
+
+/// one pool per size class. never destroyed (objects may be freed during
+/// static destruction)
+struct SizeClassPools {
+  SizeClassPool* pools[kSizeClasses];
+  SizeClassPools() {
+    for (unsigned i = 0; i < kSizeClasses; ++i) pools[i] = new SizeClassPool((i + 1) * kSizeClassBytes);
+  }
+};
+
+inline SizeClassPool* sizeClassPool(std::size_t bytes) {
+  if (!bytes || bytes > kSizeClasses * kSizeClassBytes) return 0;
+  static SizeClassPools* pools = new SizeClassPools;
+  return pools->pools[(bytes - 1) / kSizeClassBytes];
+}
+}
+
+void* pooledMalloc(std::size_t bytes) {
+  if (ArenaScope const* scope = tArenaScope) return scope->arena()->allocate(bytes);
+  if (SizeClassPool* pool = sizeClassPool(bytes)) {
+    if (void* r = pool->malloc()) return r;
+    throw std::bad_alloc();
+  }
+  return ::operator new(bytes);
+}
+
+void pooledFree(void* p, std::size_t bytes) {
+  if (!p || inArena(p)) return;
+  if (SizeClassPool* pool = sizeClassPool(bytes))
+    pool->free(p);
+  else
+    ::operator delete(p);
+}
+#else
+void* pooledMalloc(std::size_t bytes) {
+  return arenaMalloc(bytes);
+}
+
+void pooledFree(void* p, std::size_t) {
+  arenaFree(p);
+}
+#endif
+
+
+}}
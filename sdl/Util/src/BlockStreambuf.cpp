@@ -0,0 +1,281 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    MappedFileStreambuf (boost mapped_file_source) and GunzipStreambuf: a
+    producer thread reads the .gz file and decompresses it into blocks that
+    underflow() hands to the reader whole, at most kReadAheadBlocks ahead.
+
+    a file whose first member carries the BGZF 'BC' subfield (bgzip output)
+    is read member by member, and each batch of members is decompressed by
+    parallelForChunks; anything else goes through one gzip_decompressor.
+*/
+
+#include <sdl/Util/BlockStreambuf.hpp>
+#include <sdl/Util/LogHelper.hpp>
+#include <sdl/Util/ParallelFor.hpp>
+#include <sdl/Exception.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <fstream>
+#include <vector>
+
+namespace sdl {
+namespace Util {
+
+InputBackend inputBackend;
+
+struct MappedFileStreambuf::Mapping {
+  boost::iostreams::mapped_file_source file;
+};
+
+MappedFileStreambuf* MappedFileStreambuf::open(std::string const& filename) {
+  boost::system::error_code error;
+  boost::filesystem::path const path(filename);
+  if (!boost::filesystem::is_regular_file(path, error) || error) return 0;
+  boost::uintmax_t const size = boost::filesystem::file_size(path, error);
+  if (error || !size) return 0;
+  std::unique_ptr<MappedFileStreambuf> r(new MappedFileStreambuf);
+  r->mapping_.reset(new Mapping);
+  try {
+    r->mapping_->file.open(filename);
+  } catch (std::exception& e) {
+    SDL_DEBUG(Util.MappedFileStreambuf, "couldn't mmap " << filename << ": " << e.what());
+    return 0;
+  }
+  if (!r->mapping_->file.is_open()) return 0;
+  char* data = const_cast<char*>(r->mapping_->file.data());
+  r->setg(data, data, data + r->mapping_->file.size());
+  return r.release();
+}
+
+MappedFileStreambuf::MappedFileStreambuf() {}
+
+MappedFileStreambuf::~MappedFileStreambuf() {}
+
+MappedFileStreambuf::pos_type MappedFileStreambuf::seekoff(off_type off, std::ios_base::seekdir dir,
+                                                           std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+  off_type const size = egptr() - eback();
+  off_type pos = off;
+  if (dir == std::ios_base::cur)
+    pos += gptr() - eback();
+  else if (dir == std::ios_base::end)
+    pos += size;
+  if (pos < 0 || pos > size) return pos_type(off_type(-1));
+  setg(eback(), eback() + pos, egptr());
+  return pos_type(pos);
+}
+
+MappedFileStreambuf::pos_type MappedFileStreambuf::seekpos(pos_type pos, std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+GunzipStreambuf::GunzipStreambuf(std::string const& filename, std::size_t blockBytes, unsigned numThreads)
+    : filename_(filename)
+    , blockBytes_(blockBytes ? blockBytes : 1)
+    , numThreads_(effectiveNumThreads(numThreads))
+    , done_()
+    , stop_() {
+  std::shared_ptr<std::ifstream> file(new std::ifstream(filename.c_str(), std::ios::binary));
+  if (!*file) SDL_THROW_LOG(Util.GunzipStreambuf, FileException, "couldn't open " << filename);
+  setg(0, 0, 0);
+  thread_ = std::thread([this, file]() { produce(*file); });
+}
+
+GunzipStreambuf::~GunzipStreambuf() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  changed_.notify_all();
+  thread_.join();
+}
+
+GunzipStreambuf::int_type GunzipStreambuf::underflow() {
+  if (gptr() != egptr()) return traits_type::to_int_type(*gptr());
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return !ready_.empty() || done_; });
+    if (ready_.empty()) {
+      if (error_) {
+        std::exception_ptr error = error_;
+        error_ = std::exception_ptr();
+        std::rethrow_exception(error);
+      }
+      return traits_type::eof();
+    }
+    current_.swap(ready_.front());
+    ready_.pop_front();
+  }
+  changed_.notify_all();
+  char* data = &current_[0];
+  setg(data, data, data + current_.size());
+  return traits_type::to_int_type(*data);
+}
+
+bool GunzipStreambuf::push(std::string& block) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this]() { return stop_ || ready_.size() < kReadAheadBlocks; });
+  if (stop_) return false;
+  ready_.push_back(std::string());
+  ready_.back().swap(block);
+  lock.unlock();
+  changed_.notify_all();
+  return true;
+}
+
+namespace {
+
+/// gzip header bytes
+enum { kGzipId1 = 0x1f, kGzipId2 = 0x8b, kGzipDeflate = 8, kGzipFlagExtra = 4, kGzipFixedHeaderBytes = 12 };
+
+inline unsigned littleEndian16(unsigned char const* p) {
+  return p[0] | (p[1] << 8);
+}
+
+/**
+   \return the BGZF total member size (from the 'BC' extra subfield) given the
+   first kGzipFixedHeaderBytes + XLEN bytes of a member, or 0 if it's not BGZF
+*/
+std::size_t bgzfMemberSize(unsigned char const* header, std::size_t extraLen) {
+  unsigned char const* extra = header + kGzipFixedHeaderBytes;
+  for (std::size_t i = 0; i + 4 <= extraLen;) {
+    unsigned const subfieldLen = littleEndian16(extra + i + 2);
+    if (extra[i] == 'B' && extra[i + 1] == 'C' && subfieldLen == 2 && i + 6 <= extraLen)
+      return littleEndian16(extra + i + 4) + 1;
+    i += 4 + subfieldLen;
+  }
+  return 0;
+}
+
+bool isGzipHeaderWithExtra(unsigned char const* header) {
+  return header[0] == kGzipId1 && header[1] == kGzipId2 && header[2] == kGzipDeflate
+         && (header[3] & kGzipFlagExtra);
+}
+
+/**
+   \return whether file starts with a BGZF member: a gzip header whose extra
+   field has the 'BC' block size subfield (other gzip files may have FEXTRA
+   too). reads from the current position
+*/
+bool startsWithBgzfMember(std::istream& file) {
+  unsigned char header[kGzipFixedHeaderBytes + 65536];
+  file.read((char*)header, kGzipFixedHeaderBytes);
+  if (file.gcount() != kGzipFixedHeaderBytes || !isGzipHeaderWithExtra(header)) return false;
+  std::size_t const extraLen = littleEndian16(header + kGzipFixedHeaderBytes - 2);
+  file.read((char*)header + kGzipFixedHeaderBytes, extraLen);
+  return (std::size_t)file.gcount() == extraLen && bgzfMemberSize(header, extraLen);
+}
+
+/// gunzip a complete member (which ends with its uncompressed size mod 2^32)
+void gunzipMember(std::string const& member, std::string& out) {
+  std::size_t const n = member.size();
+  unsigned char const* isize = (unsigned char const*)member.data() + n - 4;
+  std::size_t const size = isize[0] | (isize[1] << 8) | (isize[2] << 16) | ((std::size_t)isize[3] << 24);
+  out.resize(size);
+  if (!size) return;
+  boost::iostreams::filtering_istream in;
+  in.push(boost::iostreams::gzip_decompressor());
+  in.push(boost::iostreams::array_source(member.data(), n));
+  in.read(&out[0], size);
+  if ((std::size_t)in.gcount() != size)
+    SDL_THROW_LOG(Util.GunzipStreambuf, FileFormatException,
+                  "BGZF member decompressed to " << in.gcount() << " bytes; expected " << size);
+}
+}
+
+void GunzipStreambuf::produce(std::istream& file) {
+  try {
+    bool const bgzf = numThreads_ > 1 && startsWithBgzfMember(file);
+    file.clear();
+    file.seekg(0);
+    if (bgzf)
+      decompressBgzf(file);
+    else
+      decompressSerial(file);
+  } catch (...) {
+    SDL_ERROR(Util.GunzipStreambuf, "error decompressing " << filename_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = std::current_exception();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  changed_.notify_all();
+}
+
+void GunzipStreambuf::decompressSerial(std::istream& file) {
+  boost::iostreams::filtering_istream in;
+  in.push(boost::iostreams::gzip_decompressor());
+  in.push(file);
+  std::string block;
+  for (;;) {
+    block.resize(blockBytes_);
+    in.read(&block[0], blockBytes_);
+    std::size_t const got = (std::size_t)in.gcount();
+    if (in.bad())
+      SDL_THROW_LOG(Util.GunzipStreambuf, FileFormatException, filename_ << ": corrupt gzip data");
+    if (!got) return;
+    block.resize(got);
+    if (!push(block)) return;
+  }
+}
+
+void GunzipStreambuf::decompressBgzf(std::istream& file) {
+  // BGZF members are at most 64k compressed and uncompressed
+  std::size_t const membersPerBlock = blockBytes_ / 65536 + 1;
+  std::vector<std::string> members, texts;
+  std::string block;
+  for (bool eof = false; !eof;) {
+    members.clear();
+    while (members.size() < membersPerBlock) {
+      unsigned char header[kGzipFixedHeaderBytes + 65536];
+      file.read((char*)header, kGzipFixedHeaderBytes);
+      std::size_t const got = (std::size_t)file.gcount();
+      if (!got) {
+        eof = true;
+        break;
+      }
+      if (got != kGzipFixedHeaderBytes || !isGzipHeaderWithExtra(header))
+        SDL_THROW_LOG(Util.GunzipStreambuf, FileFormatException,
+                      filename_ << ": not a BGZF member header at byte " << (std::size_t)file.tellg() - got);
+      std::size_t const extraLen = littleEndian16(header + kGzipFixedHeaderBytes - 2);
+      file.read((char*)header + kGzipFixedHeaderBytes, extraLen);
+      std::size_t const memberSize = bgzfMemberSize(header, extraLen);
+      std::size_t const headerSize = kGzipFixedHeaderBytes + extraLen;
+      if (!memberSize || memberSize < headerSize + 8)
+        SDL_THROW_LOG(Util.GunzipStreambuf, FileFormatException,
+                      filename_ << ": gzip member without BGZF block size");
+      members.push_back(std::string((char const*)header, headerSize));
+      std::string& member = members.back();
+      member.resize(memberSize);
+      file.read(&member[headerSize], memberSize - headerSize);
+      if ((std::size_t)file.gcount() != memberSize - headerSize)
+        SDL_THROW_LOG(Util.GunzipStreambuf, FileFormatException, filename_ << ": truncated BGZF member");
+    }
+    std::size_t const n = members.size();
+    if (texts.size() < n) texts.resize(n);
+    parallelForChunks(0, n, numThreads_, 1, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) gunzipMember(members[i], texts[i]);
+    });
+    block.clear();
+    for (std::size_t i = 0; i < n; ++i) block.append(texts[i]);
+    if (!block.empty() && !push(block)) return;
+  }
+}
+
+
+}}
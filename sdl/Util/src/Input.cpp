@@ -16,6 +16,7 @@
 #define GRAEHL__GZSTREAM_MAIN
 #define GRAEHL__RANDOM_MAIN
 
+#include <sdl/Util/BlockStreambuf.hpp>
 #include <sdl/Util/Input.hpp>
 #include <sdl/Util/LineOptions.hpp>
 #include <sdl/Util/Random.hpp>
@@ -32,12 +33,31 @@ LineOptions nfcline;
 LineOptions nfclineAlways(true);
 LineOptions nfclineWarnOnly(false, false);
 
+void Input::setFile(std::string const& filename) {
+  if (!special_input_filename(filename) && !Util::startsWith(filename, kPipePrefix)
+      && !Util::startsWith(filename, kPipePrefix2)) {
+    if (Util::endsWith(filename, kGzSuffix)) {
+      if (inputBackend.readAheadGunzip) {
+        set(new BlockIstream(new GunzipStreambuf(filename, inputBackend.blockBytes, inputBackend.gunzipThreads)),
+            filename);
+        return;
+      }
+    } else if (inputBackend.mmap) {
+      if (MappedFileStreambuf* mapped = MappedFileStreambuf::open(filename)) {
+        set(new BlockIstream(mapped), filename);
+        return;
+      }
+    }
+  }
+  set(filename);
+}
+
 void Input::init(std::string const& filename, bool mayDecrypt, bool allowNullFile) {
   decrypted.reset();
   using namespace std;
   if (!mayDecrypt || special_input_filename(filename) || Util::endsWith(filename, kGzSuffix)
       || Util::startsWith(filename, kPipePrefix) || Util::startsWith(filename, kPipePrefix2)) {
-    set(filename);
+    setFile(filename);
   } else {
 #if SDL_ENCRYPT
     shared_ptr<ifstream> f(new ifstream);
@@ -50,7 +70,7 @@ void Input::init(std::string const& filename, bool mayDecrypt, bool allowNullFil
       this->setPtr(f, filename);
     }
 #else
-    set(filename);
+    setFile(filename);
 #endif
   }
 }
@@ -0,0 +1,241 @@
+// Copyright 2014-2015 SDL plc
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/** \file
+
+    metrics registry and per-thread shards (see Metrics.hpp).
+*/
+
+#include <sdl/Util/Metrics.hpp>
+#include <sdl/Util/Output.hpp>
+#include <sdl/Exception.hpp>
+#include <algorithm>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace sdl {
+namespace Util {
+
+SDL_NAME_ENUM(MetricsFormat);
+
+std::atomic<bool> gMetricsEnabled(false);
+
+void enableMetrics(bool enable) {
+  gMetricsEnabled.store(enable, std::memory_order_relaxed);
+}
+
+namespace {
+
+/// slots per thread (a histogram takes 1 + kMetricHistogramBuckets)
+enum { kMaxMetricSlots = 4096 };
+
+typedef std::atomic<uint64> Slot;
+
+struct Metric {
+  std::string name, help;
+  MetricType type;
+  unsigned slot;
+};
+
+/**
+   shards of threads that exit go on a free list for the next new thread (so
+   their counts are kept, and the # of shards is the max # of threads that
+   recorded at once).
+*/
+struct MetricsRegistry {
+  std::mutex mutex;
+  std::vector<Metric> metrics;
+  unsigned nSlots;
+  std::vector<Slot*> shards, freeShards;
+
+  MetricsRegistry() : nSlots() {}
+
+  unsigned add(char const* name, char const* help, MetricType type) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Metric const& metric : metrics)
+      if (metric.name == name) {
+        if (metric.type != type)
+          SDL_THROW_LOG(Util.Metrics, ProgrammerMistakeException,
+                        "metric " << name << " registered as both counter and histogram");
+        return metric.slot;
+      }
+    unsigned const size = type == kHistogramMetric ? 1 + kMetricHistogramBuckets : 1;
+    if (nSlots + size > kMaxMetricSlots)
+      SDL_THROW_LOG(Util.Metrics, ProgrammerMistakeException, "too many metrics (increase kMaxMetricSlots)");
+    Metric metric;
+    metric.name = name;
+    metric.help = help;
+    metric.type = type;
+    metric.slot = nSlots;
+    nSlots += size;
+    metrics.push_back(metric);
+    return metric.slot;
+  }
+
+  Slot* acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!freeShards.empty()) {
+      Slot* r = freeShards.back();
+      freeShards.pop_back();
+      return r;
+    }
+    Slot* r = new Slot[kMaxMetricSlots]();
+    shards.push_back(r);
+    return r;
+  }
+
+  void release(Slot* shard) {
+    std::lock_guard<std::mutex> lock(mutex);
+    freeShards.push_back(shard);
+  }
+
+  /// metrics sorted by name, and the sum over shards of each slot
+  void snapshot(std::vector<Metric>& sorted, std::vector<uint64>& totals) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sorted = metrics;
+    std::sort(sorted.begin(), sorted.end(), [](Metric const& a, Metric const& b) { return a.name < b.name; });
+    totals.assign(nSlots, 0);
+    for (Slot const* shard : shards)
+      for (unsigned i = 0; i < nSlots; ++i) totals[i] += shard[i].load(std::memory_order_relaxed);
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Slot* shard : shards)
+      for (unsigned i = 0; i < nSlots; ++i) shard[i].store(0, std::memory_order_relaxed);
+  }
+};
+
+/// never destroyed (threads may record during static destruction)
+MetricsRegistry& registry() {
+  static MetricsRegistry* r = new MetricsRegistry;
+  return *r;
+}
+
+struct ThreadShard {
+  Slot* slots;
+  ThreadShard() : slots() {}
+  ~ThreadShard() {
+    if (slots) registry().release(slots);
+  }
+};
+
+thread_local ThreadShard tShard;
+
+/// inclusive upper bound of histogram bucket b
+uint64 bucketMax(unsigned b) {
+  return b >= 64 ? ~(uint64)0 : ((uint64)1 << b) - 1;
+}
+
+void writeJsonString(std::ostream& out, std::string const& str) {
+  out << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if ((unsigned char)c < 0x20)
+      out << ' ';
+    else
+      out << c;
+  }
+  out << '"';
+}
+
+void writeJson(std::ostream& out, std::vector<Metric> const& metrics, std::vector<uint64> const& totals) {
+  out << "{";
+  bool first = true;
+  for (Metric const& metric : metrics) {
+    out << (first ? "\n  " : ",\n  ");
+    first = false;
+    writeJsonString(out, metric.name);
+    out << ": {\"help\": ";
+    writeJsonString(out, metric.help);
+    uint64 const* slots = &totals[metric.slot];
+    if (metric.type == kCounterMetric) {
+      out << ", \"type\": \"counter\", \"value\": " << slots[0] << "}";
+      continue;
+    }
+    uint64 count = 0;
+    unsigned last = 0;
+    for (unsigned b = 0; b < kMetricHistogramBuckets; ++b)
+      if (slots[1 + b]) {
+        count += slots[1 + b];
+        last = b;
+      }
+    out << ", \"type\": \"histogram\", \"count\": " << count << ", \"sum\": " << slots[0] << ", \"buckets\": [";
+    uint64 cumulative = 0;
+    for (unsigned b = 0; count && b <= last; ++b) {
+      cumulative += slots[1 + b];
+      out << (b ? ", " : "") << "{\"le\": " << bucketMax(b) << ", \"count\": " << cumulative << "}";
+    }
+    out << "]}";
+  }
+  out << "\n}\n";
+}
+
+void writePrometheus(std::ostream& out, std::vector<Metric> const& metrics, std::vector<uint64> const& totals) {
+  for (Metric const& metric : metrics) {
+    std::string const& name = metric.name;
+    uint64 const* slots = &totals[metric.slot];
+    out << "# HELP " << name << ' ' << metric.help << '\n';
+    if (metric.type == kCounterMetric) {
+      out << "# TYPE " << name << " counter\n" << name << ' ' << slots[0] << '\n';
+      continue;
+    }
+    out << "# TYPE " << name << " histogram\n";
+    uint64 count = 0;
+    unsigned last = 0;
+    for (unsigned b = 0; b < kMetricHistogramBuckets; ++b)
+      if (slots[1 + b]) last = b;
+    for (unsigned b = 0; b <= last; ++b) {
+      count += slots[1 + b];
+      out << name << "_bucket{le=\"" << bucketMax(b) << "\"} " << count << '\n';
+    }
+    out << name << "_bucket{le=\"+Inf\"} " << count << '\n'
+        << name << "_sum " << slots[0] << '\n'
+        << name << "_count " << count << '\n';
+  }
+}
+}
+
+namespace detail {
+
+unsigned registerMetric(char const* name, char const* help, MetricType type) {
+  return registry().add(name, help, type);
+}
+
+std::atomic<uint64>* metricSlots() {
+  if (!tShard.slots) tShard.slots = registry().acquire();
+  return tShard.slots;
+}
+}
+
+void resetMetrics() {
+  registry().reset();
+}
+
+void writeMetrics(std::ostream& out, MetricsFormat format) {
+  std::vector<Metric> metrics;
+  std::vector<uint64> totals;
+  registry().snapshot(metrics, totals);
+  if (format == kPrometheus)
+    writePrometheus(out, metrics, totals);
+  else
+    writeJson(out, metrics, totals);
+}
+
+void MetricsOptions::finish() const {
+  if (path.empty()) return;
+  Output output(path);
+  writeMetrics(output.getStream(), format);
+}
+
+
+}}
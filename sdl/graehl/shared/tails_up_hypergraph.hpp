@@ -50,7 +50,12 @@ usage:
    returns pmap with pmap[hyperarc].remain() == 0 if the arc was usable from the final tail set
    and pmap[hyperarc].cost() being the cheapest cost to reaching all final tails
 
-   TODO: option to stop once you reach goal vertex (this is all-destinations right now)
+   or, for a single destination:
+   alg.stop_at(goal); // finish() returns as soon as goal's best cost is known
+   alg.finish();
+
+   (stop_at is exact only if no edge has a negative cost; afterwards mu of the
+   vertices not yet popped are upper bounds or unreachable)
 */
 
 #ifndef GRAEHL_SHARED__TAILS_UP_HYPERGRAPH_HPP
@@ -120,8 +125,15 @@ DECLARE_DBG_LEVEL(TUHG)
 
 struct BestTreeStats {
   std::size_t n_blocked_rereach, n_relax, n_update, n_converged_inexact, n_pop, n_unpopped;
+  bool stopped_at_goal;
   BestTreeStats()
-      : n_blocked_rereach(), n_relax(), n_update(), n_converged_inexact(), n_pop(), n_unpopped() {}
+      : n_blocked_rereach()
+      , n_relax()
+      , n_update()
+      , n_converged_inexact()
+      , n_pop()
+      , n_unpopped()
+      , stopped_at_goal() {}
   typedef BestTreeStats self_type;
   template <class O>
   void print(O& o) const {
@@ -133,6 +145,7 @@ struct BestTreeStats {
       o << ", skipping re-queueing of " << n_converged_inexact << " by within-epsilon convergence";
     o << "; found best cost of " << n_pop << " vertices";
     if (n_unpopped) o << " and left " << n_unpopped << " reachable vertices unused";
+    if (stopped_at_goal) o << " (stopped at goal)";
     o << ".";
   }
   TO_OSTREAM_PRINT
@@ -390,6 +403,8 @@ struct TailsUpHypergraph {
     BestTreeStats stat;
     typedef d_ary_heap_indirect<VD, graehl::OPTIMAL_HEAP_ARITY, VertexCostMap, LocsP, better_cost<graph>> Heap;
     Heap heap;
+    VD goal;
+    bool have_goal;
     BestTree(Self& r, VertexCostMap mu_, VertexPredMap pi_, EdgeCostMap ec,
              BestTreeOptionsParsed const& bestOpt = BestTreeOptions())
         : tu(r)
@@ -404,7 +419,9 @@ struct TailsUpHypergraph {
         , ec(ec)
         , rereachptr(opt.allow_rereach ? RereachPtr(new Rereach(g, 0)) : RereachPtr())
         , rereach(opt.allow_rereach ? rereachptr->pmap : RereachP())
-        , heap(mu, locp) {
+        , heap(mu, locp)
+        , goal()
+        , have_goal(false) {
       opt.parse();
       copy_pmap(edgeT, g, remain_pmap, tu.unique_tails_pmap);
       // visit(edgeT, g, make_indexed_pair_copier(remain_pmap, tu.unique_tails_pmap, ec)); // pair(rem)<-(tr,
@@ -459,6 +476,12 @@ struct TailsUpHypergraph {
 
     void operator()(VD v, Cost const& c) { axiom(v, c); }
 
+    /// finish() stops once v is popped (only correct for non-negative edge costs)
+    void stop_at(VD v) {
+      goal = v;
+      have_goal = true;
+    }
+
     void add_unsorted(VD v) {  // call finish() after
       heap.add_unsorted(v);
       TUHG_SHOWQ(1, "added_unsorted", v);
@@ -613,6 +636,10 @@ struct TailsUpHypergraph {
         TUHG_SHOWQ(6, "at-top", top);
         SHOWIF2(TUHG, 5, heap.size(), top, TUHG_PRINT(top, g));
         pop();
+        if (have_goal && top == goal) {
+          stat.stopped_at_goal = true;
+          break;
+        }
         reach(top);
         TUHG_SHOWP_ALL(9, "post-reach");
       }